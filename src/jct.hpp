@@ -0,0 +1,552 @@
+/**
+ * jct.hpp - C++17 interface to libjct
+ *
+ * Header-only and allocation-free on top of the C API: Document owns a
+ * tree and frees it with free_json_value, ValueView is a non-owning
+ * pointer into a tree, and iteration walks the C linked lists directly.
+ * Nothing is copied unless clone() is called explicitly.
+ *
+ *   auto doc = jct::Document::load("/etc/prudynt.json");
+ *   if (auto width = doc["stream0"]["width"].as_number()) { ... }
+ *   for (auto member : doc.root().members()) {
+ *     std::cout << member.key << '\n';
+ *   }
+ *
+ * Views and strings returned from a Document are valid until it is
+ * destroyed or modified through the C API.
+ */
+
+#ifndef JCT_HPP
+#define JCT_HPP
+
+#if !defined(__cplusplus) || __cplusplus < 201703L
+#error "jct.hpp requires C++17"
+#endif
+
+#include "json_config.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace jct {
+
+enum class Type {
+  Null = JSON_NULL,
+  Bool = JSON_BOOL,
+  Number = JSON_NUMBER,
+  String = JSON_STRING,
+  Array = JSON_ARRAY,
+  Object = JSON_OBJECT
+};
+
+class ValueView;
+class MemberIterator;
+class ElementIterator;
+
+namespace detail {
+template <typename T> inline constexpr bool dependent_false = false;
+} // namespace detail
+
+// begin/end pair for range-for loops
+template <typename Iterator> class Range {
+public:
+  constexpr Range(Iterator first, Iterator last) noexcept
+      : first_(first), last_(last) {}
+  constexpr Iterator begin() const noexcept { return first_; }
+  constexpr Iterator end() const noexcept { return last_; }
+  constexpr bool empty() const noexcept { return first_ == last_; }
+
+private:
+  Iterator first_;
+  Iterator last_;
+};
+
+/**
+ * Non-owning, nullable reference to a value in a tree
+ *
+ * Lookups on an empty view or a value of the wrong type yield an empty
+ * view or std::nullopt, so chains like doc["a"]["b"].as_number() need no
+ * checks in between.
+ */
+class ValueView {
+public:
+  constexpr ValueView() noexcept = default;
+  constexpr ValueView(const JsonValue *value) noexcept : value_(value) {}
+
+  constexpr const JsonValue *get() const noexcept { return value_; }
+  constexpr explicit operator bool() const noexcept {
+    return value_ != nullptr;
+  }
+
+  // Type of the value; an empty view reports Null
+  Type type() const noexcept {
+    return value_ ? static_cast<Type>(value_->type) : Type::Null;
+  }
+  bool is_null() const noexcept { return is(JSON_NULL); }
+  bool is_bool() const noexcept { return is(JSON_BOOL); }
+  bool is_number() const noexcept { return is(JSON_NUMBER); }
+  bool is_string() const noexcept { return is(JSON_STRING); }
+  bool is_array() const noexcept { return is(JSON_ARRAY); }
+  bool is_object() const noexcept { return is(JSON_OBJECT); }
+
+  std::optional<bool> as_bool() const noexcept {
+    if (!is(JSON_BOOL)) {
+      return std::nullopt;
+    }
+    return value_->value.boolean != 0;
+  }
+  std::optional<double> as_number() const noexcept {
+    if (!is(JSON_NUMBER)) {
+      return std::nullopt;
+    }
+    return json_number_value(value_);
+  }
+  // Points into the tree; no copy is made
+  std::optional<std::string_view> as_string() const noexcept {
+    if (!is(JSON_STRING)) {
+      return std::nullopt;
+    }
+    return std::string_view(value_->value.string);
+  }
+
+  /**
+   * Typed access: bool, integers, floating point, std::string_view,
+   * std::string (a copy) or ValueView. Integers must be whole numbers in
+   * the range of T; anything else yields std::nullopt.
+   */
+  template <typename T> std::optional<T> as() const;
+
+  // Object member by key (binary search for sorted objects)
+  std::optional<ValueView> find(std::string_view key) const noexcept {
+    const JsonValue *member =
+        value_ ? get_object_item_n(value_, key.data(), key.size()) : nullptr;
+    if (!member) {
+      return std::nullopt;
+    }
+    return ValueView(member);
+  }
+  // Array element by position (constant time; packed arrays stay packed)
+  std::optional<ValueView> at(std::size_t index) const noexcept {
+    if (!is(JSON_ARRAY) ||
+        index > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+      return std::nullopt;
+    }
+    // get_array_item only expands a lazy array, as json_array_first would
+    const JsonValue *element = get_array_item(const_cast<JsonValue *>(value_),
+                                              static_cast<int>(index));
+    if (!element) {
+      return std::nullopt;
+    }
+    return ValueView(element);
+  }
+
+  // Same as find() and at(), but empty views instead of std::nullopt
+  ValueView operator[](std::string_view key) const noexcept {
+    return find(key).value_or(ValueView());
+  }
+  ValueView operator[](const char *key) const noexcept {
+    return (*this)[std::string_view(key)];
+  }
+  ValueView operator[](std::size_t index) const noexcept {
+    return at(index).value_or(ValueView());
+  }
+  // Without it, v[0] would be ambiguous: 0 also converts to const char *
+  ValueView operator[](int index) const noexcept {
+    return index < 0 ? ValueView() : (*this)[static_cast<std::size_t>(index)];
+  }
+
+  // Members of an object; empty for other types. Members are walked in
+  // the order of the C list: sorted by key for sorted objects, otherwise
+  // newest first, which for a parsed object is reverse document order
+  // ({"a":..,"c":..,"video":..} yields video, c, a)
+  inline Range<MemberIterator> members() const noexcept;
+  // Elements of an array; empty for other types
+  inline Range<ElementIterator> elements() const noexcept;
+
+  // Number of members (a list walk) or elements (constant time); 0 for
+  // scalars
+  std::size_t size() const noexcept {
+    std::size_t count = 0;
+    if (is(JSON_OBJECT)) {
+      for (const JsonKeyValue *kv = json_object_first(value_); kv;
+           kv = kv->next) {
+        count++;
+      }
+    } else if (is(JSON_ARRAY)) {
+      count = static_cast<std::size_t>(
+          get_array_size(const_cast<JsonValue *>(value_)));
+    }
+    return count;
+  }
+
+  // Serialized JSON; empty if the view is empty or serialization failed
+  std::string to_string(bool pretty = false) const {
+    std::string out;
+    if (value_) {
+      // json_to_string does not modify the tree
+      char *json = json_to_string(const_cast<JsonValue *>(value_), pretty);
+      if (json) {
+        out = json;
+        std::free(json);
+      }
+    }
+    return out;
+  }
+
+private:
+  bool is(JsonType type) const noexcept {
+    return value_ && value_->type == type;
+  }
+
+  const JsonValue *value_ = nullptr;
+};
+
+// Object member as yielded by ValueView::members()
+struct Member {
+  std::string_view key;
+  ValueView value;
+};
+
+// Forward iterator over the members of an object
+class MemberIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Member;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = Member;
+
+  constexpr MemberIterator() noexcept = default;
+  explicit constexpr MemberIterator(const JsonKeyValue *kv) noexcept
+      : kv_(kv) {}
+
+  Member operator*() const noexcept { return {kv_->key, kv_->value}; }
+  MemberIterator &operator++() noexcept {
+    kv_ = kv_->next;
+    return *this;
+  }
+  MemberIterator operator++(int) noexcept {
+    MemberIterator old = *this;
+    kv_ = kv_->next;
+    return old;
+  }
+  bool operator==(const MemberIterator &other) const noexcept {
+    return kv_ == other.kv_;
+  }
+  bool operator!=(const MemberIterator &other) const noexcept {
+    return kv_ != other.kv_;
+  }
+
+private:
+  const JsonKeyValue *kv_ = nullptr;
+};
+
+// Forward iterator over the elements of an array
+class ElementIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = ValueView;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = ValueView;
+
+  constexpr ElementIterator() noexcept = default;
+  explicit constexpr ElementIterator(const JsonArrayItem *item) noexcept
+      : item_(item) {}
+
+  ValueView operator*() const noexcept { return ValueView(item_->value); }
+  ElementIterator &operator++() noexcept {
+    item_ = item_->next;
+    return *this;
+  }
+  ElementIterator operator++(int) noexcept {
+    ElementIterator old = *this;
+    item_ = item_->next;
+    return old;
+  }
+  bool operator==(const ElementIterator &other) const noexcept {
+    return item_ == other.item_;
+  }
+  bool operator!=(const ElementIterator &other) const noexcept {
+    return item_ != other.item_;
+  }
+
+private:
+  const JsonArrayItem *item_ = nullptr;
+};
+
+template <typename T> std::optional<T> ValueView::as() const {
+  if constexpr (std::is_same_v<T, bool>) {
+    return as_bool();
+  } else if constexpr (std::is_integral_v<T>) {
+    std::optional<double> number = as_number();
+    if (!number || std::trunc(*number) != *number) {
+      return std::nullopt;
+    }
+    // [min, 2^digits) is exact in double for every integer type
+    const double limit = std::ldexp(1.0, std::numeric_limits<T>::digits);
+    const double low = static_cast<double>(std::numeric_limits<T>::min());
+    if (*number < low || *number >= limit) {
+      return std::nullopt;
+    }
+    return static_cast<T>(*number);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    std::optional<double> number = as_number();
+    if (!number) {
+      return std::nullopt;
+    }
+    return static_cast<T>(*number);
+  } else if constexpr (std::is_same_v<T, std::string_view>) {
+    return as_string();
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    std::optional<std::string_view> text = as_string();
+    if (!text) {
+      return std::nullopt;
+    }
+    return std::string(*text);
+  } else if constexpr (std::is_same_v<T, ValueView>) {
+    if (!value_) {
+      return std::nullopt;
+    }
+    return *this;
+  } else {
+    static_assert(detail::dependent_false<T>, "unsupported type for as<T>()");
+  }
+}
+
+inline Range<MemberIterator> ValueView::members() const noexcept {
+  return {MemberIterator(is(JSON_OBJECT) ? json_object_first(value_)
+                                         : nullptr),
+          MemberIterator()};
+}
+
+inline Range<ElementIterator> ValueView::elements() const noexcept {
+  return {ElementIterator(is(JSON_ARRAY) ? json_array_first(value_)
+                                         : nullptr),
+          ElementIterator()};
+}
+
+/**
+ * Move-only owner of a parsed tree
+ *
+ * A Document may be empty (failed parse, moved-from); it then behaves like
+ * an empty ValueView. Errors are reported on stderr by the C library, as
+ * for the C API.
+ */
+class Document {
+public:
+  constexpr Document() noexcept = default;
+  // Takes ownership of a tree from the C API
+  explicit constexpr Document(JsonValue *root) noexcept : root_(root) {}
+  ~Document() { free_json_value(root_); }
+
+  Document(const Document &) = delete;
+  Document &operator=(const Document &) = delete;
+  Document(Document &&other) noexcept
+      : root_(std::exchange(other.root_, nullptr)) {}
+  Document &operator=(Document &&other) noexcept {
+    if (this != &other) {
+      reset(std::exchange(other.root_, nullptr));
+    }
+    return *this;
+  }
+
+  // Parses a file (see parse_json_file)
+  static Document parse_file(const char *path) {
+    return Document(parse_json_file(path));
+  }
+  // Parses a file and replays its journal (see load_config)
+  static Document load(const char *path) {
+    return Document(load_config(path));
+  }
+  // Parses a buffer in place; it need not be NUL-terminated
+  static Document parse(std::string_view json) {
+    return Document(parse_json_string_n(json.data(), json.size()));
+  }
+
+  // Writes the tree to path (see save_config); returns false on error
+  bool save(const char *path) const {
+    return root_ && save_config(path, root_);
+  }
+
+  // Explicit deep copy; empty on allocation failure
+  Document clone() const { return Document(clone_json_value(root_)); }
+
+  constexpr JsonValue *get() const noexcept { return root_; }
+  constexpr ValueView root() const noexcept { return ValueView(root_); }
+  constexpr explicit operator bool() const noexcept {
+    return root_ != nullptr;
+  }
+
+  // Hands the tree back to the C API; the caller frees it
+  JsonValue *release() noexcept { return std::exchange(root_, nullptr); }
+  void reset(JsonValue *root = nullptr) noexcept {
+    free_json_value(std::exchange(root_, root));
+  }
+
+  ValueView operator[](std::string_view key) const noexcept {
+    return root()[key];
+  }
+  ValueView operator[](const char *key) const noexcept {
+    return root()[key];
+  }
+  ValueView operator[](std::size_t index) const noexcept {
+    return root()[index];
+  }
+  ValueView operator[](int index) const noexcept { return root()[index]; }
+
+  std::string to_string(bool pretty = false) const {
+    return root().to_string(pretty);
+  }
+
+  // Documents can be passed wherever a view of the root is expected
+  constexpr operator ValueView() const noexcept { return root(); }
+
+private:
+  JsonValue *root_ = nullptr;
+};
+
+/**
+ * Dotted key path split at compile time
+ *
+ * Follows the rules of get_nested_item: segments are separated by dots,
+ * empty segments are ignored, and a segment of digits indexes an array.
+ * The split, the segment lengths and the array indexes are computed when
+ * the path is constructed, so a constexpr path costs one length-aware
+ * get_object_item_n() per object level at run time, with no strdup or
+ * strtok.
+ *
+ *   static constexpr jct::basic_path fps("video.fps");
+ *   std::optional<int> value = fps.get<int>(doc);
+ */
+template <std::size_t N> class basic_path {
+public:
+  constexpr basic_path(const char (&text)[N]) {
+    std::size_t i = 0;
+    while (i < N && text[i] != '\0') {
+      if (text[i] == '.') {
+        i++;
+        continue;
+      }
+      Segment &segment = segments_[count_++];
+      segment.offset = i;
+      segment.index = 0;
+      segment.is_index = true;
+      for (; i < N && text[i] != '\0' && text[i] != '.'; i++) {
+        char c = text[i];
+        std::size_t digit = static_cast<std::size_t>(c - '0');
+        if (c < '0' || c > '9' ||
+            segment.index > (std::numeric_limits<std::size_t>::max() - digit) /
+                                10) {
+          segment.is_index = false;
+        } else if (segment.is_index) {
+          segment.index = segment.index * 10 + digit;
+        }
+      }
+      segment.length = i - segment.offset;
+    }
+    for (std::size_t j = 0; j < N; j++) {
+      text_[j] = text[j];
+    }
+  }
+
+  // Number of segments
+  constexpr std::size_t size() const noexcept { return count_; }
+  constexpr std::string_view segment(std::size_t n) const noexcept {
+    return {text_ + segments_[n].offset, segments_[n].length};
+  }
+
+  // The value at this path under root; empty if any step is missing
+  ValueView find(ValueView root) const noexcept {
+    const JsonValue *current = root.get();
+    for (std::size_t n = 0; n < count_ && current; n++) {
+      const Segment &segment = segments_[n];
+      if (current->type == JSON_OBJECT) {
+        current = get_object_item_n(current, text_ + segment.offset,
+                                    segment.length);
+      } else if (current->type == JSON_ARRAY && segment.is_index) {
+        current = ValueView(current)[segment.index].get();
+      } else {
+        current = nullptr;
+      }
+    }
+    return ValueView(current);
+  }
+
+  // find(root).as<T>()
+  template <typename T> std::optional<T> get(ValueView root) const {
+    return find(root).template as<T>();
+  }
+
+private:
+  struct Segment {
+    std::size_t offset = 0;
+    std::size_t length = 0;
+    std::size_t index = 0; // array index if is_index
+    bool is_index = false;
+  };
+
+  char text_[N] = {};
+  Segment segments_[N] = {};
+  std::size_t count_ = 0;
+};
+
+template <typename T, std::size_t N>
+std::optional<T> get(ValueView root, const basic_path<N> &path) {
+  return path.template get<T>(root);
+}
+
+// A path constant usable in C++17, e.g. JCT_PATH("video.fps").get<int>(doc)
+#define JCT_PATH(text)                                                         \
+  ([]() -> const auto & {                                                      \
+    static constexpr ::jct::basic_path jct_path_(text);                        \
+    return jct_path_;                                                          \
+  }())
+
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+
+// String literal as a template argument
+template <std::size_t N> struct fixed_string {
+  char text[N] = {};
+
+  constexpr fixed_string(const char (&s)[N]) {
+    for (std::size_t i = 0; i < N; i++) {
+      text[i] = s[i];
+    }
+  }
+};
+
+/**
+ * C++20 spelling of a compile-time path
+ *
+ *   auto fps = jct::path<"video.fps">::get<int>(doc);
+ *   auto fps = jct::get<int, "video.fps">(doc);
+ */
+template <fixed_string Text> struct path {
+  static constexpr basic_path value{Text.text};
+
+  static ValueView find(ValueView root) noexcept { return value.find(root); }
+  template <typename T> static std::optional<T> get(ValueView root) {
+    return value.template get<T>(root);
+  }
+};
+
+template <typename T, fixed_string Text>
+std::optional<T> get(ValueView root) {
+  return path<Text>::template get<T>(root);
+}
+
+#endif
+
+} // namespace jct
+
+#endif /* JCT_HPP */
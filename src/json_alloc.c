@@ -0,0 +1,199 @@
+/**
+ * json_alloc.c - Counting allocator for the memory budget
+ *
+ * The library allocates through json_malloc and friends. With a budget set
+ * (json_set_memory_limit), every live block is counted by its usable size
+ * and an allocation that would take the total past the budget fails like
+ * an out-of-memory malloc; json_memory_exhausted() then tells callers that
+ * the failure was the budget's doing rather than a bug or bad input.
+ *
+ * Blocks are measured with malloc_usable_size, so nothing is stored in
+ * front of them: memory from json_malloc may be released with free() and
+ * memory from malloc with json_free (the count is then approximate, never
+ * negative). That keeps strings returned to callers, and strings callers
+ * store in values, freeable either way.
+ */
+
+#include "json_config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define usable_size(ptr) malloc_size(ptr)
+#define HAVE_USABLE_SIZE 1
+#elif defined(__linux__)
+#include <malloc.h>
+#define usable_size(ptr) malloc_usable_size(ptr)
+#define HAVE_USABLE_SIZE 1
+#endif
+
+static size_t memory_limit = 0;
+static size_t memory_used = 0;
+static size_t memory_peak = 0;
+static int memory_exhausted = 0;
+
+// The parallel serializer allocates from several threads at once
+#ifdef JCT_WITH_THREADS
+#define LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define STORE(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELAXED)
+#define ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define CAS(var, expected, desired)                                          \
+  __atomic_compare_exchange_n(&(var), &(expected), (desired), 0,             \
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+#define LOAD(var) (var)
+#define STORE(var, val) ((var) = (val))
+#define ADD(var, n) ((var) += (n))
+static int cas_plain(size_t *var, size_t *expected, size_t desired) {
+  if (*var != *expected) {
+    *expected = *var;
+    return 0;
+  }
+  *var = desired;
+  return 1;
+}
+#define CAS(var, expected, desired) cas_plain(&(var), &(expected), (desired))
+#endif
+
+/**
+ * Caps the bytes the library may hold at once (0 means unlimited)
+ *
+ * Resets the usage count, so set it before the operation it should cover.
+ *
+ * @return 1 on success, 0 if this platform cannot measure allocations
+ */
+int json_set_memory_limit(size_t bytes) {
+#ifndef HAVE_USABLE_SIZE
+  if (bytes) {
+    return 0;
+  }
+#endif
+  STORE(memory_limit, bytes);
+  STORE(memory_used, 0);
+  STORE(memory_peak, 0);
+  STORE(memory_exhausted, 0);
+  return 1;
+}
+
+size_t json_memory_limit(void) { return LOAD(memory_limit); }
+
+size_t json_memory_used(void) { return LOAD(memory_used); }
+
+size_t json_memory_peak(void) { return LOAD(memory_peak); }
+
+int json_memory_exhausted(void) { return LOAD(memory_exhausted); }
+
+static void raise_peak(size_t used) {
+  size_t peak = LOAD(memory_peak);
+  while (used > peak && !CAS(memory_peak, peak, used)) {
+  }
+}
+
+// Takes size bytes of the budget ahead of an allocation, in one atomic step
+// so that concurrent allocations cannot all pass the check and together
+// overshoot it; records the refusal if they do not fit
+static int reserve(size_t size) {
+  size_t limit = LOAD(memory_limit);
+  if (!limit) {
+    return 1;
+  }
+  size_t used = LOAD(memory_used);
+  do {
+    if (size > limit || used > limit - size) {
+      STORE(memory_exhausted, 1);
+      return 0;
+    }
+  } while (!CAS(memory_used, used, used + size));
+  raise_peak(used + size);
+  return 1;
+}
+
+// Takes size bytes off the count, stopping at zero for blocks that were
+// allocated before the budget was set
+static void release(size_t size) {
+  size_t used = LOAD(memory_used);
+  while (!CAS(memory_used, used, used > size ? used - size : 0)) {
+  }
+}
+
+#ifdef HAVE_USABLE_SIZE
+// Brings the count from old_size + reserved (what it holds for the block
+// after reserve) to the block's real size: ptr, or old_size if the
+// allocation failed and the old block (if any) is still there
+static void settle(void *ptr, size_t reserved, size_t old_size) {
+  if (!LOAD(memory_limit)) {
+    return;
+  }
+  size_t counted = old_size + reserved;
+  size_t size = ptr ? usable_size(ptr) : old_size;
+  if (size > counted) {
+    raise_peak(ADD(memory_used, size - counted));
+  } else {
+    release(counted - size);
+  }
+}
+
+static void uncount_block(void *ptr) {
+  if (!ptr || !LOAD(memory_limit)) {
+    return;
+  }
+  release(usable_size(ptr));
+}
+#else
+#define settle(ptr, reserved, old_size) ((void)(ptr))
+#define uncount_block(ptr) ((void)(ptr))
+#endif
+
+void *json_malloc(size_t size) {
+  if (!reserve(size)) {
+    return NULL;
+  }
+  void *ptr = malloc(size);
+  settle(ptr, size, 0);
+  return ptr;
+}
+
+void *json_calloc(size_t count, size_t size) {
+  if (size && count > (size_t)-1 / size) {
+    return NULL;
+  }
+  if (!reserve(count * size)) {
+    return NULL;
+  }
+  void *ptr = calloc(count, size);
+  settle(ptr, count * size, 0);
+  return ptr;
+}
+
+void *json_realloc(void *ptr, size_t size) {
+  if (!ptr) {
+    return json_malloc(size);
+  }
+#ifdef HAVE_USABLE_SIZE
+  size_t old_size = LOAD(memory_limit) ? usable_size(ptr) : 0;
+#else
+  size_t old_size = 0;
+#endif
+  size_t reserved = size > old_size ? size - old_size : 0;
+  if (reserved && !reserve(reserved)) {
+    return NULL;
+  }
+  void *grown = realloc(ptr, size);
+  settle(grown, reserved, old_size);
+  return grown;
+}
+
+char *json_strdup(const char *str) {
+  size_t len = strlen(str) + 1;
+  char *copy = (char *)json_malloc(len);
+  if (copy) {
+    memcpy(copy, str, len);
+  }
+  return copy;
+}
+
+void json_free(void *ptr) {
+  uncount_block(ptr);
+  free(ptr);
+}
@@ -0,0 +1,729 @@
+/**
+ * json_baseline.c - Precomputed digests of immutable original configs
+ *
+ * On OverlayFS systems the original of /etc/foo.json is /rom/etc/foo.json,
+ * which never changes for a given firmware. A baseline index records, for
+ * every object member of the original, a hash of its key path, a
+ * structural hash of its value and a hash of the value's raw bytes, so
+ * `export` can diff the modified copy without parsing the original at all.
+ *
+ * Index file layout (host byte order, checked through a marker):
+ *   BaselineHeader
+ *   BaselineRecord[count], in document order
+ *   BaselineSlot[count], sorted by path hash
+ *
+ * Lookups first try the record after the previous match, which is the
+ * right one as long as the modified file keeps the original's key order,
+ * and binary search the slots otherwise.
+ *
+ * An index is looked up next to the original (<original>.jctidx, built
+ * once per firmware) and otherwise in a cache under JCT_BASELINE_CACHE_DIR,
+ * which is filled on first use.
+ */
+
+#include "json_config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef JCT_BASELINE_CACHE_DIR
+#define JCT_BASELINE_CACHE_DIR "/tmp/jct"
+#endif
+
+#define BASELINE_MAGIC "JCTIDX\0\0"
+#define BASELINE_BYTE_ORDER UINT32_C(0x01020304)
+#define BASELINE_VERSION 1
+#define BASELINE_ROOT_PATH UINT64_C(0x9e3779b97f4a7c15)
+#define FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+
+typedef struct {
+  char magic[8];
+  uint32_t byte_order; // BASELINE_BYTE_ORDER as written by the builder
+  uint32_t version;
+  uint64_t count; // number of records
+  uint64_t source_size;
+  int64_t source_mtime; // nanoseconds
+  uint64_t source_ino;
+  uint32_t root_type;
+  uint32_t reserved;
+} BaselineHeader;
+
+typedef struct {
+  uint64_t path; // hash of the key path from the root
+  uint64_t hash; // hash_json_value of the member value (0 for objects)
+  uint64_t raw;  // hash of the value's source bytes (0 if unknown)
+  uint32_t type; // JsonType of the member value
+  uint32_t reserved;
+} BaselineRecord;
+
+typedef struct {
+  uint64_t path;
+  uint64_t index; // into the records
+} BaselineSlot;
+
+struct JsonBaseline {
+  void *map;
+  size_t map_len;
+  const BaselineHeader *header;
+  const BaselineRecord *records;
+  const BaselineSlot *slots;
+  size_t cursor;       // record expected next
+  unsigned char *seen; // records matched by the current diff (bitmap)
+};
+
+// Records collected while building an index
+typedef struct {
+  BaselineRecord *items;
+  size_t count;
+  size_t capacity;
+} RecordList;
+
+// 64-bit finalizer (splitmix64)
+static uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 30;
+  x *= UINT64_C(0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C(0x94d049bb133111eb);
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * Hash of the key path of a member, derived from its parent's path hash
+ */
+static uint64_t child_path_hash(uint64_t parent, const char *key,
+                                size_t length) {
+  return mix_hash(json_hash_bytes(key, length, FNV_OFFSET) ^
+                  mix_hash(parent + length));
+}
+
+/**
+ * child_path_hash for a key token, hashing its raw bytes when they are
+ * already the key itself
+ *
+ * @return 1 on success, 0 on allocation failure
+ */
+static int token_path_hash(uint64_t parent, const JsonToken *key,
+                           uint64_t *path) {
+  const char *raw = key->start + 1;
+  size_t length = key->length - 2;
+  if (!key->escaped && !memchr(raw, '\0', length)) {
+    *path = child_path_hash(parent, raw, length);
+    return 1;
+  }
+  char *decoded = json_token_string(key);
+  if (!decoded) {
+    return 0;
+  }
+  *path = child_path_hash(parent, decoded, strlen(decoded));
+  json_free(decoded);
+  return 1;
+}
+
+// Hash of a value's raw bytes; never 0, which marks "unknown"
+static uint64_t raw_hash(const char *start, size_t length) {
+  uint64_t h = json_hash_bytes(start, length, FNV_OFFSET);
+  return h ? h : 1;
+}
+
+static int append_record(RecordList *list, uint64_t path, uint64_t hash,
+                         uint64_t raw, JsonType type) {
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    BaselineRecord *items = (BaselineRecord *)json_realloc(
+        list->items, capacity * sizeof(BaselineRecord));
+    if (!items) {
+      return 0;
+    }
+    list->items = items;
+    list->capacity = capacity;
+  }
+  BaselineRecord *rec = &list->items[list->count++];
+  rec->path = path;
+  rec->hash = hash;
+  rec->raw = raw;
+  rec->type = (uint32_t)type;
+  rec->reserved = 0;
+  return 1;
+}
+
+/**
+ * Parses one complete value from a slice of a document
+ */
+static JsonValue *parse_slice(const char *start, size_t length) {
+  JsonTokenizer *tok = json_tokenizer_create(start, length);
+  JsonToken token;
+  JsonValue *value = NULL;
+  if (tok && json_tokenizer_next(tok, &token)) {
+    value = json_tokenizer_read_value(tok, &token);
+  }
+  json_tokenizer_free(tok);
+  return value;
+}
+
+/**
+ * Records the members of an object whose opening brace was just read,
+ * recursing into nested objects (arrays are compared whole by export, so
+ * their elements are not indexed)
+ */
+static int collect_stream_records(JsonTokenizer *tok, uint64_t path,
+                                  RecordList *list) {
+  JsonToken key_token;
+  JsonToken value_token;
+  for (;;) {
+    if (!json_tokenizer_next(tok, &key_token)) {
+      return 0;
+    }
+    if (key_token.type == JSON_TOKEN_OBJECT_END) {
+      return 1;
+    }
+    uint64_t child_path;
+    if (!token_path_hash(path, &key_token, &child_path) ||
+        !json_tokenizer_next(tok, &value_token)) {
+      return 0;
+    }
+
+    if (value_token.type == JSON_TOKEN_OBJECT_START) {
+      if (!append_record(list, child_path, 0, 0, JSON_OBJECT) ||
+          !collect_stream_records(tok, child_path, list)) {
+        return 0;
+      }
+      continue;
+    }
+
+    const char *start;
+    size_t length;
+    if (!json_tokenizer_skip_value(tok, &value_token, &start, &length)) {
+      return 0;
+    }
+    JsonValue *value = parse_slice(start, length);
+    int ok = value && append_record(list, child_path, hash_json_value(value),
+                                    raw_hash(start, length), value->type);
+    free_json_value(value);
+    if (!ok) {
+      return 0;
+    }
+  }
+}
+
+/**
+ * Same records from a parsed tree, without raw hashes
+ */
+static int collect_tree_records(const JsonValue *object, uint64_t path,
+                                RecordList *list) {
+  for (const JsonKeyValue *kv = json_object_first(object); kv; kv = kv->next) {
+    if (!kv->value) {
+      continue;
+    }
+    const char *key = kv->key ? kv->key : "";
+    uint64_t child_path = child_path_hash(path, key, strlen(key));
+    int ok;
+    if (kv->value->type == JSON_OBJECT) {
+      ok = append_record(list, child_path, 0, 0, JSON_OBJECT) &&
+           collect_tree_records(kv->value, child_path, list);
+    } else {
+      ok = append_record(list, child_path, hash_json_value(kv->value), 0,
+                         kv->value->type);
+    }
+    if (!ok) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int compare_slots(const void *a, const void *b) {
+  uint64_t pa = ((const BaselineSlot *)a)->path;
+  uint64_t pb = ((const BaselineSlot *)b)->path;
+  return (pa > pb) - (pa < pb);
+}
+
+/**
+ * Builds the sorted lookup slots for a record list
+ *
+ * @return The slots (caller frees), or NULL if out of memory or if two
+ *         records share a path
+ */
+static BaselineSlot *build_slots(const RecordList *list) {
+  BaselineSlot *slots = (BaselineSlot *)json_malloc(
+      (list->count ? list->count : 1) * sizeof(BaselineSlot));
+  if (!slots) {
+    return NULL;
+  }
+  for (size_t i = 0; i < list->count; i++) {
+    slots[i].path = list->items[i].path;
+    slots[i].index = i;
+  }
+  if (list->count > 1) {
+    qsort(slots, list->count, sizeof(BaselineSlot), compare_slots);
+  }
+  for (size_t i = 1; i < list->count; i++) {
+    if (slots[i].path == slots[i - 1].path) {
+      json_free(slots);
+      return NULL;
+    }
+  }
+  return slots;
+}
+
+/**
+ * Collects the records of a document, quietly
+ *
+ * The document is walked as a token stream. If it repeats a key, where the
+ * parser keeps only the last value, the records come from the parsed tree
+ * instead so they describe what the parser sees.
+ *
+ * @return 1 on success, 0 if the file cannot be read or is malformed
+ */
+static int collect_records(const char *filepath, RecordList *list,
+                           BaselineSlot **slots, JsonType *root_type) {
+  JsonTokenizer *tok = json_tokenizer_open_file(filepath);
+  if (!tok) {
+    return 0;
+  }
+  JsonToken token;
+  int ok = json_tokenizer_next(tok, &token);
+  if (ok && token.type == JSON_TOKEN_OBJECT_START) {
+    *root_type = JSON_OBJECT;
+    ok = collect_stream_records(tok, BASELINE_ROOT_PATH, list);
+  } else if (ok) {
+    JsonValue *root = json_tokenizer_read_value(tok, &token);
+    ok = root != NULL;
+    if (root) {
+      *root_type = root->type;
+      free_json_value(root);
+    }
+  }
+  ok = ok && json_tokenizer_next(tok, &token) && token.type == JSON_TOKEN_END;
+  json_tokenizer_free(tok);
+  if (!ok) {
+    return 0;
+  }
+
+  *slots = build_slots(list);
+  if (*slots) {
+    return 1;
+  }
+
+  JsonValue *doc = parse_json_file(filepath);
+  list->count = 0;
+  ok = doc && collect_tree_records(doc, BASELINE_ROOT_PATH, list);
+  free_json_value(doc);
+  if (ok) {
+    *slots = build_slots(list);
+  }
+  return *slots != NULL;
+}
+
+static int64_t mtime_ns(const struct stat *st) {
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/**
+ * Writes an index (for a file with the given stat) to index_path through
+ * a temporary file, so readers never see a partial one
+ */
+static int write_index(const RecordList *list, const BaselineSlot *slots,
+                       JsonType root_type, const struct stat *st,
+                       const char *index_path) {
+  BaselineHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BASELINE_MAGIC, sizeof(header.magic));
+  header.byte_order = BASELINE_BYTE_ORDER;
+  header.version = BASELINE_VERSION;
+  header.count = list->count;
+  header.source_size = (uint64_t)st->st_size;
+  header.source_mtime = mtime_ns(st);
+  header.source_ino = (uint64_t)st->st_ino;
+  header.root_type = (uint32_t)root_type;
+
+  char temp_path[PATH_MAX];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", index_path,
+               (int)getpid()) >= (int)sizeof(temp_path)) {
+    fprintf(stderr, "Error: Index path '%s' is too long\n", index_path);
+    return 0;
+  }
+  FILE *file = fopen(temp_path, "wb");
+  if (!file) {
+    fprintf(stderr, "Error: Failed to create index file '%s': %s\n",
+            temp_path, strerror(errno));
+    return 0;
+  }
+  int success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                (list->count == 0 ||
+                 (fwrite(list->items, sizeof(BaselineRecord), list->count,
+                         file) == list->count &&
+                  fwrite(slots, sizeof(BaselineSlot), list->count, file) ==
+                      list->count));
+  success = (fclose(file) == 0) && success;
+
+  if (!success || rename(temp_path, index_path) != 0) {
+    fprintf(stderr, "Error: Failed to write index file '%s': %s\n",
+            index_path, strerror(errno));
+    unlink(temp_path);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Indexes source_path (with the given stat) into index_path
+ *
+ * @return 1 on success; 0 with *malformed set if the source cannot be read
+ *         or parsed (not reported), or 0 if writing failed (reported)
+ */
+static int build_index(const char *source_path, const struct stat *st,
+                       const char *index_path, int *malformed) {
+  RecordList list = {NULL, 0, 0};
+  BaselineSlot *slots = NULL;
+  JsonType root_type = JSON_NULL;
+  int success = collect_records(source_path, &list, &slots, &root_type);
+  *malformed = !success;
+  if (success) {
+    success = write_index(&list, slots, root_type, st, index_path);
+  }
+  json_free(list.items);
+  json_free(slots);
+  return success;
+}
+
+/**
+ * Builds the baseline index of source_path and writes it to index_path
+ *
+ * @return 1 on success, 0 on error (reported)
+ */
+int json_baseline_build(const char *source_path, const char *index_path) {
+  struct stat st;
+  if (stat(source_path, &st) != 0) {
+    fprintf(stderr, "Error: Failed to open file '%s': %s\n", source_path,
+            strerror(errno));
+    return 0;
+  }
+  int malformed;
+  if (build_index(source_path, &st, index_path, &malformed)) {
+    return 1;
+  }
+  if (malformed) {
+    fprintf(stderr, "Error: Failed to parse JSON in '%s'.\n", source_path);
+  }
+  return 0;
+}
+
+/**
+ * Maps an index and checks it describes the file with the given stat.
+ * Cached indexes must match exactly; a sidecar is built before the ROM
+ * image is packed, which assigns new inodes and may drop sub-second
+ * timestamps, so only the size and the whole seconds are compared.
+ */
+static JsonBaseline *open_index(const char *index_path,
+                                const struct stat *source, int strict) {
+  int fd = open(index_path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BaselineHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  const size_t entry_size = sizeof(BaselineRecord) + sizeof(BaselineSlot);
+  const BaselineHeader *header = (const BaselineHeader *)map;
+  int valid =
+      memcmp(header->magic, BASELINE_MAGIC, sizeof(header->magic)) == 0 &&
+      header->byte_order == BASELINE_BYTE_ORDER &&
+      header->version == BASELINE_VERSION &&
+      header->count <= (len - sizeof(BaselineHeader)) / entry_size &&
+      sizeof(BaselineHeader) + header->count * entry_size == len &&
+      header->source_size == (uint64_t)source->st_size &&
+      (strict ? header->source_mtime == mtime_ns(source) &&
+                    header->source_ino == (uint64_t)source->st_ino
+              : header->source_mtime / 1000000000 ==
+                    (int64_t)source->st_mtim.tv_sec);
+  JsonBaseline *baseline =
+      valid ? (JsonBaseline *)json_malloc(sizeof(JsonBaseline)) : NULL;
+  if (!baseline) {
+    munmap(map, len);
+    return NULL;
+  }
+  baseline->map = map;
+  baseline->map_len = len;
+  baseline->header = header;
+  baseline->records =
+      (const BaselineRecord *)((const char *)map + sizeof(BaselineHeader));
+  baseline->slots = (const BaselineSlot *)(baseline->records + header->count);
+  baseline->cursor = 0;
+  baseline->seen = NULL;
+  return baseline;
+}
+
+/**
+ * Cache location for the index of source_path: its absolute path with
+ * '%' and '/' percent-encoded, under JCT_BASELINE_CACHE_DIR. Different
+ * spellings of one path get separate entries, which is harmless since
+ * every entry is checked against the file it describes.
+ */
+static int cache_index_path(const char *source_path, char *out,
+                            size_t out_size) {
+  char resolved[PATH_MAX];
+  if (source_path[0] == '/') {
+    snprintf(resolved, sizeof(resolved), "%s", source_path);
+  } else {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)) ||
+        snprintf(resolved, sizeof(resolved), "%s/%s", cwd, source_path) >=
+            (int)sizeof(resolved)) {
+      return 0;
+    }
+  }
+  size_t pos = (size_t)snprintf(out, out_size, "%s/", JCT_BASELINE_CACHE_DIR);
+  for (const char *p = resolved; *p; p++) {
+    if (pos + 4 >= out_size) {
+      return 0;
+    }
+    if (*p == '/' || *p == '%') {
+      pos += (size_t)snprintf(out + pos, out_size - pos, "%%%02X",
+                              (unsigned char)*p);
+    } else {
+      out[pos++] = *p;
+    }
+  }
+  return snprintf(out + pos, out_size - pos, ".jctidx") <
+         (int)(out_size - pos);
+}
+
+/**
+ * Makes sure the cache directory exists and belongs to us, so other users
+ * cannot plant indexes in it
+ */
+static int prepare_cache_dir(void) {
+  struct stat st;
+  if (mkdir(JCT_BASELINE_CACHE_DIR, 0700) != 0 && errno != EEXIST) {
+    return 0;
+  }
+  return lstat(JCT_BASELINE_CACHE_DIR, &st) == 0 && S_ISDIR(st.st_mode) &&
+         st.st_uid == geteuid() && (st.st_mode & 0022) == 0;
+}
+
+/**
+ * Opens the baseline index of an original file
+ *
+ * Uses <source_path>.jctidx if it matches the file, otherwise the cached
+ * index; with build_cache set, a missing or stale cache entry is rebuilt.
+ *
+ * @return The index, or NULL if none is usable (not an error)
+ */
+JsonBaseline *json_baseline_open(const char *source_path, int build_cache) {
+  struct stat source;
+  if (stat(source_path, &source) != 0 || !S_ISREG(source.st_mode)) {
+    return NULL;
+  }
+
+  char index_path[PATH_MAX];
+  if (snprintf(index_path, sizeof(index_path), "%s.jctidx", source_path) <
+      (int)sizeof(index_path)) {
+    JsonBaseline *baseline = open_index(index_path, &source, 0);
+    if (baseline) {
+      return baseline;
+    }
+  }
+
+  if (!cache_index_path(source_path, index_path, sizeof(index_path)) ||
+      !prepare_cache_dir()) {
+    return NULL;
+  }
+  JsonBaseline *baseline = open_index(index_path, &source, 1);
+  if (baseline || !build_cache) {
+    return baseline;
+  }
+
+  // Malformed originals are left to the regular diff, which reports them
+  int malformed;
+  if (!build_index(source_path, &source, index_path, &malformed)) {
+    return NULL;
+  }
+  return open_index(index_path, &source, 1);
+}
+
+void json_baseline_free(JsonBaseline *baseline) {
+  if (!baseline) {
+    return;
+  }
+  munmap(baseline->map, baseline->map_len);
+  json_free(baseline);
+}
+
+static const BaselineRecord *find_record(JsonBaseline *baseline,
+                                         uint64_t path) {
+  size_t count = (size_t)baseline->header->count;
+  size_t next = baseline->cursor;
+  if (next < count && baseline->records[next].path == path) {
+    baseline->cursor = next + 1;
+    return &baseline->records[next];
+  }
+
+  size_t lo = 0;
+  size_t hi = count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    uint64_t p = baseline->slots[mid].path;
+    if (p == path) {
+      size_t index = (size_t)baseline->slots[mid].index;
+      if (index >= count) {
+        return NULL;
+      }
+      baseline->cursor = index + 1;
+      return &baseline->records[index];
+    }
+    if (p < path) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return NULL;
+}
+
+static JsonValue *diff_stream_baseline(JsonTokenizer *modified, uint64_t path,
+                                       JsonBaseline *baseline);
+
+// Diffs one member whose key and value tokens were just read and adds the
+// modified value to diff if it differs from the indexed original
+static int diff_member_baseline(JsonValue *diff, const JsonToken *key,
+                                JsonTokenizer *modified,
+                                const JsonToken *value, uint64_t path,
+                                JsonBaseline *baseline) {
+  uint64_t child_path;
+  if (!token_path_hash(path, key, &child_path)) {
+    return 0;
+  }
+  const BaselineRecord *rec = find_record(baseline, child_path);
+  if (rec) {
+    // A key repeated in the modified object: the parser keeps its last
+    // value, which the token walk cannot know yet, so leave it to diff_json
+    size_t index = (size_t)(rec - baseline->records);
+    unsigned char bit = (unsigned char)(1u << (index % 8));
+    if (baseline->seen[index / 8] & bit) {
+      return 0;
+    }
+    baseline->seen[index / 8] |= bit;
+  }
+
+  JsonValue *entry;
+  if (rec && rec->type == JSON_OBJECT &&
+      value->type == JSON_TOKEN_OBJECT_START) {
+    entry = diff_stream_baseline(modified, child_path, baseline);
+    if (!entry) {
+      return 0;
+    }
+    // Only include if the child diff is not empty
+    if (!json_object_first(entry)) {
+      free_json_value(entry);
+      return 1;
+    }
+  } else {
+    const char *start;
+    size_t length;
+    if (!json_tokenizer_skip_value(modified, value, &start, &length)) {
+      return 0;
+    }
+    // Identical bytes are the common case and need no parsing
+    if (rec && rec->raw && rec->raw == raw_hash(start, length)) {
+      return 1;
+    }
+    entry = parse_slice(start, length);
+    if (!entry) {
+      return 0;
+    }
+    if (rec && rec->type == (uint32_t)entry->type &&
+        rec->hash == hash_json_value(entry)) {
+      free_json_value(entry);
+      return 1;
+    }
+  }
+
+  char *name = json_token_string(key);
+  if (!name || !add_to_object(diff, name, entry)) {
+    json_free(name);
+    free_json_value(entry);
+    return 0;
+  }
+  json_free(name);
+  return 1;
+}
+
+/**
+ * Diffs an object whose opening brace was just read against the index
+ */
+static JsonValue *diff_stream_baseline(JsonTokenizer *modified, uint64_t path,
+                                       JsonBaseline *baseline) {
+  JsonValue *diff = create_json_value(JSON_OBJECT);
+  if (!diff) {
+    return NULL;
+  }
+
+  JsonToken key_token;
+  JsonToken value_token;
+  for (;;) {
+    if (!json_tokenizer_next(modified, &key_token)) {
+      break;
+    }
+    if (key_token.type == JSON_TOKEN_OBJECT_END) {
+      return diff;
+    }
+    if (!json_tokenizer_next(modified, &value_token) ||
+        !diff_member_baseline(diff, &key_token, modified, &value_token, path,
+                              baseline)) {
+      break;
+    }
+  }
+
+  free_json_value(diff);
+  return NULL;
+}
+
+/**
+ * Computes diff_json(modified, original) from the original's baseline,
+ * reading the modified document as a token stream
+ *
+ * @return The differences, or NULL if either document is not an object,
+ *         the modified one is malformed or repeats a key of the original
+ */
+JsonValue *diff_json_stream_baseline(JsonTokenizer *modified,
+                                     JsonBaseline *baseline) {
+  JsonToken token;
+  if (!modified || !baseline || baseline->header->root_type != JSON_OBJECT ||
+      !json_tokenizer_next(modified, &token) ||
+      token.type != JSON_TOKEN_OBJECT_START) {
+    return NULL;
+  }
+
+  baseline->cursor = 0;
+  baseline->seen =
+      (unsigned char *)json_calloc((size_t)baseline->header->count / 8 + 1, 1);
+  if (!baseline->seen) {
+    return NULL;
+  }
+  JsonValue *diff =
+      diff_stream_baseline(modified, BASELINE_ROOT_PATH, baseline);
+  json_free(baseline->seen);
+  baseline->seen = NULL;
+  if (diff &&
+      (!json_tokenizer_next(modified, &token) || token.type != JSON_TOKEN_END)) {
+    free_json_value(diff);
+    return NULL;
+  }
+  return diff;
+}
@@ -0,0 +1,545 @@
+/**
+ * json_batch.c - Reading many files at once
+ *
+ * Commands that touch several files (import with overlays, short-name
+ * probing) used to open, stat and read them one after another, so on
+ * network storage each file cost a few round trips in sequence. Here the
+ * calls for a whole set are issued together:
+ *
+ * - Built with JCT_WITH_IO_URING, one io_uring submission holds an OPENAT
+ *   and a STATX per file. A file's READ is queued once both complete, and
+ *   its buffer is handed to a tokenizer as soon as it arrives, while other
+ *   reads are still in flight.
+ * - Otherwise, or when the kernel refuses io_uring, a small thread pool
+ *   runs the blocking calls; the files are mapped, with the kernel reading
+ *   them ahead.
+ *
+ * Files the ring cannot handle (pipes, empty files, any error) are redone
+ * with json_tokenizer_open_file, so results and messages match the
+ * one-file path.
+ */
+
+#ifdef JCT_WITH_IO_URING
+#define _DEFAULT_SOURCE // syscall()
+#endif
+
+#include "json_config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef JCT_WITH_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef JCT_WITH_IO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Most workers of the thread pool
+#ifndef JCT_BATCH_THREADS
+#define JCT_BATCH_THREADS 8
+#endif
+
+#ifdef JCT_WITH_THREADS
+typedef struct {
+  void (*fn)(void *ctx, size_t i);
+  void *ctx;
+  size_t count;
+  size_t next;
+  pthread_mutex_t lock;
+} BatchPool;
+
+static void *pool_worker(void *arg) {
+  BatchPool *pool = (BatchPool *)arg;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    size_t i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (i >= pool->count) {
+      return NULL;
+    }
+    pool->fn(pool->ctx, i);
+  }
+}
+#endif
+
+/**
+ * Runs fn(ctx, i) for every i below count on up to JCT_BATCH_THREADS
+ * threads (in order on the calling thread without thread support)
+ */
+static void run_pool(size_t count, void (*fn)(void *, size_t), void *ctx) {
+#ifdef JCT_WITH_THREADS
+  size_t workers = count < JCT_BATCH_THREADS ? count : JCT_BATCH_THREADS;
+  if (workers > 1) {
+    BatchPool pool;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.count = count;
+    pool.next = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    // The calling thread is a worker too
+    pthread_t threads[JCT_BATCH_THREADS];
+    size_t started = 0;
+    while (started + 1 < workers &&
+           pthread_create(&threads[started], NULL, pool_worker, &pool) == 0) {
+      started++;
+    }
+    pool_worker(&pool);
+    for (size_t i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < count; i++) {
+    fn(ctx, i);
+  }
+}
+
+static void open_one(void *ctx, size_t i) {
+  JsonBatchStream *files = (JsonBatchStream *)ctx;
+  files[i].tok = json_tokenizer_open_file(files[i].path);
+}
+
+typedef struct {
+  const char *const *paths;
+  JsonFileStat *stats;
+} StatBatch;
+
+static void stat_one(void *ctx, size_t i) {
+  StatBatch *batch = (StatBatch *)ctx;
+  struct stat st;
+  JsonFileStat *out = &batch->stats[i];
+  memset(out, 0, sizeof(*out));
+  if (stat(batch->paths[i], &st) != 0) {
+    out->error = errno;
+    return;
+  }
+  out->mode = (unsigned)st.st_mode;
+  out->size = (uint64_t)st.st_size;
+}
+
+#ifdef JCT_WITH_IO_URING
+// A minimal io_uring over the raw system calls (no liburing)
+typedef struct {
+  int fd;
+  unsigned entries;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+  unsigned queued;   // prepared, not yet submitted
+  unsigned inflight; // submitted, not yet reaped
+} Ring;
+
+static void ring_free(Ring *ring) {
+  if (ring->sqes) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  close(ring->fd);
+}
+
+static void *ring_map(int fd, size_t size, off_t offset) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/**
+ * Sets up a ring with room for about entries requests
+ *
+ * @return 1 on success, 0 if io_uring is unavailable (not reported)
+ */
+static int ring_init(Ring *ring, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (ring->fd < 0) {
+    return 0;
+  }
+
+  ring->entries = p.sq_entries;
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+      p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sq_ring = ring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+  ring->cq_ring = ring_map(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+  ring->sqes = (struct io_uring_sqe *)ring_map(ring->fd, ring->sqes_size,
+                                               IORING_OFF_SQES);
+  if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+    ring_free(ring);
+    return 0;
+  }
+
+  char *sq = (char *)ring->sq_ring;
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  char *cq = (char *)ring->cq_ring;
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 1;
+}
+
+/**
+ * Whether n more requests fit; keeping all requests within the submission
+ * queue size also keeps the (twice as large) completion queue from
+ * overflowing
+ */
+static int ring_room(const Ring *ring, unsigned n) {
+  return ring->queued + ring->inflight + n <= ring->entries;
+}
+
+// Prepares the next submission entry (check ring_room first)
+static struct io_uring_sqe *ring_sqe(Ring *ring, uint64_t user_data) {
+  unsigned index = (*ring->sq_tail + ring->queued) & ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = user_data;
+  ring->sq_array[index] = index;
+  ring->queued++;
+  return sqe;
+}
+
+/**
+ * Submits the prepared entries and waits for a completion
+ *
+ * @return 1 on success, 0 if the ring failed (requests may be in flight)
+ */
+static int ring_submit_and_wait(Ring *ring) {
+  unsigned submit = ring->queued;
+  __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+  ring->queued = 0;
+  ring->inflight += submit;
+  for (;;) {
+    long ret = syscall(__NR_io_uring_enter, ring->fd, submit, 1,
+                       IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 0;
+    }
+    if ((unsigned)ret >= submit) {
+      return 1;
+    }
+    submit -= (unsigned)ret;
+  }
+}
+
+// Takes the next completion, if any
+static int ring_reap(Ring *ring, struct io_uring_cqe *out) {
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  *out = ring->cqes[head & ring->cq_mask];
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  ring->inflight--;
+  return 1;
+}
+
+// Ring requests, kept in the low bits of user_data beside the file index
+enum { OP_OPEN, OP_STAT, OP_READ, OP_BITS = 2 };
+
+static int ring_size_for(size_t requests) {
+  return requests < 256 ? (int)(requests < 4 ? 4 : requests) : 256;
+}
+
+// Progress of one file through the ring
+typedef struct {
+  int fd;
+  int pending; // open and stat requests not completed yet
+  int failed;
+  int finished;
+  struct statx stx;
+  char *buffer;
+  size_t size;
+  size_t done;
+} RingFile;
+
+/**
+ * Finishes a file: hands its buffer to a tokenizer, or redoes it with
+ * json_tokenizer_open_file after any failure
+ */
+static void ring_finish(JsonBatchStream *file, RingFile *rf) {
+  if (rf->fd >= 0) {
+    close(rf->fd);
+    rf->fd = -1;
+  }
+  if (rf->failed) {
+    json_free(rf->buffer);
+    file->tok = json_tokenizer_open_file(file->path);
+  } else {
+    file->tok = json_tokenizer_open_contents(file->path, rf->buffer, rf->size);
+  }
+  rf->buffer = NULL;
+  rf->finished = 1;
+}
+
+/**
+ * Opens the files through io_uring
+ *
+ * @return 1 if every file got its result, 0 if io_uring is unavailable
+ *         and nothing was done
+ */
+static int ring_open(JsonBatchStream *files, size_t count) {
+  Ring ring;
+  if (!ring_init(&ring, (unsigned)ring_size_for(count * 2))) {
+    return 0;
+  }
+  RingFile *rfs = (RingFile *)json_calloc(count, sizeof(RingFile));
+  size_t *ready = (size_t *)json_malloc(count * sizeof(size_t));
+  if (!rfs || !ready) {
+    json_free(rfs);
+    json_free(ready);
+    ring_free(&ring);
+    return 0;
+  }
+  for (size_t i = 0; i < count; i++) {
+    rfs[i].fd = -1;
+  }
+
+  size_t next = 0;   // next file to open and stat
+  size_t nready = 0; // files waiting for a read request
+  size_t finished = 0;
+  int broken = 0;
+  while (finished < count) {
+    while (nready > 0 && ring_room(&ring, 1)) {
+      size_t i = ready[--nready];
+      RingFile *rf = &rfs[i];
+      size_t left = rf->size - rf->done;
+      struct io_uring_sqe *sqe =
+          ring_sqe(&ring, ((uint64_t)i << OP_BITS) | OP_READ);
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = rf->fd;
+      sqe->addr = (uint64_t)(uintptr_t)(rf->buffer + rf->done);
+      sqe->len = left > (1u << 30) ? (1u << 30) : (unsigned)left;
+      sqe->off = rf->done;
+    }
+    while (next < count && ring_room(&ring, 2)) {
+      RingFile *rf = &rfs[next];
+      rf->pending = 2;
+      struct io_uring_sqe *sqe =
+          ring_sqe(&ring, ((uint64_t)next << OP_BITS) | OP_OPEN);
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t)(uintptr_t)files[next].path;
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe = ring_sqe(&ring, ((uint64_t)next << OP_BITS) | OP_STAT);
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t)(uintptr_t)files[next].path;
+      sqe->len = STATX_TYPE | STATX_SIZE;
+      sqe->off = (uint64_t)(uintptr_t)&rf->stx;
+      next++;
+    }
+    if (!ring_submit_and_wait(&ring)) {
+      broken = 1;
+      break;
+    }
+
+    struct io_uring_cqe cqe;
+    while (ring_reap(&ring, &cqe)) {
+      size_t i = (size_t)(cqe.user_data >> OP_BITS);
+      int op = (int)(cqe.user_data & ((1u << OP_BITS) - 1));
+      RingFile *rf = &rfs[i];
+      switch (op) {
+      case OP_OPEN:
+      case OP_STAT:
+        if (cqe.res < 0) {
+          rf->failed = 1;
+        } else if (op == OP_OPEN) {
+          rf->fd = cqe.res;
+        }
+        if (--rf->pending > 0) {
+          break;
+        }
+        // Pipes, empty and huge files take the one-file path, which also
+        // rejects files over the input limit before reading them
+        if (!rf->failed &&
+            (!S_ISREG(rf->stx.stx_mode) || rf->stx.stx_size == 0 ||
+             rf->stx.stx_size >= SIZE_MAX ||
+             (json_max_input_size() &&
+              rf->stx.stx_size > json_max_input_size()))) {
+          rf->failed = 1;
+        }
+        if (!rf->failed) {
+          rf->size = (size_t)rf->stx.stx_size;
+          rf->buffer = (char *)json_malloc(rf->size);
+          rf->failed = !rf->buffer;
+        }
+        if (rf->failed) {
+          ring_finish(&files[i], rf);
+          finished++;
+        } else {
+          ready[nready++] = i;
+        }
+        break;
+      case OP_READ:
+        if (cqe.res < 0) {
+          rf->failed = 1;
+        } else if (cqe.res == 0) {
+          rf->size = rf->done; // the file shrank
+        } else {
+          rf->done += (size_t)cqe.res;
+        }
+        if (!rf->failed && rf->done < rf->size) {
+          ready[nready++] = i;
+        } else {
+          ring_finish(&files[i], rf);
+          finished++;
+        }
+        break;
+      }
+    }
+  }
+
+  ring_free(&ring);
+  json_free(ready);
+  if (!broken) {
+    json_free(rfs);
+    return 1;
+  }
+  // Requests may still be in flight, writing into rfs (statx results) and
+  // the read buffers, so those are left to them; files not finished yet
+  // are loaded the usual way
+  for (size_t i = 0; i < count; i++) {
+    if (!rfs[i].finished) {
+      if (rfs[i].fd >= 0) {
+        close(rfs[i].fd);
+      }
+      files[i].tok = json_tokenizer_open_file(files[i].path);
+    }
+  }
+  return 1;
+}
+
+/**
+ * Stats the paths through io_uring
+ *
+ * @return 1 on success, 0 if io_uring is unavailable and nothing was done
+ */
+static int ring_stat(const char *const *paths, JsonFileStat *stats,
+                     size_t count) {
+  Ring ring;
+  if (!ring_init(&ring, (unsigned)ring_size_for(count))) {
+    return 0;
+  }
+  struct statx *stx = (struct statx *)json_calloc(count, sizeof(struct statx));
+  if (!stx) {
+    ring_free(&ring);
+    return 0;
+  }
+
+  size_t next = 0;
+  size_t finished = 0;
+  int ok = 1;
+  while (finished < count) {
+    while (next < count && ring_room(&ring, 1)) {
+      struct io_uring_sqe *sqe = ring_sqe(&ring, next);
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t)(uintptr_t)paths[next];
+      sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE;
+      sqe->off = (uint64_t)(uintptr_t)&stx[next];
+      next++;
+    }
+    if (!ring_submit_and_wait(&ring)) {
+      ok = 0;
+      break;
+    }
+    struct io_uring_cqe cqe;
+    while (ring_reap(&ring, &cqe)) {
+      size_t i = (size_t)cqe.user_data;
+      JsonFileStat *out = &stats[i];
+      memset(out, 0, sizeof(*out));
+      if (cqe.res < 0) {
+        out->error = -cqe.res;
+      } else {
+        out->mode = stx[i].stx_mode;
+        out->size = stx[i].stx_size;
+      }
+      finished++;
+    }
+  }
+
+  ring_free(&ring);
+  if (ok) {
+    json_free(stx);
+    return 1;
+  }
+  // Leave stx to any request still in flight and stat again
+  StatBatch batch = {paths, stats};
+  run_pool(count, stat_one, &batch);
+  return 1;
+}
+#endif
+
+/**
+ * Opens tokenizers over several JSON files, overlapping their I/O
+ *
+ * Each files[i].tok is set to what json_tokenizer_open_file(files[i].path)
+ * would return; the caller frees them. Reading one file overlaps the
+ * reads of the others, so a command that then walks the files in turn
+ * waits on the storage about once.
+ */
+void json_tokenizer_open_batch(JsonBatchStream *files, size_t count) {
+  if (!files || count == 0) {
+    return;
+  }
+#ifdef JCT_WITH_IO_URING
+  if (ring_open(files, count)) {
+    return;
+  }
+#endif
+  run_pool(count, open_one, files);
+}
+
+/**
+ * Stats several paths at once, following symlinks
+ *
+ * stats[i].error is 0 on success or the errno of the failed call.
+ */
+void json_stat_batch(const char *const *paths, JsonFileStat *stats,
+                     size_t count) {
+  if (!paths || !stats || count == 0) {
+    return;
+  }
+#ifdef JCT_WITH_IO_URING
+  if (ring_stat(paths, stats, count)) {
+    return;
+  }
+#endif
+  StatBatch batch = {paths, stats};
+  run_pool(count, stat_one, &batch);
+}
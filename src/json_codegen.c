@@ -0,0 +1,1428 @@
+/**
+ * json_codegen.c - C struct bindings generated from a sample or a schema
+ *
+ * 'jct <file> codegen [<name>]' reads a sample document (or a JSON Schema)
+ * and prints a single-file header with a struct per object and, when
+ * <NAME>_IMPLEMENTATION is defined in one translation unit, functions that
+ * parse a document straight into those structs from json_tokenizer_*
+ * tokens, serialize them back, and free them. No JsonValue tree is built.
+ *
+ * Member names are dispatched through a perfect hash computed here: each
+ * key costs one hash, one table slot and one memcmp.
+ */
+
+#include "json_config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  GEN_NONE, // unknown (null, empty array) or unsupported
+  GEN_BOOL,
+  GEN_INT,
+  GEN_DOUBLE,
+  GEN_STRING,
+  GEN_STRUCT,
+  GEN_ARRAY
+} GenKind;
+
+typedef struct GenType GenType;
+
+typedef struct {
+  char *key;   // member name, unescaped
+  char *ident; // C member name
+  GenType *type;
+} GenField;
+
+struct GenType {
+  GenKind kind;
+  GenType *item;    // GEN_ARRAY element type
+  GenField *fields; // GEN_STRUCT members in document order
+  size_t count;
+  size_t capacity;
+  // Set by name_types for GEN_STRUCT
+  int id;
+  char *name;
+  uint32_t seed;
+  uint32_t mask;
+};
+
+static void free_gen_type(GenType *type) {
+  if (!type) {
+    return;
+  }
+  for (size_t i = 0; i < type->count; i++) {
+    free(type->fields[i].key);
+    free(type->fields[i].ident);
+    free_gen_type(type->fields[i].type);
+  }
+  free(type->fields);
+  free_gen_type(type->item);
+  free(type->name);
+  free(type);
+}
+
+static GenType *new_gen_type(GenKind kind) {
+  GenType *type = (GenType *)calloc(1, sizeof(GenType));
+  if (type) {
+    type->kind = kind;
+  }
+  return type;
+}
+
+static GenField *find_field(GenType *type, const char *key) {
+  for (size_t i = 0; i < type->count; i++) {
+    if (strcmp(type->fields[i].key, key) == 0) {
+      return &type->fields[i];
+    }
+  }
+  return NULL;
+}
+
+// Appends a member; takes ownership of key and member_type, even on error
+static int add_field(GenType *type, char *key, GenType *member_type) {
+  if (type->count == type->capacity) {
+    size_t capacity = type->capacity ? type->capacity * 2 : 8;
+    GenField *fields =
+        (GenField *)realloc(type->fields, capacity * sizeof(GenField));
+    if (!fields) {
+      free(key);
+      free_gen_type(member_type);
+      return 0;
+    }
+    type->fields = fields;
+    type->capacity = capacity;
+  }
+  GenField *field = &type->fields[type->count++];
+  field->key = key;
+  field->ident = NULL;
+  field->type = member_type;
+  return 1;
+}
+
+/**
+ * Merges from into into (consuming from): integers widen to doubles,
+ * objects gain each other's members and arrays merge their element types.
+ * On a conflict the first type wins.
+ */
+static int merge_gen_type(GenType *into, GenType *from) {
+  if (into->kind == GEN_NONE) {
+    GenType tmp = *into;
+    *into = *from;
+    *from = tmp;
+  } else if (into->kind == GEN_INT && from->kind == GEN_DOUBLE) {
+    into->kind = GEN_DOUBLE;
+  } else if (into->kind == GEN_STRUCT && from->kind == GEN_STRUCT) {
+    for (size_t i = 0; i < from->count; i++) {
+      GenField *field = &from->fields[i];
+      GenField *existing = find_field(into, field->key);
+      if (existing) {
+        GenType *member = field->type;
+        field->type = NULL;
+        if (!merge_gen_type(existing->type, member)) {
+          free_gen_type(from);
+          return 0;
+        }
+      } else {
+        if (!add_field(into, field->key, field->type)) {
+          field->key = NULL;
+          field->type = NULL;
+          free_gen_type(from);
+          return 0;
+        }
+        field->key = NULL;
+        field->type = NULL;
+      }
+    }
+  } else if (into->kind == GEN_ARRAY && from->kind == GEN_ARRAY) {
+    if (!into->item) {
+      into->item = from->item;
+      from->item = NULL;
+    } else if (from->item) {
+      int ok = merge_gen_type(into->item, from->item);
+      from->item = NULL;
+      if (!ok) {
+        free_gen_type(from);
+        return 0;
+      }
+    }
+  }
+  free_gen_type(from);
+  return 1;
+}
+
+/**
+ * Infers the type of the value starting with token from a sample
+ *
+ * @return The type, or NULL on malformed input or allocation failure
+ */
+static GenType *infer_type(JsonTokenizer *tok, const JsonToken *token) {
+  switch (token->type) {
+  case JSON_TOKEN_TRUE:
+  case JSON_TOKEN_FALSE:
+    return new_gen_type(GEN_BOOL);
+  case JSON_TOKEN_NUMBER: {
+    int fraction = 0;
+    for (size_t i = 0; i < token->length; i++) {
+      char c = token->start[i];
+      fraction |= c == '.' || c == 'e' || c == 'E';
+    }
+    return new_gen_type(fraction ? GEN_DOUBLE : GEN_INT);
+  }
+  case JSON_TOKEN_STRING:
+    return new_gen_type(GEN_STRING);
+  case JSON_TOKEN_NULL:
+    return new_gen_type(GEN_NONE);
+  case JSON_TOKEN_OBJECT_START: {
+    GenType *type = new_gen_type(GEN_STRUCT);
+    JsonToken key;
+    JsonToken value;
+    while (type && json_tokenizer_next(tok, &key) &&
+           key.type == JSON_TOKEN_KEY) {
+      char *name = json_token_string(&key);
+      GenType *member = name && json_tokenizer_next(tok, &value)
+                            ? infer_type(tok, &value)
+                            : NULL;
+      if (!member) {
+        free(name);
+        free_gen_type(type);
+        return NULL;
+      }
+      GenField *existing = find_field(type, name);
+      if (existing) {
+        free(name);
+        if (!merge_gen_type(existing->type, member)) {
+          free_gen_type(type);
+          return NULL;
+        }
+      } else if (!add_field(type, name, member)) {
+        free_gen_type(type);
+        return NULL;
+      }
+    }
+    if (type && key.type != JSON_TOKEN_OBJECT_END) {
+      free_gen_type(type);
+      return NULL;
+    }
+    return type;
+  }
+  case JSON_TOKEN_ARRAY_START: {
+    GenType *type = new_gen_type(GEN_ARRAY);
+    JsonToken element;
+    while (type && json_tokenizer_next(tok, &element) &&
+           element.type != JSON_TOKEN_ARRAY_END) {
+      GenType *item = infer_type(tok, &element);
+      if (!item) {
+        free_gen_type(type);
+        return NULL;
+      }
+      if (!type->item) {
+        type->item = item;
+      } else if (!merge_gen_type(type->item, item)) {
+        free_gen_type(type);
+        return NULL;
+      }
+    }
+    if (type && element.type != JSON_TOKEN_ARRAY_END) {
+      free_gen_type(type);
+      return NULL;
+    }
+    return type;
+  }
+  default:
+    return NULL;
+  }
+}
+
+// Compares a string token with a literal
+static int token_equals(const JsonToken *token, const char *text) {
+  size_t len = strlen(text);
+  return token->type == JSON_TOKEN_STRING && !token->escaped &&
+         token->length == len + 2 && memcmp(token->start + 1, text, len) == 0;
+}
+
+// Kind named by a JSON Schema "type" string token
+static GenKind schema_kind(const JsonToken *token) {
+  static const struct {
+    const char *name;
+    GenKind kind;
+  } kinds[] = {{"boolean", GEN_BOOL}, {"integer", GEN_INT},
+               {"number", GEN_DOUBLE}, {"string", GEN_STRING},
+               {"object", GEN_STRUCT}, {"array", GEN_ARRAY}};
+  for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+    if (token_equals(token, kinds[i].name)) {
+      return kinds[i].kind;
+    }
+  }
+  return GEN_NONE;
+}
+
+/**
+ * Reads the JSON Schema that starts with token
+ *
+ * Uses "type" (a name, or a list whose first non-null name counts),
+ * "properties" and "items"; other keywords are ignored.
+ *
+ * @return The type, or NULL on malformed input or allocation failure
+ */
+static GenType *schema_type(JsonTokenizer *tok, const JsonToken *token) {
+  if (token->type != JSON_TOKEN_OBJECT_START) {
+    // Boolean schemas and the like carry no type
+    return json_tokenizer_skip_value(tok, token, NULL, NULL)
+               ? new_gen_type(GEN_NONE)
+               : NULL;
+  }
+
+  GenKind kind = GEN_NONE;
+  int typed = 0;
+  GenType *properties = NULL;
+  GenType *items = NULL;
+  JsonToken key;
+  JsonToken value;
+  int ok = 1;
+  while (ok && json_tokenizer_next(tok, &key) && key.type == JSON_TOKEN_KEY) {
+    ok = json_tokenizer_next(tok, &value);
+    if (!ok) {
+      break;
+    }
+    char *name = json_token_string(&key);
+    if (!name) {
+      ok = 0;
+    } else if (strcmp(name, "type") == 0 && value.type == JSON_TOKEN_STRING) {
+      kind = schema_kind(&value);
+      typed = 1;
+    } else if (strcmp(name, "type") == 0 &&
+               value.type == JSON_TOKEN_ARRAY_START) {
+      JsonToken entry;
+      while (json_tokenizer_next(tok, &entry) &&
+             entry.type == JSON_TOKEN_STRING) {
+        if (!typed && !token_equals(&entry, "null")) {
+          kind = schema_kind(&entry);
+          typed = 1;
+        }
+      }
+      ok = entry.type == JSON_TOKEN_ARRAY_END;
+    } else if (strcmp(name, "properties") == 0 &&
+               value.type == JSON_TOKEN_OBJECT_START && !properties) {
+      properties = new_gen_type(GEN_STRUCT);
+      JsonToken member;
+      JsonToken member_value;
+      while (ok && properties && json_tokenizer_next(tok, &member) &&
+             member.type == JSON_TOKEN_KEY) {
+        char *member_name = json_token_string(&member);
+        GenType *member_type =
+            member_name && json_tokenizer_next(tok, &member_value)
+                ? schema_type(tok, &member_value)
+                : NULL;
+        if (!member_type) {
+          free(member_name);
+          ok = 0;
+        } else if (find_field(properties, member_name)) {
+          free(member_name);
+          free_gen_type(member_type);
+        } else {
+          ok = add_field(properties, member_name, member_type);
+        }
+      }
+      ok = ok && properties && member.type == JSON_TOKEN_OBJECT_END;
+    } else if (strcmp(name, "items") == 0 && !items) {
+      items = schema_type(tok, &value);
+      ok = items != NULL;
+    } else {
+      ok = json_tokenizer_skip_value(tok, &value, NULL, NULL);
+    }
+    free(name);
+  }
+  if (!ok || key.type != JSON_TOKEN_OBJECT_END) {
+    free_gen_type(properties);
+    free_gen_type(items);
+    return NULL;
+  }
+
+  if (!typed) {
+    kind = properties ? GEN_STRUCT : items ? GEN_ARRAY : GEN_NONE;
+  }
+  GenType *type = NULL;
+  if (kind == GEN_STRUCT && properties) {
+    type = properties;
+    properties = NULL;
+  } else if (kind == GEN_ARRAY) {
+    type = new_gen_type(GEN_ARRAY);
+    if (type) {
+      type->item = items;
+      items = NULL;
+    }
+  } else {
+    type = new_gen_type(kind == GEN_STRUCT ? GEN_NONE : kind);
+  }
+  free_gen_type(properties);
+  free_gen_type(items);
+  return type;
+}
+
+/**
+ * Drops members whose type is unknown or has no C mapping (nulls, empty
+ * arrays and objects, arrays of arrays), with a warning naming them
+ *
+ * @return 1 if type itself is usable
+ */
+static int prune_type(GenType *type, const char *where) {
+  switch (type->kind) {
+  case GEN_NONE:
+    return 0;
+  case GEN_ARRAY:
+    return type->item && type->item->kind != GEN_ARRAY &&
+           prune_type(type->item, where);
+  case GEN_STRUCT: {
+    size_t kept = 0;
+    for (size_t i = 0; i < type->count; i++) {
+      GenField *field = &type->fields[i];
+      if (prune_type(field->type, field->key)) {
+        type->fields[kept++] = *field;
+      } else {
+        fprintf(stderr,
+                "Warning: Skipping member '%s' of '%s': type not known from "
+                "the input\n",
+                field->key, where);
+        free(field->key);
+        free(field->ident);
+        free_gen_type(field->type);
+      }
+    }
+    type->count = kept;
+    return kept > 0;
+  }
+  default:
+    return 1;
+  }
+}
+
+static int is_c_keyword(const char *word) {
+  static const char *const keywords[] = {
+      "auto",     "break",    "case",     "char",       "const",
+      "continue", "default",  "do",       "double",     "else",
+      "enum",     "extern",   "float",    "for",        "goto",
+      "if",       "inline",   "int",      "long",       "register",
+      "restrict", "return",   "short",    "signed",     "sizeof",
+      "static",   "struct",   "switch",   "typedef",    "union",
+      "unsigned", "void",     "volatile", "while",      "bool",
+      "true",     "false",    "_Bool",    "_Complex",   "_Imaginary",
+      "class",    "delete",   "new",      "template",   "this",
+      "operator", "private",  "public",   "protected",  "namespace"};
+  for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+    if (strcmp(word, keywords[i]) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int is_ident_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// C identifier for a member name: other characters become '_', and names
+// that would start with a digit or clash with a keyword are adjusted
+static char *member_ident(const char *key) {
+  size_t len = strlen(key);
+  char *ident = (char *)malloc(len + 4);
+  if (!ident) {
+    return NULL;
+  }
+  size_t pos = 0;
+  if (len == 0 || (key[0] >= '0' && key[0] <= '9') || key[0] == '_') {
+    memcpy(ident, "m_", 2);
+    pos = 2;
+  }
+  for (size_t i = 0; i < len; i++) {
+    ident[pos++] = is_ident_char(key[i]) ? key[i] : '_';
+  }
+  ident[pos] = '\0';
+  if (is_c_keyword(ident)) {
+    ident[pos++] = '_';
+    ident[pos] = '\0';
+  }
+  return ident;
+}
+
+// Appends text to a CamelCase type name: words split at non-alphanumerics
+static void append_camel(char *out, size_t *pos, const char *text) {
+  int upper = 1;
+  for (; *text; text++) {
+    char c = *text;
+    if (!is_ident_char(c) || c == '_') {
+      upper = 1;
+      continue;
+    }
+    if (upper && c >= 'a' && c <= 'z') {
+      c = (char)(c - 'a' + 'A');
+    }
+    out[(*pos)++] = c;
+    upper = 0;
+  }
+  out[*pos] = '\0';
+}
+
+typedef struct {
+  const char *prefix;
+  GenType **structs; // in definition order (members before their users)
+  size_t count;
+  size_t capacity;
+} GenContext;
+
+static int name_taken(GenContext *ctx, const char *name) {
+  for (size_t i = 0; i < ctx->count; i++) {
+    if (strcmp(ctx->structs[i]->name, name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Returns 1 if the C names of a member (ident, and ident_count for an
+// array) clash with those of the members named so far
+static int ident_taken(const GenType *type, size_t upto, const char *ident,
+                       int array) {
+  char count[300];
+  snprintf(count, sizeof(count), "%s_count", ident);
+  for (size_t i = 0; i < upto; i++) {
+    const GenField *field = &type->fields[i];
+    char field_count[300];
+    snprintf(field_count, sizeof(field_count), "%s_count", field->ident);
+    int field_array = field->type->kind == GEN_ARRAY;
+    if (strcmp(field->ident, ident) == 0 ||
+        (field_array && strcmp(field_count, ident) == 0) ||
+        (array && strcmp(field->ident, count) == 0)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static uint32_t gen_hash(const char *s, size_t len, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h ^ (h >> 16);
+}
+
+// Finds a seed and a power-of-two table for which the member names hash
+// to distinct slots
+static int find_perfect_hash(GenType *type) {
+  uint32_t size = 1;
+  while (size < type->count) {
+    size *= 2;
+  }
+  unsigned char *used = NULL;
+  for (; size <= (1u << 24); size *= 2) {
+    unsigned char *grown = (unsigned char *)realloc(used, size);
+    if (!grown) {
+      free(used);
+      return 0;
+    }
+    used = grown;
+    for (uint32_t seed = 0; seed < 1024; seed++) {
+      memset(used, 0, size);
+      size_t i = 0;
+      for (; i < type->count; i++) {
+        const char *key = type->fields[i].key;
+        uint32_t slot = gen_hash(key, strlen(key), seed) & (size - 1);
+        if (used[slot]) {
+          break;
+        }
+        used[slot] = 1;
+      }
+      if (i == type->count) {
+        type->seed = seed;
+        type->mask = size - 1;
+        free(used);
+        return 1;
+      }
+    }
+  }
+  free(used);
+  return 0;
+}
+
+/**
+ * Names struct types and members and lists the structs in definition
+ * order; name is the CamelCase type name for a struct type
+ */
+static int name_types(GenContext *ctx, GenType *type, const char *name) {
+  if (type->kind == GEN_ARRAY) {
+    size_t len = strlen(name);
+    char *item_name = (char *)malloc(len + 5);
+    if (!item_name) {
+      return 0;
+    }
+    memcpy(item_name, name, len);
+    memcpy(item_name + len, "Item", 5);
+    int ok = name_types(ctx, type->item, item_name);
+    free(item_name);
+    return ok;
+  }
+  if (type->kind != GEN_STRUCT) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < type->count; i++) {
+    GenField *field = &type->fields[i];
+    char *ident = member_ident(field->key);
+    if (!ident) {
+      return 0;
+    }
+    size_t len = strlen(ident);
+    char *unique = (char *)malloc(len + 24);
+    if (!unique) {
+      free(ident);
+      return 0;
+    }
+    memcpy(unique, ident, len + 1);
+    for (int n = 2;
+         ident_taken(type, i, unique, field->type->kind == GEN_ARRAY); n++) {
+      snprintf(unique, len + 24, "%s_%d", ident, n);
+    }
+    free(ident);
+    field->ident = unique;
+
+    // Member types are named after the member and defined first
+    char *child = (char *)malloc(strlen(name) + strlen(field->key) + 1);
+    if (!child) {
+      return 0;
+    }
+    size_t pos = strlen(name);
+    memcpy(child, name, pos + 1);
+    append_camel(child, &pos, field->key);
+    int ok = name_types(ctx, field->type, child);
+    free(child);
+    if (!ok) {
+      return 0;
+    }
+  }
+
+  size_t len = strlen(name);
+  type->name = (char *)malloc(len + 24);
+  if (!type->name) {
+    return 0;
+  }
+  memcpy(type->name, name, len + 1);
+  for (int n = 2; name_taken(ctx, type->name); n++) {
+    snprintf(type->name, len + 24, "%s%d", name, n);
+  }
+  if (!find_perfect_hash(type)) {
+    fprintf(stderr, "Error: No perfect hash found for the members of %s\n",
+            type->name);
+    return 0;
+  }
+
+  if (ctx->count == ctx->capacity) {
+    size_t capacity = ctx->capacity ? ctx->capacity * 2 : 8;
+    GenType **structs =
+        (GenType **)realloc(ctx->structs, capacity * sizeof(GenType *));
+    if (!structs) {
+      return 0;
+    }
+    ctx->structs = structs;
+    ctx->capacity = capacity;
+  }
+  type->id = (int)ctx->count;
+  ctx->structs[ctx->count++] = type;
+  return 1;
+}
+
+// Writes bytes as the contents of a C string literal
+static void put_c_string(FILE *out, const char *s, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20 || c >= 0x7f || c == '?') {
+      // Three octal digits, so a following digit is never absorbed; '?'
+      // avoids trigraphs
+      fprintf(out, "\\%03o", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+}
+
+// C type of an array element or scalar member
+static const char *c_type(const GenType *type) {
+  switch (type->kind) {
+  case GEN_BOOL:
+    return "int";
+  case GEN_INT:
+    return "int64_t";
+  case GEN_DOUBLE:
+    return "double";
+  case GEN_STRING:
+    return "char *";
+  default:
+    return type->name;
+  }
+}
+
+// Scalar helper suffix ("bool", "int", ...) for a kind
+static const char *scalar_name(GenKind kind) {
+  switch (kind) {
+  case GEN_BOOL:
+    return "bool";
+  case GEN_INT:
+    return "int";
+  case GEN_DOUBLE:
+    return "double";
+  default:
+    return "string";
+  }
+}
+
+static void emit_struct(FILE *out, const GenType *type) {
+  fprintf(out, "struct %s {\n", type->name);
+  for (size_t i = 0; i < type->count; i++) {
+    const GenField *field = &type->fields[i];
+    const GenType *member = field->type;
+    const char *ctype =
+        c_type(member->kind == GEN_ARRAY ? member->item : member);
+    int pointer = ctype[strlen(ctype) - 1] == '*';
+    if (member->kind == GEN_ARRAY) {
+      fprintf(out, "  %s%s*%s;\n", ctype, pointer ? "" : " ", field->ident);
+      fprintf(out, "  size_t %s_count;\n", field->ident);
+    } else {
+      fprintf(out, "  %s%s%s;%s\n", ctype, pointer ? "" : " ", field->ident,
+              member->kind == GEN_BOOL ? " // 0 or 1" : "");
+    }
+  }
+  fprintf(out, "};\n\n");
+}
+
+// Reader call for the value in token, stored through target
+static void emit_read(FILE *out, const char *p, const GenType *type,
+                      const char *target) {
+  if (type->kind == GEN_STRUCT) {
+    fprintf(out, "%s_parse_%d(tok, &token, %s)", p, type->id, target);
+  } else {
+    fprintf(out, "%s_read_%s(&token, %s)", p, scalar_name(type->kind),
+            target);
+  }
+}
+
+// Writer call for the value of expr
+static void emit_write(FILE *out, const char *p, const GenType *type,
+                       const char *expr) {
+  if (type->kind == GEN_STRUCT) {
+    fprintf(out, "%s_write_%d(b, &%s)", p, type->id, expr);
+  } else {
+    fprintf(out, "%s_put_%s(b, %s)", p, scalar_name(type->kind), expr);
+  }
+}
+
+// Frees the elements of an array member, if they own memory
+static void emit_free_items(FILE *out, const char *p, const GenType *item,
+                            const char *items, const char *count) {
+  if (item->kind != GEN_STRING && item->kind != GEN_STRUCT) {
+    return;
+  }
+  fprintf(out, "  for (size_t i = 0; i < %s; i++) {\n", count);
+  if (item->kind == GEN_STRING) {
+    fprintf(out, "    free(%s[i]);\n", items);
+  } else {
+    fprintf(out, "    %s_free_%d(&%s[i]);\n", p, item->id, items);
+  }
+  fprintf(out, "  }\n");
+}
+
+static void emit_array_parser(FILE *out, const char *p, const GenType *type,
+                              size_t index) {
+  const GenType *item = type->fields[index].type->item;
+  const char *ctype = c_type(item);
+  int pointer = ctype[strlen(ctype) - 1] == '*';
+  fprintf(out,
+          "static int %s_parse_%d_%zu(JsonTokenizer *tok, const JsonToken "
+          "*start,\n"
+          "    %s%s**items, size_t *count) {\n",
+          p, type->id, index, ctype, pointer ? "" : " ");
+  emit_free_items(out, p, item, "(*items)", "*count");
+  fprintf(out, "  free(*items);\n"
+               "  *items = NULL;\n"
+               "  *count = 0;\n"
+               "  if (start->type == JSON_TOKEN_NULL) {\n"
+               "    return 1;\n"
+               "  }\n"
+               "  if (start->type != JSON_TOKEN_ARRAY_START) {\n"
+               "    return 0;\n"
+               "  }\n"
+               "  size_t capacity = 0;\n"
+               "  JsonToken token;\n"
+               "  while (json_tokenizer_next(tok, &token) &&\n"
+               "         token.type != JSON_TOKEN_ARRAY_END) {\n"
+               "    if (*count == capacity) {\n"
+               "      size_t grown = capacity ? capacity * 2 : 4;\n");
+  fprintf(out,
+          "      %s%s*bigger = realloc(*items, grown * sizeof(**items));\n",
+          ctype, pointer ? "" : " ");
+  fprintf(out, "      if (!bigger) {\n"
+               "        return 0;\n"
+               "      }\n"
+               "      *items = bigger;\n"
+               "      capacity = grown;\n"
+               "    }\n");
+  fprintf(out, "    %s%s*item = &(*items)[(*count)++];\n", ctype,
+          pointer ? "" : " ");
+  fprintf(out, "    memset(item, 0, sizeof(*item));\n"
+               "    if (!");
+  emit_read(out, p, item, "item");
+  fprintf(out, ") {\n"
+               "      return 0;\n"
+               "    }\n"
+               "  }\n"
+               "  return token.type == JSON_TOKEN_ARRAY_END;\n"
+               "}\n\n");
+}
+
+static void emit_struct_parser(FILE *out, const char *p, const GenType *type) {
+  for (size_t i = 0; i < type->count; i++) {
+    if (type->fields[i].type->kind == GEN_ARRAY) {
+      emit_array_parser(out, p, type, i);
+    }
+  }
+
+  fprintf(out,
+          "static int %s_parse_%d(JsonTokenizer *tok, const JsonToken *start,\n"
+          "    %s *out) {\n",
+          p, type->id, type->name);
+  fprintf(out, "  static const %s_slot slots[%lu] = {\n", p,
+          (unsigned long)type->mask + 1);
+  for (uint32_t slot = 0; slot <= type->mask; slot++) {
+    size_t i = 0;
+    for (; i < type->count; i++) {
+      const char *key = type->fields[i].key;
+      if ((gen_hash(key, strlen(key), type->seed) & type->mask) == slot) {
+        break;
+      }
+    }
+    if (i == type->count) {
+      fprintf(out, "      {NULL, 0, 0},\n");
+    } else {
+      const char *key = type->fields[i].key;
+      fprintf(out, "      {\"");
+      put_c_string(out, key, strlen(key));
+      fprintf(out, "\", %zu, %zu},\n", strlen(key), i + 1);
+    }
+  }
+  fprintf(out, "  };\n"
+               "  JsonToken token;\n"
+               "  if (start->type == JSON_TOKEN_NULL) {\n"
+               "    return 1;\n"
+               "  }\n"
+               "  if (start->type != JSON_TOKEN_OBJECT_START) {\n"
+               "    return 0;\n"
+               "  }\n"
+               "  while (json_tokenizer_next(tok, &token) &&\n"
+               "         token.type == JSON_TOKEN_KEY) {\n");
+  fprintf(out, "    int field = %s_field(slots, %luu, %luu, &token);\n", p,
+          (unsigned long)type->mask, (unsigned long)type->seed);
+  fprintf(out, "    if (field < 0 || !json_tokenizer_next(tok, &token)) {\n"
+               "      return 0;\n"
+               "    }\n"
+               "    switch (field) {\n");
+  for (size_t i = 0; i < type->count; i++) {
+    const GenField *field = &type->fields[i];
+    fprintf(out, "    case %zu:\n      if (!", i + 1);
+    if (field->type->kind == GEN_ARRAY) {
+      fprintf(out, "%s_parse_%d_%zu(tok, &token, &out->%s, &out->%s_count)",
+              p, type->id, i, field->ident, field->ident);
+    } else {
+      char target[256];
+      snprintf(target, sizeof(target), "&out->%s", field->ident);
+      emit_read(out, p, field->type, target);
+    }
+    fprintf(out, ") {\n"
+                 "        return 0;\n"
+                 "      }\n"
+                 "      break;\n");
+  }
+  fprintf(out,
+          "    default:\n"
+          "      if (!json_tokenizer_skip_value(tok, &token, NULL, NULL)) {\n"
+          "        return 0;\n"
+          "      }\n"
+          "    }\n"
+          "  }\n"
+          "  return token.type == JSON_TOKEN_OBJECT_END;\n"
+          "}\n\n");
+}
+
+static void emit_struct_writer(FILE *out, const char *p, const GenType *type) {
+  fprintf(out, "static int %s_write_%d(%s_buffer *b, const %s *value) {\n", p,
+          type->id, p, type->name);
+  for (size_t i = 0; i < type->count; i++) {
+    const GenField *field = &type->fields[i];
+    char *escaped = json_escape_string(field->key);
+    const char *key = escaped ? escaped : "";
+    // {"key": or ,"key":
+    size_t len = strlen(key) + 4;
+    int array = field->type->kind == GEN_ARRAY;
+    fprintf(out, "  if (!%s_put(b, \"%s\\\"", p, i == 0 ? "{" : ",");
+    put_c_string(out, key, strlen(key));
+    fprintf(out, "\\\":%s\", %zu)", array ? "[" : "", len + array);
+    free(escaped);
+    if (array) {
+      fprintf(out, ") {\n"
+                   "    return 0;\n"
+                   "  }\n");
+      fprintf(out, "  for (size_t i = 0; i < value->%s_count; i++) {\n",
+              field->ident);
+      fprintf(out, "    if ((i > 0 && !%s_put(b, \",\", 1)) ||\n        !", p);
+      char expr[256];
+      snprintf(expr, sizeof(expr), "value->%s[i]", field->ident);
+      emit_write(out, p, field->type->item, expr);
+      fprintf(out, ") {\n"
+                   "      return 0;\n"
+                   "    }\n"
+                   "  }\n");
+      fprintf(out,
+              "  if (!%s_put(b, \"]\", 1)) {\n"
+              "    return 0;\n"
+              "  }\n",
+              p);
+    } else {
+      char expr[256];
+      snprintf(expr, sizeof(expr), "value->%s", field->ident);
+      fprintf(out, " ||\n      !");
+      emit_write(out, p, field->type, expr);
+      fprintf(out, ") {\n"
+                   "    return 0;\n"
+                   "  }\n");
+    }
+  }
+  fprintf(out,
+          "  return %s_put(b, \"}\", 1);\n"
+          "}\n\n",
+          p);
+}
+
+static void emit_struct_free(FILE *out, const char *p, const GenType *type) {
+  fprintf(out, "static void %s_free_%d(%s *value) {\n", p, type->id,
+          type->name);
+  int owns = 0;
+  for (size_t i = 0; i < type->count; i++) {
+    const GenField *field = &type->fields[i];
+    char items[256];
+    char count[256];
+    switch (field->type->kind) {
+    case GEN_STRING:
+      fprintf(out, "  free(value->%s);\n", field->ident);
+      owns = 1;
+      break;
+    case GEN_STRUCT:
+      fprintf(out, "  %s_free_%d(&value->%s);\n", p, field->type->id,
+              field->ident);
+      owns = 1;
+      break;
+    case GEN_ARRAY:
+      snprintf(items, sizeof(items), "value->%s", field->ident);
+      snprintf(count, sizeof(count), "value->%s_count", field->ident);
+      emit_free_items(out, p, field->type->item, items, count);
+      fprintf(out, "  free(value->%s);\n", field->ident);
+      owns = 1;
+      break;
+    default:
+      break;
+    }
+  }
+  if (!owns) {
+    fprintf(out, "  (void)value;\n");
+  }
+  fprintf(out, "}\n\n");
+}
+
+// Marks which scalar kinds appear, so only the helpers in use are emitted
+static void collect_kinds(const GenType *type, int used[]) {
+  if (type->kind == GEN_ARRAY) {
+    collect_kinds(type->item, used);
+  } else if (type->kind == GEN_STRUCT) {
+    for (size_t i = 0; i < type->count; i++) {
+      collect_kinds(type->fields[i].type, used);
+    }
+  } else {
+    used[type->kind] = 1;
+  }
+}
+
+static void emit_helpers(FILE *out, const char *p, const int used[]) {
+  fprintf(out,
+          "typedef struct {\n"
+          "  const char *key;\n"
+          "  size_t len;\n"
+          "  int field;\n"
+          "} %s_slot;\n\n",
+          p);
+  fprintf(out,
+          "typedef struct {\n"
+          "  char *data;\n"
+          "  size_t len;\n"
+          "  size_t capacity;\n"
+          "} %s_buffer;\n\n",
+          p);
+  fprintf(out,
+          "static int %s_put(%s_buffer *b, const char *s, size_t len) {\n"
+          "  if (b->len + len + 1 > b->capacity) {\n"
+          "    size_t capacity = b->capacity ? b->capacity : 256;\n"
+          "    while (capacity < b->len + len + 1) {\n"
+          "      capacity *= 2;\n"
+          "    }\n"
+          "    char *data = realloc(b->data, capacity);\n"
+          "    if (!data) {\n"
+          "      return 0;\n"
+          "    }\n"
+          "    b->data = data;\n"
+          "    b->capacity = capacity;\n"
+          "  }\n"
+          "  memcpy(b->data + b->len, s, len);\n"
+          "  b->len += len;\n"
+          "  b->data[b->len] = '\\0';\n"
+          "  return 1;\n"
+          "}\n\n",
+          p, p);
+  fprintf(out,
+          "static uint32_t %s_hash(const char *s, size_t len, uint32_t seed) "
+          "{\n"
+          "  uint32_t h = 2166136261u ^ seed;\n"
+          "  for (size_t i = 0; i < len; i++) {\n"
+          "    h ^= (unsigned char)s[i];\n"
+          "    h *= 16777619u;\n"
+          "  }\n"
+          "  return h ^ (h >> 16);\n"
+          "}\n\n",
+          p);
+  fprintf(out,
+          "// Member number of a key token; 0 if unknown, -1 on error\n"
+          "static int %s_field(const %s_slot *slots, uint32_t mask, uint32_t "
+          "seed,\n"
+          "    const JsonToken *key) {\n"
+          "  const char *s = key->start + 1;\n"
+          "  size_t len = key->length - 2;\n"
+          "  char *copy = NULL;\n"
+          "  if (key->escaped) {\n"
+          "    copy = json_token_string(key);\n"
+          "    if (!copy) {\n"
+          "      return -1;\n"
+          "    }\n"
+          "    s = copy;\n"
+          "    len = strlen(copy);\n"
+          "  }\n"
+          "  const %s_slot *slot = &slots[%s_hash(s, len, seed) & mask];\n"
+          "  int field = slot->key && slot->len == len &&\n"
+          "                      memcmp(slot->key, s, len) == 0\n"
+          "                  ? slot->field\n"
+          "                  : 0;\n"
+          "  free(copy);\n"
+          "  return field;\n"
+          "}\n\n",
+          p, p, p, p);
+  if (used[GEN_INT] || used[GEN_DOUBLE]) {
+    fprintf(out,
+            "// NUL-terminated copy of a number token for strtod/strtoll\n"
+            "static char *%s_number_text(const JsonToken *token, char *buf,\n"
+            "    size_t size) {\n"
+            "  char *text = token->length < size ? buf : malloc(token->length "
+            "+ 1);\n"
+            "  if (text) {\n"
+            "    memcpy(text, token->start, token->length);\n"
+            "    text[token->length] = '\\0';\n"
+            "  }\n"
+            "  return text;\n"
+            "}\n\n",
+            p);
+  }
+  if (used[GEN_BOOL]) {
+    fprintf(out,
+            "static int %s_read_bool(const JsonToken *token, int *out) {\n"
+            "  if (token->type == JSON_TOKEN_NULL) {\n"
+            "    return 1;\n"
+            "  }\n"
+            "  if (token->type != JSON_TOKEN_TRUE && token->type != "
+            "JSON_TOKEN_FALSE) {\n"
+            "    return 0;\n"
+            "  }\n"
+            "  *out = token->type == JSON_TOKEN_TRUE;\n"
+            "  return 1;\n"
+            "}\n\n"
+            "static int %s_put_bool(%s_buffer *b, int value) {\n"
+            "  return value ? %s_put(b, \"true\", 4) : %s_put(b, \"false\", "
+            "5);\n"
+            "}\n\n",
+            p, p, p, p, p);
+  }
+  if (used[GEN_INT]) {
+    fprintf(out,
+            "// Whole numbers only, including forms like 1e3\n"
+            "static int %s_read_int(const JsonToken *token, int64_t *out) {\n"
+            "  if (token->type == JSON_TOKEN_NULL) {\n"
+            "    return 1;\n"
+            "  }\n"
+            "  char buf[64];\n"
+            "  char *text = token->type == JSON_TOKEN_NUMBER\n"
+            "                   ? %s_number_text(token, buf, sizeof(buf))\n"
+            "                   : NULL;\n"
+            "  if (!text) {\n"
+            "    return 0;\n"
+            "  }\n"
+            "  char *end;\n"
+            "  int ok;\n"
+            "  if (strcspn(text, \".eE\") == token->length) {\n"
+            "    errno = 0;\n"
+            "    long long value = strtoll(text, &end, 10);\n"
+            "    ok = errno == 0 && end == text + token->length;\n"
+            "    *out = ok ? (int64_t)value : *out;\n"
+            "  } else {\n"
+            "    double value = strtod(text, &end);\n"
+            "    ok = end == text + token->length && value >= "
+            "-9223372036854775808.0 &&\n"
+            "         value < 9223372036854775808.0 &&\n"
+            "         (double)(int64_t)value == value;\n"
+            "    *out = ok ? (int64_t)value : *out;\n"
+            "  }\n"
+            "  if (text != buf) {\n"
+            "    free(text);\n"
+            "  }\n"
+            "  return ok;\n"
+            "}\n\n"
+            "static int %s_put_int(%s_buffer *b, int64_t value) {\n"
+            "  char text[32];\n"
+            "  int len = snprintf(text, sizeof(text), \"%%lld\", (long "
+            "long)value);\n"
+            "  return %s_put(b, text, (size_t)len);\n"
+            "}\n\n",
+            p, p, p, p, p);
+  }
+  if (used[GEN_DOUBLE]) {
+    fprintf(out,
+            "static int %s_read_double(const JsonToken *token, double *out) {\n"
+            "  if (token->type == JSON_TOKEN_NULL) {\n"
+            "    return 1;\n"
+            "  }\n"
+            "  char buf[64];\n"
+            "  char *text = token->type == JSON_TOKEN_NUMBER\n"
+            "                   ? %s_number_text(token, buf, sizeof(buf))\n"
+            "                   : NULL;\n"
+            "  if (!text) {\n"
+            "    return 0;\n"
+            "  }\n"
+            "  char *end;\n"
+            "  double value = strtod(text, &end);\n"
+            "  int ok = end == text + token->length;\n"
+            "  *out = ok ? value : *out;\n"
+            "  if (text != buf) {\n"
+            "    free(text);\n"
+            "  }\n"
+            "  return ok;\n"
+            "}\n\n"
+            "// Non-finite values have no JSON form and are written as null\n"
+            "static int %s_put_double(%s_buffer *b, double value) {\n"
+            "  char text[32];\n"
+            "  if (!isfinite(value)) {\n"
+            "    return %s_put(b, \"null\", 4);\n"
+            "  }\n"
+            "  int len = snprintf(text, sizeof(text), \"%%.17g\", value);\n"
+            "  return %s_put(b, text, (size_t)len);\n"
+            "}\n\n",
+            p, p, p, p, p, p);
+  }
+  if (used[GEN_STRING]) {
+    fprintf(out,
+            "static int %s_read_string(const JsonToken *token, char **out) {\n"
+            "  if (token->type == JSON_TOKEN_NULL) {\n"
+            "    free(*out);\n"
+            "    *out = NULL;\n"
+            "    return 1;\n"
+            "  }\n"
+            "  char *value = token->type == JSON_TOKEN_STRING\n"
+            "                    ? json_token_string(token)\n"
+            "                    : NULL;\n"
+            "  if (!value) {\n"
+            "    return 0;\n"
+            "  }\n"
+            "  free(*out);\n"
+            "  *out = value;\n"
+            "  return 1;\n"
+            "}\n\n"
+            "static int %s_put_string(%s_buffer *b, const char *value) {\n"
+            "  if (!value) {\n"
+            "    return %s_put(b, \"null\", 4);\n"
+            "  }\n"
+            "  char *escaped = json_escape_string(value);\n"
+            "  int ok = escaped && %s_put(b, \"\\\"\", 1) &&\n"
+            "           %s_put(b, escaped, strlen(escaped)) && %s_put(b, "
+            "\"\\\"\", 1);\n"
+            "  free(escaped);\n"
+            "  return ok;\n"
+            "}\n\n",
+            p, p, p, p, p, p, p);
+  }
+}
+
+static void emit_header(FILE *out, const GenContext *ctx, const char *guard,
+                        const char *source) {
+  const char *p = ctx->prefix;
+  const char *root = ctx->structs[ctx->count - 1]->name;
+  int used[GEN_ARRAY + 1] = {0};
+  collect_kinds(ctx->structs[ctx->count - 1], used);
+
+  fprintf(out,
+          "/*\n"
+          " * %s.h - generated by 'jct %s codegen'; do not edit\n"
+          " *\n"
+          " * Define %s_IMPLEMENTATION in one C file before including this "
+          "header\n"
+          " * to compile the parser and serializer there. Link with -ljct.\n"
+          " */\n\n",
+          p, source, guard);
+  fprintf(out,
+          "#ifndef %s_H\n"
+          "#define %s_H\n\n"
+          "#include <stddef.h>\n"
+          "#include <stdint.h>\n\n"
+          "#ifdef __cplusplus\n"
+          "extern \"C\" {\n"
+          "#endif\n\n",
+          guard, guard);
+  for (size_t i = 0; i < ctx->count; i++) {
+    fprintf(out, "typedef struct %s %s;\n", ctx->structs[i]->name,
+            ctx->structs[i]->name);
+  }
+  fprintf(out, "\n// Members missing from a document are left zero (NULL "
+               "strings, empty arrays)\n");
+  for (size_t i = 0; i < ctx->count; i++) {
+    emit_struct(out, ctx->structs[i]);
+  }
+  fprintf(out,
+          "// Parse a document into *out, which is zeroed first. Returns 1 on "
+          "success,\n"
+          "// 0 on malformed input, a type mismatch or allocation failure.\n"
+          "int %s_parse(const char *json, size_t len, %s *out);\n"
+          "int %s_parse_file(const char *path, %s *out);\n"
+          "// Compact JSON for *value (caller frees); NULL on allocation "
+          "failure\n"
+          "char *%s_to_json(const %s *value);\n"
+          "// Free the strings and arrays of *value and zero it\n"
+          "void %s_free(%s *value);\n\n",
+          p, root, p, root, p, root, p, root);
+  fprintf(out,
+          "#ifdef __cplusplus\n"
+          "}\n"
+          "#endif\n\n"
+          "#endif /* %s_H */\n\n",
+          guard);
+
+  fprintf(out,
+          "#ifdef %s_IMPLEMENTATION\n\n"
+          "#include <json_config.h>\n",
+          guard);
+  if (used[GEN_INT]) {
+    fprintf(out, "#include <errno.h>\n");
+  }
+  if (used[GEN_DOUBLE]) {
+    fprintf(out, "#include <math.h>\n");
+  }
+  fprintf(out, "#include <stdio.h>\n"
+               "#include <stdlib.h>\n"
+               "#include <string.h>\n\n");
+
+  emit_helpers(out, p, used);
+  for (size_t i = 0; i < ctx->count; i++) {
+    fprintf(out, "static void %s_free_%d(%s *value);\n", p,
+            ctx->structs[i]->id, ctx->structs[i]->name);
+  }
+  fprintf(out, "\n");
+  for (size_t i = 0; i < ctx->count; i++) {
+    emit_struct_free(out, p, ctx->structs[i]);
+    emit_struct_parser(out, p, ctx->structs[i]);
+    emit_struct_writer(out, p, ctx->structs[i]);
+  }
+
+  int root_id = ctx->structs[ctx->count - 1]->id;
+  fprintf(out,
+          "static int %s_parse_tokens(JsonTokenizer *tok, %s *out) {\n"
+          "  JsonToken token;\n"
+          "  memset(out, 0, sizeof(*out));\n"
+          "  if (tok && json_tokenizer_next(tok, &token) &&\n"
+          "      token.type == JSON_TOKEN_OBJECT_START &&\n"
+          "      %s_parse_%d(tok, &token, out) && json_tokenizer_next(tok, "
+          "&token) &&\n"
+          "      token.type == JSON_TOKEN_END) {\n"
+          "    return 1;\n"
+          "  }\n"
+          "  %s_free(out);\n"
+          "  return 0;\n"
+          "}\n\n",
+          p, root, p, root_id, p);
+  fprintf(out,
+          "int %s_parse(const char *json, size_t len, %s *out) {\n"
+          "  JsonTokenizer *tok = json_tokenizer_create(json, len);\n"
+          "  int ok = %s_parse_tokens(tok, out);\n"
+          "  json_tokenizer_free(tok);\n"
+          "  return ok;\n"
+          "}\n\n"
+          "int %s_parse_file(const char *path, %s *out) {\n"
+          "  JsonTokenizer *tok = json_tokenizer_open_file(path);\n"
+          "  int ok = %s_parse_tokens(tok, out);\n"
+          "  json_tokenizer_free(tok);\n"
+          "  return ok;\n"
+          "}\n\n",
+          p, root, p, p, root, p);
+  fprintf(out,
+          "char *%s_to_json(const %s *value) {\n"
+          "  %s_buffer b = {NULL, 0, 0};\n"
+          "  if (!%s_write_%d(&b, value)) {\n"
+          "    free(b.data);\n"
+          "    return NULL;\n"
+          "  }\n"
+          "  return b.data;\n"
+          "}\n\n"
+          "void %s_free(%s *value) {\n"
+          "  if (value) {\n"
+          "    %s_free_%d(value);\n"
+          "    memset(value, 0, sizeof(*value));\n"
+          "  }\n"
+          "}\n\n"
+          "#endif /* %s_IMPLEMENTATION */\n",
+          p, root, p, p, root_id, p, root, p, root_id, guard);
+}
+
+// Root of a sample that is itself a JSON Schema
+static int looks_like_schema(const GenType *root) {
+  const GenField *type = NULL;
+  const GenField *properties = NULL;
+  for (size_t i = 0; i < root->count; i++) {
+    const GenField *field = &root->fields[i];
+    if (strcmp(field->key, "$schema") == 0) {
+      return 1;
+    } else if (strcmp(field->key, "type") == 0) {
+      type = field;
+    } else if (strcmp(field->key, "properties") == 0) {
+      properties = field;
+    }
+  }
+  return type && type->type->kind == GEN_STRING && properties &&
+         properties->type->kind == GEN_STRUCT;
+}
+
+// Reads the type model of a file as a sample or, if schema, as a schema
+static GenType *read_model(const char *source_path, int schema) {
+  JsonTokenizer *tok = json_tokenizer_open_file(source_path);
+  if (!tok) {
+    return NULL;
+  }
+  JsonToken token;
+  GenType *root = NULL;
+  if (json_tokenizer_next(tok, &token) &&
+      token.type == JSON_TOKEN_OBJECT_START) {
+    root = schema ? schema_type(tok, &token) : infer_type(tok, &token);
+  } else {
+    fprintf(stderr, "Error: '%s' does not contain a JSON object\n",
+            source_path);
+    json_tokenizer_free(tok);
+    return NULL;
+  }
+  if (root && (!json_tokenizer_next(tok, &token) ||
+               token.type != JSON_TOKEN_END)) {
+    free_gen_type(root);
+    root = NULL;
+  }
+  if (!root) {
+    fprintf(stderr, "Error: Failed to read '%s' as JSON\n", source_path);
+  }
+  json_tokenizer_free(tok);
+  return root;
+}
+
+/**
+ * Prints a C header binding the documents described by a file
+ *
+ * The file is a sample document, whose member types are inferred (numbers
+ * without a fraction or exponent become int64_t), or a JSON Schema (it has
+ * a top-level "$schema", or "type" and "properties"). name prefixes the
+ * generated identifiers; NULL uses the file name up to the first dot.
+ *
+ * @return 1 on success, 0 on error (reported)
+ */
+int json_codegen(const char *source_path, const char *name, FILE *out) {
+  if (!source_path || !out) {
+    return 0;
+  }
+  const char *base = strrchr(source_path, '/');
+  base = base ? base + 1 : source_path;
+  size_t name_len = name ? strlen(name) : strcspn(base, ".");
+  if (!name) {
+    name = base;
+  }
+
+  // Identifier prefix, header guard and root type name
+  char *prefix = (char *)malloc(name_len + 5);
+  char *guard = (char *)malloc(name_len + 5);
+  char *root_name = (char *)malloc(name_len + 7);
+  GenType *root = NULL;
+  GenContext ctx = {NULL, NULL, 0, 0};
+  int ok = 0;
+  if (!prefix || !guard || !root_name) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    goto done;
+  }
+  size_t pos = 0;
+  if (name_len == 0 || (name[0] >= '0' && name[0] <= '9')) {
+    memcpy(prefix, "jct_", 4);
+    pos = 4;
+  }
+  for (size_t i = 0; i < name_len; i++) {
+    prefix[pos++] = is_ident_char(name[i]) ? name[i] : '_';
+  }
+  prefix[pos] = '\0';
+  for (size_t i = 0; i <= pos; i++) {
+    char c = prefix[i];
+    guard[i] = c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+  }
+  pos = 0;
+  append_camel(root_name, &pos, prefix);
+  if (pos == 0 || (root_name[0] >= '0' && root_name[0] <= '9')) {
+    memcpy(root_name, "Config", 7);
+  }
+
+  root = read_model(source_path, 0);
+  if (root && looks_like_schema(root)) {
+    free_gen_type(root);
+    root = read_model(source_path, 1);
+  }
+  if (!root) {
+    goto done;
+  }
+  if (root->kind != GEN_STRUCT || !prune_type(root, "$")) {
+    fprintf(stderr, "Error: '%s' has no members with a known type\n",
+            source_path);
+    goto done;
+  }
+  ctx.prefix = prefix;
+  if (!name_types(&ctx, root, root_name)) {
+    fprintf(stderr, "Error: Failed to name the generated types\n");
+    goto done;
+  }
+
+  emit_header(out, &ctx, guard, base);
+  if (fflush(out) != 0 || ferror(out)) {
+    fprintf(stderr, "Error: Failed to write the generated header\n");
+    goto done;
+  }
+  ok = 1;
+
+done:
+  free(ctx.structs);
+  free_gen_type(root);
+  free(prefix);
+  free(guard);
+  free(root_name);
+  return ok;
+}
@@ -0,0 +1,263 @@
+/**
+ * json_columns.c - Columnar views of arrays of same-shaped objects
+ *
+ * Arrays such as detections[*] with x/y/w/h/score members are stored as a
+ * list of objects, each a list of members, so scanning one member across
+ * the array chases two pointers per element. A columnar view checks once
+ * that every element has the same set of keys and then keeps each member
+ * as a contiguous typed column:
+ *
+ *   detections: [{"x": 1, "score": 0.9}, {"x": 4, "score": 0.2}]
+ *   x:      double[] {1, 4}
+ *   score:  double[] {0.9, 0.2}
+ *
+ * so filters and aggregations become plain loops over an array. A view
+ * borrows strings from the document and is valid until the array or its
+ * elements are modified or freed.
+ */
+
+#include "json_config.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Where name occurs in keys (of count), starting the search at hint,
+// which is right when elements list their members in the same order
+static size_t find_key(const char *const *keys, size_t count, size_t hint,
+                       const char *name) {
+  if (hint < count && strcmp(keys[hint], name) == 0) {
+    return hint;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(keys[i], name) == 0) {
+      return i;
+    }
+  }
+  return count;
+}
+
+// The column type shared by all values, or JSON_COLUMN_MIXED
+static JsonColumnType column_type(const JsonValue *const *values,
+                                  size_t rows) {
+  JsonType type = values[0]->type;
+  for (size_t row = 1; row < rows; row++) {
+    if (values[row]->type != type) {
+      return JSON_COLUMN_MIXED;
+    }
+  }
+  switch (type) {
+  case JSON_NUMBER:
+    return JSON_COLUMN_NUMBER;
+  case JSON_BOOL:
+    return JSON_COLUMN_BOOL;
+  case JSON_STRING:
+    return JSON_COLUMN_STRING;
+  default:
+    return JSON_COLUMN_MIXED;
+  }
+}
+
+// Replaces the member values collected in column->data.values by a typed
+// copy where all of them have the same scalar type
+static int type_column(JsonColumn *column, size_t rows) {
+  const JsonValue **values = column->data.values;
+  column->type = column_type(values, rows);
+  switch (column->type) {
+  case JSON_COLUMN_NUMBER: {
+    double *numbers = (double *)json_malloc(rows * sizeof(double));
+    if (!numbers) {
+      return 0;
+    }
+    for (size_t row = 0; row < rows; row++) {
+      numbers[row] = json_number_value(values[row]);
+    }
+    column->data.numbers = numbers;
+    break;
+  }
+  case JSON_COLUMN_BOOL: {
+    unsigned char *booleans = (unsigned char *)json_malloc(rows);
+    if (!booleans) {
+      return 0;
+    }
+    for (size_t row = 0; row < rows; row++) {
+      booleans[row] = values[row]->value.boolean != 0;
+    }
+    column->data.booleans = booleans;
+    break;
+  }
+  case JSON_COLUMN_STRING: {
+    const char **strings = (const char **)json_malloc(rows * sizeof(char *));
+    if (!strings) {
+      return 0;
+    }
+    for (size_t row = 0; row < rows; row++) {
+      strings[row] = values[row]->value.string;
+    }
+    column->data.strings = strings;
+    break;
+  }
+  case JSON_COLUMN_MIXED:
+    return 1;
+  }
+  json_free(values);
+  return 1;
+}
+
+/**
+ * Builds a columnar view of an array whose elements are all objects with
+ * the same set of keys
+ *
+ * @param array The array
+ * @param fields Distinct members to build columns for, or NULL for all of
+ *               them (in the key order of the first element)
+ * @param field_count Number of fields
+ * @return The view (free with json_columns_free), or NULL if array is
+ *         empty, is not an array of same-shaped objects, lacks one of the
+ *         fields, or on allocation failure
+ */
+JsonColumns *json_columns_build(const JsonValue *array,
+                                const char *const *fields,
+                                size_t field_count) {
+  // A packed array holds numbers only; do not link it to find that out
+  size_t count;
+  if (!array || array->type != JSON_ARRAY || json_array_packed(array, &count)) {
+    return NULL;
+  }
+  JsonArrayItem *first = json_array_first(array);
+  if (!first || first->value->type != JSON_OBJECT) {
+    return NULL;
+  }
+
+  // The keys of the first element are the schema
+  size_t key_count = 0;
+  size_t rows = 0;
+  for (JsonKeyValue *kv = json_object_first(first->value); kv; kv = kv->next) {
+    key_count++;
+  }
+  for (JsonArrayItem *item = first; item; item = item->next) {
+    rows++;
+  }
+  const char **keys = (const char **)json_malloc(
+      (key_count ? key_count : 1) * sizeof(const char *));
+  JsonColumns *columns = (JsonColumns *)json_calloc(1, sizeof(JsonColumns));
+  if (!keys || !columns) {
+    json_free(keys);
+    json_free(columns);
+    return NULL;
+  }
+  size_t k = 0;
+  for (JsonKeyValue *kv = json_object_first(first->value); kv; kv = kv->next) {
+    keys[k++] = kv->key ? kv->key : "";
+  }
+
+  // Schema position of each column
+  if (!fields) {
+    fields = keys;
+    field_count = key_count;
+  }
+  size_t *slots = (size_t *)json_malloc((key_count ? key_count : 1) *
+                                        sizeof(size_t));
+  columns->columns =
+      (JsonColumn *)json_calloc(field_count ? field_count : 1,
+                                sizeof(JsonColumn));
+  columns->elements = (const JsonValue **)json_malloc(rows *
+                                                      sizeof(JsonValue *));
+  if (!slots || !columns->columns || !columns->elements) {
+    goto fail;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    slots[i] = field_count;
+  }
+  for (size_t f = 0; f < field_count; f++) {
+    size_t slot = find_key(keys, key_count, f, fields[f]);
+    if (slot == key_count || slots[slot] < field_count) {
+      goto fail; // unknown or repeated field
+    }
+    slots[slot] = f;
+    columns->columns[f].name = keys[slot];
+    columns->columns[f].data.values =
+        (const JsonValue **)json_malloc(rows * sizeof(JsonValue *));
+    if (!columns->columns[f].data.values) {
+      goto fail;
+    }
+    columns->count = f + 1;
+  }
+
+  // Check the shape of every element and gather the member values
+  size_t row = 0;
+  for (JsonArrayItem *item = first; item; item = item->next, row++) {
+    const JsonValue *element = item->value;
+    if (element->type != JSON_OBJECT) {
+      goto fail;
+    }
+    columns->elements[row] = element;
+    size_t seen = 0;
+    for (JsonKeyValue *kv = json_object_first(element); kv;
+         kv = kv->next, seen++) {
+      size_t slot = seen < key_count
+                        ? find_key(keys, key_count, seen,
+                                   kv->key ? kv->key : "")
+                        : key_count;
+      if (slot == key_count) {
+        goto fail;
+      }
+      if (slots[slot] < field_count) {
+        columns->columns[slots[slot]].data.values[row] = kv->value;
+      }
+    }
+    // Same member count and every member known: same keys (objects have
+    // unique keys)
+    if (seen != key_count) {
+      goto fail;
+    }
+  }
+  columns->rows = rows;
+
+  for (size_t f = 0; f < field_count; f++) {
+    if (!type_column(&columns->columns[f], rows)) {
+      goto fail;
+    }
+  }
+  // Column names stay valid: they are the first element's own keys
+  json_free(slots);
+  json_free(keys);
+  return columns;
+
+fail:
+  json_free(slots);
+  json_free(keys);
+  json_columns_free(columns);
+  return NULL;
+}
+
+/**
+ * Finds the column of a member
+ *
+ * @return The column, or NULL if the view has none for name
+ */
+const JsonColumn *json_columns_find(const JsonColumns *columns,
+                                    const char *name) {
+  if (!columns || !name) {
+    return NULL;
+  }
+  for (size_t f = 0; f < columns->count; f++) {
+    if (strcmp(columns->columns[f].name, name) == 0) {
+      return &columns->columns[f];
+    }
+  }
+  return NULL;
+}
+
+void json_columns_free(JsonColumns *columns) {
+  if (!columns) {
+    return;
+  }
+  if (columns->columns) {
+    // Every column type keeps its data in one block
+    for (size_t f = 0; f < columns->count; f++) {
+      json_free((void *)columns->columns[f].data.values);
+    }
+  }
+  json_free(columns->columns);
+  json_free((void *)columns->elements);
+  json_free(columns);
+}
@@ -0,0 +1,520 @@
+/**
+ * json_compress.c - Optional gzip/zstd support for config file I/O
+ */
+
+#define _DEFAULT_SOURCE // madvise()
+
+#include "json_compress.h"
+#include "json_config.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef JCT_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JCT_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Staging size for compressor input and output
+#define OUTPUT_CHUNK 16384
+
+// Compressed input handed to the decoder at a time, so that a mapped
+// input can be released as it is consumed
+#define INPUT_SLICE ((size_t)1 << 20)
+
+static int ends_with(const char *s, const char *suffix) {
+  size_t n = strlen(s);
+  size_t m = strlen(suffix);
+  return n >= m && strcmp(s + (n - m), suffix) == 0;
+}
+
+JsonCompression json_compression_for_path(const char *path) {
+  if (!path)
+    return JSON_COMPRESS_NONE;
+  if (ends_with(path, ".gz"))
+    return JSON_COMPRESS_GZIP;
+  if (ends_with(path, ".zst"))
+    return JSON_COMPRESS_ZSTD;
+  return JSON_COMPRESS_NONE;
+}
+
+JsonCompression json_compression_detect(const char *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+    return JSON_COMPRESS_GZIP;
+  if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f &&
+      p[3] == 0xfd)
+    return JSON_COMPRESS_ZSTD;
+  return JSON_COMPRESS_NONE;
+}
+
+const char *json_compression_name(JsonCompression compression) {
+  switch (compression) {
+  case JSON_COMPRESS_GZIP:
+    return "gzip";
+  case JSON_COMPRESS_ZSTD:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+static void report_unsupported(JsonCompression compression,
+                               const char *filepath) {
+  const char *name = json_compression_name(compression);
+  const char *flag =
+      compression == JSON_COMPRESS_GZIP ? "WITH_ZLIB" : "WITH_ZSTD";
+  if (filepath) {
+    fprintf(stderr,
+            "Error: '%s' is %s-compressed but this build has no %s support "
+            "(rebuild with %s=1)\n",
+            filepath, name, name, flag);
+  } else {
+    fprintf(stderr,
+            "Error: Writing %s-compressed files is not supported by this "
+            "build (rebuild with %s=1)\n",
+            name, flag);
+  }
+}
+
+#if defined(JCT_WITH_ZLIB) || defined(JCT_WITH_ZSTD)
+// Makes room for at least one more byte in a growing output buffer. The
+// first allocation takes the size the input announces (hint, if non-zero
+// and within max_out), so a well-formed file is inflated without copies.
+static int grow_output(char **buf, size_t *cap, size_t used, size_t max_out,
+                       size_t hint, const char *filepath) {
+  if (used + 1 < *cap)
+    return 1;
+  if (max_out && used >= max_out) {
+    fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+            filepath, max_out);
+    return 0;
+  }
+  size_t ncap = *cap ? *cap * 2 : 65536;
+  if (!*cap && hint && hint < SIZE_MAX - 1 && (!max_out || hint <= max_out)) {
+    ncap = hint + 1;
+  }
+  if (ncap < *cap) {
+    fprintf(stderr, "Error: File '%s' is too large\n", filepath);
+    return 0;
+  }
+  char *nb = (char *)json_realloc(*buf, ncap);
+  if (!nb) {
+    fprintf(stderr,
+            "Error: Memory allocation failed for decompressed content "
+            "(size: %zu).\n",
+            ncap);
+    return 0;
+  }
+  *buf = nb;
+  *cap = ncap;
+  return 1;
+}
+
+// Drops the pages of a mapped input below data + consumed, which the
+// decoder has read; *released is how far that has been done
+static void release_input(const char *data, size_t consumed,
+                          size_t *released) {
+#ifdef MADV_DONTNEED
+  static size_t page;
+  if (!page) {
+    long n = sysconf(_SC_PAGESIZE);
+    page = n > 0 ? (size_t)n : 4096;
+  }
+  size_t end = consumed / page * page;
+  if (end > *released) {
+    madvise((void *)(uintptr_t)(data + *released), end - *released,
+            MADV_DONTNEED);
+    *released = end;
+  }
+#else
+  (void)data;
+  (void)consumed;
+  (void)released;
+#endif
+}
+#endif
+
+#ifdef JCT_WITH_ZLIB
+static char *gunzip_buffer(const char *data, size_t len, int mapped,
+                           size_t max_out, const char *filepath,
+                           size_t *out_len) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  // 15 window bits + 32: accept both gzip and zlib headers
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+    fprintf(stderr, "Error: Failed to initialize gzip decoder\n");
+    return NULL;
+  }
+
+  // The trailer holds the inflated size modulo 2^32 (of the last member,
+  // if several are concatenated); it is only a first guess
+  size_t hint = 0;
+  if (len >= 18) {
+    const unsigned char *t = (const unsigned char *)data + len - 4;
+    hint = (size_t)t[0] | (size_t)t[1] << 8 | (size_t)t[2] << 16 |
+           (size_t)t[3] << 24;
+    if (hint / 1032 > len) {
+      hint = 0; // beyond deflate's best ratio, so not a real size
+    }
+  }
+
+  char *out = NULL;
+  size_t cap = 0;
+  size_t used = 0;
+  size_t consumed = 0;
+  size_t released = 0;
+  int ret = Z_OK;
+
+  while (consumed < len || ret != Z_STREAM_END) {
+    if (!grow_output(&out, &cap, used, max_out, hint, filepath)) {
+      inflateEnd(&zs);
+      json_free(out);
+      return NULL;
+    }
+    // avail_out is 32-bit; input goes in slices so that it can be released
+    size_t in_left = len - consumed;
+    size_t out_left = cap - used - 1;
+    zs.next_in = (unsigned char *)(uintptr_t)(data + consumed);
+    zs.avail_in = (uInt)(in_left > INPUT_SLICE ? INPUT_SLICE : in_left);
+    zs.next_out = (unsigned char *)(out + used);
+    zs.avail_out = (uInt)(out_left > UINT32_MAX ? UINT32_MAX : out_left);
+    uInt avail_in = zs.avail_in;
+    uInt avail_out = zs.avail_out;
+
+    ret = inflate(&zs, Z_NO_FLUSH);
+    consumed += avail_in - zs.avail_in;
+    used += avail_out - zs.avail_out;
+    if (mapped) {
+      release_input(data, consumed, &released);
+    }
+
+    if (ret == Z_STREAM_END) {
+      if (consumed >= len)
+        break;
+      // Concatenated gzip members decode as one stream
+      inflateReset(&zs);
+      ret = Z_OK;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "Error: Corrupt gzip data in '%s': %s\n", filepath,
+              zs.msg ? zs.msg : "inflate failed");
+      inflateEnd(&zs);
+      json_free(out);
+      return NULL;
+    } else if (ret == Z_BUF_ERROR && consumed >= len) {
+      fprintf(stderr, "Error: Truncated gzip data in '%s'\n", filepath);
+      inflateEnd(&zs);
+      json_free(out);
+      return NULL;
+    }
+  }
+
+  inflateEnd(&zs);
+  out[used] = '\0';
+  *out_len = used;
+  return out;
+}
+#endif
+
+#ifdef JCT_WITH_ZSTD
+static char *unzstd_buffer(const char *data, size_t len, int mapped,
+                           size_t max_out, const char *filepath,
+                           size_t *out_len) {
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  if (!ds) {
+    fprintf(stderr, "Error: Failed to initialize zstd decoder\n");
+    return NULL;
+  }
+  ZSTD_initDStream(ds);
+
+  // Frames written in one go record their size
+  unsigned long long frame_size = ZSTD_getFrameContentSize(data, len);
+  size_t hint = frame_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+                        frame_size == ZSTD_CONTENTSIZE_ERROR ||
+                        frame_size >= SIZE_MAX
+                    ? 0
+                    : (size_t)frame_size;
+
+  char *out = NULL;
+  size_t cap = 0;
+  size_t used = 0;
+  size_t released = 0;
+  ZSTD_inBuffer in = {data, 0, 0};
+  size_t ret = 1;
+
+  while (in.pos < len || ret != 0) {
+    if (!grow_output(&out, &cap, used, max_out, hint, filepath)) {
+      ZSTD_freeDStream(ds);
+      json_free(out);
+      return NULL;
+    }
+    // Input goes in slices so that it can be released
+    in.size = len - in.pos > INPUT_SLICE ? in.pos + INPUT_SLICE : len;
+    ZSTD_outBuffer ob = {out + used, cap - used - 1, 0};
+    size_t in_before = in.pos;
+    ret = ZSTD_decompressStream(ds, &ob, &in);
+    if (ZSTD_isError(ret)) {
+      fprintf(stderr, "Error: Corrupt zstd data in '%s': %s\n", filepath,
+              ZSTD_getErrorName(ret));
+      ZSTD_freeDStream(ds);
+      json_free(out);
+      return NULL;
+    }
+    used += ob.pos;
+    if (mapped) {
+      release_input(data, in.pos, &released);
+    }
+    if (ret != 0 && in.pos >= len && in.pos == in_before && ob.pos == 0) {
+      fprintf(stderr, "Error: Truncated zstd data in '%s'\n", filepath);
+      ZSTD_freeDStream(ds);
+      json_free(out);
+      return NULL;
+    }
+  }
+
+  ZSTD_freeDStream(ds);
+  out[used] = '\0';
+  *out_len = used;
+  return out;
+}
+#endif
+
+char *json_decompress_buffer(const char *data, size_t len, int mapped,
+                             JsonCompression compression, size_t max_out,
+                             const char *filepath, size_t *out_len) {
+  (void)data;
+  (void)len;
+  (void)mapped;
+  (void)max_out;
+  (void)out_len;
+  switch (compression) {
+#ifdef JCT_WITH_ZLIB
+  case JSON_COMPRESS_GZIP:
+    return gunzip_buffer(data, len, mapped, max_out, filepath, out_len);
+#endif
+#ifdef JCT_WITH_ZSTD
+  case JSON_COMPRESS_ZSTD:
+    return unzstd_buffer(data, len, mapped, max_out, filepath, out_len);
+#endif
+  default:
+    report_unsupported(compression, filepath);
+    return NULL;
+  }
+}
+
+struct JsonOutput {
+  FILE *file;
+  JsonCompression compression;
+  int failed;
+#ifdef JCT_WITH_ZLIB
+  z_stream zs;
+#endif
+#ifdef JCT_WITH_ZSTD
+  ZSTD_CCtx *cctx;
+#endif
+  size_t pending_len;
+  char pending[OUTPUT_CHUNK];    // uncompressed bytes waiting for the encoder
+  unsigned char out[OUTPUT_CHUNK]; // encoder output waiting for fwrite
+};
+
+JsonOutput *json_output_open(FILE *file, JsonCompression compression) {
+  if (!file)
+    return NULL;
+
+#ifndef JCT_WITH_ZLIB
+  if (compression == JSON_COMPRESS_GZIP) {
+    report_unsupported(compression, NULL);
+    return NULL;
+  }
+#endif
+#ifndef JCT_WITH_ZSTD
+  if (compression == JSON_COMPRESS_ZSTD) {
+    report_unsupported(compression, NULL);
+    return NULL;
+  }
+#endif
+
+  // Plain output writes straight through the FILE buffer, so it does not
+  // need the staging buffers
+  size_t size = compression == JSON_COMPRESS_NONE
+                    ? offsetof(JsonOutput, pending_len)
+                    : sizeof(JsonOutput);
+  JsonOutput *out = (JsonOutput *)json_calloc(1, size);
+  if (!out) {
+    fprintf(stderr, "Error: Memory allocation failed for output stream\n");
+    return NULL;
+  }
+  out->file = file;
+  out->compression = compression;
+
+#ifdef JCT_WITH_ZLIB
+  if (compression == JSON_COMPRESS_GZIP) {
+    // 15 window bits + 16: write a gzip header and trailer
+    if (deflateInit2(&out->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      fprintf(stderr, "Error: Failed to initialize gzip encoder\n");
+      json_free(out);
+      return NULL;
+    }
+  }
+#endif
+#ifdef JCT_WITH_ZSTD
+  if (compression == JSON_COMPRESS_ZSTD) {
+    out->cctx = ZSTD_createCCtx();
+    if (!out->cctx) {
+      fprintf(stderr, "Error: Failed to initialize zstd encoder\n");
+      json_free(out);
+      return NULL;
+    }
+  }
+#endif
+
+  return out;
+}
+
+// Runs the pending bytes through the encoder; finish flushes the stream end
+static int encode_pending(JsonOutput *out, int finish) {
+#ifdef JCT_WITH_ZLIB
+  if (out->compression == JSON_COMPRESS_GZIP) {
+    out->zs.next_in = (unsigned char *)out->pending;
+    out->zs.avail_in = (uInt)out->pending_len;
+    int ret;
+    do {
+      out->zs.next_out = out->out;
+      out->zs.avail_out = sizeof(out->out);
+      ret = deflate(&out->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR) {
+        return 0;
+      }
+      size_t produced = sizeof(out->out) - out->zs.avail_out;
+      if (produced && fwrite(out->out, 1, produced, out->file) != produced) {
+        return 0;
+      }
+    } while (out->zs.avail_out == 0 || (finish && ret != Z_STREAM_END));
+    out->pending_len = 0;
+    return 1;
+  }
+#endif
+#ifdef JCT_WITH_ZSTD
+  if (out->compression == JSON_COMPRESS_ZSTD) {
+    ZSTD_inBuffer in = {out->pending, out->pending_len, 0};
+    size_t remaining;
+    do {
+      ZSTD_outBuffer ob = {out->out, sizeof(out->out), 0};
+      remaining = ZSTD_compressStream2(out->cctx, &ob, &in,
+                                       finish ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(remaining)) {
+        return 0;
+      }
+      if (ob.pos && fwrite(out->out, 1, ob.pos, out->file) != ob.pos) {
+        return 0;
+      }
+    } while (in.pos < in.size || (finish && remaining != 0));
+    out->pending_len = 0;
+    return 1;
+  }
+#endif
+  (void)out;
+  (void)finish;
+  return 0;
+}
+
+int json_output_write(JsonOutput *out, const char *data, size_t len) {
+  if (!out || out->failed)
+    return 0;
+
+  if (out->compression == JSON_COMPRESS_NONE) {
+    if (len && fwrite(data, 1, len, out->file) != len) {
+      out->failed = 1;
+      return 0;
+    }
+    return 1;
+  }
+
+  while (len > 0) {
+    size_t room = sizeof(out->pending) - out->pending_len;
+    size_t n = len < room ? len : room;
+    memcpy(out->pending + out->pending_len, data, n);
+    out->pending_len += n;
+    data += n;
+    len -= n;
+    if (out->pending_len == sizeof(out->pending) && !encode_pending(out, 0)) {
+      out->failed = 1;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int json_output_printf(JsonOutput *out, const char *fmt, ...) {
+  if (!out || out->failed)
+    return 0;
+
+  va_list ap;
+  va_start(ap, fmt);
+
+  if (out->compression == JSON_COMPRESS_NONE) {
+    int n = vfprintf(out->file, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+      out->failed = 1;
+      return 0;
+    }
+    return 1;
+  }
+
+  char small[256];
+  va_list ap2;
+  va_copy(ap2, ap);
+  int n = vsnprintf(small, sizeof(small), fmt, ap);
+  va_end(ap);
+  if (n < 0) {
+    va_end(ap2);
+    out->failed = 1;
+    return 0;
+  }
+
+  int ok;
+  if ((size_t)n < sizeof(small)) {
+    ok = json_output_write(out, small, (size_t)n);
+  } else {
+    char *big = (char *)json_malloc((size_t)n + 1);
+    if (!big) {
+      va_end(ap2);
+      out->failed = 1;
+      return 0;
+    }
+    vsnprintf(big, (size_t)n + 1, fmt, ap2);
+    ok = json_output_write(out, big, (size_t)n);
+    json_free(big);
+  }
+  va_end(ap2);
+  return ok;
+}
+
+int json_output_close(JsonOutput *out) {
+  if (!out)
+    return 0;
+
+  int ok = !out->failed;
+  if (out->compression != JSON_COMPRESS_NONE && ok) {
+    ok = encode_pending(out, 1);
+  }
+
+#ifdef JCT_WITH_ZLIB
+  if (out->compression == JSON_COMPRESS_GZIP)
+    deflateEnd(&out->zs);
+#endif
+#ifdef JCT_WITH_ZSTD
+  if (out->compression == JSON_COMPRESS_ZSTD)
+    ZSTD_freeCCtx(out->cctx);
+#endif
+
+  json_free(out);
+  return ok;
+}
@@ -0,0 +1,53 @@
+/**
+ * json_compress.h - Optional gzip/zstd support for config file I/O
+ *
+ * Internal to the library; not installed. Compression backends are enabled
+ * at build time with JCT_WITH_ZLIB and JCT_WITH_ZSTD (make WITH_ZLIB=1
+ * WITH_ZSTD=1); without them only uncompressed files are supported.
+ */
+
+#ifndef JSON_COMPRESS_H
+#define JSON_COMPRESS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum {
+  JSON_COMPRESS_NONE,
+  JSON_COMPRESS_GZIP,
+  JSON_COMPRESS_ZSTD
+} JsonCompression;
+
+// Compression implied by a file name (".gz" or ".zst" suffix)
+JsonCompression json_compression_for_path(const char *path);
+
+// Compression detected from the leading magic bytes of a buffer
+JsonCompression json_compression_detect(const char *data, size_t len);
+
+// Human-readable name ("gzip", "zstd") for messages
+const char *json_compression_name(JsonCompression compression);
+
+// Decompresses a whole buffer into a newly allocated, NUL-terminated heap
+// buffer. Output larger than max_out (when non-zero) is rejected. Returns
+// NULL on error after printing a message that mentions filepath. With
+// mapped, data is the start of a read-only private file mapping, and the
+// pages already decoded are dropped as decoding goes on (re-reading them
+// reads the file again), so the compressed input and the inflated output
+// are not both resident.
+char *json_decompress_buffer(const char *data, size_t len, int mapped,
+                             JsonCompression compression, size_t max_out,
+                             const char *filepath, size_t *out_len);
+
+// Output sink that writes plain or compressed bytes to a FILE
+typedef struct JsonOutput JsonOutput;
+
+// Returns NULL (with a message) if the compression is not built in
+JsonOutput *json_output_open(FILE *file, JsonCompression compression);
+// Both return 1 on success and 0 on a write or compression error
+int json_output_write(JsonOutput *out, const char *data, size_t len);
+int json_output_printf(JsonOutput *out, const char *fmt, ...);
+// Flushes the compressor and frees the sink; the FILE stays open.
+// Returns 1 on success, 0 if any write failed.
+int json_output_close(JsonOutput *out);
+
+#endif /* JSON_COMPRESS_H */
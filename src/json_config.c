@@ -3,6 +3,7 @@
  */
 
 #include "json_config.h"
+#include "json_compress.h"
 #include <errno.h>
 #include <inttypes.h>
 #include <stdint.h>
@@ -11,6 +12,10 @@
 #include <string.h>
 #include <unistd.h> // for getpid() and unlink()
 
+#ifdef JCT_WITH_THREADS
+#include <pthread.h>
+#endif
+
 /**
  * Loads JSON data from a file path
  *
@@ -18,9 +23,16 @@
  * @return Pointer to JsonValue or NULL on error
  */
 JsonValue *load_config(const char *filepath) {
-  return parse_json_file(filepath);
+  JsonValue *config = parse_json_file(filepath);
+  // Changes made in journaled mode are kept beside the file
+  if (config && !json_journal_replay(filepath, config)) {
+    free_json_value(config);
+    return NULL;
+  }
+  return config;
 }
 
+
 /**
  * Compare function for sorting JSON keys alphabetically
  */
@@ -39,9 +51,56 @@ static int compare_json_keys(const void *a, const void *b) {
 }
 
 /**
- * Writes a JSON value directly to a file with proper indentation
+ * Writes a string as a quoted JSON string, escaping quotes, backslashes and
+ * control characters
  */
-static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
+static int write_json_string(JsonOutput *file, const char *str) {
+  // Simple string escaping for common characters
+  int success = (json_output_printf(file, "\"") > 0);
+  for (const char *p = str; *p; p++) {
+    switch (*p) {
+    case '\\':
+      success = success && (json_output_printf(file, "\\\\") > 0);
+      break;
+    case '\"':
+      success = success && (json_output_printf(file, "\\\"") > 0);
+      break;
+    case '\b':
+      success = success && (json_output_printf(file, "\\b") > 0);
+      break;
+    case '\f':
+      success = success && (json_output_printf(file, "\\f") > 0);
+      break;
+    case '\n':
+      success = success && (json_output_printf(file, "\\n") > 0);
+      break;
+    case '\r':
+      success = success && (json_output_printf(file, "\\r") > 0);
+      break;
+    case '\t':
+      success = success && (json_output_printf(file, "\\t") > 0);
+      break;
+    default:
+      if ((unsigned char)*p < 32) {
+        success = success && (json_output_printf(file, "\\u%04x",
+                                                 (unsigned char)*p) > 0);
+      } else {
+        success = success && (json_output_printf(file, "%c", *p) > 0);
+      }
+      break;
+    }
+    if (!success)
+      break;
+  }
+  success = success && (json_output_printf(file, "\"") > 0);
+  return success;
+}
+
+/**
+ * Writes a JSON value to an output sink (plain or compressed file) with
+ * proper indentation
+ */
+static int write_json_to_file(JsonOutput *file, JsonValue *json, int indent) {
 #ifdef DEBUG
   fprintf(stderr,
           "DEBUG: write_json_to_file called with file=%p, json=%p, indent=%d\n",
@@ -89,72 +148,40 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
 
   switch (json->type) {
   case JSON_NULL:
-    success = (fprintf(file, "null") > 0);
+    success = (json_output_printf(file, "null") > 0);
     break;
   case JSON_BOOL:
-    success = (fprintf(file, "%s", json->value.boolean ? "true" : "false") > 0);
+    success = (json_output_printf(file, "%s",
+                                  json->value.boolean ? "true" : "false") > 0);
     break;
-  case JSON_NUMBER:
-    // Check if it's an integer
-    if (json->value.number == (int64_t)json->value.number) {
-      success = (fprintf(file, "%" PRId64, (int64_t)json->value.number) > 0);
+  case JSON_NUMBER: {
+    const char *lexeme;
+    size_t lexeme_len = json_number_lexeme(json, &lexeme);
+    if (lexeme_len) {
+      // Untouched number from a lazy parse: write it as it was read
+      success =
+          (json_output_printf(file, "%.*s", (int)lexeme_len, lexeme) > 0);
+    } else if (json->value.number == (int64_t)json->value.number) {
+      success = (json_output_printf(file, "%" PRId64,
+                                    (int64_t)json->value.number) > 0);
     } else {
-      success = (fprintf(file, "%g", json->value.number) > 0);
+      success = (json_output_printf(file, "%g", json->value.number) > 0);
     }
     break;
+  }
   case JSON_STRING:
-    if (json->value.string) {
-      // Simple string escaping for common characters
-      success = (fprintf(file, "\"") > 0);
-      for (const char *p = json->value.string; *p; p++) {
-        switch (*p) {
-        case '\\':
-          success = success && (fprintf(file, "\\\\") > 0);
-          break;
-        case '\"':
-          success = success && (fprintf(file, "\\\"") > 0);
-          break;
-        case '\b':
-          success = success && (fprintf(file, "\\b") > 0);
-          break;
-        case '\f':
-          success = success && (fprintf(file, "\\f") > 0);
-          break;
-        case '\n':
-          success = success && (fprintf(file, "\\n") > 0);
-          break;
-        case '\r':
-          success = success && (fprintf(file, "\\r") > 0);
-          break;
-        case '\t':
-          success = success && (fprintf(file, "\\t") > 0);
-          break;
-        default:
-          if ((unsigned char)*p < 32) {
-            success =
-                success && (fprintf(file, "\\u%04x", (unsigned char)*p) > 0);
-          } else {
-            success = success && (fprintf(file, "%c", *p) > 0);
-          }
-          break;
-        }
-        if (!success)
-          break;
-      }
-      success = success && (fprintf(file, "\"") > 0);
-    } else {
-      success = (fprintf(file, "\"\"") > 0);
-    }
+    success = write_json_string(
+        file, json->value.string ? json->value.string : "");
     break;
   case JSON_OBJECT: {
-    if (!json->value.object_head) {
-      success = (fprintf(file, "{}") > 0);
+    if (!json_object_first(json)) {
+      success = (json_output_printf(file, "{}") > 0);
       break;
     }
 
     // Count the number of key-value pairs
     int count = 0;
-    JsonKeyValue *kv = json->value.object_head;
+    JsonKeyValue *kv = json_object_first(json);
     while (kv) {
       count++;
       kv = kv->next;
@@ -162,7 +189,7 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
 
     // Create an array of pointers to key-value pairs
     JsonKeyValue **kvs =
-        (JsonKeyValue **)malloc(count * sizeof(JsonKeyValue *));
+        (JsonKeyValue **)json_malloc(count * sizeof(JsonKeyValue *));
     if (!kvs) {
       fprintf(stderr,
               "Error: Memory allocation failed for sorting JSON keys.\n");
@@ -170,14 +197,16 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
     }
 
     // Fill the array
-    kv = json->value.object_head;
+    kv = json_object_first(json);
     for (int i = 0; i < count; i++) {
       kvs[i] = kv;
       kv = kv->next;
     }
 
-    // Sort the array alphabetically by key
-    qsort(kvs, count, sizeof(JsonKeyValue *), compare_json_keys);
+    // Sort the array alphabetically by key (sorted objects already are)
+    if (!(JSON_FLAG_SORTED & json->flags)) {
+      qsort(kvs, count, sizeof(JsonKeyValue *), compare_json_keys);
+    }
 
     // Debug: Show all keys after sorting
 #ifdef DEBUG
@@ -190,17 +219,17 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
 #endif
 
     // Write the sorted key-value pairs
-    success = (fprintf(file, "{\n") > 0);
+    success = (json_output_printf(file, "{\n") > 0);
     int first = 1;
 
     for (int i = 0; i < count && success; i++) {
       if (!first) {
-        success = success && (fprintf(file, ",\n") > 0);
+        success = success && (json_output_printf(file, ",\n") > 0);
       }
 
       // Print indentation
       for (int j = 0; j < indent + 1 && success; j++) {
-        success = success && (fprintf(file, "  ") > 0);
+        success = success && (json_output_printf(file, "  ") > 0);
       }
 
       // Print key with detailed debugging
@@ -223,7 +252,8 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
 #endif
 
       success = success &&
-                (fprintf(file, "\"%s\": ", kvs[i]->key ? kvs[i]->key : "") > 0);
+                write_json_string(file, kvs[i]->key ? kvs[i]->key : "") &&
+                (json_output_printf(file, ": ") > 0);
 
       // Print value
       if (kvs[i]->value) {
@@ -235,63 +265,68 @@ static int write_json_to_file(FILE *file, JsonValue *json, int indent) {
         success =
             success && write_json_to_file(file, kvs[i]->value, indent + 1);
       } else {
-        success = success && (fprintf(file, "null") > 0);
+        success = success && (json_output_printf(file, "null") > 0);
       }
 
       first = 0;
     }
 
     // Free the array
-    free(kvs);
+    json_free(kvs);
 
     if (success) {
-      success = (fprintf(file, "\n") > 0);
+      success = (json_output_printf(file, "\n") > 0);
       // Print indentation for closing brace
       for (int i = 0; i < indent && success; i++) {
-        success = success && (fprintf(file, "  ") > 0);
+        success = success && (json_output_printf(file, "  ") > 0);
       }
-      success = success && (fprintf(file, "}") > 0);
+      success = success && (json_output_printf(file, "}") > 0);
     }
     break;
   }
   case JSON_ARRAY: {
-    if (!json->value.array_head) {
-      success = (fprintf(file, "[]") > 0);
+    // Packed arrays are read in place rather than linked
+    size_t count = 0;
+    JsonValue *packed = json_array_packed(json, &count);
+    JsonArrayItem *item = packed ? NULL : json_array_first(json);
+    if (!packed && !item) {
+      success = (json_output_printf(file, "[]") > 0);
       break;
     }
 
-    success = (fprintf(file, "[\n") > 0);
-    JsonArrayItem *item = json->value.array_head;
+    success = (json_output_printf(file, "[\n") > 0);
+    size_t index = 0;
     int first = 1;
 
-    while (item && success) {
+    while ((item || index < count) && success) {
+      JsonValue *element = item ? item->value : &packed[index++];
       if (!first) {
-        success = success && (fprintf(file, ",\n") > 0);
+        success = success && (json_output_printf(file, ",\n") > 0);
       }
 
       // Print indentation
       for (int i = 0; i < indent + 1 && success; i++) {
-        success = success && (fprintf(file, "  ") > 0);
+        success = success && (json_output_printf(file, "  ") > 0);
       }
 
       // Print value
-      if (item->value) {
-        success = success && write_json_to_file(file, item->value, indent + 1);
+      if (element) {
+        success = success && write_json_to_file(file, element, indent + 1);
       } else {
-        success = success && (fprintf(file, "null") > 0);
+        success = success && (json_output_printf(file, "null") > 0);
       }
 
       first = 0;
-      item = item->next;
+      item = item ? item->next : NULL;
     }
 
     if (success) {
-      success = (fprintf(file, "\n") > 0);
+      success = (json_output_printf(file, "\n") > 0);
       // Print indentation for closing bracket
       for (int i = 0; i < indent && success; i++) {
-        success = success && (fprintf(file, "  ") > 0);
+        success = success && (json_output_printf(file, "  ") > 0);
       }
-      success = success && (fprintf(file, "]") > 0);
+      success = success && (json_output_printf(file, "]") > 0);
     }
     break;
   }
@@ -345,10 +380,18 @@ int save_config(const char *filepath, JsonValue *json) {
     return 0;
   }
 
+  // A .gz or .zst destination is written compressed
+  JsonOutput *out = json_output_open(file, json_compression_for_path(filepath));
+  if (!out) {
+    fclose(file);
+    unlink(temp_filepath);
+    return 0;
+  }
+
 #ifdef DEBUG
   fprintf(stderr, "DEBUG: save_config - about to call write_json_to_file\n");
 #endif
-  int success = write_json_to_file(file, json, 0);
+  int success = write_json_to_file(out, json, 0);
 #ifdef DEBUG
   fprintf(stderr, "DEBUG: save_config - write_json_to_file returned %d\n",
           success);
@@ -356,13 +399,17 @@ int save_config(const char *filepath, JsonValue *json) {
 
   // Add a final newline
   if (success) {
-    success = (fprintf(file, "\n") > 0);
+    success = (json_output_printf(out, "\n") > 0);
 #ifdef DEBUG
     fprintf(stderr, "DEBUG: save_config - added final newline, success=%d\n",
             success);
 #endif
   }
 
+  // Closing flushes the compressor, so it must succeed too. The data is
+  // synced before the journal (if any) is dropped below.
+  success = json_output_close(out) && success;
+  success = success && fflush(file) == 0 && fsync(fileno(file)) == 0;
   fclose(file);
 
   if (!success) {
@@ -418,6 +465,11 @@ int save_config(const char *filepath, JsonValue *json) {
         }
       }
 
+      if (copy_success && (fflush(dst) != 0 || fsync(fileno(dst)) != 0)) {
+        fprintf(stderr, "Error: Failed to write during copy: %s\n",
+                strerror(errno));
+        copy_success = 0;
+      }
       fclose(src);
       fclose(dst);
 
@@ -451,6 +503,76 @@ int save_config(const char *filepath, JsonValue *json) {
   fprintf(stderr,
           "DEBUG: save_config - completed successfully with atomic rename\n");
 #endif
+  // The file now holds every journaled change
+  return json_journal_discard(filepath);
+}
+
+static int merge_object_into(JsonValue *dest_obj, const JsonValue *src_obj);
+
+// The member key of object, made private first if it is shared by
+// hash-consing (see json_unshare) so that it can be modified in place.
+// NULL if there is no such member or on allocation failure.
+static JsonValue *own_member(JsonValue *object, const char *key) {
+  for (JsonKeyValue *kv = json_object_first(object); kv; kv = kv->next) {
+    if (strcmp(kv->key, key) == 0) {
+      return json_unshare(&kv->value);
+    }
+  }
+  return NULL;
+}
+
+// Merges two sorted objects with a single pass over both member lists.
+// Keys missing from dest are added afterwards, since inserting may move
+// dest's member block under the cursor.
+static int merge_sorted_objects(JsonValue *dest_obj, const JsonValue *src_obj) {
+  JsonKeyValue *dest_kv = json_object_first(dest_obj);
+  size_t missing = 0;
+
+  for (JsonKeyValue *kv = json_object_first(src_obj); kv; kv = kv->next) {
+    while (dest_kv && strcmp(dest_kv->key, kv->key) < 0) {
+      dest_kv = dest_kv->next;
+    }
+    if (!dest_kv || strcmp(dest_kv->key, kv->key) != 0) {
+      missing++;
+      continue;
+    }
+
+    JsonValue *dest_child = dest_kv->value;
+    JsonValue *src_child = kv->value;
+    if (dest_child && src_child && dest_child->type == JSON_OBJECT &&
+        src_child->type == JSON_OBJECT) {
+      dest_child = json_unshare(&dest_kv->value);
+      if (!dest_child || !merge_object_into(dest_child, src_child)) {
+        return 0;
+      }
+    } else {
+      JsonValue *replacement = src_child ? clone_json_value(src_child)
+                                         : create_json_value(JSON_NULL);
+      if (!replacement) {
+        return 0;
+      }
+      free_json_value(dest_kv->value);
+      dest_kv->value = replacement;
+    }
+  }
+
+  for (JsonKeyValue *kv = json_object_first(src_obj); kv && missing;
+       kv = kv->next) {
+    if (get_object_item(dest_obj, kv->key)) {
+      continue;
+    }
+    JsonValue *added = kv->value ? clone_json_value(kv->value)
+                                 : create_json_value(JSON_NULL);
+    if (!added) {
+      return 0;
+    }
+    if (!add_to_object(dest_obj, kv->key, added)) {
+      free_json_value(added);
+      return 0;
+    }
+    missing--;
+  }
+
   return 1;
 }
 
@@ -461,7 +583,11 @@ static int merge_object_into(JsonValue *dest_obj, const JsonValue *src_obj) {
     return 0;
   }
 
-  JsonKeyValue *kv = src_obj->value.object_head;
+  if (dest_obj->flags & src_obj->flags & JSON_FLAG_SORTED) {
+    return merge_sorted_objects(dest_obj, src_obj);
+  }
+
+  JsonKeyValue *kv = json_object_first(src_obj);
   while (kv) {
     const char *key = kv->key ? kv->key : "";
     JsonValue *dest_child = get_object_item(dest_obj, key);
@@ -469,7 +595,10 @@ static int merge_object_into(JsonValue *dest_obj, const JsonValue *src_obj) {
 
     if (dest_child && src_child && dest_child->type == JSON_OBJECT &&
         src_child->type == JSON_OBJECT) {
-      if (!merge_object_into(dest_child, src_child)) {
+      if (json_is_shared(dest_child)) {
+        dest_child = own_member(dest_obj, key);
+      }
+      if (!dest_child || !merge_object_into(dest_child, src_child)) {
         return 0;
       }
     } else {
@@ -520,6 +649,184 @@ int merge_json_into(JsonValue **dest_ptr, const JsonValue *src) {
   return 1;
 }
 
+// Hashes of the keys seen in one source object, to notice repeated keys
+typedef struct {
+  uint64_t *slots; // open addressing, 0 marks an empty slot
+  size_t capacity; // power of two
+  size_t count;
+} KeySet;
+
+/**
+ * Adds a key to the set
+ *
+ * @return 1 if it was new, 0 if it (or a key with the same hash) was seen
+ *         before, -1 on allocation failure
+ */
+static int key_set_add(KeySet *set, const char *key) {
+  if ((set->count + 1) * 2 > set->capacity) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 16;
+    uint64_t *slots = (uint64_t *)json_calloc(capacity, sizeof(uint64_t));
+    if (!slots) {
+      return -1;
+    }
+    for (size_t i = 0; i < set->capacity; i++) {
+      if (set->slots[i]) {
+        size_t j = (size_t)set->slots[i] & (capacity - 1);
+        while (slots[j]) {
+          j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = set->slots[i];
+      }
+    }
+    json_free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+  }
+
+  uint64_t h = json_hash_bytes(key, strlen(key), UINT64_C(0xcbf29ce484222325));
+  h = h ? h : 1;
+  size_t i = (size_t)h & (set->capacity - 1);
+  while (set->slots[i]) {
+    if (set->slots[i] == h) {
+      return 0;
+    }
+    i = (i + 1) & (set->capacity - 1);
+  }
+  set->slots[i] = h;
+  set->count++;
+  return 1;
+}
+
+// Whether merging the object whose '{' was just read from src into dest
+// meets a key twice in one source object. The stream merge would apply
+// both values there, while the tree parser keeps only the last. Consumes
+// the object; 1 if so, 0 if not, -1 if the source is malformed or on
+// allocation failure.
+static int stream_repeats_key(const JsonValue *dest, JsonTokenizer *src) {
+  KeySet seen = {NULL, 0, 0};
+  JsonToken token;
+  int rc = 0;
+  while (rc == 0) {
+    if (!json_tokenizer_next(src, &token)) {
+      rc = -1;
+      break;
+    }
+    if (token.type == JSON_TOKEN_OBJECT_END) {
+      break;
+    }
+    char *key = json_token_string(&token);
+    int added = key ? key_set_add(&seen, key) : -1;
+    if (added != 1 || !json_tokenizer_next(src, &token)) {
+      json_free(key);
+      rc = added == 0 ? 1 : -1;
+      break;
+    }
+
+    const JsonValue *dest_child = get_object_item((JsonValue *)dest, key);
+    json_free(key);
+    if (token.type == JSON_TOKEN_OBJECT_START && dest_child &&
+        dest_child->type == JSON_OBJECT) {
+      rc = stream_repeats_key(dest_child, src);
+    } else if (!json_tokenizer_skip_value(src, &token, NULL, NULL)) {
+      rc = -1;
+    }
+  }
+  json_free(seen.slots);
+  return rc;
+}
+
+// Merges the members of the object whose '{' was just read from src into
+// dest; objects on both sides are merged, anything else replaces
+static int merge_object_stream(JsonValue *dest, JsonTokenizer *src) {
+  JsonToken token;
+  for (;;) {
+    if (!json_tokenizer_next(src, &token)) {
+      return 0;
+    }
+    if (token.type == JSON_TOKEN_OBJECT_END) {
+      return 1;
+    }
+    char *key = json_token_string(&token);
+    if (!key || !json_tokenizer_next(src, &token)) {
+      json_free(key);
+      return 0;
+    }
+
+    JsonValue *dest_child = get_object_item(dest, key);
+    int ok;
+    if (token.type == JSON_TOKEN_OBJECT_START && dest_child &&
+        dest_child->type == JSON_OBJECT) {
+      if (json_is_shared(dest_child)) {
+        dest_child = own_member(dest, key);
+      }
+      ok = dest_child && merge_object_stream(dest_child, src);
+    } else {
+      JsonValue *replacement = json_tokenizer_read_value(src, &token);
+      ok = replacement && add_to_object(dest, key, replacement);
+      if (!ok) {
+        free_json_value(replacement);
+      }
+    }
+    json_free(key);
+    if (!ok) {
+      return 0;
+    }
+  }
+}
+
+/**
+ * Merges a document read from a tokenizer into *dest_ptr, with the same
+ * result as merge_json_into
+ *
+ * Members are applied as they are read, and only values that replace
+ * destination values are built, one at a time; peak memory is the
+ * destination plus the largest replaced value instead of a second copy of
+ * the source.
+ *
+ * An object source is read twice: a first pass checks that no object being
+ * merged repeats a key, since the parser keeps only the last value of a
+ * repeated key. A source that does is parsed and merged as a tree.
+ *
+ * @return 1 on success, 0 if the source is malformed or on allocation
+ *         failure; *dest_ptr may then hold part of the source
+ */
+int merge_json_stream(JsonValue **dest_ptr, JsonTokenizer *src) {
+  JsonToken token;
+  if (!dest_ptr || !src || !json_tokenizer_next(src, &token)) {
+    return 0;
+  }
+
+  if (token.type == JSON_TOKEN_OBJECT_START && *dest_ptr &&
+      (*dest_ptr)->type == JSON_OBJECT) {
+    int repeats = stream_repeats_key(*dest_ptr, src);
+    json_tokenizer_rewind(src);
+    if (repeats < 0 || !json_tokenizer_next(src, &token)) {
+      return 0;
+    }
+    if (repeats) {
+      JsonValue *source = json_tokenizer_read_value(src, &token);
+      int merged = source && json_tokenizer_next(src, &token) &&
+                   token.type == JSON_TOKEN_END &&
+                   merge_json_into(dest_ptr, source);
+      free_json_value(source);
+      return merged;
+    }
+    if (!merge_object_stream(*dest_ptr, src)) {
+      return 0;
+    }
+  } else {
+    JsonValue *replacement = json_tokenizer_read_value(src, &token);
+    if (!replacement) {
+      return 0;
+    }
+    free_json_value(*dest_ptr);
+    *dest_ptr = replacement;
+  }
+
+  // Unlike the tree parser, trailing data is not tolerated
+  return json_tokenizer_next(src, &token) && token.type == JSON_TOKEN_END;
+}
+
 // Helper to check if two JSON values are equal
 static int json_values_equal(const JsonValue *a, const JsonValue *b) {
   if (!a && !b) {
@@ -538,7 +845,7 @@ static int json_values_equal(const JsonValue *a, const JsonValue *b) {
   case JSON_BOOL:
     return a->value.boolean == b->value.boolean;
   case JSON_NUMBER:
-    return a->value.number == b->value.number;
+    return json_number_value(a) == json_number_value(b);
   case JSON_STRING:
     if (!a->value.string && !b->value.string) {
       return 1;
@@ -563,7 +870,22 @@ static int json_values_equal(const JsonValue *a, const JsonValue *b) {
     return 1;
   }
   case JSON_OBJECT: {
-    JsonKeyValue *kv_a = a->value.object_head;
+    if (a->flags & b->flags & JSON_FLAG_SORTED) {
+      // Both sorted: compare the member lists in lockstep
+      const JsonKeyValue *kv_a = json_object_first(a);
+      const JsonKeyValue *kv_b = json_object_first(b);
+      while (kv_a && kv_b) {
+        if (strcmp(kv_a->key, kv_b->key) != 0 ||
+            !json_values_equal(kv_a->value, kv_b->value)) {
+          return 0;
+        }
+        kv_a = kv_a->next;
+        kv_b = kv_b->next;
+      }
+      return !kv_a && !kv_b;
+    }
+
+    JsonKeyValue *kv_a = json_object_first(a);
     while (kv_a) {
       const char *key = kv_a->key ? kv_a->key : "";
       JsonValue *val_b = get_object_item((JsonValue *)b, key);
@@ -572,7 +894,7 @@ static int json_values_equal(const JsonValue *a, const JsonValue *b) {
       }
       kv_a = kv_a->next;
     }
-    JsonKeyValue *kv_b = b->value.object_head;
+    JsonKeyValue *kv_b = json_object_first(b);
     while (kv_b) {
       const char *key = kv_b->key ? kv_b->key : "";
       JsonValue *val_a = get_object_item((JsonValue *)a, key);
@@ -599,12 +921,32 @@ static JsonValue *diff_objects(const JsonValue *modified_obj,
     return NULL;
   }
 
-  JsonKeyValue *kv = modified_obj->value.object_head;
+  // With both sides sorted, walk the original alongside the modified
+  // members instead of looking each key up; the diff comes out sorted too
+  int merge_join =
+      original_obj &&
+      (modified_obj->flags & original_obj->flags & JSON_FLAG_SORTED);
+  const JsonKeyValue *original_kv =
+      merge_join ? json_object_first(original_obj) : NULL;
+  if (merge_join) {
+    diff->flags |= JSON_FLAG_SORTED;
+  }
+
+  JsonKeyValue *kv = json_object_first(modified_obj);
   while (kv) {
     const char *key = kv->key ? kv->key : "";
     JsonValue *modified_child = kv->value;
-    JsonValue *original_child =
-        original_obj ? get_object_item((JsonValue *)original_obj, key) : NULL;
+    JsonValue *original_child = NULL;
+    if (merge_join) {
+      while (original_kv && strcmp(original_kv->key, key) < 0) {
+        original_kv = original_kv->next;
+      }
+      if (original_kv && strcmp(original_kv->key, key) == 0) {
+        original_child = original_kv->value;
+      }
+    } else if (original_obj) {
+      original_child = get_object_item((JsonValue *)original_obj, key);
+    }
 
     // If key doesn't exist in original, include it
     if (!original_child) {
@@ -619,7 +961,7 @@ static JsonValue *diff_objects(const JsonValue *modified_obj,
       JsonValue *child_diff = diff_objects(modified_child, original_child);
       if (child_diff) {
         // Only include if the child diff is not empty
-        if (child_diff->value.object_head != NULL) {
+        if (json_object_first(child_diff) != NULL) {
           add_to_object(diff, key, child_diff);
         } else {
           free_json_value(child_diff);
@@ -672,6 +1014,350 @@ JsonValue *diff_json(const JsonValue *modified, const JsonValue *original) {
   return clone_json_value(modified);
 }
 
+// Remaining members of an original object, indexed once the member order
+// of the two documents diverges
+typedef struct {
+  char *key;
+  const char *start; // raw value bytes
+  size_t length;
+  size_t seq; // position, so the last duplicate key wins like the parser
+} StreamMember;
+
+typedef struct {
+  StreamMember *items;
+  size_t count;
+} StreamIndex;
+
+static void free_stream_index(StreamIndex *index) {
+  for (size_t i = 0; i < index->count; i++) {
+    json_free(index->items[i].key);
+  }
+  json_free(index->items);
+  json_free(index);
+}
+
+static int compare_stream_members(const void *a, const void *b) {
+  const StreamMember *ma = (const StreamMember *)a;
+  const StreamMember *mb = (const StreamMember *)b;
+  int cmp = strcmp(ma->key, mb->key);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return ma->seq < mb->seq ? -1 : ma->seq > mb->seq;
+}
+
+// Indexes the rest of an object; first is an already-read key, or NULL if
+// the object end has been reached
+static StreamIndex *build_stream_index(JsonTokenizer *tok,
+                                       const JsonToken *first) {
+  StreamIndex *index = (StreamIndex *)json_calloc(1, sizeof(StreamIndex));
+  if (!index) {
+    return NULL;
+  }
+  size_t capacity = 0;
+  JsonToken key = first ? *first : (JsonToken){JSON_TOKEN_OBJECT_END, 0, 0, 0};
+
+  while (key.type == JSON_TOKEN_KEY) {
+    JsonToken value;
+    StreamMember member = {NULL, NULL, 0, index->count};
+    if (!json_tokenizer_next(tok, &value) ||
+        !json_tokenizer_skip_value(tok, &value, &member.start,
+                                   &member.length) ||
+        !(member.key = json_token_string(&key))) {
+      free_stream_index(index);
+      return NULL;
+    }
+    if (index->count == capacity) {
+      size_t ncap = capacity ? capacity * 2 : 16;
+      StreamMember *items = (StreamMember *)json_realloc(
+          index->items, ncap * sizeof(StreamMember));
+      if (!items) {
+        json_free(member.key);
+        free_stream_index(index);
+        return NULL;
+      }
+      index->items = items;
+      capacity = ncap;
+    }
+    index->items[index->count++] = member;
+
+    if (!json_tokenizer_next(tok, &key)) {
+      free_stream_index(index);
+      return NULL;
+    }
+  }
+
+  if (key.type != JSON_TOKEN_OBJECT_END) {
+    free_stream_index(index);
+    return NULL;
+  }
+  if (index->count > 1) {
+    qsort(index->items, index->count, sizeof(StreamMember),
+          compare_stream_members);
+  }
+  return index;
+}
+
+static const StreamMember *find_stream_member(const StreamIndex *index,
+                                              const char *key) {
+  size_t lo = 0;
+  size_t hi = index->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(index->items[mid].key, key) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  // lo is past the last entry <= key, which is the last duplicate
+  if (lo > 0 && strcmp(index->items[lo - 1].key, key) == 0) {
+    return &index->items[lo - 1];
+  }
+  return NULL;
+}
+
+// Parses a standalone value from raw bytes
+static JsonValue *parse_stream_slice(const char *start, size_t length) {
+  JsonTokenizer *tok = json_tokenizer_create(start, length);
+  if (!tok) {
+    return NULL;
+  }
+  JsonToken token;
+  JsonValue *value = json_tokenizer_next(tok, &token)
+                         ? json_tokenizer_read_value(tok, &token)
+                         : NULL;
+  json_tokenizer_free(tok);
+  return value;
+}
+
+static JsonValue *diff_object_streams(JsonTokenizer *modified,
+                                      JsonTokenizer *original);
+
+// Diffs one member whose value tokens were just read from both sides and
+// adds the modified value to diff if it changed
+static int diff_member_streams(JsonValue *diff, const char *key,
+                               JsonTokenizer *modified,
+                               const JsonToken *modified_value,
+                               JsonTokenizer *original,
+                               const JsonToken *original_value) {
+  if (modified_value->type == JSON_TOKEN_OBJECT_START &&
+      original_value->type == JSON_TOKEN_OBJECT_START) {
+    JsonValue *child = diff_object_streams(modified, original);
+    if (!child) {
+      return 0;
+    }
+    // Only include if the child diff is not empty
+    if (!json_object_first(child)) {
+      free_json_value(child);
+      return 1;
+    }
+    if (!add_to_object(diff, key, child)) {
+      free_json_value(child);
+      return 0;
+    }
+    return 1;
+  }
+
+  const char *mod_start;
+  const char *orig_start;
+  size_t mod_len;
+  size_t orig_len;
+  if (!json_tokenizer_skip_value(modified, modified_value, &mod_start,
+                                 &mod_len) ||
+      !json_tokenizer_skip_value(original, original_value, &orig_start,
+                                 &orig_len)) {
+    return 0;
+  }
+
+  // Identical bytes are the common case and need no parsing
+  if (mod_len == orig_len && memcmp(mod_start, orig_start, mod_len) == 0) {
+    return 1;
+  }
+
+  JsonValue *mod_child = parse_stream_slice(mod_start, mod_len);
+  JsonValue *orig_child = parse_stream_slice(orig_start, orig_len);
+  int ok = mod_child && orig_child;
+  if (ok && !json_values_equal(mod_child, orig_child)) {
+    ok = add_to_object(diff, key, mod_child);
+    if (ok) {
+      mod_child = NULL;
+    }
+  }
+  free_json_value(mod_child);
+  free_json_value(orig_child);
+  return ok;
+}
+
+// Keys are compared on their raw bytes unless escapes make that ambiguous
+static int stream_keys_equal(const JsonToken *a, const JsonToken *b) {
+  if (!a->escaped && !b->escaped) {
+    return a->length == b->length && memcmp(a->start, b->start, a->length) == 0;
+  }
+  char *ka = json_token_string(a);
+  char *kb = json_token_string(b);
+  int equal = ka && kb && strcmp(ka, kb) == 0;
+  json_free(ka);
+  json_free(kb);
+  return equal;
+}
+
+/**
+ * Diffs two objects whose opening braces were just read
+ *
+ * Members are compared in lockstep while both documents list the same keys
+ * in the same order. At the first divergence the rest of the original
+ * object is indexed (keys and raw value positions, no values) and the
+ * remaining modified members are looked up in it.
+ */
+static JsonValue *diff_object_streams(JsonTokenizer *modified,
+                                      JsonTokenizer *original) {
+  JsonValue *diff = create_json_value(JSON_OBJECT);
+  if (!diff) {
+    return NULL;
+  }
+
+  StreamIndex *index = NULL;
+  KeySet seen = {NULL, 0, 0};
+  int original_done = 0;
+  JsonToken mod_key;
+  JsonToken mod_value;
+  JsonToken orig_key;
+  JsonToken orig_value;
+
+  for (;;) {
+    if (!json_tokenizer_next(modified, &mod_key)) {
+      goto fail;
+    }
+    if (mod_key.type == JSON_TOKEN_OBJECT_END) {
+      break;
+    }
+    char *key = json_token_string(&mod_key);
+    // A repeated key only counts with its last value, which is not known
+    // yet; such documents are left to the tree diff
+    if (!key || key_set_add(&seen, key) != 1 ||
+        !json_tokenizer_next(modified, &mod_value)) {
+      json_free(key);
+      goto fail;
+    }
+
+    int ok;
+    if (!index) {
+      if (!original_done) {
+        if (!json_tokenizer_next(original, &orig_key)) {
+          json_free(key);
+          goto fail;
+        }
+        original_done = orig_key.type == JSON_TOKEN_OBJECT_END;
+      }
+      if (!original_done && stream_keys_equal(&mod_key, &orig_key)) {
+        ok = json_tokenizer_next(original, &orig_value) &&
+             diff_member_streams(diff, key, modified, &mod_value, original,
+                                 &orig_value);
+        json_free(key);
+        if (!ok) {
+          goto fail;
+        }
+        continue;
+      }
+      index = build_stream_index(original, original_done ? NULL : &orig_key);
+      original_done = 1;
+      if (!index) {
+        json_free(key);
+        goto fail;
+      }
+    }
+
+    const StreamMember *member = find_stream_member(index, key);
+    if (!member) {
+      // If key doesn't exist in original, include it
+      JsonValue *added = json_tokenizer_read_value(modified, &mod_value);
+      ok = added && add_to_object(diff, key, added);
+      if (!ok) {
+        free_json_value(added);
+      }
+    } else {
+      JsonTokenizer *sub = json_tokenizer_create(member->start, member->length);
+      ok = sub && json_tokenizer_next(sub, &orig_value) &&
+           diff_member_streams(diff, key, modified, &mod_value, sub,
+                               &orig_value);
+      json_tokenizer_free(sub);
+    }
+    json_free(key);
+    if (!ok) {
+      goto fail;
+    }
+  }
+
+  // Consume the original members that had no counterpart
+  while (!original_done) {
+    if (!json_tokenizer_next(original, &orig_key)) {
+      goto fail;
+    }
+    if (orig_key.type == JSON_TOKEN_OBJECT_END) {
+      break;
+    }
+    if (!json_tokenizer_next(original, &orig_value) ||
+        !json_tokenizer_skip_value(original, &orig_value, NULL, NULL)) {
+      goto fail;
+    }
+  }
+
+  if (index) {
+    free_stream_index(index);
+  }
+  json_free(seen.slots);
+  return diff;
+
+fail:
+  if (index) {
+    free_stream_index(index);
+  }
+  json_free(seen.slots);
+  free_json_value(diff);
+  return NULL;
+}
+
+/**
+ * Computes the same result as diff_json for two documents that are read
+ * from tokenizers instead of trees
+ *
+ * Memory use is bounded by the differences and by the member index of
+ * objects whose key order differs, not by the document sizes.
+ *
+ * @return The diff, or NULL if the documents are not both objects, either
+ *         one is malformed or the modified one repeats a key; callers then
+ *         fall back to diff_json, which reports any problem
+ */
+JsonValue *diff_json_stream(JsonTokenizer *modified, JsonTokenizer *original) {
+  if (!modified || !original) {
+    return NULL;
+  }
+
+  JsonToken mod_token;
+  JsonToken orig_token;
+  if (!json_tokenizer_next(modified, &mod_token) ||
+      !json_tokenizer_next(original, &orig_token) ||
+      mod_token.type != JSON_TOKEN_OBJECT_START ||
+      orig_token.type != JSON_TOKEN_OBJECT_START) {
+    return NULL;
+  }
+
+  JsonValue *diff = diff_object_streams(modified, original);
+  if (!diff) {
+    return NULL;
+  }
+
+  // Trailing data is left to the tree parser to warn about
+  if (!json_tokenizer_next(modified, &mod_token) ||
+      !json_tokenizer_next(original, &orig_token)) {
+    free_json_value(diff);
+    return NULL;
+  }
+
+  return diff;
+}
+
 /**
  * Gets a nested item using dot notation
  *
@@ -684,7 +1370,7 @@ JsonValue *get_nested_item(JsonValue *object, const char *key) {
     return NULL;
   }
 
-  char *key_copy = strdup(key);
+  char *key_copy = json_strdup(key);
   if (!key_copy) {
     fprintf(stderr, "Error: Memory allocation failed for key copy.\n");
     return NULL;
@@ -702,19 +1388,19 @@ JsonValue *get_nested_item(JsonValue *object, const char *key) {
       if (*endptr != '\0' || index < 0 || index >= get_array_size(current)) {
         fprintf(stderr, "Error: Invalid array index '%s' for key '%s'.\n",
                 token, key);
-        free(key_copy);
+        json_free(key_copy);
         return NULL;
       }
       current = get_array_item(current, index);
     } else {
       // Cannot traverse further
-      free(key_copy);
+      json_free(key_copy);
       return NULL;
     }
     token = strtok(NULL, ".");
   }
 
-  free(key_copy);
+  json_free(key_copy);
   return current;
 }
 
@@ -731,7 +1417,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
     return 0;
   }
 
-  char *key_copy = strdup(key);
+  char *key_copy = json_strdup(key);
   if (!key_copy) {
     fprintf(stderr, "Error: Memory allocation failed for key copy.\n");
     return 0;
@@ -748,7 +1434,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
   }
 
   if (part_count == 0) {
-    free(key_copy);
+    json_free(key_copy);
     return 0;
   }
 
@@ -768,10 +1454,18 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
           fprintf(stderr,
                   "Error: Failed to create intermediate object for key '%s'.\n",
                   parts[i]);
-          free(key_copy);
+          json_free(key_copy);
           return 0;
         }
         add_to_object(current, parts[i], next);
+      } else if (json_is_shared(next)) {
+        next = own_member(current, parts[i]);
+        if (!next) {
+          fprintf(stderr, "Error: Memory allocation failed for key '%s'.\n",
+                  parts[i]);
+          json_free(key_copy);
+          return 0;
+        }
       }
       current = next;
     } else if (current->type == JSON_ARRAY) {
@@ -780,7 +1474,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
       if (*endptr != '\0' || index < 0) {
         fprintf(stderr, "Error: Invalid array index '%s' for key '%s'.\n",
                 parts[i], key);
-        free(key_copy);
+        json_free(key_copy);
         return 0;
       }
 
@@ -789,19 +1483,29 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
         JsonValue *new_obj = create_json_value(JSON_OBJECT);
         if (!new_obj) {
           fprintf(stderr, "Error: Failed to create new array item.\n");
-          free(key_copy);
+          json_free(key_copy);
           return 0;
         }
         add_to_array(current, new_obj);
       }
 
-      current = get_array_item(current, index);
+      JsonArrayItem *item = json_array_first(current);
+      for (long n = 0; n < index; n++) {
+        item = item->next;
+      }
+      current = json_unshare(&item->value);
+      if (!current) {
+        fprintf(stderr, "Error: Memory allocation failed for key '%s'.\n",
+                parts[i]);
+        json_free(key_copy);
+        return 0;
+      }
     } else {
       // Cannot traverse further
       fprintf(stderr,
               "Error: Cannot set key part '%s' on a non-object/non-array.\n",
               parts[i]);
-      free(key_copy);
+      json_free(key_copy);
       return 0;
     }
   }
@@ -831,14 +1535,14 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
     } else { // Treat as string
       new_value = create_json_value(JSON_STRING);
       if (new_value)
-        new_value->value.string = strdup(value_str);
+        new_value->value.string = json_strdup(value_str);
     }
   }
 
   if (!new_value) {
     fprintf(stderr, "Error: Failed to create JSON value for '%s'.\n",
             value_str);
-    free(key_copy);
+    json_free(key_copy);
     return 0;
   }
 
@@ -853,7 +1557,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
     long index = strtol(last_key, &endptr, 10);
     if (*endptr != '\0' || index < 0) {
       fprintf(stderr, "Error: Invalid array index '%s'.\n", last_key);
-      free(key_copy);
+      json_free(key_copy);
       free_json_value(new_value);
       return 0;
     }
@@ -863,7 +1567,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
       JsonValue *null_value = create_json_value(JSON_NULL);
       if (!null_value) {
         fprintf(stderr, "Error: Failed to create new array item.\n");
-        free(key_copy);
+        json_free(key_copy);
         free_json_value(new_value);
         return 0;
       }
@@ -871,7 +1575,7 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
     }
 
     // Replace the item at the index
-    JsonArrayItem *item = current->value.array_head;
+    JsonArrayItem *item = json_array_first(current);
     int i = 0;
 
     while (item && i < index) {
@@ -894,205 +1598,384 @@ int set_nested_item(JsonValue *object, const char *key, const char *value_str) {
     success = 0;
   }
 
-  free(key_copy);
+  json_free(key_copy);
   return success;
 }
 
+// Where print_json_value writes: stdout, or a growing buffer when a range
+// of a large document is printed on its own thread
+typedef struct {
+  FILE *file;
+  char *buffer;
+  size_t len;
+  size_t cap;
+  int failed;
+} JsonPrinter;
+
+static void print_bytes(JsonPrinter *out, const char *s, size_t n) {
+  if (out->file) {
+    fwrite(s, 1, n, out->file);
+    return;
+  }
+  if (out->failed) {
+    return;
+  }
+  if (n > out->cap - out->len) {
+    size_t cap = out->cap ? out->cap : 4096;
+    while (cap < out->len + n) {
+      cap *= 2;
+    }
+    char *nb = (char *)json_realloc(out->buffer, cap);
+    if (!nb) {
+      out->failed = 1;
+      return;
+    }
+    out->buffer = nb;
+    out->cap = cap;
+  }
+  memcpy(out->buffer + out->len, s, n);
+  out->len += n;
+}
+
+static void print_str(JsonPrinter *out, const char *s) {
+  print_bytes(out, s, strlen(s));
+}
+
 // Forward declaration for recursive printing
-static void print_json_value(JsonValue *item, int indent);
+static void print_json_value(JsonPrinter *out, JsonValue *item, int indent);
 
 /**
  * Prints indentation
  */
-static void print_indent(int indent) {
+static void print_indent(JsonPrinter *out, int indent) {
   for (int i = 0; i < indent; i++) {
-    printf("  ");
+    print_bytes(out, "  ", 2);
   }
 }
 
 // Helper: print a JSON-escaped string (without surrounding quotes)
-static void print_escaped_string(const char *s) {
+static void print_escaped_string(JsonPrinter *out, const char *s) {
   if (!s)
     return;
-  for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+  const char *run = s;
+  for (const char *p = s; *p; ++p) {
+    const char *esc;
     switch (*p) {
     case '"':
-      putchar('\\');
-      putchar('"');
+      esc = "\\\"";
       break;
     case '\\':
-      putchar('\\');
-      putchar('\\');
+      esc = "\\\\";
       break;
     case '\b':
-      putchar('\\');
-      putchar('b');
+      esc = "\\b";
       break;
     case '\f':
-      putchar('\\');
-      putchar('f');
+      esc = "\\f";
       break;
     case '\n':
-      putchar('\\');
-      putchar('n');
+      esc = "\\n";
       break;
     case '\r':
-      putchar('\\');
-      putchar('r');
+      esc = "\\r";
       break;
     case '\t':
-      putchar('\\');
-      putchar('t');
+      esc = "\\t";
       break;
     default:
-      putchar(*p);
-      break;
+      continue;
     }
+    print_bytes(out, run, (size_t)(p - run));
+    print_bytes(out, esc, 2);
+    run = p + 1;
+  }
+  print_str(out, run);
+}
+
+// Prints one member of an object being printed at indent
+static void print_member(JsonPrinter *out, const JsonKeyValue *kv, int first,
+                         int indent) {
+  if (!first) {
+    print_bytes(out, ",\n", 2);
+  }
+  print_indent(out, indent + 1);
+  print_bytes(out, "\"", 1);
+  if (kv->key) {
+    print_escaped_string(out, kv->key);
+  }
+  print_bytes(out, "\": ", 3);
+  print_json_value(out, kv->value, indent + 1);
+}
+
+// Prints one element of an array being printed at indent
+static void print_element(JsonPrinter *out, JsonValue *element, int first,
+                          int indent) {
+  if (!first) {
+    print_bytes(out, ",\n", 2);
+  }
+  print_indent(out, indent + 1);
+  print_json_value(out, element, indent + 1);
+}
+
+// Members of an object in print order (sorted by key), or NULL if it has
+// none or on allocation failure (reported)
+static JsonKeyValue **sorted_members(const JsonValue *object, size_t *count) {
+  size_t n = 0;
+  for (JsonKeyValue *kv = json_object_first(object); kv; kv = kv->next) {
+    n++;
   }
+  *count = n;
+  if (n == 0) {
+    return NULL;
+  }
+
+  JsonKeyValue **kvs = (JsonKeyValue **)json_malloc(n * sizeof(JsonKeyValue *));
+  if (!kvs) {
+    fprintf(stderr, "Error: Memory allocation failed for sorting JSON keys.\n");
+    return NULL;
+  }
+  n = 0;
+  for (JsonKeyValue *kv = json_object_first(object); kv; kv = kv->next) {
+    kvs[n++] = kv;
+  }
+
+  // Sort the array alphabetically by key (sorted objects already are)
+  if (!(JSON_FLAG_SORTED & object->flags)) {
+    qsort(kvs, n, sizeof(JsonKeyValue *), compare_json_keys);
+  }
+  return kvs;
 }
 
 /**
  * Recursively prints a JSON value with proper indentation
  */
-static void print_json_value(JsonValue *item, int indent) {
+static void print_json_value(JsonPrinter *out, JsonValue *item, int indent) {
   if (!item) {
-    printf("null");
+    print_bytes(out, "null", 4);
     return;
   }
 
   switch (item->type) {
   case JSON_NULL:
-    printf("null");
+    print_bytes(out, "null", 4);
     break;
   case JSON_BOOL:
-    printf("%s", item->value.boolean ? "true" : "false");
+    print_str(out, item->value.boolean ? "true" : "false");
     break;
-  case JSON_NUMBER:
-    // Check if it's an integer
-    if (item->value.number == (int64_t)item->value.number) {
-      printf("%" PRId64, (int64_t)item->value.number);
+  case JSON_NUMBER: {
+    const char *lexeme;
+    size_t lexeme_len = json_number_lexeme(item, &lexeme);
+    char number[32];
+    if (lexeme_len) {
+      print_bytes(out, lexeme, lexeme_len);
+      break;
+    } else if (item->value.number == (int64_t)item->value.number) {
+      snprintf(number, sizeof(number), "%" PRId64,
+               (int64_t)item->value.number);
     } else {
-      printf("%g", item->value.number);
+      snprintf(number, sizeof(number), "%g", item->value.number);
     }
+    print_str(out, number);
     break;
+  }
   case JSON_STRING:
-    if (item->value.string) {
-      putchar('"');
-      print_escaped_string(item->value.string);
-      putchar('"');
-    } else {
-      printf("\"\"");
-    }
+    print_bytes(out, "\"", 1);
+    print_escaped_string(out, item->value.string);
+    print_bytes(out, "\"", 1);
     break;
   case JSON_OBJECT: {
-    if (!item->value.object_head) {
-      printf("{}");
+    if (!json_object_first(item)) {
+      print_bytes(out, "{}", 2);
       break;
     }
 
-    // Count the number of key-value pairs
-    int count = 0;
-    JsonKeyValue *kv = item->value.object_head;
-    while (kv) {
-      count++;
-      kv = kv->next;
-    }
-
-    // Create an array of pointers to key-value pairs
-    JsonKeyValue **kvs =
-        (JsonKeyValue **)malloc(count * sizeof(JsonKeyValue *));
+    size_t count;
+    JsonKeyValue **kvs = sorted_members(item, &count);
     if (!kvs) {
-      fprintf(stderr,
-              "Error: Memory allocation failed for sorting JSON keys.\n");
-      printf("{...}"); // Fallback
+      print_bytes(out, "{...}", 5); // Fallback
       return;
     }
 
-    // Fill the array
-    kv = item->value.object_head;
-    for (int i = 0; i < count; i++) {
-      kvs[i] = kv;
-      kv = kv->next;
+    // Print the sorted key-value pairs
+    print_bytes(out, "{\n", 2);
+    for (size_t i = 0; i < count; i++) {
+      print_member(out, kvs[i], i == 0, indent);
     }
+    json_free(kvs);
 
-    // Sort the array alphabetically by key
-    qsort(kvs, count, sizeof(JsonKeyValue *), compare_json_keys);
+    print_bytes(out, "\n", 1);
+    print_indent(out, indent);
+    print_bytes(out, "}", 1);
+    break;
+  }
+  case JSON_ARRAY: {
+    // Packed arrays are read in place rather than linked
+    size_t count = 0;
+    JsonValue *packed = json_array_packed(item, &count);
+    JsonArrayItem *item_ptr = packed ? NULL : json_array_first(item);
+    if (!packed && !item_ptr) {
+      print_bytes(out, "[]", 2);
+      break;
+    }
 
-    // Print the sorted key-value pairs
-    printf("{\n");
+    print_bytes(out, "[\n", 2);
+    size_t index = 0;
     int first = 1;
 
-    for (int i = 0; i < count; i++) {
-      if (!first) {
-        printf(",\n");
-      }
-
-      print_indent(indent + 1);
-      putchar('"');
-      if (kvs[i]->key) {
-        print_escaped_string(kvs[i]->key);
-      }
-      putchar('"');
-      printf(": ");
-
-      if (kvs[i]->value) {
-        print_json_value(kvs[i]->value, indent + 1);
-      } else {
-        printf("null");
-      }
-
+    while (item_ptr || index < count) {
+      JsonValue *element = item_ptr ? item_ptr->value : &packed[index++];
+      print_element(out, element, first, indent);
       first = 0;
+      item_ptr = item_ptr ? item_ptr->next : NULL;
     }
 
-    // Free the array
-    free(kvs);
-
-    printf("\n");
-    print_indent(indent);
-    printf("}");
+    print_bytes(out, "\n", 1);
+    print_indent(out, indent);
+    print_bytes(out, "]", 1);
     break;
   }
-  case JSON_ARRAY: {
-    if (!item->value.array_head) {
-      printf("[]");
-      break;
-    }
+  default:
+    print_str(out, "(unknown type)");
+    break;
+  }
+}
 
-    printf("[\n");
-    JsonArrayItem *item_ptr = item->value.array_head;
-    int first = 1;
+// A contiguous range of top-level entries printed into its own buffer
+typedef struct {
+  JsonKeyValue **members; // object entries, or NULL
+  JsonValue **elements;   // array entries, or NULL
+  size_t begin;
+  size_t end;
+  JsonPrinter out;
+} PrintPart;
+
+#ifdef JCT_WITH_THREADS
+static void *print_part(void *arg) {
+  PrintPart *part = (PrintPart *)arg;
+  for (size_t i = part->begin; i < part->end; i++) {
+    if (part->members) {
+      print_member(&part->out, part->members[i], i == 0, 0);
+    } else {
+      print_element(&part->out, part->elements[i], i == 0, 0);
+    }
+  }
+  return NULL;
+}
+#endif
 
-    while (item_ptr) {
-      if (!first) {
-        printf(",\n");
-      }
+/**
+ * Prints a large top-level container with json_serialize_threads() threads
+ *
+ * As with json_to_string, each thread prints a contiguous range of entries
+ * into its own buffer and the buffers are written in order, so the output
+ * is the same as print_json_value's.
+ *
+ * @return 1 if item was printed, 0 to print it on this thread (not worth
+ *         splitting, or out of memory before anything was written)
+ */
+static int print_parallel(JsonValue *item) {
+#ifdef JCT_WITH_THREADS
+  unsigned threads = json_serialize_threads();
+  if (threads < 2 || (item->type != JSON_ARRAY && item->type != JSON_OBJECT)) {
+    return 0;
+  }
 
-      print_indent(indent + 1);
+  size_t count = 0;
+  JsonValue *packed = json_array_packed(item, &count); // counts it
+  if (!packed && item->type == JSON_ARRAY) {
+    for (JsonArrayItem *it = json_array_first(item); it; it = it->next) {
+      count++;
+    }
+  } else if (!packed) {
+    for (JsonKeyValue *kv = json_object_first(item); kv; kv = kv->next) {
+      count++;
+    }
+  }
+  if (count < JCT_PARALLEL_MIN_ENTRIES) {
+    return 0;
+  }
 
-      if (item_ptr->value) {
-        print_json_value(item_ptr->value, indent + 1);
-      } else {
-        printf("null");
+  void **entries;
+  if (item->type == JSON_OBJECT) {
+    entries = (void **)sorted_members(item, &count);
+  } else {
+    entries = (void **)json_malloc(count * sizeof(void *));
+    size_t n = 0;
+    if (entries && packed) {
+      for (; n < count; n++) {
+        entries[n] = &packed[n];
       }
+    } else if (entries) {
+      for (JsonArrayItem *it = json_array_first(item); it; it = it->next) {
+        entries[n++] = it->value;
+      }
+    }
+  }
+  if (!entries) {
+    return 0;
+  }
 
-      first = 0;
-      item_ptr = item_ptr->next;
+  size_t nparts = threads < count ? threads : count;
+  PrintPart *parts = (PrintPart *)json_calloc(nparts, sizeof(PrintPart));
+  pthread_t *tids = (pthread_t *)json_malloc(nparts * sizeof(pthread_t));
+  int *started = (int *)json_calloc(nparts, sizeof(int));
+  int ok = parts && tids && started;
+  for (size_t i = 0; ok && i < nparts; i++) {
+    if (item->type == JSON_OBJECT) {
+      parts[i].members = (JsonKeyValue **)entries;
+    } else {
+      parts[i].elements = (JsonValue **)entries;
     }
+    parts[i].begin = count * i / nparts;
+    parts[i].end = count * (i + 1) / nparts;
+  }
 
-    printf("\n");
-    print_indent(indent);
-    printf("]");
-    break;
+  // Parts whose thread cannot be started run on this thread
+  for (size_t i = 1; ok && i < nparts; i++) {
+    started[i] = pthread_create(&tids[i], NULL, print_part, &parts[i]) == 0;
   }
-  default:
-    printf("(unknown type)");
-    break;
+  if (ok) {
+    print_part(&parts[0]);
   }
+  for (size_t i = 1; ok && i < nparts; i++) {
+    if (started[i]) {
+      pthread_join(tids[i], NULL);
+    } else {
+      print_part(&parts[i]);
+    }
+  }
+  for (size_t i = 0; ok && i < nparts; i++) {
+    ok = !parts[i].out.failed;
+  }
+
+  if (ok) {
+    fputs(item->type == JSON_OBJECT ? "{\n" : "[\n", stdout);
+    for (size_t i = 0; i < nparts; i++) {
+      fwrite(parts[i].out.buffer, 1, parts[i].out.len, stdout);
+    }
+    fputs(item->type == JSON_OBJECT ? "\n}" : "\n]", stdout);
+  }
+  for (size_t i = 0; parts && i < nparts; i++) {
+    json_free(parts[i].out.buffer);
+  }
+  json_free(parts);
+  json_free(tids);
+  json_free(started);
+  json_free(entries);
+  return ok;
+#else
+  (void)item;
+  return 0;
+#endif
 }
 
 /**
  * Prints a JSON item appropriately
  *
+ * Objects and arrays are pretty-printed with sorted keys; large top-level
+ * ones are split across threads as json_to_string does (see
+ * json_set_serialize_threads).
+ *
  * @param item The JSON object to print
  */
 void print_item(JsonValue *item) {
@@ -1103,8 +1986,11 @@ void print_item(JsonValue *item) {
 
   // Special case for printing a single number value
   if (item->type == JSON_NUMBER) {
-    // Check if it's an integer
-    if (item->value.number == (int64_t)item->value.number) {
+    const char *lexeme;
+    size_t lexeme_len = json_number_lexeme(item, &lexeme);
+    if (lexeme_len) {
+      printf("%.*s\n", (int)lexeme_len, lexeme);
+    } else if (item->value.number == (int64_t)item->value.number) {
       int64_t int_value = (int64_t)item->value.number;
       printf("%" PRId64 "\n", int_value);
     } else {
@@ -1129,6 +2015,9 @@ void print_item(JsonValue *item) {
     return;
   }
 
-  print_json_value(item, 0);
+  if (!print_parallel(item)) {
+    JsonPrinter out = {stdout, NULL, 0, 0, 0};
+    print_json_value(&out, item, 0);
+  }
   printf("\n");
 }
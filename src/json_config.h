@@ -6,6 +6,8 @@
 #define JSON_CONFIG_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,15 +39,53 @@ typedef struct JsonArrayItem {
   struct JsonArrayItem *next;
 } JsonArrayItem;
 
+// Bits for JsonValue.flags
+// Object members are sorted by key and stored in one block (see
+// sort_json_keys); the linked list order matches the sorted order.
+#define JSON_FLAG_SORTED 0x1u
+// Number kept as its source lexeme by a lazy parse: value.string points at
+// the lexeme (read it with json_number_value)
+#define JSON_FLAG_RAW_NUMBER 0x2u
+// value.string points into the document source and is not freed with it
+#define JSON_FLAG_BORROWED 0x4u
+// Root of a lazily parsed document; it owns the source (a file mapping or
+// buffer taken over, or a copy in its allocation) and releases it when freed
+#define JSON_FLAG_OWNS_SOURCE 0x8u
+// Container not expanded yet (lazy containers): value.lazy locates its
+// bytes in the source. Walk it with json_object_first / json_array_first,
+// which expand it on first use. With JSON_FLAG_SORTED it is sorted then.
+#define JSON_FLAG_LAZY 0x10u
+// Array whose elements are all numbers, stored in one block: value.packed
+// holds them as consecutive values (read them with json_array_packed)
+// until json_array_first links them for walking
+#define JSON_FLAG_PACKED 0x20u
+// Element inside a packed array's block, freed with the array
+#define JSON_FLAG_INLINE 0x40u
+// Lazy container whose arrays of numbers are packed when it is expanded
+#define JSON_FLAG_PACK_ARRAYS 0x80u
+// The bits from JSON_REF_SHIFT up count the extra references to a value
+// shared by hash-consing (see json_dedup.c); free_json_value drops one of
+// them while any are left
+#define JSON_REF_SHIFT 8
+#define JSON_REF_ONE (1u << JSON_REF_SHIFT)
+
+// Source range of an unexpanded container (see json_set_lazy_containers)
+typedef struct JsonSpan JsonSpan;
+// Block of a packed array (see JSON_FLAG_PACKED)
+typedef struct JsonPackedArray JsonPackedArray;
+
 // Structure for JSON values
 struct JsonValue {
   JsonType type;
+  unsigned int flags; // JSON_FLAG_* bits
   union {
     int boolean;
     double number;
     char *string;
     JsonArrayItem *array_head;
     JsonKeyValue *object_head;
+    const JsonSpan *lazy;
+    JsonPackedArray *packed;
   } value;
 };
 
@@ -54,17 +94,193 @@ JsonValue *create_json_value(JsonType type);
 void free_json_value(JsonValue *value);
 int add_to_object(JsonValue *object, const char *key, JsonValue *value);
 int add_to_array(JsonValue *array, JsonValue *value);
+// Bulk building, for code that makes large documents: room for count more
+// elements or members, an add that takes ownership of a json_malloc'd key
+// without looking for it (freeing it on failure), and the pass that
+// resolves keys added more than once that way as add_to_object would.
+// Each returns 1 on success, 0 on failure.
+int json_reserve(JsonValue *container, size_t count);
+int json_object_add_owned(JsonValue *object, char *key, JsonValue *value);
+int json_object_unique_keys(JsonValue *object);
 JsonValue *get_array_item(JsonValue *array, int index);
 int get_array_size(JsonValue *array);
 JsonValue *get_object_item(JsonValue *object, const char *key);
+// Same as get_object_item for a key of len bytes that need not be
+// NUL-terminated
+JsonValue *get_object_item_n(const JsonValue *object, const char *key,
+                             size_t len);
+// First member of an object / element of an array (NULL if empty),
+// expanding a lazy container first
+JsonKeyValue *json_object_first(const JsonValue *object);
+JsonArrayItem *json_array_first(const JsonValue *array);
+// Elements of a packed array as *count consecutive values, or NULL if the
+// array is not packed or has been linked by json_array_first; lets code
+// walk arrays of numbers without linking them
+JsonValue *json_array_packed(const JsonValue *array, size_t *count);
+// Convert all objects in a tree to the sorted-key layout: lookups become
+// binary searches and sorted output needs no extra sorting. Objects stay
+// sorted when members are added later. Returns 1 on success, 0 on failure.
+int sort_json_keys(JsonValue *value);
+
+// Numeric value of a JSON_NUMBER, decoding a raw lexeme if needed
+double json_number_value(const JsonValue *value);
+// Replace the value of a JSON_NUMBER (drops its raw lexeme)
+void json_set_number(JsonValue *value, double number);
+// Source lexeme of a raw number: returns its length (0 if not raw)
+size_t json_number_lexeme(const JsonValue *value, const char **lexeme);
+
+// Structural hash: equal values hash equally (member order is ignored)
+uint64_t hash_json_value(const JsonValue *value);
+// FNV-1a over a byte string, continuing from h
+uint64_t json_hash_bytes(const char *data, size_t len, uint64_t h);
+
+// Hash-consing (see json_dedup.c): values below the root equal to an
+// earlier one become references to it. Returns 1 on success, 0 on
+// allocation failure (the tree is still valid). Before modifying a value
+// in place, make each slot on the way to it private with json_unshare.
+int json_dedup(JsonValue *value);
+int json_is_shared(const JsonValue *value);
+JsonValue *json_unshare(JsonValue **slot);
+
+// Memory budget (see json_alloc.c): the library allocates through these,
+// and with a limit set, allocations past it fail (return NULL) and
+// json_memory_exhausted() reports it. 1 on success, 0 if unsupported.
+int json_set_memory_limit(size_t bytes);
+size_t json_memory_limit(void);
+size_t json_memory_used(void);
+size_t json_memory_peak(void);
+int json_memory_exhausted(void);
+void *json_malloc(size_t size);
+void *json_calloc(size_t count, size_t size);
+void *json_realloc(void *ptr, size_t size);
+char *json_strdup(const char *str);
+void json_free(void *ptr);
+
+// Default size limit (bytes) for parsing and serializing; 0 disables it.
+// Override at build time with -DJCT_DEFAULT_SIZE_LIMIT=<bytes>.
+#ifndef JCT_DEFAULT_SIZE_LIMIT
+#define JCT_DEFAULT_SIZE_LIMIT ((size_t)100 * 1024 * 1024)
+#endif
+
+// Options of one parse (see parse_json_file_ex); each is off when zero,
+// as the matching json_set_* function describes
+typedef struct {
+  int sorted_keys;
+  int lazy_scalars;
+  int lazy_containers;
+  int dedup;
+  int packed_arrays;
+  const char *select; // comma-separated patterns, or NULL
+} JsonParseOptions;
 
 // JSON parsing functions
 JsonValue *parse_json_file(const char *filepath);
+// Parse a file with its own options rather than the json_set_* defaults;
+// safe to call from several threads with different options
+JsonValue *parse_json_file_ex(const char *filepath,
+                              const JsonParseOptions *options);
+// Parse a file building only the values matching comma-separated patterns
+// (see json_set_select)
+JsonValue *parse_json_file_select(const char *filepath, const char *patterns);
 // Parse from a JSON string buffer
 JsonValue *parse_json_string(const char *json_str);
+// Parse from the first len bytes of a buffer (need not be NUL-terminated)
+JsonValue *parse_json_string_n(const char *json_str, size_t len);
+// Parse the contents of filepath, already read by the caller, as
+// parse_json_file would
+JsonValue *parse_json_file_contents(const char *filepath, const char *data,
+                                    size_t len);
+// Limit the size of accepted input (0 means unlimited)
+void json_set_max_input_size(size_t bytes);
+size_t json_max_input_size(void);
+// The json_set_* functions below set the defaults used by the parse
+// functions that take no options. They are process-wide: set them once
+// at startup, and use parse_json_file_ex where threads parse differently.
+// Store parsed objects in the sorted-key layout (off by default)
+void json_set_sorted_keys(int enabled);
+// Keep number lexemes and unescaped strings in a copy of the input until
+// read (off by default); untouched numbers serialize verbatim
+void json_set_lazy_scalars(int enabled);
+// Also leave objects and arrays as source ranges until first accessed (off
+// by default; implies lazy scalars)
+void json_set_lazy_containers(int enabled);
+// Share identical subtrees and repeated scalars of parsed documents, as
+// json_dedup does (off by default)
+void json_set_dedup(int enabled);
+// Store arrays of numbers as packed arrays, without value.array_head (off
+// by default)
+void json_set_packed_arrays(int enabled);
+// Build only the values matching comma-separated dotted patterns (a.b, a.*,
+// ..name) and the containers leading to them, skipping the rest of the
+// input unchecked; NULL builds everything. Returns 0 if a pattern is
+// malformed.
+int json_set_select(const char *patterns);
+// Expand a lazy container in place; 1 on success (or if not lazy), 0 if
+// its source is not valid JSON
+int json_expand(const JsonValue *value);
+
+// Pull tokenizer for walking a document without building a tree
+typedef enum {
+  JSON_TOKEN_ERROR,
+  JSON_TOKEN_END, // end of the document
+  JSON_TOKEN_OBJECT_START,
+  JSON_TOKEN_OBJECT_END,
+  JSON_TOKEN_ARRAY_START,
+  JSON_TOKEN_ARRAY_END,
+  JSON_TOKEN_KEY, // object member name (the ':' is consumed with it)
+  JSON_TOKEN_STRING,
+  JSON_TOKEN_NUMBER,
+  JSON_TOKEN_TRUE,
+  JSON_TOKEN_FALSE,
+  JSON_TOKEN_NULL
+} JsonTokenType;
+
+typedef struct {
+  JsonTokenType type;
+  const char *start; // raw lexeme in the input; strings include the quotes
+  size_t length;
+  int escaped; // string or key contains backslash escapes
+} JsonToken;
+
+typedef struct JsonTokenizer JsonTokenizer;
+
+// Tokenize a caller-owned buffer, which must outlive the tokenizer
+JsonTokenizer *json_tokenizer_create(const char *buf, size_t len);
+// Tokenize a file (mapped, or inflated if compressed); NULL on I/O errors
+JsonTokenizer *json_tokenizer_open_file(const char *filepath);
+// Same for the contents of filepath that the caller has read into data
+// (from json_malloc), which the tokenizer takes over, also on failure
+JsonTokenizer *json_tokenizer_open_contents(const char *filepath, char *data,
+                                            size_t len);
+void json_tokenizer_free(JsonTokenizer *tok);
+// Start again from the first token
+void json_tokenizer_rewind(JsonTokenizer *tok);
+// Read the next token; returns 0 (type JSON_TOKEN_ERROR) on malformed input
+int json_tokenizer_next(JsonTokenizer *tok, JsonToken *token);
+// Build the value that starts with token (the last one read), consuming
+// the rest of it if it is an object or array
+JsonValue *json_tokenizer_read_value(JsonTokenizer *tok,
+                                     const JsonToken *token);
+// Skip the value that starts with token and report its raw bytes
+int json_tokenizer_skip_value(JsonTokenizer *tok, const JsonToken *token,
+                              const char **start, size_t *length);
+// Unescaped copy of a string or key token (caller frees)
+char *json_token_string(const JsonToken *token);
 
 // JSON serialization functions
 char *json_to_string(JsonValue *json, int pretty);
+// Limit the size of strings produced by json_to_string (0 means unlimited)
+void json_set_max_output_size(size_t bytes);
+// Let json_to_string and print_item split large top-level containers
+// across threads (1 by default, at most 1024)
+void json_set_serialize_threads(unsigned threads);
+unsigned json_serialize_threads(void);
+// Fewest top-level entries worth splitting across threads
+#ifndef JCT_PARALLEL_MIN_ENTRIES
+#define JCT_PARALLEL_MIN_ENTRIES 4096
+#endif
+// Escape a string for a JSON string literal, without quotes (caller frees)
+char *json_escape_string(const char *str);
 
 // Deep clone a JSON value (recursively)
 JsonValue *clone_json_value(const JsonValue *value);
@@ -75,9 +291,102 @@ int save_config(const char *filepath, JsonValue *json);
 JsonValue *get_nested_item(JsonValue *object, const char *key);
 int set_nested_item(JsonValue *object, const char *key, const char *value_str);
 int merge_json_into(JsonValue **dest_ptr, const JsonValue *src);
+// merge_json_into from a token stream, building only the source values
+// that replace destination values; 0 if the source is malformed
+int merge_json_stream(JsonValue **dest_ptr, JsonTokenizer *src);
 JsonValue *diff_json(const JsonValue *modified, const JsonValue *original);
+// diff_json over two token streams; NULL if not both objects or malformed
+JsonValue *diff_json_stream(JsonTokenizer *modified, JsonTokenizer *original);
 void print_item(JsonValue *item);
 
+// Journaled 'set': changes are appended to <file>.journal, replayed by
+// load_config and merged into the file by save_config (see json_journal.c)
+int json_journal_set(const char *filepath, JsonValue *config, const char *key,
+                     const char *value_str);
+int json_journal_replay(const char *filepath, JsonValue *config);
+int json_journal_compact(const char *filepath);
+int json_journal_discard(const char *filepath);
+
+// Batched file access: the I/O for a set of files is issued at once, as one
+// io_uring submission (JCT_WITH_IO_URING) or on a thread pool, to hide
+// storage latency (see json_batch.c)
+typedef struct {
+  const char *path;
+  JsonTokenizer *tok; // set as by json_tokenizer_open_file
+} JsonBatchStream;
+typedef struct {
+  int error;     // 0, or the errno of the failed stat
+  unsigned mode; // st_mode, following symlinks
+  uint64_t size;
+} JsonFileStat;
+void json_tokenizer_open_batch(JsonBatchStream *files, size_t count);
+void json_stat_batch(const char *const *paths, JsonFileStat *stats,
+                     size_t count);
+
+// Columnar view of an array of same-shaped objects: one contiguous typed
+// column per member (see json_columns.c)
+typedef enum {
+  JSON_COLUMN_NUMBER, // data.numbers
+  JSON_COLUMN_BOOL,   // data.booleans (0 or 1)
+  JSON_COLUMN_STRING, // data.strings, borrowed from the document
+  JSON_COLUMN_MIXED   // data.values: the member values themselves
+} JsonColumnType;
+typedef struct {
+  const char *name;
+  JsonColumnType type;
+  union {
+    const double *numbers;
+    const unsigned char *booleans;
+    const char **strings;
+    const JsonValue **values;
+  } data;
+} JsonColumn;
+typedef struct {
+  size_t rows;                // array elements
+  size_t count;               // columns
+  JsonColumn *columns;
+  const JsonValue **elements; // the element objects, in order
+} JsonColumns;
+JsonColumns *json_columns_build(const JsonValue *array,
+                                const char *const *fields,
+                                size_t field_count);
+const JsonColumn *json_columns_find(const JsonColumns *columns,
+                                    const char *name);
+void json_columns_free(JsonColumns *columns);
+
+// Streaming transform (see json_transform.c): copies a token stream to an
+// output, dropping, keeping, redacting and renaming members by path pattern
+typedef enum {
+  JSON_TRANSFORM_KEEP,
+  JSON_TRANSFORM_DROP,
+  JSON_TRANSFORM_REDACT,
+  JSON_TRANSFORM_RENAME, // pattern=new_name
+  JSON_TRANSFORM_STAGES
+} JsonTransformStage;
+typedef struct JsonTransform JsonTransform;
+JsonTransform *json_transform_create(void);
+int json_transform_add(JsonTransform *transform, JsonTransformStage stage,
+                       const char *patterns);
+int json_transform_stream(const JsonTransform *transform, JsonTokenizer *in,
+                          FILE *out);
+void json_transform_free(JsonTransform *transform);
+
+// Baseline index: per-member digests of an immutable original, so diffs
+// against it do not need to parse it (see json_baseline.c)
+typedef struct JsonBaseline JsonBaseline;
+int json_baseline_build(const char *source_path, const char *index_path);
+// <source_path>.jctidx or a cached index (built on demand with build_cache)
+JsonBaseline *json_baseline_open(const char *source_path, int build_cache);
+void json_baseline_free(JsonBaseline *baseline);
+// diff_json of a token stream against the indexed original; NULL if it
+// cannot be streamed (see diff_json_stream)
+JsonValue *diff_json_stream_baseline(JsonTokenizer *modified,
+                                     JsonBaseline *baseline);
+
+// Print a C header with structs, a parser and a serializer for documents
+// shaped like a sample or JSON Schema file (see json_codegen.c)
+int json_codegen(const char *source_path, const char *name, FILE *out);
+
 #ifdef __cplusplus
 }
 #endif
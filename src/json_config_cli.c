@@ -6,11 +6,17 @@
 #include "jsonpath.h"
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <glob.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/mount.h>
+#include <sys/statvfs.h>
+#endif
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
@@ -25,27 +31,16 @@ static int has_path_separator(const char *s) {
   return 0;
 }
 
-static int ends_with_json_ext(const char *s) {
+static int ends_with(const char *s, const char *suffix) {
   size_t n = strlen(s);
-  return (n >= 5 && strcmp(s + (n - 5), ".json") == 0);
-}
-
-static int is_regular_file_following_symlink(const char *path) {
-  struct stat st;
-  if (stat(path, &st) != 0)
-    return 0;
-  return S_ISREG(st.st_mode);
-}
-
-static int is_directory_following_symlink(const char *path) {
-  struct stat st;
-  if (stat(path, &st) != 0)
-    return 0;
-  return S_ISDIR(st.st_mode);
+  size_t m = strlen(suffix);
+  return (n >= m && strcmp(s + (n - m), suffix) == 0);
 }
 
-static int path_exists(const char *path) {
-  return access(path, F_OK) == 0;
+// Compressed configs (.json.gz, .json.zst) are explicit paths too
+static int ends_with_json_ext(const char *s) {
+  return ends_with(s, ".json") || ends_with(s, ".json.gz") ||
+         ends_with(s, ".json.zst");
 }
 
 static int path_readable(const char *path) {
@@ -91,21 +86,25 @@ static int resolve_config_target(const char *target, int trace, char *out_path,
   if (have_cand3)
     candidates[cand_count++] = cand3;
 
+  // Stat all candidates together; they are still evaluated in order
+  JsonFileStat stats[3];
+  json_stat_batch(candidates, stats, (size_t)cand_count);
+
   for (int i = 0; i < cand_count; ++i) {
     const char *c = candidates[i];
     if (trace)
       fprintf(stderr, "[trace] checking %s... ", c);
-    if (!path_exists(c)) {
+    if (stats[i].error) {
       if (trace)
         fprintf(stderr, "not found\n");
       continue;
     }
-    if (is_directory_following_symlink(c)) {
+    if (S_ISDIR(stats[i].mode)) {
       if (trace)
         fprintf(stderr, "is a directory, skip\n");
       continue;
     }
-    if (!is_regular_file_following_symlink(c)) {
+    if (!S_ISREG(stats[i].mode)) {
       if (trace)
         fprintf(stderr, "not a regular file, skip\n");
       continue;
@@ -140,7 +139,70 @@ static int resolve_config_target(const char *target, int trace, char *out_path,
   return 2;
 }
 
+// Parses a byte count with an optional K/M/G suffix (e.g. "512K", "2G").
+// Returns 1 on success, 0 if the string is not a valid size.
+static int parse_size_arg(const char *s, size_t *out) {
+  char *end;
+  errno = 0;
+  unsigned long long v = strtoull(s, &end, 10);
+  if (errno != 0 || end == s || *s == '-') {
+    return 0;
+  }
+  unsigned long long mult = 1;
+  switch (*end) {
+  case '\0':
+    break;
+  case 'k':
+  case 'K':
+    mult = 1024ULL;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    mult = 1024ULL * 1024;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    mult = 1024ULL * 1024 * 1024;
+    end++;
+    break;
+  default:
+    return 0;
+  }
+  if (*end != '\0' || (v && mult > ULLONG_MAX / v) ||
+      v * mult > (unsigned long long)SIZE_MAX) {
+    return 0;
+  }
+  *out = (size_t)(v * mult);
+  return 1;
+}
+
 // --- JSONPath (path) command handler ---
+// Appends {"value": *value, "path": path} to out, taking *value (set to
+// NULL once taken). Returns 1 on success, 0 on allocation failure.
+static int add_path_pair(JsonValue *out, JsonValue **value, const char *path) {
+  JsonValue *obj = create_json_value(JSON_OBJECT);
+  JsonValue *sp = create_json_value(JSON_STRING);
+  if (!obj || !sp || !(sp->value.string = json_strdup(path)) ||
+      !add_to_array(out, obj)) {
+    free_json_value(obj);
+    free_json_value(sp);
+    return 0;
+  }
+  // Put 'value' then 'path' so printing order matches expected
+  if (!add_to_object(obj, "value", *value)) {
+    free_json_value(sp);
+    return 0;
+  }
+  *value = NULL;
+  if (!add_to_object(obj, "path", sp)) {
+    free_json_value(sp);
+    return 0;
+  }
+  return 1;
+}
+
 static int handle_path_command(const char *config_file, int argc, char *argv[],
                                int start_index) {
   // Syntax: jct <file> path <expression> [--mode values|paths|pairs] [--limit
@@ -177,6 +239,12 @@ static int handle_path_command(const char *config_file, int argc, char *argv[],
       pretty = 1;
     } else if (strcmp(a, "--unwrap-single") == 0) {
       unwrap_single = 1;
+    } else if ((strcmp(a, "--max-size") == 0 || strcmp(a, "--max-mem") == 0 ||
+                strcmp(a, "--threads") == 0 || strcmp(a, "--select") == 0) &&
+               i + 1 < argc) {
+      i++; // global option, applied by main
+    } else if (strcmp(a, "--dedup") == 0) {
+      // global option, applied by main
     } else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
       printf("Usage: jct <file.json> path <expression> [--mode "
              "values|paths|pairs] [--limit N] [--strict] [--pretty] "
@@ -194,12 +262,17 @@ static int handle_path_command(const char *config_file, int argc, char *argv[],
     return 2;
   }
 
-  JsonValue *doc = parse_json_file(config_file);
+  JsonValue *doc = load_config(config_file);
   if (!doc) {
     return opt.strict ? 3 : 0;
   }
 
   JsonPathResults *res = evaluate_jsonpath(doc, expr, &opt);
+  // A query that ran out of budget may have missed matches
+  if (res && json_memory_exhausted()) {
+    free_jsonpath_results(res);
+    res = NULL;
+  }
   if (!res) {
     free_json_value(doc);
     return opt.strict ? 2 : 0;
@@ -208,9 +281,10 @@ static int handle_path_command(const char *config_file, int argc, char *argv[],
   // Unwrap single for values mode if requested
   if (opt.mode == JSONPATH_MODE_VALUES && unwrap_single && res->count == 1) {
     char *scalar = json_to_string(res->values[0], pretty);
-    if (!scalar)
+    if (!scalar && !json_memory_exhausted())
       scalar = strdup("null");
-    printf("%s\n", scalar);
+    if (scalar)
+      printf("%s\n", scalar);
     free(scalar);
     free_jsonpath_results(res);
     free_json_value(doc);
@@ -224,34 +298,42 @@ static int handle_path_command(const char *config_file, int argc, char *argv[],
     return opt.strict ? 3 : 0;
   }
 
+  // Values move from the results into the output as they are added
+  int built = json_reserve(out_json, (size_t)res->count);
   if (res->mode == JSONPATH_MODE_VALUES) {
-    for (int i = 0; i < res->count; ++i) {
-      add_to_array(out_json, res->values[i]);
-      res->values[i] = NULL;
+    for (int i = 0; built && i < res->count; ++i) {
+      built = add_to_array(out_json, res->values[i]);
+      if (built)
+        res->values[i] = NULL;
     }
   } else if (res->mode == JSONPATH_MODE_PATHS) {
-    for (int i = 0; i < res->count; ++i) {
+    for (int i = 0; built && i < res->count; ++i) {
       JsonValue *s = create_json_value(JSON_STRING);
-      s->value.string = strdup(res->paths[i] ? res->paths[i] : "$");
-      add_to_array(out_json, s);
+      built = s && (s->value.string = json_strdup(
+                        res->paths[i] ? res->paths[i] : "$")) &&
+              add_to_array(out_json, s);
+      if (!built)
+        free_json_value(s);
     }
   } else { // pairs
-    for (int i = 0; i < res->count; ++i) {
-      JsonValue *obj = create_json_value(JSON_OBJECT);
-      // Put 'value' then 'path' so printing order matches expected
-      add_to_object(obj, "value", res->values[i]);
-      res->values[i] = NULL;
-      JsonValue *sp = create_json_value(JSON_STRING);
-      sp->value.string = strdup(res->paths[i] ? res->paths[i] : "$");
-      add_to_object(obj, "path", sp);
-      add_to_array(out_json, obj);
+    for (int i = 0; built && i < res->count; ++i) {
+      built = add_path_pair(out_json, &res->values[i],
+                            res->paths[i] ? res->paths[i] : "$");
     }
   }
+  if (!built) {
+    fprintf(stderr, "Error: Memory allocation failed for path results\n");
+    free_json_value(out_json);
+    free_jsonpath_results(res);
+    free_json_value(doc);
+    return opt.strict ? 3 : 0;
+  }
 
   char *out_str = json_to_string(out_json, pretty);
-  if (!out_str)
+  if (!out_str && !json_memory_exhausted())
     out_str = strdup("[]");
-  printf("%s\n", out_str);
+  if (out_str)
+    printf("%s\n", out_str);
   free(out_str);
   free_json_value(out_json);
   free_jsonpath_results(res);
@@ -259,6 +341,332 @@ static int handle_path_command(const char *config_file, int argc, char *argv[],
   return 0;
 }
 
+// --- Aggregation (agg) command handler ---
+// Aggregations 'agg' can print, in the order they were asked for
+typedef enum {
+  AGG_SUM,
+  AGG_AVG,
+  AGG_MIN,
+  AGG_MAX,
+  AGG_COUNT,
+  AGG_TOPK,
+  AGG_OP_COUNT
+} AggOp;
+
+static const char *const agg_op_names[AGG_OP_COUNT] = {
+    "sum", "avg", "min", "max", "count", "topk"};
+
+// Running fold of the numbers among the matches. top keeps the top_k
+// largest values seen as a min-heap, so most values only meet top[0].
+typedef struct {
+  size_t count;
+  double sum;
+  double min;
+  double max;
+  double *top;
+  size_t top_count;
+  size_t top_cap;
+  size_t top_k;
+  int failed; // top could not grow
+} AggState;
+
+static int agg_keep_top(AggState *agg, double v) {
+  double *heap = agg->top;
+  if (agg->top_count < agg->top_k) {
+    if (agg->top_count == agg->top_cap) {
+      size_t cap = agg->top_cap ? agg->top_cap * 2 : 16;
+      if (cap > agg->top_k)
+        cap = agg->top_k;
+      heap = (double *)json_realloc(agg->top, cap * sizeof(double));
+      if (!heap) {
+        agg->failed = 1;
+        return 0;
+      }
+      agg->top = heap;
+      agg->top_cap = cap;
+    }
+    size_t i = agg->top_count++;
+    while (i > 0 && heap[(i - 1) / 2] > v) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = v;
+  } else if (agg->top_k && v > heap[0]) {
+    size_t i = 0;
+    for (;;) {
+      size_t child = 2 * i + 1;
+      if (child >= agg->top_count)
+        break;
+      if (child + 1 < agg->top_count && heap[child + 1] < heap[child])
+        child++;
+      if (heap[child] >= v)
+        break;
+      heap[i] = heap[child];
+      i = child;
+    }
+    heap[i] = v;
+  }
+  return 1;
+}
+
+static int agg_visit(JsonValue *value, void *data) {
+  AggState *agg = (AggState *)data;
+  if (!value || value->type != JSON_NUMBER) {
+    return 1; // only numbers are folded
+  }
+  double v = json_number_value(value);
+  if (agg->count == 0 || v < agg->min)
+    agg->min = v;
+  if (agg->count == 0 || v > agg->max)
+    agg->max = v;
+  agg->sum += v;
+  agg->count++;
+  return agg_keep_top(agg, v);
+}
+
+static int compare_descending(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x < y) - (x > y);
+}
+
+static JsonValue *agg_number(double d) {
+  JsonValue *v = create_json_value(JSON_NUMBER);
+  if (v)
+    v->value.number = d;
+  return v;
+}
+
+// The value printed for op, or NULL on allocation failure
+static JsonValue *agg_result(AggState *agg, AggOp op) {
+  switch (op) {
+  case AGG_SUM:
+    return agg_number(agg->sum);
+  case AGG_COUNT:
+    return agg_number((double)agg->count);
+  case AGG_AVG:
+  case AGG_MIN:
+  case AGG_MAX:
+    if (!agg->count)
+      return create_json_value(JSON_NULL);
+    return agg_number(op == AGG_AVG   ? agg->sum / (double)agg->count
+                      : op == AGG_MIN ? agg->min
+                                      : agg->max);
+  case AGG_TOPK: {
+    JsonValue *arr = create_json_value(JSON_ARRAY);
+    if (!arr)
+      return NULL;
+    if (agg->top_count)
+      qsort(agg->top, agg->top_count, sizeof(double), compare_descending);
+    for (size_t i = 0; i < agg->top_count; i++) {
+      JsonValue *n = agg_number(agg->top[i]);
+      if (!n || !add_to_array(arr, n)) {
+        free_json_value(n);
+        free_json_value(arr);
+        return NULL;
+      }
+    }
+    return arr;
+  }
+  default:
+    return NULL;
+  }
+}
+
+// Parses --op's list into ops (in order, repeats dropped); topk takes =N
+static int parse_agg_ops(const char *list, AggOp *ops, int *op_count,
+                         size_t *top_k) {
+  *op_count = 0;
+  const char *p = list;
+  while (*p) {
+    size_t len = strcspn(p, ",");
+    size_t name_len = strcspn(p, ",=");
+    int op = 0;
+    while (op < AGG_OP_COUNT && !(strlen(agg_op_names[op]) == name_len &&
+                                  strncmp(p, agg_op_names[op], name_len) == 0))
+      op++;
+    if (op == AGG_OP_COUNT || (name_len < len && op != AGG_TOPK)) {
+      fprintf(stderr, "Error: invalid --op '%.*s'\n", (int)len, p);
+      return 0;
+    }
+    if (op == AGG_TOPK) {
+      *top_k = 10;
+      if (name_len < len) {
+        char *end;
+        unsigned long k = strtoul(p + name_len + 1, &end, 10);
+        if (end != p + len || end == p + name_len + 1 || k == 0) {
+          fprintf(stderr, "Error: invalid --op '%.*s'\n", (int)len, p);
+          return 0;
+        }
+        *top_k = (size_t)k;
+      }
+    }
+    int seen = 0;
+    for (int i = 0; i < *op_count; i++)
+      seen |= ops[i] == (AggOp)op;
+    if (!seen)
+      ops[(*op_count)++] = (AggOp)op;
+    p += len;
+    if (*p == ',')
+      p++;
+  }
+  if (*op_count == 0) {
+    fprintf(stderr, "Error: --op needs at least one aggregation\n");
+    return 0;
+  }
+  return 1;
+}
+
+static int handle_agg_command(const char *config_file, int argc, char *argv[],
+                              int start_index) {
+  // Syntax: jct <file> agg <expression> [--op sum,avg,min,max,count,topk=N]
+  // [--strict] [--pretty]
+  const char *expr = NULL;
+  const char *op_list = "count,sum,avg,min,max";
+  int pretty = 0;
+  JsonPathOptions opt = {.mode = JSONPATH_MODE_VALUES, .limit = 0, .strict = 0};
+  for (int i = start_index; i < argc; ++i) {
+    const char *a = argv[i];
+    if (strcmp(a, "--op") == 0 && i + 1 < argc) {
+      op_list = argv[++i];
+    } else if (strcmp(a, "--strict") == 0) {
+      opt.strict = 1;
+    } else if (strcmp(a, "--pretty") == 0) {
+      pretty = 1;
+    } else if ((strcmp(a, "--max-size") == 0 || strcmp(a, "--max-mem") == 0 ||
+                strcmp(a, "--threads") == 0 || strcmp(a, "--select") == 0) &&
+               i + 1 < argc) {
+      i++; // global option, applied by main
+    } else if (strcmp(a, "--dedup") == 0) {
+      // global option, applied by main
+    } else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
+      printf("Usage: jct <file.json> agg <expression> [--op "
+             "sum,avg,min,max,count,topk=N] [--strict] [--pretty]\n");
+      return 0;
+    } else if (!expr) {
+      expr = a;
+    } else {
+      fprintf(stderr, "Error: unknown argument '%s'\n", a);
+      return 2;
+    }
+  }
+  if (!expr) {
+    fprintf(stderr, "Error: agg requires an expression.\n");
+    return 2;
+  }
+  AggOp ops[AGG_OP_COUNT];
+  int op_count;
+  AggState agg = {0};
+  if (!parse_agg_ops(op_list, ops, &op_count, &agg.top_k)) {
+    return 2;
+  }
+
+  JsonValue *doc = load_config(config_file);
+  if (!doc) {
+    return opt.strict ? 3 : 0;
+  }
+  // Numbers are folded as the matches are found; nothing is copied
+  int visited = visit_jsonpath(doc, expr, &opt, agg_visit, &agg);
+  free_json_value(doc);
+  // A fold that ran out of memory or budget may have missed values
+  if (agg.failed || json_memory_exhausted()) {
+    if (!json_memory_exhausted())
+      fprintf(stderr, "Error: Memory allocation failed for agg results\n");
+    json_free(agg.top);
+    return opt.strict ? 3 : 0;
+  }
+  if (visited < 0 && opt.strict) {
+    json_free(agg.top);
+    return 2;
+  }
+
+  JsonValue *out_json = create_json_value(JSON_OBJECT);
+  int built = out_json != NULL;
+  // Members are prepended, so add the last one first
+  for (int i = op_count - 1; built && i >= 0; i--) {
+    JsonValue *v = agg_result(&agg, ops[i]);
+    built = v && add_to_object(out_json, agg_op_names[ops[i]], v);
+    if (!built)
+      free_json_value(v);
+  }
+  json_free(agg.top);
+  char *out_str = built ? json_to_string(out_json, pretty) : NULL;
+  free_json_value(out_json);
+  if (!out_str) {
+    if (!json_memory_exhausted())
+      fprintf(stderr, "Error: Memory allocation failed for agg results\n");
+    return opt.strict ? 3 : 0;
+  }
+  printf("%s\n", out_str);
+  free(out_str);
+  return 0;
+}
+
+static int handle_transform_command(const char *config_file, int argc,
+                                    char *argv[], int start_index) {
+  // Syntax: jct <file> transform [--keep p,...] [--drop p,...]
+  // [--redact p,...] [--rename p=new,...]
+  static const struct {
+    const char *flag;
+    JsonTransformStage stage;
+  } stages[] = {{"--keep", JSON_TRANSFORM_KEEP},
+                {"--drop", JSON_TRANSFORM_DROP},
+                {"--redact", JSON_TRANSFORM_REDACT},
+                {"--rename", JSON_TRANSFORM_RENAME}};
+  JsonTransform *transform = json_transform_create();
+  if (!transform) {
+    fprintf(stderr, "Error: Memory allocation failed for transform\n");
+    return 1;
+  }
+  for (int i = start_index; i < argc; ++i) {
+    const char *a = argv[i];
+    size_t s = 0;
+    while (s < sizeof(stages) / sizeof(stages[0]) &&
+           strcmp(a, stages[s].flag) != 0) {
+      s++;
+    }
+    if (s < sizeof(stages) / sizeof(stages[0]) && i + 1 < argc) {
+      if (!json_transform_add(transform, stages[s].stage, argv[++i])) {
+        fprintf(stderr, "Error: invalid %s '%s'\n", a, argv[i]);
+        json_transform_free(transform);
+        return 2;
+      }
+    } else if ((strcmp(a, "--max-size") == 0 || strcmp(a, "--max-mem") == 0 ||
+                strcmp(a, "--threads") == 0) &&
+               i + 1 < argc) {
+      i++; // global option, applied by main
+    } else if (strcmp(a, "--dedup") == 0) {
+      // global option, applied by main
+    } else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
+      printf("Usage: jct <file.json> transform [--keep p,...] [--drop p,...] "
+             "[--redact p,...] [--rename p=new,...]\n");
+      json_transform_free(transform);
+      return 0;
+    } else {
+      fprintf(stderr, "Error: unknown argument '%s'\n", a);
+      json_transform_free(transform);
+      return 2;
+    }
+  }
+
+  JsonTokenizer *tok = json_tokenizer_open_file(config_file);
+  if (!tok) {
+    fprintf(stderr, "Error: Failed to load config file '%s'.\n", config_file);
+    json_transform_free(transform);
+    return 1;
+  }
+  int ok = json_transform_stream(transform, tok, stdout);
+  json_tokenizer_free(tok);
+  json_transform_free(transform);
+  if (ok == 0 && !json_memory_exhausted()) {
+    fflush(stdout);
+    fprintf(stderr,
+            "Error: Failed to transform '%s'; it may not be valid JSON.\n",
+            config_file);
+  }
+  return ok == 1 ? 0 : 1;
+}
+
 // Function to print usage information
 static void print_usage(void) {
   printf("Usage: jct [--trace-resolve] <config_file> <command> [options]\n\n");
@@ -267,24 +675,48 @@ static void print_usage(void) {
          "file\n");
   printf("  <config_file> set <key> <value>      Set a value in the config "
          "file\n");
-  printf("  <config_file> import <source_file>    Merge values from another "
-         "JSON file\n");
+  printf("  <config_file> import <source_file>...\n");
+  printf("                                       Merge values from other JSON "
+         "files, in order\n");
   printf("  <config_file> export [<original_file>]\n");
   printf("                                       Export differences to stdout\n");
   printf("  <config_file> create                 Create a new empty config "
          "file\n");
   printf("  <config_file> print                  Print the entire config "
          "file\n");
-  printf("  <config_file> restore                Restore config file to "
+  printf("  <config_file> restore [<file>...] [--list <expr>]\n");
+  printf("                                       Restore config files to "
          "original state (OverlayFS)\n");
   printf("  <config_file> path <expression>      Query JSON using JSONPath "
          "(Goessner)\n");
+  printf("  <config_file> agg <expression>       Aggregate the numbers a "
+         "JSONPath matches\n");
+  printf("  <config_file> transform [options]    Keep, drop, redact or rename "
+         "members in one pass\n");
+  printf("  <config_file> index [<index_file>]   Write a baseline index for "
+         "fast export\n");
+  printf("  <config_file> codegen [<name>]       Print a C struct binding "
+         "for a sample or schema\n");
   printf("\n");
   printf("Options:\n");
   printf("  --trace-resolve                      Trace short-name resolution "
          "steps (get/set/import/print/restore)\n");
+  printf("  --max-size <bytes>[K|M|G]            Largest JSON input/output "
+         "accepted (0 = unlimited, default 100M)\n");
+  printf("  --max-mem <bytes>[K|M|G]             Memory budget; exit 12 when "
+         "exceeded (0 = unlimited)\n");
+  printf("  --threads <n>                        Threads for printing large "
+         "results (default 1)\n");
+  printf("  --dedup                              Share identical values of "
+         "loaded documents to save memory\n");
+  printf("  --select <p,...>                     Load only matching values "
+         "(get/print/path/agg)\n");
   printf("  path options: --mode values|paths|pairs [--limit N] [--strict] "
          "[--pretty] [--unwrap-single]\n");
+  printf("  agg options: --op sum,avg,min,max,count,topk=N (default "
+         "count,sum,avg,min,max) [--strict] [--pretty]\n");
+  printf("  transform options: --keep|--drop|--redact <p,...> "
+         "[--rename <p=new,...>] (repeatable)\n");
   printf("\n");
   printf("Short-name resolution (when <config_file> has no '/' and no "
          "'.json'):\n");
@@ -310,8 +742,14 @@ static void print_usage(void) {
   printf("  jct modified.json export base.json > diff.json\n");
   printf("                                        Export differences between "
          "two files\n");
+  printf("  jct /rom/etc/prudynt.json index       Index the original "
+         "(<file>.jctidx)\n");
   printf("  jct /etc/config.json restore          Restore /etc/config.json "
          "(absolute path required)\n");
+  printf("  jct '/etc/*.json' restore             Restore every modified "
+         "match, remounting once\n");
+  printf("  jct sample.json codegen cam > cam.h  Generate cam.h with struct "
+         "Cam and cam_parse()\n");
   printf("  jct books.json path '$..author' --mode values\n");
 }
 
@@ -337,9 +775,22 @@ static int handle_get_command(const char *config_file, const char *key) {
 
 // Function to handle the 'set' command
 static int handle_set_command(const char *config_file, const char *key,
-                              const char *value_str) {
+                              const char *value_str, int journal) {
   JsonValue *config = load_config(config_file);
+  if (config && journal) {
+    // Append the change instead of rewriting the file
+    int success = json_journal_set(config_file, config, key, value_str);
+    free_json_value(config);
+    return success ? 0 : 1;
+  }
   if (!config) {
+    // An existing file that could not be loaded (too large, compressed
+    // without build support, ...) must not be overwritten
+    if (access(config_file, F_OK) == 0) {
+      fprintf(stderr, "Error: Failed to load config file '%s'.\n",
+              config_file);
+      return 1;
+    }
     // If the file doesn't exist, create a new empty config
     config = create_json_value(JSON_OBJECT);
     if (!config) {
@@ -405,8 +856,28 @@ static int handle_print_command(const char *config_file) {
   return 0;
 }
 
-// Function to handle the 'restore' command
-static int handle_restore_command(const char *config_file) {
+// Whether a file has journaled changes (see json_journal.c)
+static int has_journal(const char *config_file) {
+  char path[PATH_MAX];
+  return snprintf(path, sizeof(path), "%s.journal", config_file) <
+             (int)sizeof(path) &&
+         access(path, F_OK) == 0;
+}
+
+// Directory holding the rom/ and overlay/ trees: $JCT_ROOT if set, for
+// running restore and export against a scratch copy, else the real root
+static const char *overlay_root(void) {
+  const char *root = getenv("JCT_ROOT");
+  return root ? root : "";
+}
+
+// Removes the overlay copy and the journal of one config file so the ROM
+// version shows through. Returns 0 on success or a restore exit code (1, 2,
+// 3 or 5). With skip_unrestorable, files that have no ROM version or no
+// changes are skipped quietly (returns -1); glob matches use this. In a
+// batch, messages name the file.
+static int remove_overlay_copy(const char *config_file, int skip_unrestorable,
+                               int batch) {
   char rom_path[PATH_MAX];
   char overlay_path[PATH_MAX];
 
@@ -426,50 +897,364 @@ static int handle_restore_command(const char *config_file) {
   }
 
   // Build ROM and overlay paths using the absolute path
-  if (snprintf(rom_path, sizeof(rom_path), "/rom%s", config_file) >=
+  const char *root = overlay_root();
+  if (snprintf(rom_path, sizeof(rom_path), "%s/rom%s", root, config_file) >=
       (int)sizeof(rom_path)) {
     fprintf(stderr, "Error: ROM path too long.\n");
     return 5;
   }
-  if (snprintf(overlay_path, sizeof(overlay_path), "/overlay%s", config_file) >=
-      (int)sizeof(overlay_path)) {
+  if (snprintf(overlay_path, sizeof(overlay_path), "%s/overlay%s", root,
+               config_file) >= (int)sizeof(overlay_path)) {
     fprintf(stderr, "Error: Overlay path too long.\n");
     return 5;
   }
 
   // Check if ROM file exists
   if (access(rom_path, F_OK) != 0) {
+    if (skip_unrestorable)
+      return -1;
     fprintf(stderr, "Error: Original file '%s' not found\n", rom_path);
     return 1;
   }
 
-  // Check if overlay file exists
-  if (access(overlay_path, F_OK) != 0) {
-    fprintf(stderr, "Error: The file is original, nothing to restore\n");
+  // A file with no overlay copy may still have journaled changes made on
+  // top of the ROM version; those are restored by dropping the journal
+  int have_copy = access(overlay_path, F_OK) == 0;
+  if (!have_copy && !has_journal(overlay_path)) {
+    if (skip_unrestorable)
+      return -1;
+    if (batch)
+      fprintf(stderr, "Error: '%s' is original, nothing to restore\n",
+              config_file);
+    else
+      fprintf(stderr, "Error: The file is original, nothing to restore\n");
     return 2;
   }
 
-  // Remove the overlay file
-  if (unlink(overlay_path) != 0) {
+  // Remove the overlay file, and the journal of changes made on top of it
+  if (have_copy && unlink(overlay_path) != 0) {
     fprintf(stderr, "Error: Failed to remove overlay file '%s': %s\n",
             overlay_path, strerror(errno));
     return 3;
   }
+  if (!json_journal_discard(overlay_path)) {
+    return 3;
+  }
+
+  return 0;
+}
 
-  // Remount the overlay filesystem
-  if (system("mount -o remount /") != 0) {
+// Remounts the root filesystem so OverlayFS drops the removed upper files.
+// Uses mount(2) directly, keeping the current mount flags; falls back to
+// the mount utility if the syscall is unavailable or refused.
+static int remount_root(void) {
+#ifdef __linux__
+  struct statvfs sv;
+  if (statvfs("/", &sv) == 0) {
+    unsigned long flags = MS_REMOUNT;
+    if (sv.f_flag & ST_RDONLY)
+      flags |= MS_RDONLY;
+    if (sv.f_flag & ST_NOSUID)
+      flags |= MS_NOSUID;
+#ifdef ST_NODEV
+    if (sv.f_flag & ST_NODEV)
+      flags |= MS_NODEV;
+#endif
+#ifdef ST_NOEXEC
+    if (sv.f_flag & ST_NOEXEC)
+      flags |= MS_NOEXEC;
+#endif
+#ifdef ST_SYNCHRONOUS
+    if (sv.f_flag & ST_SYNCHRONOUS)
+      flags |= MS_SYNCHRONOUS;
+#endif
+#ifdef ST_NOATIME
+    if (sv.f_flag & ST_NOATIME)
+      flags |= MS_NOATIME;
+#endif
+#ifdef ST_NODIRATIME
+    if (sv.f_flag & ST_NODIRATIME)
+      flags |= MS_NODIRATIME;
+#endif
+#ifdef ST_RELATIME
+    if (sv.f_flag & ST_RELATIME)
+      flags |= MS_RELATIME;
+#endif
+    if (mount(NULL, "/", NULL, flags, NULL) == 0)
+      return 1;
+  }
+#endif
+  return system("mount -o remount /") == 0;
+}
+
+// Files collected for one restore run
+typedef struct {
+  char *path;
+  int from_glob;
+} RestoreTarget;
+
+typedef struct {
+  RestoreTarget *items;
+  int count;
+  int cap;
+} RestoreList;
+
+static int add_restore_target(RestoreList *list, const char *path,
+                              int from_glob) {
+  if (list->count == list->cap) {
+    int nc = list->cap ? list->cap * 2 : 16;
+    RestoreTarget *ni =
+        (RestoreTarget *)realloc(list->items, nc * sizeof(RestoreTarget));
+    if (!ni)
+      return 0;
+    list->items = ni;
+    list->cap = nc;
+  }
+  char *copy = strdup(path);
+  if (!copy)
+    return 0;
+  list->items[list->count].path = copy;
+  list->items[list->count].from_glob = from_glob;
+  list->count++;
+  return 1;
+}
+
+// Expands a pattern against the overlay's upper directory, so only files
+// that were actually modified are candidates; files changed only through
+// a journal are found by their .journal file. Returns the number of
+// matches, or -1 on error.
+static int expand_restore_glob(const char *pattern, RestoreList *list) {
+  char overlay_pattern[PATH_MAX];
+  if (pattern[0] != '/' ||
+      snprintf(overlay_pattern, sizeof(overlay_pattern), "%s/overlay%s",
+               overlay_root(), pattern) >= (int)sizeof(overlay_pattern)) {
+    fprintf(stderr,
+            "Error: Config file path must be absolute (start with '/'). Got: "
+            "'%s'\n",
+            pattern);
+    return -1;
+  }
+
+  glob_t g;
+  int rc = glob(overlay_pattern, 0, NULL, &g);
+  if (rc != 0 && rc != GLOB_NOMATCH) {
+    fprintf(stderr, "Error: Failed to expand '%s'\n", pattern);
+    return -1;
+  }
+  size_t prefix = strlen(overlay_root()) + strlen("/overlay");
+  int matched = 0;
+  for (size_t i = 0; rc == 0 && i < g.gl_pathc; i++) {
+    if (!add_restore_target(list, g.gl_pathv[i] + prefix, 1)) {
+      globfree(&g);
+      return -1;
+    }
+    matched++;
+  }
+  if (rc == 0)
+    globfree(&g);
+
+  // Journals whose file has no overlay copy (those were matched above)
+  size_t len = strlen(overlay_pattern);
+  if (len + strlen(".journal") >= sizeof(overlay_pattern))
+    return matched;
+  memcpy(overlay_pattern + len, ".journal", sizeof(".journal"));
+  rc = glob(overlay_pattern, 0, NULL, &g);
+  if (rc == GLOB_NOMATCH)
+    return matched;
+  if (rc != 0) {
+    fprintf(stderr, "Error: Failed to expand '%s'\n", pattern);
+    return -1;
+  }
+  for (size_t i = 0; i < g.gl_pathc; i++) {
+    char *path = g.gl_pathv[i];
+    path[strlen(path) - strlen(".journal")] = '\0';
+    if (access(path, F_OK) == 0)
+      continue;
+    if (!add_restore_target(list, path + prefix, 1)) {
+      globfree(&g);
+      return -1;
+    }
+    matched++;
+  }
+  globfree(&g);
+  return matched;
+}
+
+// Adds the string values a JSONPath selects from a list document
+static int add_listed_targets(const char *list_file, const char *expr,
+                              RestoreList *list) {
+  JsonValue *doc = load_config(list_file);
+  if (!doc) {
+    fprintf(stderr, "Error: Failed to load list file '%s'.\n", list_file);
+    return 0;
+  }
+  JsonPathOptions opt = {JSONPATH_MODE_VALUES, 0, 1};
+  JsonPathResults *res = evaluate_jsonpath(doc, expr, &opt);
+  // A query that ran out of budget may have missed matches
+  if (res && json_memory_exhausted()) {
+    free_jsonpath_results(res);
+    res = NULL;
+  }
+  if (!res) {
+    free_json_value(doc);
+    return 0;
+  }
+  int ok = 1;
+  for (int i = 0; i < res->count && ok; i++) {
+    JsonValue *v = res->values[i];
+    if (!v || v->type != JSON_STRING || !v->value.string) {
+      fprintf(stderr, "Error: '%s' selected a value that is not a path\n",
+              expr);
+      ok = 0;
+    } else {
+      ok = add_restore_target(list, v->value.string, 0);
+    }
+  }
+  free_jsonpath_results(res);
+  free_json_value(doc);
+  return ok;
+}
+
+// Function to handle the 'restore' command
+//
+// Restores config_file and any extra files; arguments containing glob
+// characters are matched against the modified files in /overlay. With
+// --list <expr>, config_file is instead a JSON document and the strings the
+// JSONPath selects are the files to restore. All overlay copies are removed
+// first and the filesystem is remounted once at the end.
+static int handle_restore_command(const char *config_file, char *argv[],
+                                  const int *idxs, int nidx) {
+  RestoreList list = {NULL, 0, 0};
+  int rc = 0;
+  const char *list_expr = NULL;
+
+  for (int k = 2; k < nidx; k++) {
+    const char *a = argv[idxs[k]];
+    if (strcmp(a, "--list") == 0) {
+      if (k + 1 >= nidx) {
+        fprintf(stderr, "Error: --list requires a JSONPath expression.\n");
+        return 5;
+      }
+      list_expr = argv[idxs[++k]];
+    }
+  }
+
+  // Gather targets: the config file (unless it is a list) and extra files
+  for (int k = 1; k < nidx && rc == 0; k++) {
+    const char *a;
+    if (k == 1) {
+      if (list_expr)
+        continue;
+      a = config_file;
+    } else {
+      a = argv[idxs[k]];
+      if (strcmp(a, "--list") == 0) {
+        k++;
+        continue;
+      }
+    }
+    if (strpbrk(a, "*?[")) {
+      if (expand_restore_glob(a, &list) < 0)
+        rc = 5;
+    } else if (!add_restore_target(&list, a, 0)) {
+      rc = 5;
+    }
+  }
+  if (rc == 0 && list_expr &&
+      !add_listed_targets(config_file, list_expr, &list)) {
+    rc = 5;
+  }
+
+  // Remove every overlay copy; a failing entry does not stop the rest, and
+  // the first failure sets the exit code. Nothing is removed if the list
+  // itself could not be built.
+  int removed = 0;
+  int gathered = rc == 0;
+  for (int i = 0; i < list.count && gathered; i++) {
+    int r = remove_overlay_copy(list.items[i].path, list.items[i].from_glob,
+                                list.count > 1);
+    if (r == 0)
+      removed++;
+    else if (r > 0 && rc == 0)
+      rc = r;
+  }
+  for (int i = 0; i < list.count; i++) {
+    free(list.items[i].path);
+  }
+  free(list.items);
+
+  if (rc == 0 && removed == 0) {
+    fprintf(stderr, "Error: No modified files to restore\n");
+    rc = 2;
+  }
+
+  // Remount the overlay filesystem once for the whole batch; a scratch
+  // root from $JCT_ROOT is not mounted
+  if (removed > 0 && !*overlay_root() && !remount_root()) {
     fprintf(stderr, "Error: Failed to remount overlay filesystem: %s\n",
             strerror(errno));
-    return 4;
+    if (rc == 0)
+      rc = 4;
   }
 
   // Silent success - no output for restore command
+  return rc;
+}
+
+// Merges one import source into *dest, reading it as a token stream so
+// only the values it replaces are held in memory. tok is the source opened
+// by json_tokenizer_open_batch, or NULL if it has a journal; it is freed
+// here. Returns 0 on success.
+static int import_source(JsonValue **dest, const char *dest_file,
+                         const char *source_file, JsonTokenizer *tok) {
+  // Journaled changes have to be replayed on a tree
+  if (!tok && has_journal(source_file)) {
+    JsonValue *source = load_config(source_file);
+    if (!source) {
+      fprintf(stderr, "Error: Failed to load source file '%s'.\n",
+              source_file);
+      return 1;
+    }
+    int merged = merge_json_into(dest, source);
+    free_json_value(source);
+    if (!merged) {
+      fprintf(stderr, "Error: Failed to merge '%s' into '%s'.\n",
+              source_file, dest_file);
+      return 1;
+    }
+    return 0;
+  }
+
+  // An empty source changes nothing, as it did when parsed into a tree
+  struct stat st;
+  if (stat(source_file, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0) {
+    fprintf(stderr, "Error: File '%s' is empty\n", source_file);
+    json_tokenizer_free(tok);
+    return 0;
+  }
+
+  if (!tok) {
+    fprintf(stderr, "Error: Failed to load source file '%s'.\n",
+            source_file);
+    return 1;
+  }
+  int merged = merge_json_stream(dest, tok);
+  json_tokenizer_free(tok);
+  if (!merged) {
+    fprintf(stderr, "Error: Failed to merge '%s' into '%s'; the source may "
+                    "not be valid JSON.\n",
+            source_file, dest_file);
+    return 1;
+  }
   return 0;
 }
 
 // Function to handle the 'import' command
+// Sources are merged in order, so later ones override earlier ones; their
+// files are opened together first, so slow storage is waited on once
 static int handle_import_command(const char *dest_file,
-                                 const char *source_file) {
+                                 const char *const *source_files,
+                                 int source_count) {
   JsonValue *dest = load_config(dest_file);
   if (!dest) {
     dest = create_json_value(JSON_OBJECT);
@@ -481,32 +1266,44 @@ static int handle_import_command(const char *dest_file,
     }
   }
 
-  JsonValue *source = load_config(source_file);
-  if (!source) {
-    fprintf(stderr, "Error: Failed to load source file '%s'.\n", source_file);
+  JsonBatchStream *streams =
+      (JsonBatchStream *)calloc((size_t)source_count, sizeof(*streams));
+  if (!streams) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
     free_json_value(dest);
     return 1;
   }
-
-  if (!merge_json_into(&dest, source)) {
-    fprintf(stderr, "Error: Failed to merge '%s' into '%s'.\n", source_file,
-            dest_file);
-    free_json_value(source);
-    free_json_value(dest);
-    return 1;
+  size_t stream_count = 0;
+  for (int i = 0; i < source_count; i++) {
+    if (!has_journal(source_files[i])) {
+      streams[stream_count++].path = source_files[i];
+    }
   }
+  json_tokenizer_open_batch(streams, stream_count);
+
+  int rc = 0;
+  size_t next = 0;
+  for (int i = 0; i < source_count; i++) {
+    JsonTokenizer *tok = NULL;
+    if (next < stream_count && streams[next].path == source_files[i]) {
+      tok = streams[next++].tok;
+    }
+    if (rc == 0) {
+      rc = import_source(&dest, dest_file, source_files[i], tok);
+    } else {
+      json_tokenizer_free(tok);
+    }
+  }
+  free(streams);
 
-  if (!save_config(dest_file, dest)) {
+  if (rc == 0 && !save_config(dest_file, dest)) {
     fprintf(stderr, "Error: Failed to save merged config to '%s'.\n",
             dest_file);
-    free_json_value(source);
-    free_json_value(dest);
-    return 1;
+    rc = 1;
   }
 
-  free_json_value(source);
   free_json_value(dest);
-  return 0;
+  return rc;
 }
 
 // Function to handle the 'export' command
@@ -519,8 +1316,8 @@ static int handle_export_command(const char *modified_file,
   if (!original_file) {
     // Default to /rom/<modified_file> for OverlayFS systems
     if (modified_file[0] == '/') {
-      snprintf(default_original, sizeof(default_original), "/rom%s",
-               modified_file);
+      snprintf(default_original, sizeof(default_original), "%s/rom%s",
+               overlay_root(), modified_file);
       original_path = default_original;
     } else {
       fprintf(stderr,
@@ -530,6 +1327,95 @@ static int handle_export_command(const char *modified_file,
     }
   }
 
+  // Journaled changes are only seen through load_config, so files with a
+  // journal skip the shortcuts below and go through the tree diff
+  int journaled = has_journal(modified_file) || has_journal(original_path);
+
+  // A file that is the original itself (same inode, or no upper copy on
+  // an OverlayFS system) has no differences
+  struct stat modified_st, original_st;
+  int have_modified = stat(modified_file, &modified_st) == 0;
+  if (!journaled && have_modified && stat(original_path, &original_st) == 0) {
+    int same_file = modified_st.st_dev == original_st.st_dev &&
+                    modified_st.st_ino == original_st.st_ino;
+    if (!same_file && !original_file) {
+      char overlay_dir[PATH_MAX];
+      char overlay_path[PATH_MAX];
+      struct stat overlay_st;
+      same_file =
+          snprintf(overlay_dir, sizeof(overlay_dir), "%s/overlay",
+                   overlay_root()) < (int)sizeof(overlay_dir) &&
+          snprintf(overlay_path, sizeof(overlay_path), "%s%s", overlay_dir,
+                   modified_file) < (int)sizeof(overlay_path) &&
+          stat(overlay_dir, &overlay_st) == 0 && S_ISDIR(overlay_st.st_mode) &&
+          lstat(overlay_path, &overlay_st) != 0 && errno == ENOENT;
+    }
+    if (same_file) {
+      printf("{}\n");
+      return 0;
+    }
+  }
+
+  // With a baseline index of the original only the modified file is
+  // read; the ROM copy never changes, so its index is cached on first use
+  JsonBaseline *baseline = have_modified && !journaled
+                               ? json_baseline_open(original_path,
+                                                    !original_file)
+                               : NULL;
+  if (baseline) {
+    JsonTokenizer *modified_tok = json_tokenizer_open_file(modified_file);
+    if (!modified_tok) {
+      fprintf(stderr, "Error: Failed to load modified file '%s'.\n",
+              modified_file);
+      json_baseline_free(baseline);
+      return 1;
+    }
+    JsonValue *diff = diff_json_stream_baseline(modified_tok, baseline);
+    json_tokenizer_free(modified_tok);
+    json_baseline_free(baseline);
+    if (diff) {
+      print_item(diff);
+      free_json_value(diff);
+      return 0;
+    }
+  }
+
+  if (!journaled) {
+    // Walk both files as token streams so only the differences are held in
+    // memory; documents that cannot be streamed (not both objects, or
+    // malformed) go through the tree diff below, which reports problems
+    JsonTokenizer *modified_tok = json_tokenizer_open_file(modified_file);
+    if (!modified_tok) {
+      fprintf(stderr, "Error: Failed to load modified file '%s'.\n",
+              modified_file);
+      return 1;
+    }
+    JsonTokenizer *original_tok = json_tokenizer_open_file(original_path);
+    if (!original_tok) {
+      fprintf(stderr, "Error: Failed to load original file '%s'.\n",
+              original_path);
+      if (!original_file) {
+        fprintf(stderr, "Hint: Provide an explicit original file to compare "
+                        "against.\n");
+      }
+      json_tokenizer_free(modified_tok);
+      return 1;
+    }
+    JsonValue *streamed = diff_json_stream(modified_tok, original_tok);
+    json_tokenizer_free(modified_tok);
+    json_tokenizer_free(original_tok);
+    if (streamed) {
+      print_item(streamed);
+      free_json_value(streamed);
+      return 0;
+    }
+  }
+
+  // The tree diff needs far more memory than the streams did
+  if (json_memory_exhausted()) {
+    return 1;
+  }
+
   JsonValue *modified = load_config(modified_file);
   if (!modified) {
     fprintf(stderr, "Error: Failed to load modified file '%s'.\n",
@@ -566,9 +1452,42 @@ static int handle_export_command(const char *modified_file,
   return 0;
 }
 
-int main(int argc, char *argv[]) {
+// Function to handle the 'compact' command
+static int handle_compact_command(const char *config_file) {
+  if (!json_journal_compact(config_file)) {
+    fprintf(stderr, "Error: Failed to compact journal of '%s'.\n",
+            config_file);
+    return 1;
+  }
+  return 0;
+}
+
+// Function to handle the 'index' command
+static int handle_index_command(const char *config_file,
+                                const char *index_file) {
+  char default_index[PATH_MAX];
+  if (!index_file) {
+    if (snprintf(default_index, sizeof(default_index), "%s.jctidx",
+                 config_file) >= (int)sizeof(default_index)) {
+      fprintf(stderr, "Error: Index path too long.\n");
+      return 1;
+    }
+    index_file = default_index;
+  }
+  return json_baseline_build(config_file, index_file) ? 0 : 1;
+}
+
+// Function to handle the 'codegen' command
+static int handle_codegen_command(const char *config_file, const char *name) {
+  return json_codegen(config_file, name, stdout) ? 0 : 1;
+}
+
+static int run(int argc, char *argv[]) {
   // Gather non-flag arguments and recognize --trace-resolve
   int trace_resolve = 0;
+  int journal = 0;
+  int dedup = 0;
+  const char *selection = NULL;
   int idxs[argc];
   int nidx = 0;
   for (int i = 1; i < argc; ++i) {
@@ -576,6 +1495,52 @@ int main(int argc, char *argv[]) {
       trace_resolve = 1;
       continue;
     }
+    if (strcmp(argv[i], "--journal") == 0) {
+      journal = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--dedup") == 0) {
+      dedup = 1;
+      json_set_dedup(1);
+      continue;
+    }
+    if (strcmp(argv[i], "--select") == 0 && i + 1 < argc) {
+      selection = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+      size_t limit;
+      if (!parse_size_arg(argv[++i], &limit)) {
+        fprintf(stderr, "Error: invalid --max-size '%s'\n", argv[i]);
+        return 1;
+      }
+      json_set_max_input_size(limit);
+      json_set_max_output_size(limit);
+      continue;
+    }
+    if (strcmp(argv[i], "--max-mem") == 0 && i + 1 < argc) {
+      size_t limit;
+      if (!parse_size_arg(argv[++i], &limit)) {
+        fprintf(stderr, "Error: invalid --max-mem '%s'\n", argv[i]);
+        return 1;
+      }
+      if (!json_set_memory_limit(limit)) {
+        fprintf(stderr, "Error: --max-mem is not supported on this "
+                        "platform\n");
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      char *end;
+      unsigned long threads = strtoul(argv[++i], &end, 10);
+      if (*end || end == argv[i] || threads == 0 || threads > 1024) {
+        fprintf(stderr, "Error: invalid --threads '%s'\n", argv[i]);
+        return 1;
+      }
+      json_set_serialize_threads((unsigned)threads);
+      continue;
+    }
     idxs[nidx++] = i;
   }
 
@@ -587,12 +1552,64 @@ int main(int argc, char *argv[]) {
   const char *config_target = argv[idxs[0]];
   const char *command = argv[idxs[1]];
 
+  // A selection loads part of the document, so it is only for commands
+  // that read it; writing it back would lose the rest
+  if (selection) {
+    if (strcmp(command, "get") != 0 && strcmp(command, "print") != 0 &&
+        strcmp(command, "path") != 0 && strcmp(command, "agg") != 0) {
+      fprintf(stderr, "Error: --select only applies to get, print, path and "
+                      "agg\n");
+      return 1;
+    }
+    if (!json_set_select(selection)) {
+      fprintf(stderr, "Error: invalid --select '%s'\n", selection);
+      return 1;
+    }
+  } else if (json_memory_limit() && nidx >= 3) {
+    // Under a budget, a lookup of one fixed key ('get', or 'path' with only
+    // member and index steps) loads just the values on its way, as --select
+    // with the key would, rather than the document it may not fit beside.
+    // Anything a pattern reads differently keeps to lazy containers.
+    const char *key = argv[idxs[2]];
+    if ((strcmp(command, "get") == 0 && !strpbrk(key, "*[$,") &&
+         !strstr(key, "..")) ||
+        (strcmp(command, "path") == 0 && key[0] == '$' &&
+         !strpbrk(key, "*?:,()@") && !strstr(key, ".."))) {
+      json_set_select(key);
+    }
+  }
+
+  // These commands only do keyed lookups and write keys sorted, so they
+  // load documents in the sorted-key layout; 'path' keeps document order.
+  // They read few of the values they load, so scalars are decoded lazily.
+  if (strcmp(command, "get") == 0 || strcmp(command, "set") == 0 ||
+      strcmp(command, "print") == 0 || strcmp(command, "import") == 0 ||
+      strcmp(command, "export") == 0) {
+    json_set_sorted_keys(1);
+    json_set_lazy_scalars(1);
+  }
+  // The commands reach array elements through get_array_item and
+  // json_array_first, so arrays of numbers can be stored packed
+  json_set_packed_arrays(1);
+  // 'get' reads one value, so it only expands the containers on its path;
+  // under a memory budget 'path' and 'agg' do the same, which leaves the
+  // parts of the document a query does not visit as source bytes, unless
+  // --dedup is to share values as they are parsed
+  if (strcmp(command, "get") == 0 ||
+      (json_memory_limit() && !dedup &&
+       (strcmp(command, "path") == 0 || strcmp(command, "agg") == 0))) {
+    json_set_lazy_containers(1);
+  }
+
   char resolved_path[PATH_MAX];
   const char *cfg_for_handlers = config_target;
 
   // Decide path handling per command
   if (strcmp(command, "get") == 0 || strcmp(command, "print") == 0 ||
-      strcmp(command, "restore") == 0 || strcmp(command, "path") == 0) {
+      strcmp(command, "restore") == 0 || strcmp(command, "path") == 0 ||
+      strcmp(command, "agg") == 0 || strcmp(command, "transform") == 0 ||
+      strcmp(command, "index") == 0 || strcmp(command, "compact") == 0 ||
+      strcmp(command, "codegen") == 0) {
     // These require an existing readable file; apply short-name resolution
     int rc = resolve_config_target(config_target, trace_resolve, resolved_path,
                                    sizeof(resolved_path));
@@ -637,12 +1654,11 @@ int main(int argc, char *argv[]) {
     cfg_for_handlers = config_target; // explicit path
   } else if (strcmp(command, "import") == 0) {
     if (nidx < 3) {
-      fprintf(stderr, "Error: 'import' command requires a source file.\n");
+      fprintf(stderr, "Error: 'import' command requires at least one source file.\n");
       print_usage();
       return 1;
     }
 
-    const char *source_target = argv[idxs[2]];
     const char *dest_path = config_target;
     char dest_resolved[PATH_MAX];
 
@@ -662,14 +1678,29 @@ int main(int argc, char *argv[]) {
       dest_path = dest_resolved;
     }
 
-    char source_resolved[PATH_MAX];
-    int rc = resolve_config_target(source_target, trace_resolve,
-                                   source_resolved,
-                                   sizeof(source_resolved));
-    if (rc != 0) {
-      return rc;
+    int source_count = nidx - 2;
+    char(*source_resolved)[PATH_MAX] =
+        malloc((size_t)source_count * sizeof(*source_resolved));
+    const char **sources =
+        (const char **)malloc((size_t)source_count * sizeof(*sources));
+    if (!source_resolved || !sources) {
+      fprintf(stderr, "Error: Memory allocation failed for import\n");
+      free(source_resolved);
+      free(sources);
+      return 1;
+    }
+    int rc = 0;
+    for (int i = 0; rc == 0 && i < source_count; i++) {
+      rc = resolve_config_target(argv[idxs[i + 2]], trace_resolve,
+                                 source_resolved[i], PATH_MAX);
+      sources[i] = source_resolved[i];
     }
-    return handle_import_command(dest_path, source_resolved);
+    if (rc == 0) {
+      rc = handle_import_command(dest_path, sources, source_count);
+    }
+    free(source_resolved);
+    free(sources);
+    return rc;
   } else if (strcmp(command, "export") == 0) {
     const char *original_file = (nidx >= 3) ? argv[idxs[2]] : NULL;
     const char *modified_path = config_target;
@@ -719,13 +1750,14 @@ int main(int argc, char *argv[]) {
       print_usage();
       return 1;
     }
-    return handle_set_command(cfg_for_handlers, argv[idxs[2]], argv[idxs[3]]);
+    return handle_set_command(cfg_for_handlers, argv[idxs[2]], argv[idxs[3]],
+                              journal);
   } else if (strcmp(command, "create") == 0) {
     return handle_create_command(cfg_for_handlers);
   } else if (strcmp(command, "print") == 0) {
     return handle_print_command(cfg_for_handlers);
   } else if (strcmp(command, "restore") == 0) {
-    return handle_restore_command(cfg_for_handlers);
+    return handle_restore_command(cfg_for_handlers, argv, idxs, nidx);
   } else if (strcmp(command, "path") == 0) {
     if (nidx < 3) {
       fprintf(stderr, "Error: 'path' command requires an expression.\n");
@@ -733,6 +1765,24 @@ int main(int argc, char *argv[]) {
       return 1;
     }
     return handle_path_command(cfg_for_handlers, argc, argv, idxs[2]);
+  } else if (strcmp(command, "agg") == 0) {
+    if (nidx < 3) {
+      fprintf(stderr, "Error: 'agg' command requires an expression.\n");
+      print_usage();
+      return 1;
+    }
+    return handle_agg_command(cfg_for_handlers, argc, argv, idxs[2]);
+  } else if (strcmp(command, "transform") == 0) {
+    return handle_transform_command(cfg_for_handlers, argc, argv,
+                                    idxs[1] + 1);
+  } else if (strcmp(command, "compact") == 0) {
+    return handle_compact_command(cfg_for_handlers);
+  } else if (strcmp(command, "index") == 0) {
+    return handle_index_command(cfg_for_handlers,
+                                nidx >= 3 ? argv[idxs[2]] : NULL);
+  } else if (strcmp(command, "codegen") == 0) {
+    return handle_codegen_command(cfg_for_handlers,
+                                  nidx >= 3 ? argv[idxs[2]] : NULL);
   } else if (strcmp(command, "--help") == 0 || strcmp(command, "-h") == 0) {
     print_usage();
     return 0;
@@ -742,3 +1792,15 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 }
+
+int main(int argc, char *argv[]) {
+  int rc = run(argc, argv);
+  // Whatever the command reported, running out of the --max-mem budget
+  // gets its own exit code
+  if (json_memory_exhausted()) {
+    fprintf(stderr, "Error: Memory budget of %zu bytes exceeded\n",
+            json_memory_limit());
+    return 12;
+  }
+  return rc;
+}
@@ -0,0 +1,417 @@
+/**
+ * json_dedup.c - Hash-consing of identical subtrees and repeated scalars
+ *
+ * Merged fleet configs repeat the same blocks many times over:
+ *
+ *   {"ch0": {"codec": "h264", "mode": "auto", "enabled": true, ...},
+ *    "ch1": {"codec": "h264", "mode": "auto", "enabled": true, ...}, ...}
+ *
+ * Hash-consing keeps one copy of each distinct value and points every
+ * occurrence at it. Values are interned bottom-up, so by the time a
+ * container is interned its children already are, and two containers are
+ * equal exactly when their keys and child pointers are: hashing and
+ * comparing a container only looks at one level.
+ *
+ * A shared value counts its extra references in the bits of flags above
+ * JSON_REF_SHIFT. free_json_value drops one while any are left, so
+ * replacing or removing one occurrence leaves the others alone; code that
+ * modifies a value in place first makes the slot holding it private with
+ * json_unshare. Object keys are not shared.
+ */
+
+#include "json_dedup.h"
+#include "json_packed.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REF_MAX (UINT_MAX >> JSON_REF_SHIFT)
+
+typedef struct {
+  uint64_t hash;
+  JsonValue *value; // NULL if the slot is empty
+} DedupSlot;
+
+struct JsonDedup {
+  DedupSlot *slots;
+  size_t capacity; // a power of two
+  size_t count;
+  int failed; // a value was left unshared for lack of memory
+};
+
+static uint64_t hash_pointer(const JsonValue *value, uint64_t h) {
+  return json_hash_bytes((const char *)&value, sizeof(value), h);
+}
+
+static uint64_t hash_number(const JsonValue *value, uint64_t h) {
+  const char *lexeme;
+  size_t len = json_number_lexeme(value, &lexeme);
+  if (len) {
+    return json_hash_bytes(lexeme, len, h);
+  }
+  return json_hash_bytes((const char *)&value->value.number, sizeof(double),
+                         h);
+}
+
+// Element i of a packed array, through its link once it has one
+static const JsonValue *packed_element(const JsonPackedArray *block,
+                                       size_t i) {
+  return block->items ? block->items[i].value : &block->values[i];
+}
+
+// Hash of a value whose children are interned: child pointers stand for
+// the children
+static uint64_t shallow_hash(const JsonValue *value) {
+  uint64_t h = json_hash_bytes((const char *)&value->type,
+                               sizeof(value->type),
+                               UINT64_C(0xcbf29ce484222325));
+  switch (value->type) {
+  case JSON_NULL:
+    break;
+  case JSON_BOOL:
+    h = json_hash_bytes(value->value.boolean ? "t" : "f", 1, h);
+    break;
+  case JSON_NUMBER:
+    h = hash_number(value, h);
+    break;
+  case JSON_STRING:
+    if (value->value.string) {
+      h = json_hash_bytes(value->value.string, strlen(value->value.string),
+                          h);
+    }
+    break;
+  case JSON_ARRAY:
+    // Elements inside a packed array's block are not interned, so they
+    // stand for themselves; linking the array does not change its hash
+    if (value->flags & JSON_FLAG_PACKED) {
+      const JsonPackedArray *block = value->value.packed;
+      for (size_t i = 0; i < block->count; i++) {
+        const JsonValue *element = packed_element(block, i);
+        h = element->flags & JSON_FLAG_INLINE ? hash_number(element, h)
+                                              : hash_pointer(element, h);
+      }
+      break;
+    }
+    for (JsonArrayItem *it = value->value.array_head; it; it = it->next) {
+      h = hash_pointer(it->value, h);
+    }
+    break;
+  case JSON_OBJECT:
+    for (JsonKeyValue *kv = value->value.object_head; kv; kv = kv->next) {
+      h = json_hash_bytes(kv->key, strlen(kv->key) + 1, h);
+      h = hash_pointer(kv->value, h);
+    }
+    break;
+  }
+  return h;
+}
+
+// Equality of values whose children are interned. Numbers compare by
+// lexeme or bits, so values that print differently (1.0 and 1, -0 and 0)
+// stay apart.
+static int shallow_equal(const JsonValue *a, const JsonValue *b) {
+  if (a->type != b->type) {
+    return 0;
+  }
+  switch (a->type) {
+  case JSON_NULL:
+    return 1;
+  case JSON_BOOL:
+    return !a->value.boolean == !b->value.boolean;
+  case JSON_NUMBER: {
+    const char *la;
+    const char *lb;
+    size_t na = json_number_lexeme(a, &la);
+    size_t nb = json_number_lexeme(b, &lb);
+    if (na || nb) {
+      return na == nb && memcmp(la, lb, na) == 0;
+    }
+    return memcmp(&a->value.number, &b->value.number, sizeof(double)) == 0;
+  }
+  case JSON_STRING:
+    if (!a->value.string || !b->value.string) {
+      return a->value.string == b->value.string;
+    }
+    return strcmp(a->value.string, b->value.string) == 0;
+  case JSON_ARRAY: {
+    if ((a->flags ^ b->flags) & JSON_FLAG_PACKED) {
+      return 0;
+    }
+    if (a->flags & JSON_FLAG_PACKED) {
+      const JsonPackedArray *x = a->value.packed;
+      const JsonPackedArray *y = b->value.packed;
+      if (x->count != y->count) {
+        return 0;
+      }
+      for (size_t i = 0; i < x->count; i++) {
+        const JsonValue *ex = packed_element(x, i);
+        const JsonValue *ey = packed_element(y, i);
+        if (ex != ey && !(ex->flags & ey->flags & JSON_FLAG_INLINE &&
+                          shallow_equal(ex, ey))) {
+          return 0;
+        }
+      }
+      return 1;
+    }
+    JsonArrayItem *x = a->value.array_head;
+    JsonArrayItem *y = b->value.array_head;
+    for (; x && y; x = x->next, y = y->next) {
+      if (x->value != y->value) {
+        return 0;
+      }
+    }
+    return !x && !y;
+  }
+  case JSON_OBJECT: {
+    JsonKeyValue *x = a->value.object_head;
+    JsonKeyValue *y = b->value.object_head;
+    for (; x && y; x = x->next, y = y->next) {
+      if (x->value != y->value || strcmp(x->key, y->key) != 0) {
+        return 0;
+      }
+    }
+    return !x && !y;
+  }
+  }
+  return 0;
+}
+
+JsonDedup *json_dedup_create(void) {
+  JsonDedup *dedup = (JsonDedup *)json_calloc(1, sizeof(JsonDedup));
+  if (!dedup) {
+    return NULL;
+  }
+  dedup->capacity = 256;
+  dedup->slots = (DedupSlot *)json_calloc(dedup->capacity, sizeof(DedupSlot));
+  if (!dedup->slots) {
+    json_free(dedup);
+    return NULL;
+  }
+  return dedup;
+}
+
+static int grow_table(JsonDedup *dedup) {
+  size_t capacity = dedup->capacity * 2;
+  DedupSlot *slots = (DedupSlot *)json_calloc(capacity, sizeof(DedupSlot));
+  if (!slots) {
+    return 0;
+  }
+  for (size_t i = 0; i < dedup->capacity; i++) {
+    if (dedup->slots[i].value) {
+      size_t j = dedup->slots[i].hash & (capacity - 1);
+      while (slots[j].value) {
+        j = (j + 1) & (capacity - 1);
+      }
+      slots[j] = dedup->slots[i];
+    }
+  }
+  json_free(dedup->slots);
+  dedup->slots = slots;
+  dedup->capacity = capacity;
+  return 1;
+}
+
+JsonValue *json_dedup_intern(JsonDedup *dedup, JsonValue *value) {
+  if (!dedup || !value || (value->flags & JSON_FLAG_LAZY)) {
+    return value;
+  }
+  uint64_t hash = shallow_hash(value);
+  size_t mask = dedup->capacity - 1;
+  size_t i = hash & mask;
+  for (; dedup->slots[i].value; i = (i + 1) & mask) {
+    JsonValue *interned = dedup->slots[i].value;
+    if (dedup->slots[i].hash != hash || !shallow_equal(interned, value)) {
+      continue;
+    }
+    if (interned == value || (interned->flags >> JSON_REF_SHIFT) == REF_MAX) {
+      return value;
+    }
+    interned->flags += JSON_REF_ONE;
+    free_json_value(value);
+    return interned;
+  }
+
+  // Keep the load factor under 3/4
+  if ((dedup->count + 1) * 4 > dedup->capacity * 3) {
+    if (!grow_table(dedup)) {
+      dedup->failed = 1;
+      return value;
+    }
+    mask = dedup->capacity - 1;
+    for (i = hash & mask; dedup->slots[i].value; i = (i + 1) & mask) {
+    }
+  }
+  // The table holds a reference, so values it points to stay alive even if
+  // the document drops them (a repeated key replaces its first value)
+  value->flags += JSON_REF_ONE;
+  dedup->slots[i].hash = hash;
+  dedup->slots[i].value = value;
+  dedup->count++;
+  return value;
+}
+
+int json_dedup_free(JsonDedup *dedup) {
+  if (!dedup) {
+    return 1;
+  }
+  for (size_t i = 0; i < dedup->capacity; i++) {
+    free_json_value(dedup->slots[i].value);
+  }
+  int ok = !dedup->failed;
+  json_free(dedup->slots);
+  json_free(dedup);
+  return ok;
+}
+
+// Interns the descendants of value, bottom-up
+static void intern_children(JsonDedup *dedup, JsonValue *value) {
+  if (value->flags & JSON_FLAG_LAZY) {
+    return;
+  }
+  if (value->type == JSON_ARRAY) {
+    size_t count;
+    if (json_array_packed(value, &count)) {
+      return;
+    }
+    for (JsonArrayItem *it = json_array_first(value); it; it = it->next) {
+      if (it->value->flags & JSON_FLAG_INLINE) {
+        continue;
+      }
+      intern_children(dedup, it->value);
+      it->value = json_dedup_intern(dedup, it->value);
+    }
+  } else if (value->type == JSON_OBJECT) {
+    for (JsonKeyValue *kv = value->value.object_head; kv; kv = kv->next) {
+      intern_children(dedup, kv->value);
+      kv->value = json_dedup_intern(dedup, kv->value);
+    }
+  }
+}
+
+/**
+ * Shares identical subtrees and repeated scalars of a tree
+ *
+ * Every value below the root that equals an earlier one (same type and
+ * contents, with object members in the same order) is replaced by a
+ * reference to it. Containers left unexpanded by lazy parsing are not
+ * looked into. See json_set_dedup to do this while parsing.
+ *
+ * @param value Root of the tree, which itself stays as it is
+ * @return 1 on success, 0 on allocation failure; the tree is valid either
+ *         way, with fewer values shared
+ */
+int json_dedup(JsonValue *value) {
+  if (!value) {
+    return 1;
+  }
+  JsonDedup *dedup = json_dedup_create();
+  if (!dedup) {
+    return 0;
+  }
+  intern_children(dedup, value);
+  return json_dedup_free(dedup);
+}
+
+/**
+ * Reports whether a value is shared by hash-consing
+ */
+int json_is_shared(const JsonValue *value) {
+  return value && value->flags >= JSON_REF_ONE;
+}
+
+/**
+ * Takes one more reference to a value, or copies it if it has as many as
+ * the count can hold
+ *
+ * @return The value or its copy, NULL on allocation failure
+ */
+JsonValue *json_share(JsonValue *child) {
+  if (child && (child->flags >> JSON_REF_SHIFT) < REF_MAX) {
+    child->flags += JSON_REF_ONE;
+    return child;
+  }
+  return clone_json_value(child);
+}
+
+// Copy of a container whose children are shared with it
+static JsonValue *copy_container(const JsonValue *value) {
+  JsonValue *copy = create_json_value(value->type);
+  if (!copy) {
+    return NULL;
+  }
+  if (value->flags & JSON_FLAG_PACKED) {
+    free_json_value(copy);
+    return clone_json_value(value);
+  }
+  if (value->type == JSON_ARRAY) {
+    for (JsonArrayItem *it = value->value.array_head; it; it = it->next) {
+      JsonValue *child = json_share(it->value);
+      if (!child || !add_to_array(copy, child)) {
+        free_json_value(child);
+        free_json_value(copy);
+        return NULL;
+      }
+    }
+    return copy;
+  }
+
+  // Members of a sorted object arrive in order, so each add appends
+  copy->flags = value->flags & JSON_FLAG_SORTED;
+  JsonKeyValue **tail = &copy->value.object_head;
+  for (JsonKeyValue *kv = value->value.object_head; kv; kv = kv->next) {
+    JsonValue *child = json_share(kv->value);
+    if (!child) {
+      free_json_value(copy);
+      return NULL;
+    }
+    if (copy->flags & JSON_FLAG_SORTED) {
+      if (!add_to_object(copy, kv->key, child)) {
+        free_json_value(child);
+        free_json_value(copy);
+        return NULL;
+      }
+      continue;
+    }
+    JsonKeyValue *member = (JsonKeyValue *)json_malloc(sizeof(*member));
+    if (!member || !(member->key = json_strdup(kv->key))) {
+      json_free(member);
+      free_json_value(child);
+      free_json_value(copy);
+      return NULL;
+    }
+    member->value = child;
+    member->next = NULL;
+    *tail = member;
+    tail = &member->next;
+  }
+  return copy;
+}
+
+/**
+ * Makes the value in a slot (a member or element, or a root pointer)
+ * private, so that it can be modified in place
+ *
+ * A shared value is replaced in the slot by a copy of its own; the
+ * children of a copied container stay shared, so modifying a value deep in
+ * a tree takes json_unshare on each slot on the way down.
+ *
+ * @return The value now in the slot, or NULL on allocation failure (the
+ *         slot is then unchanged)
+ */
+JsonValue *json_unshare(JsonValue **slot) {
+  if (!slot || !*slot || !json_is_shared(*slot)) {
+    return slot ? *slot : NULL;
+  }
+  JsonValue *value = *slot;
+  JsonValue *copy =
+      value->type == JSON_ARRAY || value->type == JSON_OBJECT
+          ? copy_container(value)
+          : clone_json_value(value);
+  if (!copy) {
+    return NULL;
+  }
+  value->flags -= JSON_REF_ONE;
+  *slot = copy;
+  return copy;
+}
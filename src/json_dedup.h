@@ -0,0 +1,30 @@
+/**
+ * json_dedup.h - Hash-consing table shared by the parser and json_dedup
+ *
+ * Internal to the library; not installed.
+ */
+
+#ifndef JSON_DEDUP_H
+#define JSON_DEDUP_H
+
+#include "json_config.h"
+
+typedef struct JsonDedup JsonDedup;
+
+// NULL on allocation failure
+JsonDedup *json_dedup_create(void);
+
+// Returns the value interned before that equals value, taking a reference
+// to it and freeing value, or else interns value and returns it. The
+// children of value must have been interned already. Values that cannot
+// be shared (lazy containers, or on allocation failure) are returned as is.
+JsonValue *json_dedup_intern(JsonDedup *dedup, JsonValue *value);
+
+// Drops the table's references; 0 if some value could not be interned
+int json_dedup_free(JsonDedup *dedup);
+
+// One more reference to value (a copy if its count is full); NULL on
+// allocation failure
+JsonValue *json_share(JsonValue *value);
+
+#endif /* JSON_DEDUP_H */
@@ -0,0 +1,272 @@
+/**
+ * json_journal.c - Append-only journal of 'set' operations
+ *
+ * Rewriting a whole config for every small change wears flash storage. In
+ * journaled mode a change is appended to <file>.journal as one line,
+ *
+ *   ["set","image.hflip","true"]
+ *
+ * and fsync'd. load_config replays the journal on top of the base file,
+ * and save_config (which writes the complete state) removes it. Once the
+ * journal grows past JCT_JOURNAL_COMPACT_BYTES it is compacted that way.
+ *
+ * A crash can only tear the last line; torn lines are skipped on replay,
+ * and the next append starts on a fresh line.
+ */
+
+#include "json_config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef JCT_JOURNAL_COMPACT_BYTES
+#define JCT_JOURNAL_COMPACT_BYTES (64 * 1024)
+#endif
+
+static int journal_path(const char *filepath, char *out, size_t out_size) {
+  if (snprintf(out, out_size, "%s.journal", filepath) >= (int)out_size) {
+    fprintf(stderr, "Error: Journal path for '%s' is too long\n", filepath);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Parses one journal line quietly; NULL if it is damaged
+ */
+static JsonValue *parse_record(const char *line, size_t len) {
+  JsonTokenizer *tok = json_tokenizer_create(line, len);
+  JsonToken token;
+  JsonValue *record = NULL;
+  if (tok && json_tokenizer_next(tok, &token)) {
+    record = json_tokenizer_read_value(tok, &token);
+  }
+  if (record &&
+      (!json_tokenizer_next(tok, &token) || token.type != JSON_TOKEN_END)) {
+    free_json_value(record);
+    record = NULL;
+  }
+  json_tokenizer_free(tok);
+  return record;
+}
+
+/**
+ * Applies one parsed record to config
+ *
+ * @return 1 if applied, 0 if the record is not a valid operation
+ */
+static int apply_record(JsonValue *config, JsonValue *record) {
+  if (record->type != JSON_ARRAY || get_array_size(record) != 3) {
+    return 0;
+  }
+  JsonValue *op = get_array_item(record, 0);
+  JsonValue *key = get_array_item(record, 1);
+  JsonValue *value = get_array_item(record, 2);
+  if (op->type != JSON_STRING || strcmp(op->value.string, "set") != 0 ||
+      key->type != JSON_STRING || value->type != JSON_STRING) {
+    return 0;
+  }
+  return set_nested_item(config, key->value.string, value->value.string);
+}
+
+/**
+ * Replays the journal of filepath, if any, on top of config
+ *
+ * @return 1 on success (including when there is no journal), 0 if the
+ *         journal exists but cannot be read
+ */
+int json_journal_replay(const char *filepath, JsonValue *config) {
+  char path[PATH_MAX];
+  if (!filepath || !config || !journal_path(filepath, path, sizeof(path))) {
+    return 0;
+  }
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    if (errno == ENOENT) {
+      return 1;
+    }
+    fprintf(stderr, "Error: Failed to open journal '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  unsigned long lineno = 0;
+  while ((len = getline(&line, &capacity, file)) > 0) {
+    lineno++;
+    if (line[len - 1] != '\n') {
+      break; // torn final append
+    }
+    if (len == 1) {
+      continue;
+    }
+    JsonValue *record = parse_record(line, (size_t)len - 1);
+    if (!record || !apply_record(config, record)) {
+      fprintf(stderr, "Warning: Skipping damaged record %lu in journal '%s'\n",
+              lineno, path);
+    }
+    free_json_value(record);
+  }
+  int ok = !ferror(file);
+  if (!ok) {
+    fprintf(stderr, "Error: Failed to read journal '%s': %s\n", path,
+            strerror(errno));
+  }
+  json_free(line);
+  fclose(file);
+  return ok;
+}
+
+/**
+ * Appends a record line to the journal and syncs it to storage
+ *
+ * @return The journal size after the append, or -1 on error (reported)
+ */
+static off_t append_record(const char *path, const char *record) {
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to open journal '%s': %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  // Start on a fresh line if the previous append was torn
+  struct stat st;
+  char last = '\n';
+  if (fstat(fd, &st) != 0 ||
+      (st.st_size > 0 && pread(fd, &last, 1, st.st_size - 1) != 1)) {
+    fprintf(stderr, "Error: Failed to read journal '%s': %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  size_t record_len = strlen(record);
+  size_t len = (last != '\n') + record_len + 1;
+  char *buf = (char *)json_malloc(len);
+  if (!buf) {
+    fprintf(stderr, "Error: Memory allocation failed for journal record\n");
+    close(fd);
+    return -1;
+  }
+  size_t pos = 0;
+  if (last != '\n') {
+    buf[pos++] = '\n';
+  }
+  memcpy(buf + pos, record, record_len);
+  buf[len - 1] = '\n';
+
+  // One write, so concurrent appends never interleave within a record
+  ssize_t written = write(fd, buf, len);
+  json_free(buf);
+  if (written != (ssize_t)len || fsync(fd) != 0) {
+    fprintf(stderr, "Error: Failed to append to journal '%s': %s\n", path,
+            written < 0 || written == (ssize_t)len ? strerror(errno)
+                                                   : "short write");
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return st.st_size + (off_t)len;
+}
+
+// Appends a copy of str to array; 0 on allocation failure
+static int add_string(JsonValue *array, const char *str) {
+  JsonValue *value = create_json_value(JSON_STRING);
+  if (!value || !(value->value.string = json_strdup(str)) ||
+      !add_to_array(array, value)) {
+    free_json_value(value);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Sets a key through the journal instead of rewriting the file
+ *
+ * config is the current state of filepath as returned by load_config; the
+ * change is applied to it and appended to the journal. When the journal
+ * exceeds JCT_JOURNAL_COMPACT_BYTES, config is saved in full instead.
+ *
+ * @return 1 on success, 0 on error (reported)
+ */
+int json_journal_set(const char *filepath, JsonValue *config, const char *key,
+                     const char *value_str) {
+  char path[PATH_MAX];
+  if (!filepath || !config || !key || !value_str ||
+      !journal_path(filepath, path, sizeof(path))) {
+    return 0;
+  }
+  if (!set_nested_item(config, key, value_str)) {
+    fprintf(stderr, "Error: Failed to set key '%s' in config file.\n", key);
+    return 0;
+  }
+
+  JsonValue *record = create_json_value(JSON_ARRAY);
+  char *line = NULL;
+  if (record && add_string(record, "set") && add_string(record, key) &&
+      add_string(record, value_str)) {
+    line = json_to_string(record, 0);
+  }
+  free_json_value(record);
+  if (!line) {
+    fprintf(stderr, "Error: Failed to encode journal record\n");
+    return 0;
+  }
+
+  off_t size = append_record(path, line);
+  json_free(line);
+  if (size < 0) {
+    return 0;
+  }
+  if (size > JCT_JOURNAL_COMPACT_BYTES) {
+    return save_config(filepath, config);
+  }
+  return 1;
+}
+
+/**
+ * Merges the journal of filepath into the file
+ *
+ * @return 1 on success (including when there is no journal), 0 on error
+ */
+int json_journal_compact(const char *filepath) {
+  char path[PATH_MAX];
+  if (!filepath || !journal_path(filepath, path, sizeof(path))) {
+    return 0;
+  }
+  if (access(path, F_OK) != 0) {
+    return 1;
+  }
+  JsonValue *config = load_config(filepath);
+  if (!config) {
+    return 0;
+  }
+  int success = save_config(filepath, config);
+  free_json_value(config);
+  return success;
+}
+
+/**
+ * Removes the journal of filepath after its changes were saved
+ *
+ * @return 1 on success (including when there is no journal), 0 on error
+ */
+int json_journal_discard(const char *filepath) {
+  char path[PATH_MAX];
+  if (!filepath || !journal_path(filepath, path, sizeof(path))) {
+    return 0;
+  }
+  if (unlink(path) != 0 && errno != ENOENT) {
+    fprintf(stderr, "Error: Failed to remove journal '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+  return 1;
+}
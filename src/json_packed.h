@@ -0,0 +1,20 @@
+/**
+ * json_packed.h - Layout of packed arrays of numbers
+ *
+ * Internal to the library; not installed. The parser stores an array
+ * whose elements are all numbers as one block instead of an item and a
+ * value allocation per element (see JSON_FLAG_PACKED).
+ */
+
+#ifndef JSON_PACKED_H
+#define JSON_PACKED_H
+
+#include "json_config.h"
+
+struct JsonPackedArray {
+  size_t count;         // at least 1
+  JsonArrayItem *items; // links over the elements, made by the first walk
+  JsonValue values[];   // the elements, flagged JSON_FLAG_INLINE
+};
+
+#endif /* JSON_PACKED_H */
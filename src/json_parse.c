@@ -3,17 +3,72 @@
  */
 
 #include "json_config.h"
+#include "json_compress.h"
+#include "json_dedup.h"
+#include "json_packed.h"
+#include "json_pattern.h"
+#include "json_simd.h"
+#include "json_source.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File contents loaded for parsing: a read-only mapping or a heap buffer
+typedef struct {
+  const char *data;
+  size_t len;
+  void *mapped;
+  size_t mapped_len;
+  char *heap;
+} JsonFileData;
+
+// Source range of an unexpanded container, allocated with it
+struct JsonSpan {
+  size_t open;  // offset of '{' or '['
+  size_t close; // offset of the matching bracket
+  char *source; // the document's source (see LazyDocument)
+};
+
+// A lazily parsed document: the root value and the source its lazy values
+// point into. That is the loaded file, taken over (a mapping made
+// writable, or a heap buffer), or else a copy of the input after the block.
+typedef struct {
+  JsonValue root;
+  JsonFileData file;
+  char copy[];
+} LazyDocument;
 
 // Simple JSON parser state
 typedef struct {
   const char *json;
   size_t pos;
   size_t len;
+  // Writable copy of json owned by the document being built (lazy scalar
+  // mode), or NULL to decode every scalar into its own allocation
+  char *source;
+  // Lazy containers: containers other than the one opening at expand are
+  // left unexpanded, as ranges of source
+  int lazy;
+  size_t expand;
+  // Arrays of numbers are parsed into packed arrays
+  int packed;
+  // Hash-consing table values are interned in as they complete, or NULL
+  JsonDedup *dedup;
+  // Selective parse: values no pattern reaches are skipped (patterns is
+  // NULL below a selected value, or to build everything); path holds the
+  // steps down to the value being parsed
+  const JsonPattern *patterns;
+  size_t pattern_count;
+  JsonPathStep *path;
+  int depth;
+  int path_capacity;
 } JsonParser;
 
 // Function prototypes for internal use
@@ -23,6 +78,10 @@ static JsonValue *parse_value(JsonParser *parser);
 static JsonValue *parse_array(JsonParser *parser);
 static JsonValue *parse_object(JsonParser *parser);
 static JsonValue *parse_number(JsonParser *parser);
+static int starts_number(char c);
+static int read_number(JsonParser *parser, JsonValue *value);
+static int parse_selected(JsonParser *parser, const char *name, long index,
+                          JsonValue **out);
 
 // Function to skip whitespace
 static void skip_whitespace(JsonParser *parser) {
@@ -42,27 +101,25 @@ static char *parse_string(JsonParser *parser) {
 
   parser->pos++; // Skip opening quote
 
-  // Find the closing quote and count actual characters needed
-  int escaped = 0;
+  const char *json = parser->json;
+  size_t start = parser->pos;
   size_t actual_len = 0;
+  int has_escapes = 0;
 
-  // First pass: find the end and count unescaped length
-  size_t temp_pos = parser->pos;
+  // First pass: find the end and count unescaped length, jumping over plain
+  // runs with the vectorized scanner
+  size_t temp_pos = start;
   while (temp_pos < parser->len) {
-    char c = parser->json[temp_pos];
-
-    if (escaped) {
-      escaped = 0;
-      actual_len++; // Each escape sequence becomes one character
-    } else if (c == '\\') {
-      escaped = 1;
-    } else if (c == '"') {
+    size_t run = json_scan_string(json + temp_pos, parser->len - temp_pos);
+    temp_pos += run;
+    actual_len += run;
+    if (temp_pos >= parser->len || json[temp_pos] == '"') {
       break;
-    } else {
-      actual_len++;
     }
-
-    temp_pos++;
+    // Backslash: each escape sequence becomes one character
+    has_escapes = 1;
+    temp_pos += 2;
+    actual_len++;
   }
 
   if (temp_pos >= parser->len) {
@@ -70,67 +127,194 @@ static char *parse_string(JsonParser *parser) {
   }
 
   // Allocate memory for the unescaped string
-  char *str = (char *)malloc(actual_len + 1);
+  char *str = (char *)json_malloc(actual_len + 1);
   if (!str) {
     return NULL;
   }
 
-  // Second pass: copy and unescape the string
+  if (!has_escapes) {
+    memcpy(str, json + start, actual_len);
+    str[actual_len] = '\0';
+    parser->pos = temp_pos + 1; // Skip closing quote
+    return str;
+  }
+
+  // Second pass: copy plain runs and unescape the sequences between them
   size_t j = 0;
-  escaped = 0;
-  while (parser->pos < parser->len) {
-    char c = parser->json[parser->pos];
+  size_t pos = start;
+  while (pos < temp_pos) {
+    size_t run = json_scan_string(json + pos, temp_pos - pos);
+    memcpy(str + j, json + pos, run);
+    j += run;
+    pos += run;
+    if (pos >= temp_pos) {
+      break;
+    }
 
-    if (escaped) {
-      // Handle escape sequences
-      switch (c) {
-      case '"':
-        str[j++] = '"';
-        break;
-      case '\\':
-        str[j++] = '\\';
-        break;
-      case 'b':
-        str[j++] = '\b';
-        break;
-      case 'f':
-        str[j++] = '\f';
-        break;
-      case 'n':
-        str[j++] = '\n';
-        break;
-      case 'r':
-        str[j++] = '\r';
-        break;
-      case 't':
-        str[j++] = '\t';
-        break;
-      case '/':
-        str[j++] = '/';
-        break;
-      default:
-        // For unrecognized escape sequences, keep the character as-is
-        str[j++] = c;
-        break;
-      }
-      escaped = 0;
-    } else if (c == '\\') {
-      escaped = 1;
-    } else if (c == '"') {
+    // Handle escape sequences
+    char c = json[pos + 1];
+    switch (c) {
+    case '"':
+      str[j++] = '"';
       break;
-    } else {
+    case '\\':
+      str[j++] = '\\';
+      break;
+    case 'b':
+      str[j++] = '\b';
+      break;
+    case 'f':
+      str[j++] = '\f';
+      break;
+    case 'n':
+      str[j++] = '\n';
+      break;
+    case 'r':
+      str[j++] = '\r';
+      break;
+    case 't':
+      str[j++] = '\t';
+      break;
+    case '/':
+      str[j++] = '/';
+      break;
+    default:
+      // For unrecognized escape sequences, keep the character as-is
       str[j++] = c;
+      break;
     }
-
-    parser->pos++;
+    pos += 2;
   }
 
-  parser->pos++; // Skip closing quote
+  parser->pos = temp_pos + 1; // Skip closing quote
   str[j] = '\0';
 
   return str;
 }
 
+/**
+ * Lazy mode: returns a string without escapes as a view into the source
+ *
+ * The closing quote is overwritten with the terminator. Returns NULL
+ * without consuming anything if the string has escapes or is unterminated,
+ * leaving it to parse_string.
+ */
+static JsonValue *parse_string_view(JsonParser *parser) {
+  size_t start = parser->pos + 1;
+  size_t end = start + json_scan_string(parser->json + start,
+                                        parser->len - start);
+  if (end >= parser->len || parser->json[end] != '"') {
+    return NULL;
+  }
+
+  JsonValue *value = create_json_value(JSON_STRING);
+  if (!value) {
+    return NULL;
+  }
+  parser->source[end] = '\0';
+  value->flags = JSON_FLAG_BORROWED;
+  value->value.string = parser->source + start;
+  parser->pos = end + 1;
+  return value;
+}
+
+// Options of one parse, with its selection parsed into patterns
+typedef struct {
+  JsonParseOptions options;
+  JsonPattern *patterns;
+  size_t pattern_count;
+} ParseSettings;
+
+// Options set by the json_set_* functions, used by the parse functions
+// that take none
+static ParseSettings defaults;
+
+/**
+ * Enables or disables packed number arrays for parsed documents
+ *
+ * Arrays whose elements are all numbers are then stored as one block of
+ * values (see JSON_FLAG_PACKED), whose value.array_head is not set; code
+ * reading the elements must go through get_array_item, json_array_first
+ * or json_array_packed.
+ *
+ * @param enabled Non-zero to pack arrays of numbers
+ */
+void json_set_packed_arrays(int enabled) {
+  defaults.options.packed_arrays = enabled;
+}
+
+/**
+ * Parses the elements of an array of numbers into one block (see
+ * JSON_FLAG_PACKED) and makes array a packed array of them
+ *
+ * Starts at the first element. If an element is not a number or the block
+ * cannot be allocated, returns 0 with the parser back at the first element,
+ * and the array is parsed the usual way.
+ */
+static int parse_packed_array(JsonParser *parser, JsonValue *array) {
+  size_t start = parser->pos;
+  JsonPackedArray *block = NULL;
+  size_t capacity = 0;
+  size_t count = 0;
+
+  for (;;) {
+    skip_whitespace(parser);
+    if (parser->pos >= parser->len ||
+        !starts_number(parser->json[parser->pos])) {
+      break;
+    }
+    if (count == capacity) {
+      size_t ncap = capacity ? capacity * 2 : 8;
+      if (ncap > (SIZE_MAX - sizeof(JsonPackedArray)) / sizeof(JsonValue)) {
+        break;
+      }
+      JsonPackedArray *grown = (JsonPackedArray *)json_realloc(
+          block, sizeof(JsonPackedArray) + ncap * sizeof(JsonValue));
+      if (!grown) {
+        break;
+      }
+      block = grown;
+      capacity = ncap;
+    }
+    // Elements hold no allocations of their own until the array is built
+    JsonValue *value = &block->values[count];
+    memset(value, 0, sizeof(*value));
+    value->type = JSON_NUMBER;
+    value->flags = JSON_FLAG_INLINE;
+    if (!read_number(parser, value)) {
+      break;
+    }
+    count++;
+
+    skip_whitespace(parser);
+    if (parser->pos < parser->len && parser->json[parser->pos] == ',') {
+      parser->pos++;
+      continue;
+    }
+    if (parser->pos >= parser->len || parser->json[parser->pos] != ']') {
+      break;
+    }
+    parser->pos++; // Skip closing bracket
+
+    if (count < capacity) {
+      JsonPackedArray *shrunk = (JsonPackedArray *)json_realloc(
+          block, sizeof(JsonPackedArray) + count * sizeof(JsonValue));
+      if (shrunk) {
+        block = shrunk;
+      }
+    }
+    block->count = count;
+    block->items = NULL;
+    array->flags |= JSON_FLAG_PACKED;
+    array->value.packed = block;
+    return 1;
+  }
+
+  json_free(block);
+  parser->pos = start;
+  return 0;
+}
+
 // Function to parse a JSON array
 static JsonValue *parse_array(JsonParser *parser) {
   if (parser->pos >= parser->len || parser->json[parser->pos] != '[') {
@@ -151,17 +335,44 @@ static JsonValue *parse_array(JsonParser *parser) {
     return array;
   }
 
-  // Parse array elements
+  // Elements are selected one by one, so only whole arrays are packed
+  if (parser->packed && !parser->patterns && parser->pos < parser->len &&
+      starts_number(parser->json[parser->pos]) &&
+      parse_packed_array(parser, array)) {
+    return array;
+  }
+
+  // Parse array elements. Elements skipped by a selection are kept as
+  // nulls when a later one is selected, so that it keeps its index; they
+  // all share one value.
+  long index = 0;
+  long skipped = 0;
+  JsonValue *null_value = NULL;
   while (parser->pos < parser->len) {
     skip_whitespace(parser);
 
-    JsonValue *value = parse_value(parser);
-    if (!value) {
+    JsonValue *value = NULL;
+    if (!parse_selected(parser, NULL, index++, &value)) {
       free_json_value(array);
       return NULL;
     }
+    value = json_dedup_intern(parser->dedup, value);
 
-    if (!add_to_array(array, value)) {
+    if (!value) {
+      skipped++;
+    }
+    for (; value && skipped > 0; skipped--) {
+      JsonValue *placeholder = null_value ? json_share(null_value)
+                                          : create_json_value(JSON_NULL);
+      if (!placeholder || !add_to_array(array, placeholder)) {
+        free_json_value(placeholder);
+        free_json_value(value);
+        free_json_value(array);
+        return NULL;
+      }
+      null_value = placeholder;
+    }
+    if (value && !add_to_array(array, value)) {
       free_json_value(value);
       free_json_value(array);
       return NULL;
@@ -221,7 +432,7 @@ static JsonValue *parse_object(JsonParser *parser) {
 
     // Check for colon
     if (parser->pos >= parser->len || parser->json[parser->pos] != ':') {
-      free(key);
+      json_free(key);
       free_json_value(object);
       return NULL;
     }
@@ -230,27 +441,32 @@ static JsonValue *parse_object(JsonParser *parser) {
     skip_whitespace(parser);
 
     // Parse value
-    JsonValue *value = parse_value(parser);
-    if (!value) {
-      free(key);
+    JsonValue *value = NULL;
+    if (!parse_selected(parser, key, -1, &value)) {
+      json_free(key);
       free_json_value(object);
       return NULL;
     }
+    value = json_dedup_intern(parser->dedup, value);
 
-    // Add key-value pair to object
-    if (!add_to_object(object, key, value)) {
-      free(key);
+    // Add key-value pair to object; the key moves into it, and repeated
+    // keys are resolved once the object is complete
+    if (!value) {
+      json_free(key);
+    } else if (!json_object_add_owned(object, key, value)) {
       free_json_value(value);
       free_json_value(object);
       return NULL;
     }
 
-    free(key); // Key is copied in add_to_object
-
     skip_whitespace(parser);
 
     if (parser->pos < parser->len && parser->json[parser->pos] == '}') {
       parser->pos++; // Skip closing brace
+      if (!json_object_unique_keys(object)) {
+        free_json_value(object);
+        return NULL;
+      }
       return object;
     }
 
@@ -266,17 +482,59 @@ static JsonValue *parse_object(JsonParser *parser) {
   return NULL; // Unterminated object
 }
 
-// Function to parse a JSON number
-static JsonValue *parse_number(JsonParser *parser) {
-  if (parser->pos >= parser->len) {
-    return NULL;
+/**
+ * Checks a lexeme against the JSON number grammar
+ *
+ * parse_number accepts looser input (a leading '+' or '.', signs anywhere);
+ * only strict lexemes are kept raw, so their verbatim output stays valid.
+ */
+static int is_json_number(const char *s, size_t len) {
+  size_t i = 0;
+  if (i < len && s[i] == '-') {
+    i++;
   }
-
-  // Check if it's a number
-  char c = parser->json[parser->pos];
-  if (!isdigit(c) && c != '-' && c != '+' && c != '.') {
-    return NULL;
+  if (i < len && s[i] == '0') {
+    i++;
+  } else if (i < len && s[i] >= '1' && s[i] <= '9') {
+    while (i < len && isdigit((unsigned char)s[i])) {
+      i++;
+    }
+  } else {
+    return 0;
   }
+  if (i < len && s[i] == '.') {
+    size_t digits = ++i;
+    while (i < len && isdigit((unsigned char)s[i])) {
+      i++;
+    }
+    if (i == digits) {
+      return 0;
+    }
+  }
+  if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+    i++;
+    if (i < len && (s[i] == '+' || s[i] == '-')) {
+      i++;
+    }
+    size_t digits = i;
+    while (i < len && isdigit((unsigned char)s[i])) {
+      i++;
+    }
+    if (i == digits) {
+      return 0;
+    }
+  }
+  return i == len;
+}
+
+static int starts_number(char c) {
+  return isdigit((unsigned char)c) || c == '-' || c == '+' || c == '.';
+}
+
+// Reads the number at the parser position into a value of type JSON_NUMBER,
+// either created or an element of a packed array; 0 on allocation failure
+static int read_number(JsonParser *parser, JsonValue *value) {
+  char c;
 
   // Find the end of the number
   size_t start = parser->pos;
@@ -305,39 +563,96 @@ static JsonValue *parse_number(JsonParser *parser) {
     parser->pos++;
   }
 
-  // Extract the number string
+  // Lazy mode: keep a valid lexeme in the source and decode it on access.
+  // Its length is recovered with strspn (json_number_lexeme), so it must
+  // not run into further number characters.
   size_t len = parser->pos - start;
-  char *num_str = (char *)malloc(len + 1);
+  if (parser->source && is_json_number(parser->json + start, len) &&
+      strspn(parser->source + start, "0123456789+-.eE") == len) {
+    value->flags |= JSON_FLAG_RAW_NUMBER | JSON_FLAG_BORROWED;
+    value->value.string = parser->source + start;
+    return 1;
+  }
+
+  // Extract the number string; short ones, the usual case, on the stack
+  char buffer[64];
+  char *num_str =
+      len < sizeof(buffer) ? buffer : (char *)json_malloc(len + 1);
   if (!num_str) {
-    return NULL;
+    return 0;
   }
 
   memcpy(num_str, parser->json + start, len);
   num_str[len] = '\0';
 
   // Convert to number
-  double num = strtod(num_str, NULL);
-  free(num_str);
+  value->value.number = strtod(num_str, NULL);
+  if (num_str != buffer) {
+    json_free(num_str);
+  }
+  return 1;
+}
+
+// Function to parse a JSON number
+static JsonValue *parse_number(JsonParser *parser) {
+  if (parser->pos >= parser->len || !starts_number(parser->json[parser->pos])) {
+    return NULL;
+  }
 
-  // Create JSON number value
   JsonValue *value = create_json_value(JSON_NUMBER);
-  if (!value) {
+  if (value && !read_number(parser, value)) {
+    free_json_value(value);
+    return NULL;
+  }
+  return value;
+}
+
+static int skip_value(JsonParser *parser);
+
+/**
+ * Lazy containers: returns the container at the parser position unexpanded,
+ * skipping to its end with a scan of its strings and brackets
+ */
+static JsonValue *lazy_container(JsonParser *parser) {
+  size_t open = parser->pos;
+  if (!skip_value(parser)) {
     return NULL;
   }
 
-  value->value.number = num;
+  JsonSpan *span = (JsonSpan *)json_malloc(sizeof(JsonSpan));
+  JsonValue *value = span ? create_json_value(parser->json[open] == '{'
+                                                  ? JSON_OBJECT
+                                                  : JSON_ARRAY)
+                          : NULL;
+  if (!value) {
+    json_free(span);
+    return NULL;
+  }
+  span->open = open;
+  span->close = parser->pos - 1;
+  span->source = parser->source;
+  value->flags = JSON_FLAG_LAZY;
+  if (parser->packed) {
+    value->flags |= JSON_FLAG_PACK_ARRAYS;
+  }
+  value->value.lazy = span;
   return value;
 }
 
 // Function to parse a JSON value
 static JsonValue *parse_value(JsonParser *parser) {
+  skip_whitespace(parser);
+
+  // The buffer need not be NUL-terminated, so never read past len
   if (parser->pos >= parser->len) {
     return NULL;
   }
 
-  skip_whitespace(parser);
-
   char c = parser->json[parser->pos];
+  if ((c == '{' || c == '[') && parser->lazy &&
+      parser->pos != parser->expand) {
+    return lazy_container(parser);
+  }
 
   switch (c) {
   case '{':
@@ -345,6 +660,13 @@ static JsonValue *parse_value(JsonParser *parser) {
   case '[':
     return parse_array(parser);
   case '"': {
+    if (parser->source) {
+      JsonValue *view = parse_string_view(parser);
+      if (view) {
+        return view;
+      }
+    }
+
     char *str = parse_string(parser);
     if (!str) {
       return NULL;
@@ -352,7 +674,7 @@ static JsonValue *parse_value(JsonParser *parser) {
 
     JsonValue *value = create_json_value(JSON_STRING);
     if (!value) {
-      free(str);
+      json_free(str);
       return NULL;
     }
 
@@ -409,6 +731,428 @@ static JsonValue *parse_value(JsonParser *parser) {
   }
 }
 
+/**
+ * Skips the value at the parser position without building it
+ *
+ * Only strings and brackets are looked at, so this runs at scan speed but
+ * does not check that the value is valid JSON.
+ *
+ * @return 0 if the value is missing or its end cannot be found
+ */
+static int skip_value(JsonParser *parser) {
+  const char *json = parser->json;
+  size_t pos = parser->pos;
+  size_t depth = 0;
+  while (pos < parser->len) {
+    char c = json[pos];
+    if (c == '"') {
+      pos++;
+      for (;;) {
+        if (pos >= parser->len) {
+          return 0;
+        }
+        pos += json_scan_string(json + pos, parser->len - pos);
+        if (pos >= parser->len) {
+          return 0;
+        }
+        if (json[pos] == '"') {
+          break;
+        }
+        pos += 2; // Backslash and the escaped character
+      }
+      pos++;
+      if (depth == 0) {
+        break;
+      }
+      continue;
+    }
+    if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        break; // End of the enclosing container
+      }
+      if (--depth == 0) {
+        pos++;
+        break;
+      }
+    } else if (depth == 0 &&
+               (c == ',' || c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
+      break;
+    }
+    pos++;
+  }
+  if (depth > 0 || pos == parser->pos) {
+    return 0;
+  }
+  parser->pos = pos;
+  return 1;
+}
+
+static int is_empty_container(const JsonValue *value) {
+  if (value->type == JSON_OBJECT) {
+    return !value->value.object_head;
+  }
+  return value->type == JSON_ARRAY && !(value->flags & JSON_FLAG_PACKED) &&
+         !value->value.array_head;
+}
+
+/**
+ * Parses the value of a member (name) or element (index) into *out
+ *
+ * While selecting, a value that no pattern reaches is skipped and *out
+ * left NULL. So is a container that turns out to hold no selected value,
+ * so that selections do not leave empty shells behind.
+ *
+ * @return 1 on success, 0 on invalid JSON or allocation failure
+ */
+static int parse_selected(JsonParser *parser, const char *name, long index,
+                          JsonValue **out) {
+  *out = NULL;
+  if (!parser->patterns) {
+    *out = parse_value(parser);
+    return *out != NULL;
+  }
+
+  if (parser->depth == parser->path_capacity) {
+    int capacity = parser->path_capacity ? parser->path_capacity * 2 : 16;
+    JsonPathStep *path = (JsonPathStep *)json_realloc(
+        parser->path, capacity * sizeof(JsonPathStep));
+    if (!path) {
+      return 0;
+    }
+    parser->path = path;
+    parser->path_capacity = capacity;
+  }
+  JsonPathStep *step = &parser->path[parser->depth++];
+  step->name = name;
+  step->len = name ? strlen(name) : 0;
+  step->index = index;
+  step->owned = NULL;
+
+  JsonMatch best = JSON_MATCH_NONE;
+  for (size_t i = 0; i < parser->pattern_count && best != JSON_MATCH_FULL;
+       i++) {
+    JsonMatch m =
+        json_pattern_match(&parser->patterns[i], parser->path, parser->depth);
+    if (m > best) {
+      best = m;
+    }
+  }
+
+  char c = parser->pos < parser->len ? parser->json[parser->pos] : '\0';
+  int ok;
+  if (best == JSON_MATCH_FULL) {
+    // Everything below a selected value is built
+    const JsonPattern *patterns = parser->patterns;
+    parser->patterns = NULL;
+    *out = parse_value(parser);
+    parser->patterns = patterns;
+    ok = *out != NULL;
+  } else if (best == JSON_MATCH_PREFIX && (c == '{' || c == '[')) {
+    *out = parse_value(parser);
+    ok = *out != NULL;
+    if (ok && is_empty_container(*out)) {
+      free_json_value(*out);
+      *out = NULL;
+    }
+  } else {
+    ok = skip_value(parser);
+  }
+  parser->depth--;
+  return ok;
+}
+
+// Maximum accepted input size in bytes (0 means unlimited)
+static size_t max_input_size = JCT_DEFAULT_SIZE_LIMIT;
+
+/**
+ * Sets the maximum size of JSON input accepted by the parse functions
+ *
+ * @param bytes Limit in bytes, or 0 to disable the check
+ */
+void json_set_max_input_size(size_t bytes) {
+  max_input_size = bytes;
+}
+
+/**
+ * Returns the limit set by json_set_max_input_size (0 if unlimited)
+ */
+size_t json_max_input_size(void) {
+  return max_input_size;
+}
+
+/**
+ * Enables or disables sorting object keys of parsed documents
+ *
+ * Sorted objects answer lookups with a binary search, which suits
+ * read-mostly configs; key order from the input is not preserved.
+ *
+ * @param enabled Non-zero to sort keys after parsing
+ */
+void json_set_sorted_keys(int enabled) {
+  defaults.options.sorted_keys = enabled;
+}
+
+/**
+ * Enables or disables lazy scalar decoding for parsed documents
+ *
+ * Numbers stay as their source lexeme until read with json_number_value,
+ * and strings without escapes point into the input kept with the document
+ * instead of being copied one by one. A file's mapping or read buffer is
+ * taken over by the document; other input is copied. Untouched numbers are
+ * serialized verbatim, so they round-trip exactly.
+ *
+ * @param enabled Non-zero to parse scalars lazily
+ */
+void json_set_lazy_scalars(int enabled) {
+  defaults.options.lazy_scalars = enabled;
+}
+
+/**
+ * Enables or disables lazy containers for parsed documents
+ *
+ * Parsing then only finds where the root ends. A container is expanded
+ * into its members or elements when first walked (get_object_item,
+ * get_array_item, json_object_first, ...): its bytes are scanned once and
+ * its own children are left unexpanded in turn, as byte ranges, so reading
+ * a few values of a large document parses little more than the containers
+ * on their paths and allocates nothing for the rest. Errors inside a
+ * container are only reported when it is expanded. Reading a document may
+ * modify it, so concurrent readers must lock it.
+ *
+ * Implies lazy scalars.
+ *
+ * @param enabled Non-zero to expand containers on first access
+ */
+void json_set_lazy_containers(int enabled) {
+  defaults.options.lazy_containers = enabled;
+}
+
+/**
+ * Enables or disables hash-consing of parsed documents
+ *
+ * Values are interned as the parser completes them, so a duplicate is
+ * freed as soon as it is read and peak memory stays close to that of the
+ * deduplicated document. Containers left unexpanded by lazy parsing are
+ * not shared.
+ *
+ * @param enabled Non-zero to share identical values (see json_dedup)
+ */
+void json_set_dedup(int enabled) {
+  defaults.options.dedup = enabled;
+}
+
+static void free_patterns(JsonPattern *patterns, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    json_pattern_free(&patterns[i]);
+  }
+  json_free(patterns);
+}
+
+// Parses comma-separated patterns; 0 if one is malformed or on allocation
+// failure
+static int parse_patterns(const char *text, JsonPattern **out,
+                          size_t *out_count) {
+  size_t count = 1;
+  for (const char *p = text; *p; p++) {
+    count += *p == ',';
+  }
+  JsonPattern *patterns =
+      (JsonPattern *)json_calloc(count, sizeof(JsonPattern));
+  if (!patterns) {
+    return 0;
+  }
+  const char *p = text;
+  for (size_t i = 0; i < count; i++) {
+    size_t len = strcspn(p, ",");
+    if (!json_pattern_parse(&patterns[i], p, len)) {
+      free_patterns(patterns, i + 1);
+      return 0;
+    }
+    p += len + 1;
+  }
+  *out = patterns;
+  *out_count = count;
+  return 1;
+}
+
+/**
+ * Restricts parsed documents to the values matching some patterns
+ *
+ * Patterns are dotted paths with '*' and '..' wildcards, as 'transform'
+ * takes them (video.*, ..enabled, optionally starting with "$."). Only the
+ * matching values and the containers leading to them are built; the rest
+ * of the input is skipped with a scan that does not check it is valid
+ * JSON. Containers holding no selected value are left out; in arrays they
+ * become nulls before a selected element, which keeps its index, and are
+ * dropped after the last one. Documents are parsed without
+ * lazy scalars or containers while selecting, so that nothing of the
+ * input is kept.
+ *
+ * @param patterns Comma-separated patterns, or NULL to build everything
+ * @return 1 on success, 0 if a pattern is malformed or on allocation
+ *         failure (nothing is selected then)
+ */
+int json_set_select(const char *patterns) {
+  free_patterns(defaults.patterns, defaults.pattern_count);
+  defaults.patterns = NULL;
+  defaults.pattern_count = 0;
+  return !patterns || parse_patterns(patterns, &defaults.patterns,
+                                     &defaults.pattern_count);
+}
+
+static void release_json_file_data(JsonFileData *file) {
+  if (file->mapped) {
+    munmap(file->mapped, file->mapped_len);
+  }
+  json_free(file->heap);
+  memset(file, 0, sizeof(*file));
+}
+
+void json_release_source(JsonValue *root) {
+  release_json_file_data(&((LazyDocument *)root)->file);
+}
+
+// Whether a lazy document can keep file's contents as its source: they
+// must be writable, and lexemes are read up to the first byte that cannot
+// continue them, so the input must not end inside one
+static int take_file_data(JsonFileData *file) {
+  if (!file || file->len == 0 ||
+      memchr("0123456789+-.eE", file->data[file->len - 1], 15)) {
+    return 0;
+  }
+  if (file->mapped) {
+    return mprotect(file->mapped, file->mapped_len,
+                    PROT_READ | PROT_WRITE) == 0;
+  }
+  return file->heap != NULL;
+}
+
+/**
+ * Parse JSON from a buffer of known length (need not be NUL-terminated)
+ *
+ * file holds buf if it was loaded from a file (else NULL); a lazy document
+ * takes its contents over instead of copying them, and clears it.
+ */
+static JsonValue *parse_json_buffer(const char *buf, size_t len,
+                                    JsonFileData *file,
+                                    const ParseSettings *settings) {
+  const JsonParseOptions *opt = &settings->options;
+  JsonParser parser = {
+      .json = buf, .pos = 0, .len = len, .packed = opt->packed_arrays};
+
+  LazyDocument *doc = NULL;
+  if ((opt->lazy_scalars || opt->lazy_containers) && !settings->patterns) {
+    int take = take_file_data(file);
+    if (!take && len > SIZE_MAX - sizeof(LazyDocument) - 1) {
+      fprintf(stderr, "Error: JSON source too large\n");
+      return NULL;
+    }
+    doc = (LazyDocument *)json_malloc(sizeof(LazyDocument) +
+                                      (take ? 0 : len + 1));
+    if (!doc) {
+      fprintf(stderr, "Error: Memory allocation failed for JSON source\n");
+      return NULL;
+    }
+    char *source;
+    if (take) {
+      doc->file = *file;
+      memset(file, 0, sizeof(*file));
+      source = doc->file.mapped ? (char *)doc->file.mapped : doc->file.heap;
+    } else {
+      memset(&doc->file, 0, sizeof(doc->file));
+      source = doc->copy;
+      memcpy(source, buf, len);
+      source[len] = '\0';
+    }
+    parser.json = parser.source = source;
+    if (opt->lazy_containers) {
+      parser.lazy = 1;
+      parser.expand = SIZE_MAX; // leave the root unexpanded too
+    }
+  }
+
+  if (opt->dedup) {
+    parser.dedup = json_dedup_create(); // without it, nothing is shared
+  }
+  parser.patterns = settings->patterns;
+  parser.pattern_count = settings->pattern_count;
+  JsonValue *result = parse_value(&parser);
+  json_dedup_free(parser.dedup);
+  json_free(parser.path);
+  if (doc) {
+    // Move the root into the block, so freeing the root frees the source
+    if (!result) {
+      release_json_file_data(&doc->file);
+      json_free(doc);
+      return NULL;
+    }
+    doc->root = *result;
+    doc->root.flags |= JSON_FLAG_OWNS_SOURCE;
+    json_free(result);
+    result = &doc->root;
+  }
+  if (result && opt->sorted_keys && !sort_json_keys(result)) {
+    fprintf(stderr, "Error: Memory allocation failed while sorting keys\n");
+    free_json_value(result);
+    return NULL;
+  }
+
+  // Check if the entire buffer was parsed
+  skip_whitespace(&parser);
+  if (result && parser.pos < parser.len) {
+    fprintf(stderr, "Warning: Extra characters found after JSON data\n");
+  }
+
+  return result;
+}
+
+/**
+ * Expands a lazy container into members or elements, which are lazy in turn
+ *
+ * Takes a const value because expanding does not change what it denotes;
+ * the accessors call this before walking a container.
+ *
+ * @return 1 on success (or if value is not lazy), 0 if the container is
+ *         not valid JSON (reported) or on allocation failure
+ */
+int json_expand(const JsonValue *value) {
+  if (!value || !(value->flags & JSON_FLAG_LAZY)) {
+    return 1;
+  }
+
+  const JsonSpan *span = value->value.lazy;
+  JsonParser parser = {.json = span->source,
+                       .pos = span->open,
+                       .len = span->close + 1,
+                       .source = span->source,
+                       .lazy = 1,
+                       .expand = span->open,
+                       .packed = (value->flags & JSON_FLAG_PACK_ARRAYS) != 0};
+  JsonValue *expanded = parse_value(&parser);
+  if (!expanded) {
+    if (!json_memory_exhausted()) {
+      fprintf(stderr, "Error: Invalid JSON in %s at offset %zu\n",
+              value->type == JSON_OBJECT ? "object" : "array", span->open);
+    }
+    return 0;
+  }
+  json_free((void *)span);
+
+  JsonValue *target = (JsonValue *)value;
+  int sort = (target->flags & JSON_FLAG_SORTED) != 0;
+  target->value = expanded->value;
+  target->flags = (target->flags & JSON_FLAG_OWNS_SOURCE) |
+                  (expanded->flags & JSON_FLAG_PACKED);
+  json_free(expanded);
+  if (sort && !sort_json_keys(target)) {
+    fprintf(stderr, "Error: Memory allocation failed while sorting keys\n");
+    return 0;
+  }
+  return 1;
+}
+
 /**
  * Parse JSON from a string
  */
@@ -418,111 +1162,730 @@ JsonValue *parse_json_string(const char *json_str) {
     return NULL;
   }
 
-  size_t len = strlen(json_str);
+  return parse_json_string_n(json_str, strlen(json_str));
+}
+
+/**
+ * Parse JSON from the first len bytes of a string
+ *
+ * The buffer need not be NUL-terminated, so callers holding a slice of a
+ * larger buffer can parse it in place.
+ */
+JsonValue *parse_json_string_n(const char *json_str, size_t len) {
+  if (!json_str) {
+    fprintf(stderr, "Error: NULL JSON string provided\n");
+    return NULL;
+  }
+
   if (len == 0) {
     fprintf(stderr, "Error: Empty JSON string provided\n");
     return NULL;
   }
 
-  // Check for reasonable string size (100MB limit)
-  if (len > 100 * 1024 * 1024) {
-    fprintf(stderr, "Error: JSON string too large (over 100MB)\n");
+  if (max_input_size && len > max_input_size) {
+    fprintf(stderr, "Error: JSON string too large (over %zu bytes)\n",
+            max_input_size);
     return NULL;
   }
 
-  JsonParser parser = {.json = json_str, .pos = 0, .len = len};
+  return parse_json_buffer(json_str, len, NULL, &defaults);
+}
 
-  JsonValue *result = parse_value(&parser);
+/**
+ * Reads a non-seekable stream (pipe, character device) into a heap buffer
+ */
+static char *read_stream_contents(int fd, const char *filepath,
+                                  size_t *out_len) {
+  size_t cap = 65536;
+  size_t len = 0;
+  char *buffer = (char *)json_malloc(cap);
+  if (!buffer) {
+    fprintf(stderr, "Error: Memory allocation failed for file content.\n");
+    return NULL;
+  }
 
-  // Check if the entire string was parsed
-  skip_whitespace(&parser);
-  if (parser.pos < parser.len) {
-    fprintf(stderr, "Warning: Extra characters found after JSON data\n");
+  for (;;) {
+    if (len == cap) {
+      if (max_input_size && cap >= max_input_size) {
+        fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+                filepath, max_input_size);
+        json_free(buffer);
+        return NULL;
+      }
+      size_t ncap = cap * 2;
+      if (ncap < cap) {
+        fprintf(stderr, "Error: File '%s' is too large\n", filepath);
+        json_free(buffer);
+        return NULL;
+      }
+      char *nb = (char *)json_realloc(buffer, ncap);
+      if (!nb) {
+        fprintf(stderr,
+                "Error: Memory allocation failed for file content (size: "
+                "%zu).\n",
+                ncap);
+        json_free(buffer);
+        return NULL;
+      }
+      buffer = nb;
+      cap = ncap;
+    }
+    ssize_t n = read(fd, buffer + len, cap - len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "Error: Failed to read from file '%s': %s\n", filepath,
+              strerror(errno));
+      json_free(buffer);
+      return NULL;
+    }
+    if (n == 0)
+      break;
+    len += (size_t)n;
   }
 
-  return result;
+  if (max_input_size && len > max_input_size) {
+    fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+            filepath, max_input_size);
+    json_free(buffer);
+    return NULL;
+  }
+
+  *out_len = len;
+  return buffer;
 }
 
+static int inflate_json_file_data(const char *filepath, JsonFileData *file);
+static JsonValue *parse_json_file_data(const char *filepath,
+                                       JsonFileData *file, int rc,
+                                       const ParseSettings *settings);
+
 /**
- * Parse JSON from a file
+ * Loads a file for parsing
+ *
+ * Regular files are mapped read-only rather than copied to the heap, so the
+ * file contents are backed by the page cache and large inputs do not double
+ * the resident memory of the process. Compressed files are inflated into a
+ * heap buffer.
+ *
+ * @return 1 on success, 0 on error (reported), -1 if the file is empty
  */
-JsonValue *parse_json_file(const char *filepath) {
-  FILE *file = fopen(filepath, "r");
-  if (!file) {
+static int load_json_file_data(const char *filepath, JsonFileData *file) {
+  memset(file, 0, sizeof(*file));
+
+  int fd = open(filepath, O_RDONLY);
+  if (fd < 0) {
     fprintf(stderr, "Error: Failed to open file '%s': %s\n", filepath,
             strerror(errno));
-    return NULL;
+    return 0;
   }
 
-  // Get file size
-  if (fseek(file, 0, SEEK_END) != 0) {
-    fprintf(stderr, "Error: Failed to seek to end of file '%s': %s\n", filepath,
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error: Failed to get file size for '%s': %s\n", filepath,
             strerror(errno));
-    fclose(file);
+    close(fd);
+    return 0;
+  }
+
+  if (S_ISREG(st.st_mode)) {
+    // Check for empty file
+    if (st.st_size == 0) {
+      close(fd);
+      return -1;
+    }
+
+    // off_t is 64-bit (_FILE_OFFSET_BITS=64) but size_t may not be
+    if ((uintmax_t)st.st_size > (uintmax_t)SIZE_MAX) {
+      fprintf(stderr, "Error: File '%s' is too large for this platform\n",
+              filepath);
+      close(fd);
+      return 0;
+    }
+    size_t size = (size_t)st.st_size;
+
+    if (max_input_size && size > max_input_size) {
+      fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+              filepath, max_input_size);
+      close(fd);
+      return 0;
+    }
+
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      // Have the kernel read the whole file ahead; files opened as a batch
+      // (see json_batch.c) have their reads in flight together
+      posix_madvise(mapped, size, POSIX_MADV_WILLNEED);
+      file->mapped = mapped;
+      file->mapped_len = size;
+      file->data = (const char *)mapped;
+      file->len = size;
+    }
+  }
+
+  if (!file->data) {
+    // Not a regular file or not mappable: fall back to reading
+    file->heap = read_stream_contents(fd, filepath, &file->len);
+    if (!file->heap) {
+      close(fd);
+      return 0;
+    }
+    if (file->len == 0) {
+      release_json_file_data(file);
+      close(fd);
+      return -1;
+    }
+    file->data = file->heap;
+  }
+
+  close(fd);
+  return inflate_json_file_data(filepath, file);
+}
+
+/**
+ * Inflates gzip/zstd contents into a heap buffer; the size limit applies to
+ * the decompressed document
+ *
+ * @return 1 on success (including plain contents), 0 on error (reported)
+ */
+static int inflate_json_file_data(const char *filepath, JsonFileData *file) {
+  JsonCompression compression = json_compression_detect(file->data, file->len);
+  if (compression != JSON_COMPRESS_NONE) {
+    size_t inflated_len = 0;
+    char *inflated =
+        json_decompress_buffer(file->data, file->len, file->mapped != NULL,
+                               compression, max_input_size, filepath,
+                               &inflated_len);
+    release_json_file_data(file);
+    if (!inflated) {
+      return 0;
+    }
+    file->heap = inflated;
+    file->data = inflated;
+    file->len = inflated_len;
+  }
+
+  return 1;
+}
+
+/**
+ * Parse JSON from a file
+ *
+ * Returns NULL if the file cannot be read, and an empty object if it is
+ * empty or not valid JSON.
+ */
+JsonValue *parse_json_file(const char *filepath) {
+  JsonFileData file;
+  return parse_json_file_data(filepath, &file,
+                              load_json_file_data(filepath, &file),
+                              &defaults);
+}
+
+/**
+ * Parse a JSON file with the given options instead of the defaults
+ *
+ * The defaults set with json_set_* are neither used nor changed, so
+ * threads can parse with different options at the same time.
+ *
+ * @param options Options of this parse, or NULL for the defaults
+ * @return As parse_json_file, or NULL if options->select is malformed
+ *         (reported)
+ */
+JsonValue *parse_json_file_ex(const char *filepath,
+                              const JsonParseOptions *options) {
+  if (!options) {
+    return parse_json_file(filepath);
+  }
+  ParseSettings settings = {*options, NULL, 0};
+  if (options->select && !parse_patterns(options->select, &settings.patterns,
+                                         &settings.pattern_count)) {
+    if (!json_memory_exhausted()) {
+      fprintf(stderr, "Error: Invalid selection '%s'\n", options->select);
+    }
     return NULL;
   }
+  JsonFileData file;
+  JsonValue *value = parse_json_file_data(
+      filepath, &file, load_json_file_data(filepath, &file), &settings);
+  free_patterns(settings.patterns, settings.pattern_count);
+  return value;
+}
 
-  long file_size = ftell(file);
-  if (file_size < 0) {
-    fprintf(stderr, "Error: Failed to get file size for '%s': %s\n", filepath,
-            strerror(errno));
-    fclose(file);
+/**
+ * Parse a JSON file, building only the values matching some patterns
+ *
+ * As parse_json_file with json_set_select(patterns) in effect; the
+ * selection set with json_set_select, if any, is left as it was.
+ *
+ * @param patterns Comma-separated patterns (see json_set_select)
+ * @return The selected part of the document, or NULL on failure or if a
+ *         pattern is malformed (reported)
+ */
+JsonValue *parse_json_file_select(const char *filepath,
+                                  const char *patterns) {
+  if (!patterns) {
+    fprintf(stderr, "Error: Invalid selection '(null)'\n");
     return NULL;
   }
+  JsonParseOptions options = defaults.options;
+  options.select = patterns;
+  return parse_json_file_ex(filepath, &options);
+}
+
+/**
+ * Parse JSON from the contents of a file that the caller has read
+ *
+ * Behaves like parse_json_file once the bytes are in memory: compressed
+ * contents are inflated and empty or invalid input gives an empty object.
+ * data is neither modified nor kept.
+ */
+JsonValue *parse_json_file_contents(const char *filepath, const char *data,
+                                    size_t len) {
+  JsonFileData file = {.data = data, .len = len};
+  int rc = len == 0 ? -1 : 1;
+  if (rc > 0 && max_input_size && len > max_input_size) {
+    fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+            filepath, max_input_size);
+    rc = 0;
+  }
+  if (rc > 0 && !inflate_json_file_data(filepath, &file)) {
+    rc = 0;
+  }
+  return parse_json_file_data(filepath, &file, rc, &defaults);
+}
 
-  // Check for empty file
-  if (file_size == 0) {
+/**
+ * Parses loaded file contents; rc is the result of loading them
+ */
+static JsonValue *parse_json_file_data(const char *filepath,
+                                       JsonFileData *file, int rc,
+                                       const ParseSettings *settings) {
+  if (rc == 0) {
+    return NULL;
+  }
+  if (rc < 0) {
     fprintf(stderr, "Error: File '%s' is empty\n", filepath);
-    fclose(file);
     // Return an empty object instead of NULL for empty files
     return create_json_value(JSON_OBJECT);
   }
 
-  // Check for reasonable file size (100MB limit)
-  if (file_size > 100 * 1024 * 1024) {
-    fprintf(stderr, "Error: File '%s' is too large (over 100MB)\n", filepath);
-    fclose(file);
+  // Parse JSON
+  JsonValue *json = parse_json_buffer(file->data, file->len, file, settings);
+  release_json_file_data(file);
+
+  if (!json && json_memory_exhausted()) {
+    // Not a parse error: the caller must not mistake the file for empty
+    fprintf(stderr, "Error: Out of memory budget while parsing '%s'.\n",
+            filepath);
+    return NULL;
+  }
+  if (!json) {
+    fprintf(stderr, "Error: Failed to parse JSON in '%s'.\n", filepath);
+    // Return an empty object instead of NULL for parse failures
+    return create_json_value(JSON_OBJECT);
+  }
+
+  return json;
+}
+
+// Pull tokenizer states: what the grammar allows next
+typedef enum {
+  EXPECT_VALUE,
+  EXPECT_FIRST_VALUE, // after '[': a value or ']'
+  EXPECT_FIRST_KEY,   // after '{': a key or '}'
+  EXPECT_KEY,
+  EXPECT_COMMA, // ',' or the closing bracket of the container
+  EXPECT_DONE
+} TokenizerExpect;
+
+struct JsonTokenizer {
+  JsonParser parser;
+  JsonFileData file; // owned contents when opened from a file
+  TokenizerExpect expect;
+  char *stack; // '{' or '[' for each open container
+  size_t depth;
+  size_t capacity;
+};
+
+JsonTokenizer *json_tokenizer_create(const char *buf, size_t len) {
+  JsonTokenizer *tok = (JsonTokenizer *)json_calloc(1, sizeof(JsonTokenizer));
+  if (!tok) {
     return NULL;
   }
+  tok->parser.json = buf;
+  tok->parser.len = len;
+  tok->expect = EXPECT_VALUE;
+  return tok;
+}
 
-  if (fseek(file, 0, SEEK_SET) != 0) {
-    fprintf(stderr, "Error: Failed to seek to start of file '%s': %s\n",
-            filepath, strerror(errno));
-    fclose(file);
+JsonTokenizer *json_tokenizer_open_file(const char *filepath) {
+  JsonFileData file;
+  int rc = load_json_file_data(filepath, &file);
+  if (rc == 0) {
     return NULL;
   }
+  // An empty file yields an empty buffer, which fails on the first token
+  JsonTokenizer *tok = json_tokenizer_create(file.data, file.len);
+  if (!tok) {
+    release_json_file_data(&file);
+    return NULL;
+  }
+  tok->file = file;
+  return tok;
+}
 
-  // Read file content
-  char *buffer = (char *)malloc((size_t)file_size + 1);
-  if (!buffer) {
-    fprintf(stderr,
-            "Error: Memory allocation failed for file content (size: %ld).\n",
-            file_size);
-    fclose(file);
+/**
+ * Tokenizes file contents that the caller has read
+ *
+ * As json_tokenizer_open_file once the bytes are in memory: compressed
+ * contents are inflated, and the size limit applies.
+ *
+ * @param data len bytes from json_malloc, owned by the tokenizer from here
+ *             on (freed on failure)
+ * @return The tokenizer, or NULL on error (reported)
+ */
+JsonTokenizer *json_tokenizer_open_contents(const char *filepath, char *data,
+                                            size_t len) {
+  JsonFileData file = {.data = data, .len = len, .heap = data};
+  if (max_input_size && len > max_input_size) {
+    fprintf(stderr, "Error: File '%s' is too large (over %zu bytes)\n",
+            filepath, max_input_size);
+    release_json_file_data(&file);
+    return NULL;
+  }
+  if (!inflate_json_file_data(filepath, &file)) {
     return NULL;
   }
+  JsonTokenizer *tok = json_tokenizer_create(file.data, file.len);
+  if (!tok) {
+    release_json_file_data(&file);
+    return NULL;
+  }
+  tok->file = file;
+  return tok;
+}
 
-  size_t read_size = fread(buffer, 1, (size_t)file_size, file);
-  if (read_size == 0) {
-    fprintf(stderr, "Error: Failed to read from file '%s': %s\n", filepath,
-            strerror(errno));
-    free(buffer);
-    fclose(file);
+void json_tokenizer_free(JsonTokenizer *tok) {
+  if (!tok) {
+    return;
+  }
+  release_json_file_data(&tok->file);
+  json_free(tok->stack);
+  json_free(tok);
+}
+
+void json_tokenizer_rewind(JsonTokenizer *tok) {
+  if (!tok) {
+    return;
+  }
+  tok->parser.pos = 0;
+  tok->expect = EXPECT_VALUE;
+  tok->depth = 0;
+}
+
+static int tokenizer_push(JsonTokenizer *tok, char open) {
+  if (tok->depth == tok->capacity) {
+    size_t capacity = tok->capacity ? tok->capacity * 2 : 16;
+    char *stack = (char *)json_realloc(tok->stack, capacity);
+    if (!stack) {
+      return 0;
+    }
+    tok->stack = stack;
+    tok->capacity = capacity;
+  }
+  tok->stack[tok->depth++] = open;
+  return 1;
+}
+
+// A value has been completed at the current depth
+static void tokenizer_value_done(JsonTokenizer *tok) {
+  tok->expect = tok->depth == 0 ? EXPECT_DONE : EXPECT_COMMA;
+}
+
+static int token_error(JsonToken *token) {
+  token->type = JSON_TOKEN_ERROR;
+  return 0;
+}
+
+// Scans a string starting at the opening quote; same rules as parse_string
+static int lex_string(JsonTokenizer *tok, JsonToken *token) {
+  JsonParser *p = &tok->parser;
+  size_t start = p->pos;
+  size_t pos = start + 1;
+  int escaped = 0;
+  while (pos < p->len) {
+    pos += json_scan_string(p->json + pos, p->len - pos);
+    if (pos >= p->len || p->json[pos] == '"') {
+      break;
+    }
+    escaped = 1;
+    pos += 2;
+  }
+  if (pos >= p->len) {
+    return 0; // Unterminated string
+  }
+  p->pos = pos + 1;
+  token->start = p->json + start;
+  token->length = p->pos - start;
+  token->escaped = escaped;
+  return 1;
+}
+
+// Scans a number with the same character rules as parse_number
+static int lex_number(JsonTokenizer *tok, JsonToken *token) {
+  JsonParser *p = &tok->parser;
+  size_t start = p->pos;
+  int has_decimal = 0;
+  int has_exponent = 0;
+  while (p->pos < p->len) {
+    char c = p->json[p->pos];
+    if (c == '.') {
+      if (has_decimal)
+        break;
+      has_decimal = 1;
+    } else if (c == 'e' || c == 'E') {
+      if (has_exponent)
+        break;
+      has_exponent = 1;
+    } else if (!isdigit((unsigned char)c) && c != '-' && c != '+') {
+      break;
+    }
+    p->pos++;
+  }
+  token->type = JSON_TOKEN_NUMBER;
+  token->start = p->json + start;
+  token->length = p->pos - start;
+  token->escaped = 0;
+  return 1;
+}
+
+static int lex_literal(JsonTokenizer *tok, JsonToken *token, const char *word,
+                       JsonTokenType type) {
+  JsonParser *p = &tok->parser;
+  size_t n = strlen(word);
+  if (p->len - p->pos < n || memcmp(p->json + p->pos, word, n) != 0) {
+    return 0;
+  }
+  token->type = type;
+  token->start = p->json + p->pos;
+  token->length = n;
+  token->escaped = 0;
+  p->pos += n;
+  return 1;
+}
+
+/**
+ * Reads the next token of the document
+ *
+ * @return 1 with the token filled in, or 0 on malformed input
+ */
+int json_tokenizer_next(JsonTokenizer *tok, JsonToken *token) {
+  JsonParser *p = &tok->parser;
+
+  for (;;) {
+    skip_whitespace(p);
+
+    if (tok->expect == EXPECT_DONE) {
+      if (p->pos < p->len) {
+        return token_error(token); // Extra characters after the document
+      }
+      token->type = JSON_TOKEN_END;
+      token->start = p->json + p->pos;
+      token->length = 0;
+      token->escaped = 0;
+      return 1;
+    }
+
+    if (p->pos >= p->len) {
+      return token_error(token); // Unterminated document
+    }
+
+    char c = p->json[p->pos];
+    token->start = p->json + p->pos;
+    token->length = 1;
+    token->escaped = 0;
+
+    switch (tok->expect) {
+    case EXPECT_COMMA: {
+      char open = tok->stack[tok->depth - 1];
+      if (c == ',') {
+        p->pos++;
+        tok->expect = open == '{' ? EXPECT_KEY : EXPECT_VALUE;
+        continue;
+      }
+      if ((open == '{' && c == '}') || (open == '[' && c == ']')) {
+        p->pos++;
+        tok->depth--;
+        token->type = c == '}' ? JSON_TOKEN_OBJECT_END : JSON_TOKEN_ARRAY_END;
+        tokenizer_value_done(tok);
+        return 1;
+      }
+      return token_error(token);
+    }
+
+    case EXPECT_FIRST_KEY:
+      if (c == '}') {
+        p->pos++;
+        tok->depth--;
+        token->type = JSON_TOKEN_OBJECT_END;
+        tokenizer_value_done(tok);
+        return 1;
+      }
+      // fall through
+    case EXPECT_KEY:
+      if (c != '"' || !lex_string(tok, token)) {
+        return token_error(token);
+      }
+      token->type = JSON_TOKEN_KEY;
+      skip_whitespace(p);
+      if (p->pos >= p->len || p->json[p->pos] != ':') {
+        return token_error(token);
+      }
+      p->pos++;
+      tok->expect = EXPECT_VALUE;
+      return 1;
+
+    case EXPECT_FIRST_VALUE:
+      if (c == ']') {
+        p->pos++;
+        tok->depth--;
+        token->type = JSON_TOKEN_ARRAY_END;
+        tokenizer_value_done(tok);
+        return 1;
+      }
+      // fall through
+    case EXPECT_VALUE:
+      switch (c) {
+      case '{':
+      case '[':
+        if (!tokenizer_push(tok, c)) {
+          return token_error(token);
+        }
+        p->pos++;
+        token->type =
+            c == '{' ? JSON_TOKEN_OBJECT_START : JSON_TOKEN_ARRAY_START;
+        tok->expect = c == '{' ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+        return 1;
+      case '"':
+        if (!lex_string(tok, token)) {
+          return token_error(token);
+        }
+        token->type = JSON_TOKEN_STRING;
+        break;
+      case 't':
+        if (!lex_literal(tok, token, "true", JSON_TOKEN_TRUE)) {
+          return token_error(token);
+        }
+        break;
+      case 'f':
+        if (!lex_literal(tok, token, "false", JSON_TOKEN_FALSE)) {
+          return token_error(token);
+        }
+        break;
+      case 'n':
+        if (!lex_literal(tok, token, "null", JSON_TOKEN_NULL)) {
+          return token_error(token);
+        }
+        break;
+      default:
+        if (!isdigit((unsigned char)c) && c != '-' && c != '+' && c != '.') {
+          return token_error(token);
+        }
+        lex_number(tok, token);
+        break;
+      }
+      tokenizer_value_done(tok);
+      return 1;
+
+    default:
+      return token_error(token);
+    }
+  }
+}
+
+static int is_container_start(const JsonToken *token) {
+  return token->type == JSON_TOKEN_OBJECT_START ||
+         token->type == JSON_TOKEN_ARRAY_START;
+}
+
+/**
+ * Builds a JsonValue for the value starting at token
+ *
+ * Scalars are converted directly. For '{' and '[' the container is parsed
+ * with the tree parser from its opening bracket, and the tokenizer resumes
+ * after the closing one.
+ */
+JsonValue *json_tokenizer_read_value(JsonTokenizer *tok,
+                                     const JsonToken *token) {
+  if (!tok || !token || token->type < JSON_TOKEN_OBJECT_START ||
+      token->type == JSON_TOKEN_OBJECT_END ||
+      token->type == JSON_TOKEN_ARRAY_END || token->type == JSON_TOKEN_KEY) {
     return NULL;
   }
 
-  buffer[read_size] = '\0';
-  fclose(file);
+  JsonParser sub = {.json = tok->parser.json,
+                    .pos = (size_t)(token->start - tok->parser.json),
+                    .len = tok->parser.len};
+  JsonValue *value = parse_value(&sub);
+  if (!value) {
+    return NULL;
+  }
 
-  // Parse JSON
-  JsonValue *json = parse_json_string(buffer);
-  free(buffer);
+  if (is_container_start(token)) {
+    tok->parser.pos = sub.pos;
+    tok->depth--;
+    tokenizer_value_done(tok);
+  }
 
-  if (!json) {
-    fprintf(stderr, "Error: Failed to parse JSON in '%s'.\n", filepath);
-    // Return an empty object instead of NULL for parse failures
-    return create_json_value(JSON_OBJECT);
+  if (defaults.options.sorted_keys && !sort_json_keys(value)) {
+    free_json_value(value);
+    return NULL;
+  }
+  return value;
+}
+
+/**
+ * Skips the value starting at token, validating it on the way
+ *
+ * @param start,length Receive the raw bytes of the value (may be NULL)
+ * @return 1 on success, 0 on malformed input
+ */
+int json_tokenizer_skip_value(JsonTokenizer *tok, const JsonToken *token,
+                              const char **start, size_t *length) {
+  if (!tok || !token) {
+    return 0;
   }
 
-  return json;
+  if (is_container_start(token)) {
+    size_t depth = tok->depth - 1;
+    JsonToken t;
+    while (tok->depth > depth) {
+      if (!json_tokenizer_next(tok, &t)) {
+        return 0;
+      }
+    }
+    if (start)
+      *start = token->start;
+    if (length)
+      *length = (size_t)(tok->parser.json + tok->parser.pos - token->start);
+    return 1;
+  }
+
+  if (token->type < JSON_TOKEN_STRING) {
+    return 0;
+  }
+  if (start)
+    *start = token->start;
+  if (length)
+    *length = token->length;
+  return 1;
+}
+
+char *json_token_string(const JsonToken *token) {
+  if (!token ||
+      (token->type != JSON_TOKEN_STRING && token->type != JSON_TOKEN_KEY)) {
+    return NULL;
+  }
+  JsonParser sub = {.json = token->start, .pos = 0, .len = token->length};
+  return parse_string(&sub);
 }
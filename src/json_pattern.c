@@ -0,0 +1,174 @@
+/**
+ * json_pattern.c - Dotted path patterns
+ *
+ * Paths are matched against patterns spelled as 'get' spells keys, with
+ * two wildcards:
+ *
+ *   a.b        member b of a (or element b of an array, for digits)
+ *   c.*        any one member or element of c
+ *   ..password password members at any depth
+ *
+ * A leading "$." is accepted, and so are the bracket steps a[0], a[*] and
+ * a['b'] (or a["b"], for keys holding dots), so simple JSONPaths
+ * ($.video.*, $.lut[3]) work too.
+ * Matching tells a full match from a path that only leads towards one, so
+ * walkers can skip subtrees no pattern reaches.
+ */
+
+#include "json_pattern.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Reads the bracket step at *p ([0], [*], ['key'] or ["key"]) into seg and
+// moves *p past it; 0 if malformed
+static int split_bracket(char **p, JsonSegment *seg) {
+  char *s = *p + 1;
+  size_t len;
+  seg->index = -1;
+  if (*s == '\'' || *s == '"') {
+    char *name = s + 1;
+    len = strcspn(name, *s == '"' ? "\"\\" : "'\\");
+    if (name[len] != *s) {
+      return 0; // unterminated, or an escape
+    }
+    seg->kind = JSON_SEGMENT_NAME;
+    seg->name = name;
+    seg->len = len;
+    s = name + len + 1;
+  } else if (*s == '*') {
+    seg->kind = JSON_SEGMENT_ANY;
+    s++;
+  } else {
+    len = strspn(s, "0123456789");
+    if (len == 0 || len >= 10) {
+      return 0;
+    }
+    seg->kind = JSON_SEGMENT_NAME;
+    seg->name = s;
+    seg->len = len;
+    seg->index = strtol(s, NULL, 10);
+    s += len;
+  }
+  if (*s != ']' || (s[1] && s[1] != '.' && s[1] != '[')) {
+    return 0;
+  }
+  *p = s + 1;
+  return 1;
+}
+
+// Splits pattern->text into segments
+static int split_pattern(JsonPattern *pattern) {
+  char *p = pattern->text;
+  if (*p == '$') {
+    p++; // "$.a.b" is "a.b"
+  }
+  pattern->segments =
+      (JsonSegment *)json_malloc((strlen(p) + 1) * sizeof(JsonSegment));
+  if (!pattern->segments) {
+    return 0;
+  }
+  int dangling = *p == '.' && p[1] != '.'; // a '.' still needs a name
+  if (dangling) {
+    p++;
+  }
+  while (*p) {
+    JsonSegment *seg = &pattern->segments[pattern->count];
+    if (p[0] == '.' && p[1] == '.') {
+      if (dangling) {
+        return 0; // "a...b"
+      }
+      seg->kind = JSON_SEGMENT_DESCENT;
+      pattern->count++;
+      p += 2;
+      dangling = 0;
+      continue;
+    }
+    if (*p == '.') {
+      if (dangling || pattern->count == 0 ||
+          pattern->segments[pattern->count - 1].kind == JSON_SEGMENT_DESCENT) {
+        return 0;
+      }
+      p++;
+      dangling = 1;
+      continue;
+    }
+    if (*p == '[') {
+      if (dangling || !split_bracket(&p, seg)) {
+        return 0; // "a.[0]", "a[x]"
+      }
+      pattern->count++;
+      continue;
+    }
+    size_t len = strcspn(p, ".[");
+    seg->name = p;
+    seg->len = len;
+    seg->kind = (len == 1 && *p == '*') ? JSON_SEGMENT_ANY : JSON_SEGMENT_NAME;
+    seg->index = -1;
+    if (strspn(p, "0123456789") == len && len < 10) {
+      seg->index = strtol(p, NULL, 10);
+    }
+    pattern->count++;
+    p += len;
+    dangling = 0;
+  }
+  return pattern->count > 0 && !dangling;
+}
+
+int json_pattern_parse(JsonPattern *pattern, const char *text, size_t len) {
+  memset(pattern, 0, sizeof(*pattern));
+  pattern->text = (char *)json_malloc(len + 1);
+  if (!pattern->text) {
+    return 0;
+  }
+  memcpy(pattern->text, text, len);
+  pattern->text[len] = '\0';
+  return split_pattern(pattern);
+}
+
+void json_pattern_free(JsonPattern *pattern) {
+  json_free(pattern->text);
+  json_free(pattern->segments);
+}
+
+static int segment_matches(const JsonSegment *seg, const JsonPathStep *step) {
+  if (seg->kind == JSON_SEGMENT_ANY) {
+    return 1;
+  }
+  if (!step->name) {
+    return seg->index == step->index;
+  }
+  return seg->len == step->len && memcmp(seg->name, step->name, seg->len) == 0;
+}
+
+static JsonMatch match_segments(const JsonSegment *segs, int count,
+                                const JsonPathStep *path, int depth) {
+  if (depth == 0) {
+    for (int i = 0; i < count; i++) {
+      if (segs[i].kind != JSON_SEGMENT_DESCENT) {
+        return JSON_MATCH_PREFIX;
+      }
+    }
+    return JSON_MATCH_FULL;
+  }
+  if (count == 0) {
+    return JSON_MATCH_NONE;
+  }
+  if (segs[0].kind == JSON_SEGMENT_DESCENT) {
+    // .. stands for no level at all, or for this one and maybe more
+    JsonMatch skip = match_segments(segs + 1, count - 1, path, depth);
+    if (skip == JSON_MATCH_FULL) {
+      return skip;
+    }
+    JsonMatch take = match_segments(segs, count, path + 1, depth - 1);
+    return skip > take ? skip : take;
+  }
+  if (!segment_matches(&segs[0], &path[0])) {
+    return JSON_MATCH_NONE;
+  }
+  return match_segments(segs + 1, count - 1, path + 1, depth - 1);
+}
+
+JsonMatch json_pattern_match(const JsonPattern *pattern,
+                             const JsonPathStep *path, int depth) {
+  return match_segments(pattern->segments, pattern->count, path, depth);
+}
@@ -0,0 +1,54 @@
+/**
+ * json_pattern.h - Dotted path patterns shared by transform and --select
+ *
+ * Internal to the library; not installed.
+ */
+
+#ifndef JSON_PATTERN_H
+#define JSON_PATTERN_H
+
+#include "json_config.h"
+
+typedef enum {
+  JSON_SEGMENT_NAME,   // member name, or array index if all digits
+  JSON_SEGMENT_ANY,    // *
+  JSON_SEGMENT_DESCENT // .. (any number of levels)
+} JsonSegmentKind;
+
+typedef struct {
+  JsonSegmentKind kind;
+  const char *name; // into JsonPattern.text
+  size_t len;
+  long index; // name as an array index, or -1
+} JsonSegment;
+
+typedef struct {
+  char *text; // pattern, split in place
+  JsonSegment *segments;
+  int count;
+} JsonPattern;
+
+// One step of the path of a value being read
+typedef struct {
+  const char *name; // member name (unescaped), NULL for array elements
+  size_t len;
+  long index;  // array index, -1 for members
+  char *owned; // unescaped copy of an escaped key, freed by the walker
+} JsonPathStep;
+
+typedef enum {
+  JSON_MATCH_NONE,
+  JSON_MATCH_PREFIX, // a value below the path may match
+  JSON_MATCH_FULL
+} JsonMatch;
+
+// Parses the first len bytes of text into pattern, which keeps a copy;
+// 0 if malformed or on allocation failure. Free pattern either way.
+int json_pattern_parse(JsonPattern *pattern, const char *text, size_t len);
+void json_pattern_free(JsonPattern *pattern);
+
+// Whether the path of depth steps matches pattern, or could once extended
+JsonMatch json_pattern_match(const JsonPattern *pattern,
+                             const JsonPathStep *path, int depth);
+
+#endif /* JSON_PATTERN_H */
@@ -3,14 +3,20 @@
  */
 
 #include "json_config.h"
+#include "json_simd.h"
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <float.h>
 
+#ifdef JCT_WITH_THREADS
+#include <pthread.h>
+#endif
+
 static int is_exact_int64_double(double d, long long *out_ll) {
   // NaN
   if (!(d == d))
@@ -35,9 +41,57 @@ static int is_exact_int64_double(double d, long long *out_ll) {
 
 // Function prototypes for internal use
 static char *escape_string(const char *str);
-static int calculate_json_size(JsonValue *json, int pretty, int level);
-static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
-                                    int level);
+static size_t calculate_json_size(JsonValue *json, int pretty, int level);
+static size_t serialize_json_to_buffer(JsonValue *json, char *buffer,
+                                       int pretty, int level);
+
+// Maximum size of a string produced by json_to_string (0 means unlimited)
+static size_t max_output_size = JCT_DEFAULT_SIZE_LIMIT;
+
+/**
+ * Sets the maximum size of strings produced by json_to_string
+ *
+ * @param bytes Limit in bytes, or 0 to disable the check
+ */
+void json_set_max_output_size(size_t bytes) {
+  max_output_size = bytes;
+}
+
+// Number of spaces used to indent a pretty-printed line at the given level
+static size_t indent_width(int level) {
+  size_t indent = (size_t)level * 2;
+  // Limit indentation to keep deeply nested output readable
+  return indent > 100 ? 100 : indent;
+}
+
+// Adds b to *a, saturating at SIZE_MAX so oversized documents are caught by
+// the size checks instead of wrapping around
+static void size_add(size_t *a, size_t b) {
+  *a = (*a > SIZE_MAX - b) ? SIZE_MAX : *a + b;
+}
+
+// Returns the escape letter for characters written as a two-byte sequence,
+// or 0 for characters that are copied through unchanged
+static char escape_letter(char c) {
+  switch (c) {
+  case '"':
+    return '"';
+  case '\\':
+    return '\\';
+  case '\b':
+    return 'b';
+  case '\f':
+    return 'f';
+  case '\n':
+    return 'n';
+  case '\r':
+    return 'r';
+  case '\t':
+    return 't';
+  default:
+    return 0;
+  }
+}
 
 /**
  * Escapes a string for JSON output
@@ -47,72 +101,160 @@ static char *escape_string(const char *str) {
     return NULL;
   }
 
-  // Count the number of characters that need escaping
+  // Count the number of characters that need escaping; the scanner skips
+  // runs that cannot contain any
   size_t len = strlen(str);
   size_t escaped_len = len;
 
-  for (size_t i = 0; i < len; i++) {
-    char c = str[i];
-    if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' ||
-        c == '\r' || c == '\t') {
+  for (size_t i = json_scan_escape(str, len); i < len;
+       i += 1 + json_scan_escape(str + i + 1, len - i - 1)) {
+    if (escape_letter(str[i])) {
       escaped_len++;
     }
   }
 
   // Allocate memory for the escaped string
-  char *escaped = (char *)malloc(escaped_len + 1);
+  char *escaped = (char *)json_malloc(escaped_len + 1);
   if (!escaped) {
     return NULL;
   }
 
+  if (escaped_len == len) {
+    memcpy(escaped, str, len + 1);
+    return escaped;
+  }
+
   // Copy the string with escaping
   size_t j = 0;
-  for (size_t i = 0; i < len; i++) {
-    char c = str[i];
-
-    switch (c) {
-    case '"':
-      escaped[j++] = '\\';
-      escaped[j++] = '"';
-      break;
-    case '\\':
-      escaped[j++] = '\\';
-      escaped[j++] = '\\';
-      break;
-    case '\b':
-      escaped[j++] = '\\';
-      escaped[j++] = 'b';
-      break;
-    case '\f':
-      escaped[j++] = '\\';
-      escaped[j++] = 'f';
-      break;
-    case '\n':
-      escaped[j++] = '\\';
-      escaped[j++] = 'n';
+  size_t i = 0;
+  while (i < len) {
+    size_t run = json_scan_escape(str + i, len - i);
+    memcpy(escaped + j, str + i, run);
+    j += run;
+    i += run;
+    if (i >= len) {
       break;
-    case '\r':
-      escaped[j++] = '\\';
-      escaped[j++] = 'r';
-      break;
-    case '\t':
+    }
+
+    char letter = escape_letter(str[i]);
+    if (letter) {
       escaped[j++] = '\\';
-      escaped[j++] = 't';
-      break;
-    default:
-      escaped[j++] = c;
-      break;
+      escaped[j++] = letter;
+    } else {
+      escaped[j++] = str[i];
     }
+    i++;
   }
 
   escaped[j] = '\0';
   return escaped;
 }
 
+/**
+ * Escapes a string for a JSON string literal (without the quotes)
+ *
+ * @return A newly allocated string (caller frees), or NULL on error
+ */
+char *json_escape_string(const char *str) {
+  return escape_string(str);
+}
+
+// Size of the separator and indentation written before a container entry
+static size_t separator_size(int first, int pretty, int level) {
+  size_t size = 0;
+  if (!first) {
+    size_add(&size, pretty ? 2 : 1); // Comma and space after it
+  }
+  if (pretty) {
+    // Newline and indentation
+    size_add(&size, 1 + indent_width(level + 1));
+  }
+  return size;
+}
+
+// Writes the separator and indentation before a container entry
+static size_t write_separator(char *buffer, int first, int pretty, int level) {
+  size_t pos = 0;
+  if (!first) {
+    buffer[pos++] = ',';
+    if (pretty)
+      buffer[pos++] = ' ';
+  }
+  if (pretty) {
+    buffer[pos++] = '\n';
+    size_t indent = indent_width(level + 1);
+    memset(buffer + pos, ' ', indent);
+    pos += indent;
+  }
+  return pos;
+}
+
+// Size of an array element of a container at level, with its separator
+static size_t element_size(JsonValue *value, int first, int pretty,
+                           int level) {
+  size_t size = separator_size(first, pretty, level);
+  size_add(&size, calculate_json_size(value, pretty, level + 1));
+  return size;
+}
+
+static size_t write_element(JsonValue *value, int first, char *buffer,
+                            int pretty, int level) {
+  size_t pos = write_separator(buffer, first, pretty, level);
+  return pos + serialize_json_to_buffer(value, buffer + pos, pretty, level + 1);
+}
+
+// Size of an object member of a container at level, with its separator
+static size_t member_size(JsonKeyValue *kv, int first, int pretty, int level) {
+  size_t size = separator_size(first, pretty, level);
+
+  size_add(&size, 2); // Quotes around the key
+  if (kv->key) {
+    char *escaped_key = escape_string(kv->key);
+    if (escaped_key) {
+      size_add(&size, strlen(escaped_key));
+      json_free(escaped_key);
+    }
+  }
+
+  size_add(&size, pretty ? 2 : 1); // Colon and space after it
+
+  size_add(&size, calculate_json_size(kv->value, pretty, level + 1));
+  return size;
+}
+
+static size_t write_member(JsonKeyValue *kv, int first, char *buffer,
+                           int pretty, int level) {
+  size_t pos = write_separator(buffer, first, pretty, level);
+
+  buffer[pos++] = '"';
+
+  if (!kv->key) {
+    // Handle NULL key
+    buffer[pos++] = '"';
+  } else {
+    char *escaped_key = escape_string(kv->key);
+    if (escaped_key) {
+      size_t escaped_len = strlen(escaped_key);
+      memcpy(buffer + pos, escaped_key, escaped_len);
+      pos += escaped_len;
+      json_free(escaped_key);
+    }
+
+    buffer[pos++] = '"';
+  }
+
+  buffer[pos++] = ':';
+  if (pretty)
+    buffer[pos++] = ' ';
+
+  return pos +
+         serialize_json_to_buffer(kv->value, buffer + pos, pretty, level + 1);
+}
+
 /**
  * Calculates the size needed for the JSON string
  */
-static int calculate_json_size(JsonValue *json, int pretty, int level) {
+static size_t calculate_json_size(JsonValue *json, int pretty, int level) {
   if (!json) {
     return 4; // "null"
   }
@@ -123,7 +265,7 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
     return 4; // Return "null" size
   }
 
-  int size = 0;
+  size_t size = 0;
 
   switch (json->type) {
   case JSON_NULL:
@@ -133,6 +275,12 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
     size = json->value.boolean ? 4 : 5; // "true" or "false"
     break;
   case JSON_NUMBER: {
+    const char *lexeme;
+    size_t lexeme_len = json_number_lexeme(json, &lexeme);
+    if (lexeme_len) {
+      size = lexeme_len; // written verbatim
+      break;
+    }
     char buffer[128];
     double d = json->value.number;
     long long ll;
@@ -141,33 +289,23 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
       if (len < 0 || len >= (int)sizeof(buffer))
         size = 32;
       else
-        size = len;
+        size = (size_t)len;
     } else {
       int len = snprintf(buffer, sizeof(buffer), "%g", d);
       if (len < 0 || len >= (int)sizeof(buffer))
         size = 16;
       else
-        size = len;
+        size = (size_t)len;
     }
     break;
   }
   case JSON_STRING: {
-    if (!json->value.string) {
-      size = 2; // Just quotes for NULL string
-    } else {
+    size = 2; // Quotes
+    if (json->value.string) {
       char *escaped = escape_string(json->value.string);
       if (escaped) {
-        size_t escaped_len = strlen(escaped);
-        if (escaped_len > INT_MAX - 2) {
-          // Prevent integer overflow
-          fprintf(stderr, "Error: String too large to serialize\n");
-          free(escaped);
-          return 2; // Just quotes
-        }
-        size = (int)escaped_len + 2; // Add quotes
-        free(escaped);
-      } else {
-        size = 2; // Just quotes
+        size_add(&size, strlen(escaped));
+        json_free(escaped);
       }
     }
     break;
@@ -175,47 +313,26 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
   case JSON_ARRAY: {
     size = 2; // []
 
-    JsonArrayItem *item = json->value.array_head;
+    // Packed arrays are read in place rather than linked
+    size_t count = 0;
+    JsonValue *packed = json_array_packed(json, &count);
+    JsonArrayItem *item = packed ? NULL : json_array_first(json);
+    int empty = !packed && !item;
+    for (size_t i = 0; i < count; i++) {
+      size_add(&size, element_size(&packed[i], i == 0, pretty, level));
+    }
+
     int first = 1;
 
     while (item) {
-      if (!first) {
-        size += 1; // Comma
-        if (pretty)
-          size += 1; // Space after comma
-      }
-
-      if (pretty) {
-        int indent_size = 2 + level * 2; // Newline and indentation
-        if (indent_size < 0 || size > INT_MAX - indent_size) {
-          // Prevent integer overflow
-          fprintf(stderr, "Error: JSON too large to serialize\n");
-          return size;
-        }
-        size += indent_size;
-      }
-
-      int item_size = calculate_json_size(item->value, pretty, level + 1);
-      if (item_size < 0 || size > INT_MAX - item_size) {
-        // Prevent integer overflow
-        fprintf(stderr, "Error: JSON too large to serialize\n");
-        return size;
-      }
-      size += item_size;
-
+      size_add(&size, element_size(item->value, first, pretty, level));
       first = 0;
       item = item->next;
     }
 
-    if (pretty && json->value.array_head) {
-      int indent_size =
-          1 + level * 2; // Newline and indentation for closing bracket
-      if (indent_size < 0 || size > INT_MAX - indent_size) {
-        // Prevent integer overflow
-        fprintf(stderr, "Error: JSON too large to serialize\n");
-        return size;
-      }
-      size += indent_size;
+    if (pretty && !empty) {
+      // Newline and indentation for closing bracket
+      size_add(&size, 1 + indent_width(level));
     }
 
     break;
@@ -223,71 +340,18 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
   case JSON_OBJECT: {
     size = 2; // {}
 
-    JsonKeyValue *kv = json->value.object_head;
+    JsonKeyValue *kv = json_object_first(json);
     int first = 1;
 
     while (kv) {
-      if (!first) {
-        size += 1; // Comma
-        if (pretty)
-          size += 1; // Space after comma
-      }
-
-      if (pretty) {
-        int indent_size = 2 + level * 2; // Newline and indentation
-        if (indent_size < 0 || size > INT_MAX - indent_size) {
-          // Prevent integer overflow
-          fprintf(stderr, "Error: JSON too large to serialize\n");
-          return size;
-        }
-        size += indent_size;
-      }
-
-      if (!kv->key) {
-        size += 2; // Just quotes for NULL key
-      } else {
-        char *escaped_key = escape_string(kv->key);
-        if (escaped_key) {
-          size_t escaped_len = strlen(escaped_key);
-          if (escaped_len > INT_MAX - 2 ||
-              size > INT_MAX - ((int)escaped_len + 2)) {
-            // Prevent integer overflow
-            fprintf(stderr, "Error: Key too large to serialize\n");
-            free(escaped_key);
-            return size;
-          }
-          size += (int)escaped_len + 2; // Add quotes
-          free(escaped_key);
-        } else {
-          size += 2; // Just quotes
-        }
-      }
-
-      size += 1; // Colon
-      if (pretty)
-        size += 1; // Space after colon
-
-      int value_size = calculate_json_size(kv->value, pretty, level + 1);
-      if (value_size < 0 || size > INT_MAX - value_size) {
-        // Prevent integer overflow
-        fprintf(stderr, "Error: JSON too large to serialize\n");
-        return size;
-      }
-      size += value_size;
-
+      size_add(&size, member_size(kv, first, pretty, level));
       first = 0;
       kv = kv->next;
     }
 
-    if (pretty && json->value.object_head) {
-      int indent_size =
-          1 + level * 2; // Newline and indentation for closing brace
-      if (indent_size < 0 || size > INT_MAX - indent_size) {
-        // Prevent integer overflow
-        fprintf(stderr, "Error: JSON too large to serialize\n");
-        return size;
-      }
-      size += indent_size;
+    if (pretty && json_object_first(json)) {
+      // Newline and indentation for closing brace
+      size_add(&size, 1 + indent_width(level));
     }
 
     break;
@@ -300,8 +364,8 @@ static int calculate_json_size(JsonValue *json, int pretty, int level) {
 /**
  * Serializes a JSON value to a buffer
  */
-static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
-                                    int level) {
+static size_t serialize_json_to_buffer(JsonValue *json, char *buffer,
+                                       int pretty, int level) {
   if (!json || !buffer) {
     strncpy(buffer, "null", 5);
     return 4;
@@ -313,7 +377,7 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
     return 4;
   }
 
-  int pos = 0;
+  size_t pos = 0;
 
   switch (json->type) {
   case JSON_NULL:
@@ -330,17 +394,26 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
     }
     break;
   case JSON_NUMBER: {
+    const char *lexeme;
+    size_t lexeme_len = json_number_lexeme(json, &lexeme);
+    if (lexeme_len) {
+      memcpy(buffer, lexeme, lexeme_len);
+      pos = lexeme_len;
+      break;
+    }
     double d = json->value.number;
     long long ll;
+    int len;
     if (is_exact_int64_double(d, &ll)) {
-      pos = snprintf(buffer, 128, "%lld", ll);
+      len = snprintf(buffer, 128, "%lld", ll);
     } else {
-      pos = snprintf(buffer, 128, "%g", d);
+      len = snprintf(buffer, 128, "%g", d);
     }
-    if (pos < 0 || pos >= 128) {
+    if (len < 0 || len >= 128) {
       strncpy(buffer, "0", 2);
-      pos = 1;
+      len = 1;
     }
+    pos = (size_t)len;
     break;
   }
   case JSON_STRING: {
@@ -354,12 +427,9 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
       char *escaped = escape_string(json->value.string);
       if (escaped) {
         size_t escaped_len = strlen(escaped);
-        if (escaped_len < INT_MAX) {
-          /* Copy without depending on source length for the bound */
-          memcpy(buffer + pos, escaped, escaped_len);
-          pos += (int)escaped_len;
-        }
-        free(escaped);
+        memcpy(buffer + pos, escaped, escaped_len);
+        pos += escaped_len;
+        json_free(escaped);
       }
 
       buffer[pos++] = '"';
@@ -371,48 +441,27 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
     buffer[pos++] = '[';
     buffer[pos] = '\0';
 
-    JsonArrayItem *item = json->value.array_head;
+    size_t count = 0;
+    JsonValue *packed = json_array_packed(json, &count);
+    JsonArrayItem *item = packed ? NULL : json_array_first(json);
+    int empty = !packed && !item;
+    for (size_t i = 0; i < count; i++) {
+      pos += write_element(&packed[i], i == 0, buffer + pos, pretty, level);
+    }
+
     int first = 1;
 
     while (item) {
-      if (!first) {
-        buffer[pos++] = ',';
-        if (pretty)
-          buffer[pos++] = ' ';
-      }
-
-      if (pretty) {
-        buffer[pos++] = '\n';
-        int indent = (level + 1) * 2;
-        // Limit indentation to prevent buffer overflow
-        if (indent > 100)
-          indent = 100;
-        for (int i = 0; i < indent; i++) {
-          buffer[pos++] = ' ';
-        }
-      }
-
-      int written = serialize_json_to_buffer(item->value, buffer + pos, pretty,
-                                             level + 1);
-      if (written < 0) {
-        // Handle error
-        return pos;
-      }
-      pos += written;
-
+      pos += write_element(item->value, first, buffer + pos, pretty, level);
       first = 0;
       item = item->next;
     }
 
-    if (pretty && json->value.array_head) {
+    if (pretty && !empty) {
       buffer[pos++] = '\n';
-      int indent = level * 2;
-      // Limit indentation to prevent buffer overflow
-      if (indent > 100)
-        indent = 100;
-      for (int i = 0; i < indent; i++) {
-        buffer[pos++] = ' ';
-      }
+      size_t indent = indent_width(level);
+      memset(buffer + pos, ' ', indent);
+      pos += indent;
     }
 
     buffer[pos++] = ']';
@@ -423,73 +472,20 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
     buffer[pos++] = '{';
     buffer[pos] = '\0';
 
-    JsonKeyValue *kv = json->value.object_head;
+    JsonKeyValue *kv = json_object_first(json);
     int first = 1;
 
     while (kv) {
-      if (!first) {
-        buffer[pos++] = ',';
-        if (pretty)
-          buffer[pos++] = ' ';
-      }
-
-      if (pretty) {
-        buffer[pos++] = '\n';
-        int indent = (level + 1) * 2;
-        // Limit indentation to prevent buffer overflow
-        if (indent > 100)
-          indent = 100;
-        for (int i = 0; i < indent; i++) {
-          buffer[pos++] = ' ';
-        }
-      }
-
-      buffer[pos++] = '"';
-
-      if (!kv->key) {
-        // Handle NULL key
-        buffer[pos++] = '"';
-      } else {
-        char *escaped_key = escape_string(kv->key);
-        if (escaped_key) {
-          size_t escaped_len = strlen(escaped_key);
-          if (escaped_len < INT_MAX) {
-            /* Copy without depending on source length for the bound
-             */
-            memcpy(buffer + pos, escaped_key, escaped_len);
-            pos += (int)escaped_len;
-          }
-          free(escaped_key);
-        }
-
-        buffer[pos++] = '"';
-      }
-
-      buffer[pos++] = ':';
-      if (pretty)
-        buffer[pos++] = ' ';
-
-      int written =
-          serialize_json_to_buffer(kv->value, buffer + pos, pretty, level + 1);
-      if (written < 0) {
-        // Handle error
-        return pos;
-      }
-      pos += written;
-
+      pos += write_member(kv, first, buffer + pos, pretty, level);
       first = 0;
       kv = kv->next;
     }
 
-    if (pretty && json->value.object_head) {
+    if (pretty && json_object_first(json)) {
       buffer[pos++] = '\n';
-      int indent = level * 2;
-      // Limit indentation to prevent buffer overflow
-      if (indent > 100)
-        indent = 100;
-      for (int i = 0; i < indent; i++) {
-        buffer[pos++] = ' ';
-      }
+      size_t indent = indent_width(level);
+      memset(buffer + pos, ' ', indent);
+      pos += indent;
     }
 
     buffer[pos++] = '}';
@@ -503,6 +499,231 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
   return pos;
 }
 
+// Threads json_to_string may use for a large top-level container, at most
+// MAX_SERIALIZE_THREADS (the --threads limit)
+#define MAX_SERIALIZE_THREADS 1024u
+static unsigned serialize_threads = 1;
+
+/**
+ * Sets how many threads json_to_string and print_item may use
+ *
+ * A top-level array or object with at least JCT_PARALLEL_MIN_ENTRIES
+ * entries is split into one contiguous range per thread. Without
+ * JCT_WITH_THREADS the setting is ignored.
+ *
+ * @param threads Thread count; 0 or 1 serializes on the calling thread,
+ *                larger counts are capped at MAX_SERIALIZE_THREADS
+ */
+void json_set_serialize_threads(unsigned threads) {
+  serialize_threads = threads ? threads : 1;
+  if (serialize_threads > MAX_SERIALIZE_THREADS) {
+    serialize_threads = MAX_SERIALIZE_THREADS;
+  }
+}
+
+/**
+ * Returns the thread count set by json_set_serialize_threads
+ */
+unsigned json_serialize_threads(void) {
+  return serialize_threads;
+}
+
+// A contiguous range of top-level entries serialized into its own buffer
+typedef struct {
+  JsonValue **elements;  // array entries, or NULL
+  JsonKeyValue **members; // object entries, or NULL
+  size_t begin;
+  size_t end;
+  int pretty;
+  size_t size;
+  char *buffer;
+  size_t written;
+} SerializePart;
+
+// Parts of a top-level container serialized in parallel
+typedef struct {
+  SerializePart *parts;
+  size_t count;
+  void **entries;
+  size_t size; // whole document, brackets included
+} ParallelJob;
+
+#ifdef JCT_WITH_THREADS
+static void *size_part(void *arg) {
+  SerializePart *part = (SerializePart *)arg;
+  size_t size = 0;
+  for (size_t i = part->begin; i < part->end; i++) {
+    size_add(&size, part->members
+                        ? member_size(part->members[i], i == 0, part->pretty, 0)
+                        : element_size(part->elements[i], i == 0,
+                                       part->pretty, 0));
+  }
+  part->size = size;
+  return NULL;
+}
+
+static void *write_part(void *arg) {
+  SerializePart *part = (SerializePart *)arg;
+  // Padding as in json_to_string: writers terminate after each value
+  part->buffer = (char *)json_malloc(part->size + 16);
+  if (!part->buffer) {
+    return NULL;
+  }
+  size_t pos = 0;
+  for (size_t i = part->begin; i < part->end; i++) {
+    pos += part->members ? write_member(part->members[i], i == 0,
+                                        part->buffer + pos, part->pretty, 0)
+                         : write_element(part->elements[i], i == 0,
+                                         part->buffer + pos, part->pretty, 0);
+  }
+  part->written = pos;
+  return NULL;
+}
+
+/**
+ * Runs fn on every part, one thread each; parts whose thread cannot be
+ * started run on the calling thread
+ *
+ * The thread handles live on the heap, as the part count comes from the
+ * caller's json_set_serialize_threads and may be large.
+ */
+static void run_parts(ParallelJob *job, void *(*fn)(void *)) {
+  pthread_t *threads =
+      (pthread_t *)json_malloc(job->count * sizeof(pthread_t));
+  int *started = (int *)json_calloc(job->count, sizeof(int));
+  for (size_t i = 1; threads && started && i < job->count; i++) {
+    started[i] =
+        pthread_create(&threads[i], NULL, fn, &job->parts[i]) == 0;
+  }
+  fn(&job->parts[0]);
+  for (size_t i = 1; i < job->count; i++) {
+    if (started && started[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      fn(&job->parts[i]);
+    }
+  }
+  json_free(threads);
+  json_free(started);
+}
+#endif
+
+static void free_parallel(ParallelJob *job) {
+  for (size_t i = 0; i < job->count; i++) {
+    json_free(job->parts[i].buffer);
+  }
+  json_free(job->parts);
+  json_free(job->entries);
+}
+
+/**
+ * Splits a large top-level container into parts and sizes them in parallel
+ *
+ * @return 1 if job is ready to write, 0 to serialize on this thread (not
+ *         worth splitting, or no memory for the bookkeeping)
+ */
+static int plan_parallel(JsonValue *json, int pretty, ParallelJob *job) {
+#ifdef JCT_WITH_THREADS
+  if (serialize_threads < 2 ||
+      (json->type != JSON_ARRAY && json->type != JSON_OBJECT)) {
+    return 0;
+  }
+
+  size_t count = 0;
+  JsonValue *packed = json_array_packed(json, &count); // counts it
+  if (!packed && json->type == JSON_ARRAY) {
+    for (JsonArrayItem *it = json_array_first(json); it; it = it->next) {
+      count++;
+    }
+  } else if (!packed) {
+    for (JsonKeyValue *kv = json_object_first(json); kv; kv = kv->next) {
+      count++;
+    }
+  }
+  if (count < JCT_PARALLEL_MIN_ENTRIES) {
+    return 0;
+  }
+
+  size_t nparts = serialize_threads < count ? serialize_threads : count;
+  job->entries = (void **)json_malloc(count * sizeof(void *));
+  job->parts = (SerializePart *)json_calloc(nparts, sizeof(SerializePart));
+  job->count = nparts;
+  if (!job->entries || !job->parts) {
+    json_free(job->entries);
+    json_free(job->parts);
+    return 0;
+  }
+  size_t n = 0;
+  if (packed) {
+    for (; n < count; n++) {
+      job->entries[n] = &packed[n];
+    }
+  } else if (json->type == JSON_ARRAY) {
+    for (JsonArrayItem *it = json_array_first(json); it; it = it->next) {
+      job->entries[n++] = it->value;
+    }
+  } else {
+    for (JsonKeyValue *kv = json_object_first(json); kv; kv = kv->next) {
+      job->entries[n++] = kv;
+    }
+  }
+
+  for (size_t i = 0; i < nparts; i++) {
+    SerializePart *part = &job->parts[i];
+    if (json->type == JSON_ARRAY) {
+      part->elements = (JsonValue **)job->entries;
+    } else {
+      part->members = (JsonKeyValue **)job->entries;
+    }
+    part->begin = count * i / nparts;
+    part->end = count * (i + 1) / nparts;
+    part->pretty = pretty;
+  }
+  run_parts(job, size_part);
+
+  job->size = 2; // Brackets
+  for (size_t i = 0; i < nparts; i++) {
+    size_add(&job->size, job->parts[i].size);
+  }
+  if (pretty) {
+    size_add(&job->size, 1); // Newline before the closing bracket
+  }
+  return 1;
+#else
+  (void)json;
+  (void)pretty;
+  (void)job;
+  return 0;
+#endif
+}
+
+/**
+ * Writes the parts in parallel and concatenates them into buffer
+ *
+ * @return Bytes written, or 0 on allocation failure
+ */
+static size_t write_parallel(JsonValue *json, ParallelJob *job, char *buffer,
+                             int pretty) {
+#ifdef JCT_WITH_THREADS
+  run_parts(job, write_part);
+#endif
+  size_t pos = 0;
+  buffer[pos++] = json->type == JSON_ARRAY ? '[' : '{';
+  for (size_t i = 0; i < job->count; i++) {
+    if (!job->parts[i].buffer) {
+      return 0;
+    }
+    memcpy(buffer + pos, job->parts[i].buffer, job->parts[i].written);
+    pos += job->parts[i].written;
+  }
+  if (pretty) {
+    buffer[pos++] = '\n';
+  }
+  buffer[pos++] = json->type == JSON_ARRAY ? ']' : '}';
+  buffer[pos] = '\0';
+  return pos;
+}
+
 /**
  * Converts a JSON value to a string
  *
@@ -512,37 +733,60 @@ static int serialize_json_to_buffer(JsonValue *json, char *buffer, int pretty,
  */
 char *json_to_string(JsonValue *json, int pretty) {
   if (!json) {
-    char *str = strdup("null");
+    char *str = json_strdup("null");
     return str;
   }
 
-  // Calculate the size needed for the JSON string
-  int size = calculate_json_size(json, pretty, 0);
+  // Calculate the size needed for the JSON string; large top-level
+  // containers are sized and written by several threads
+  ParallelJob job = {0};
+  int parallel = plan_parallel(json, pretty, &job);
+  size_t size = parallel ? job.size : calculate_json_size(json, pretty, 0);
 
   // Validate the calculated size
-  if (size <= 0) {
+  if (size == 0 || size == SIZE_MAX) {
     fprintf(stderr, "Error: Invalid size calculated for JSON string\n");
-    return strdup("null");
+    if (parallel) {
+      free_parallel(&job);
+    }
+    return json_strdup("null");
   }
 
-  // Use a reasonable maximum size to prevent allocation issues
-  if (size > 100 * 1024 * 1024) { // 100 MB limit
-    fprintf(stderr, "Error: JSON string too large (over 100MB)\n");
-    return strdup("null");
+  if (max_output_size && size > max_output_size) {
+    fprintf(stderr, "Error: JSON string too large (over %zu bytes)\n",
+            max_output_size);
+    if (parallel) {
+      free_parallel(&job);
+    }
+    return json_strdup("null");
   }
 
   // Allocate memory for the JSON string with extra padding for safety
-  char *str = (char *)malloc((size_t)size + 16); // Add extra padding
+  char *str = (char *)json_malloc(size + 16); // Add extra padding
   if (!str) {
     fprintf(stderr, "Error: Memory allocation failed for JSON string\n");
+    if (parallel) {
+      free_parallel(&job);
+    }
     return NULL;
   }
 
   // Serialize the JSON value to the buffer
-  int written = serialize_json_to_buffer(json, str, pretty, 0);
+  size_t written;
+  if (parallel) {
+    written = write_parallel(json, &job, str, pretty);
+    free_parallel(&job);
+    if (!written) {
+      fprintf(stderr, "Error: Memory allocation failed for JSON string\n");
+      json_free(str);
+      return NULL;
+    }
+  } else {
+    written = serialize_json_to_buffer(json, str, pretty, 0);
+  }
 
   // Ensure proper null termination
-  if (written >= 0 && written <= size + 15) {
+  if (written <= size + 15) {
     str[written] = '\0';
   } else {
     // Safety measure if serialization wrote more than expected
@@ -0,0 +1,237 @@
+/**
+ * json_simd.c - Byte scanning kernels with runtime CPU dispatch
+ *
+ * The same library binary runs on x86 hosts with very different vector
+ * units, so the SSE2/AVX2/AVX-512 variants are compiled with per-function
+ * target attributes and picked at first use from the CPU feature bits.
+ * Other architectures (and builds with -DJCT_NO_SIMD) only get the portable
+ * scalar kernels.
+ *
+ * Setting JCT_SIMD=scalar|sse2|avx2|avx512bw in the environment forces a
+ * variant (if the CPU supports it), which is useful for testing.
+ */
+
+#include "json_simd.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(JCT_NO_SIMD) && defined(__GNUC__) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define JSON_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Scalar kernels
+static size_t scan_string_scalar(const char *s, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '"' || s[i] == '\\') {
+      return i;
+    }
+  }
+  return len;
+}
+
+static size_t scan_escape_scalar(const char *s, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c == '"' || c == '\\' || c < 0x20) {
+      return i;
+    }
+  }
+  return len;
+}
+
+#ifdef JSON_SIMD_X86
+
+// SSE2 kernels (16 bytes per step)
+__attribute__((target("sse2"))) static size_t
+scan_string_sse2(const char *s, size_t len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i hit =
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask) {
+      return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+  }
+  return i + scan_string_scalar(s + i, len - i);
+}
+
+__attribute__((target("sse2"))) static size_t
+scan_escape_sse2(const char *s, size_t len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctrl = _mm_set1_epi8(0x1f);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    // Unsigned v <= 0x1f  <=>  min(v, 0x1f) == v
+    __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v);
+    __m128i hit = _mm_or_si128(
+        low, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask) {
+      return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+  }
+  return i + scan_escape_scalar(s + i, len - i);
+}
+
+// AVX2 kernels (32 bytes per step)
+__attribute__((target("avx2"))) static size_t
+scan_string_avx2(const char *s, size_t len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i bslash = _mm256_set1_epi8('\\');
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                  _mm256_cmpeq_epi8(v, bslash));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+  return i + scan_string_sse2(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_escape_avx2(const char *s, size_t len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i bslash = _mm256_set1_epi8('\\');
+  const __m256i ctrl = _mm256_set1_epi8(0x1f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v);
+    __m256i hit = _mm256_or_si256(
+        low, _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                             _mm256_cmpeq_epi8(v, bslash)));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+  return i + scan_escape_sse2(s + i, len - i);
+}
+
+// AVX-512BW kernels (64 bytes per step)
+__attribute__((target("avx512bw"))) static size_t
+scan_string_avx512(const char *s, size_t len) {
+  const __m512i quote = _mm512_set1_epi8('"');
+  const __m512i bslash = _mm512_set1_epi8('\\');
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i v = _mm512_loadu_si512((const void *)(s + i));
+    __mmask64 mask =
+        _mm512_cmpeq_epi8_mask(v, quote) | _mm512_cmpeq_epi8_mask(v, bslash);
+    if (mask) {
+      return i + (size_t)__builtin_ctzll((unsigned long long)mask);
+    }
+  }
+  return i + scan_string_avx2(s + i, len - i);
+}
+
+__attribute__((target("avx512bw"))) static size_t
+scan_escape_avx512(const char *s, size_t len) {
+  const __m512i quote = _mm512_set1_epi8('"');
+  const __m512i bslash = _mm512_set1_epi8('\\');
+  const __m512i ctrl = _mm512_set1_epi8(0x1f);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i v = _mm512_loadu_si512((const void *)(s + i));
+    __mmask64 mask = _mm512_cmpeq_epi8_mask(v, quote) |
+                     _mm512_cmpeq_epi8_mask(v, bslash) |
+                     _mm512_cmple_epu8_mask(v, ctrl);
+    if (mask) {
+      return i + (size_t)__builtin_ctzll((unsigned long long)mask);
+    }
+  }
+  return i + scan_escape_avx2(s + i, len - i);
+}
+
+#endif /* JSON_SIMD_X86 */
+
+// Dispatch table
+typedef struct {
+  const char *name;
+  size_t (*scan_string)(const char *, size_t);
+  size_t (*scan_escape)(const char *, size_t);
+} SimdKernels;
+
+static const SimdKernels kernels_scalar = {"scalar", scan_string_scalar,
+                                           scan_escape_scalar};
+#ifdef JSON_SIMD_X86
+static const SimdKernels kernels_sse2 = {"sse2", scan_string_sse2,
+                                         scan_escape_sse2};
+static const SimdKernels kernels_avx2 = {"avx2", scan_string_avx2,
+                                         scan_escape_avx2};
+static const SimdKernels kernels_avx512 = {"avx512bw", scan_string_avx512,
+                                           scan_escape_avx512};
+#endif
+
+static const SimdKernels *active_kernels = NULL;
+
+// Picks the widest variant the CPU supports, capped by $JCT_SIMD if set
+static const SimdKernels *select_kernels(void) {
+  const SimdKernels *best = &kernels_scalar;
+#ifdef JSON_SIMD_X86
+  const SimdKernels *candidates[3] = {&kernels_sse2, &kernels_avx2,
+                                      &kernels_avx512};
+  int supported[3];
+  __builtin_cpu_init();
+  supported[0] = __builtin_cpu_supports("sse2");
+  supported[1] = supported[0] && __builtin_cpu_supports("avx2");
+  supported[2] = supported[1] && __builtin_cpu_supports("avx512bw");
+
+  const char *want = getenv("JCT_SIMD");
+  for (int i = 0; i < 3; i++) {
+    if (!supported[i])
+      break;
+    best = candidates[i];
+    if (want && strcmp(want, candidates[i]->name) == 0)
+      break;
+  }
+  if (want && strcmp(want, "scalar") == 0)
+    best = &kernels_scalar;
+#endif
+  return best;
+}
+
+// The parser and serializer scan from several threads at once
+#ifdef __GNUC__
+#define LOAD_KERNELS() __atomic_load_n(&active_kernels, __ATOMIC_ACQUIRE)
+#define STORE_KERNELS(k)                                                       \
+  __atomic_store_n(&active_kernels, (k), __ATOMIC_RELEASE)
+#else
+#define LOAD_KERNELS() active_kernels
+#define STORE_KERNELS(k) (active_kernels = (k))
+#endif
+
+// Resolves the kernels on first use. Concurrent first calls may both run the
+// selection, but they store the same pointer.
+static const SimdKernels *kernels(void) {
+  const SimdKernels *k = LOAD_KERNELS();
+  if (!k) {
+    k = select_kernels();
+    STORE_KERNELS(k);
+  }
+  return k;
+}
+
+size_t json_scan_string(const char *s, size_t len) {
+  return kernels()->scan_string(s, len);
+}
+
+size_t json_scan_escape(const char *s, size_t len) {
+  return kernels()->scan_escape(s, len);
+}
+
+const char *json_simd_backend(void) {
+  return kernels()->name;
+}
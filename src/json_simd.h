@@ -0,0 +1,23 @@
+/**
+ * json_simd.h - Byte scanning kernels with runtime CPU dispatch
+ *
+ * Internal to the library; not installed.
+ */
+
+#ifndef JSON_SIMD_H
+#define JSON_SIMD_H
+
+#include <stddef.h>
+
+// Returns the offset of the first '"' or '\\' in s[0..len), or len if none.
+size_t json_scan_string(const char *s, size_t len);
+
+// Returns the offset of the first byte that may need escaping on output
+// ('"', '\\' or a control character below 0x20), or len if none.
+size_t json_scan_escape(const char *s, size_t len);
+
+// Name of the kernel variant selected for this CPU ("scalar", "sse2",
+// "avx2" or "avx512bw").
+const char *json_simd_backend(void);
+
+#endif /* JSON_SIMD_H */
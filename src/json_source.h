@@ -0,0 +1,17 @@
+/**
+ * json_source.h - Input kept by lazily parsed documents
+ *
+ * Internal to the library; not installed.
+ */
+
+#ifndef JSON_SOURCE_H
+#define JSON_SOURCE_H
+
+#include "json_config.h"
+
+// Releases the input a document root owns (JSON_FLAG_OWNS_SOURCE): the
+// file mapping or buffer its lazy values point into. The root's own
+// allocation is left to the caller.
+void json_release_source(JsonValue *root);
+
+#endif /* JSON_SOURCE_H */
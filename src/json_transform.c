@@ -0,0 +1,487 @@
+/**
+ * json_transform.c - Streaming keep/drop/redact/rename of a document
+ *
+ * 'jct <file> transform' copies a document from json_tokenizer_* tokens to
+ * an output, deciding for each member or element from its path whether to
+ * write it, and never builds a JsonValue tree. Paths are matched against
+ * dotted patterns as 'get' spells them, with '*' and '..' wildcards (see
+ * json_pattern.c).
+ *
+ * Stages, all applied in the same pass and matched against input names:
+ *   drop    leave out matching values
+ *   keep    write only matching values and the containers leading to them
+ *   redact  write "[redacted]" in place of matching values
+ *   rename  write matching members under a new name (pattern=new)
+ *
+ * A new name is a single key, so it may not contain '.', and a rename may
+ * not give a member the name of a sibling that is also written: as output
+ * is streamed, that is only found when the second one is reached, and the
+ * transform fails there.
+ *
+ * Output is indented like 'print', in document order. Containers that
+ * --keep only passes through are written once they turn out to hold a kept
+ * value, so projections do not leave empty shells behind.
+ */
+
+#include "json_pattern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  JsonPattern pattern;
+  char *rename; // quoted and escaped new name (rename stage)
+  char *name;   // the new name as given
+  size_t group; // index of the first rename to the same name
+} TransformPattern;
+
+struct JsonTransform {
+  TransformPattern *patterns[JSON_TRANSFORM_STAGES];
+  size_t counts[JSON_TRANSFORM_STAGES];
+};
+
+// An object or array being copied
+typedef struct {
+  int is_object;
+  int keep_all;  // everything below passes --keep
+  int opened;    // its bracket has been written
+  size_t written; // entries written
+  long next_index;
+  const char *key; // quoted member name to write before the bracket
+  size_t key_len;
+  long claim; // rename group of that name, or -1 (see claim_name)
+} Frame;
+
+typedef struct {
+  const JsonTransform *transform;
+  FILE *out;
+  Frame *frames;
+  int depth;
+  int opened; // frames[0..opened) have been written
+  JsonPathStep *path;
+  int path_len;
+  int cap;
+  // For each frame, which rename groups name a member it has written
+  unsigned char *claimed;
+  // New name of a rename that would repeat a member's name, or NULL
+  const char *duplicate;
+} Transformer;
+
+JsonTransform *json_transform_create(void) {
+  return (JsonTransform *)json_calloc(1, sizeof(JsonTransform));
+}
+
+void json_transform_free(JsonTransform *transform) {
+  if (!transform) {
+    return;
+  }
+  for (int s = 0; s < JSON_TRANSFORM_STAGES; s++) {
+    for (size_t i = 0; i < transform->counts[s]; i++) {
+      json_pattern_free(&transform->patterns[s][i].pattern);
+      json_free(transform->patterns[s][i].rename);
+      json_free(transform->patterns[s][i].name);
+    }
+    json_free(transform->patterns[s]);
+  }
+  json_free(transform);
+}
+
+/**
+ * Adds comma-separated patterns to a stage
+ *
+ * For JSON_TRANSFORM_RENAME each entry is pattern=new_name, where
+ * new_name is a single key (no '.').
+ *
+ * @return 1 on success, 0 if a pattern is malformed or on allocation
+ *         failure
+ */
+int json_transform_add(JsonTransform *transform, JsonTransformStage stage,
+                       const char *patterns) {
+  if (!transform || !patterns || stage < 0 ||
+      stage >= JSON_TRANSFORM_STAGES) {
+    return 0;
+  }
+  const char *p = patterns;
+  do {
+    size_t len = strcspn(p, ",");
+    TransformPattern *list = (TransformPattern *)json_realloc(
+        transform->patterns[stage],
+        (transform->counts[stage] + 1) * sizeof(TransformPattern));
+    if (!list) {
+      return 0;
+    }
+    transform->patterns[stage] = list;
+    TransformPattern *pattern = &list[transform->counts[stage]];
+    memset(pattern, 0, sizeof(*pattern));
+    transform->counts[stage]++;
+
+    size_t pattern_len = len;
+    if (stage == JSON_TRANSFORM_RENAME) {
+      const char *eq = memchr(p, '=', len);
+      if (!eq || eq + 1 == p + len) {
+        return 0;
+      }
+      pattern_len = (size_t)(eq - p);
+      char *name = (char *)json_malloc(len - pattern_len);
+      if (!name) {
+        return 0;
+      }
+      memcpy(name, eq + 1, len - pattern_len - 1);
+      name[len - pattern_len - 1] = '\0';
+      pattern->name = name;
+      if (strchr(name, '.')) {
+        return 0;
+      }
+      pattern->group = transform->counts[stage] - 1;
+      for (size_t i = 0; i + 1 < transform->counts[stage]; i++) {
+        if (strcmp(list[i].name, name) == 0) {
+          pattern->group = list[i].group;
+          break;
+        }
+      }
+      char *escaped = json_escape_string(name);
+      if (!escaped) {
+        return 0;
+      }
+      size_t escaped_len = strlen(escaped);
+      pattern->rename = (char *)json_malloc(escaped_len + 3);
+      if (pattern->rename) {
+        pattern->rename[0] = '"';
+        memcpy(pattern->rename + 1, escaped, escaped_len);
+        memcpy(pattern->rename + 1 + escaped_len, "\"", 2);
+      }
+      json_free(escaped);
+      if (!pattern->rename) {
+        return 0;
+      }
+    }
+    if (!json_pattern_parse(&pattern->pattern, p, pattern_len)) {
+      return 0;
+    }
+    p += len;
+  } while (*p++ == ',');
+  return 1;
+}
+
+// Best match of the current path among a stage's patterns; *which is set
+// to the first full match
+static JsonMatch match_stage(const Transformer *t, JsonTransformStage stage,
+                             const TransformPattern **which) {
+  JsonMatch best = JSON_MATCH_NONE;
+  for (size_t i = 0; i < t->transform->counts[stage]; i++) {
+    const TransformPattern *pattern = &t->transform->patterns[stage][i];
+    JsonMatch m = json_pattern_match(&pattern->pattern, t->path, t->path_len);
+    if (m == JSON_MATCH_FULL) {
+      if (which) {
+        *which = pattern;
+      }
+      return m;
+    }
+    if (m > best) {
+      best = m;
+    }
+  }
+  return best;
+}
+
+static void write_indent(FILE *out, int level) {
+  for (int i = 0; i < level; i++) {
+    fputs("  ", out);
+  }
+}
+
+// Rename group whose new name is name (len bytes), or -1
+static long rename_group(const Transformer *t, const char *name, size_t len) {
+  const JsonTransform *tr = t->transform;
+  for (size_t i = 0; i < tr->counts[JSON_TRANSFORM_RENAME]; i++) {
+    const TransformPattern *pattern = &tr->patterns[JSON_TRANSFORM_RENAME][i];
+    if (strlen(pattern->name) == len && memcmp(pattern->name, name, len) == 0) {
+      return (long)pattern->group;
+    }
+  }
+  return -1;
+}
+
+// Records that frame level writes a member named by rename group claim;
+// 0 if one was already written there (nothing is recorded then)
+static int claim_name(Transformer *t, int level, long claim) {
+  if (claim < 0) {
+    return 1;
+  }
+  unsigned char *claimed =
+      &t->claimed[(size_t)level * t->transform->counts[JSON_TRANSFORM_RENAME]];
+  if (claimed[claim]) {
+    t->duplicate = t->transform->patterns[JSON_TRANSFORM_RENAME][claim].name;
+    return 0;
+  }
+  claimed[claim] = 1;
+  return 1;
+}
+
+// Writes the separator, indentation and key before an entry of frame level;
+// 0 if the key would repeat one already written there (see claim_name)
+static int write_separator(Transformer *t, int level, const char *key,
+                           size_t key_len, long claim) {
+  Frame *parent = &t->frames[level];
+  if (!claim_name(t, level, claim)) {
+    return 0;
+  }
+  fputs(parent->written++ ? ",\n" : "\n", t->out);
+  write_indent(t->out, level + 1);
+  if (key) {
+    fwrite(key, 1, key_len, t->out);
+    fputs(": ", t->out);
+  }
+  return 1;
+}
+
+// Writes the brackets of the frames still pending, outermost first; 0 if
+// a key would repeat (see write_separator)
+static int open_frames(Transformer *t) {
+  for (; t->opened < t->depth; t->opened++) {
+    Frame *frame = &t->frames[t->opened];
+    if (t->opened > 0 && !write_separator(t, t->opened - 1, frame->key,
+                                          frame->key_len, frame->claim)) {
+      return 0;
+    }
+    fputc(frame->is_object ? '{' : '[', t->out);
+    frame->opened = 1;
+  }
+  return 1;
+}
+
+// Starts a new entry of the innermost frame; 0 if its key would repeat
+static int begin_entry(Transformer *t, const char *key, size_t key_len,
+                       long claim) {
+  return open_frames(t) &&
+         write_separator(t, t->depth - 1, key, key_len, claim);
+}
+
+static void end_frame(Transformer *t) {
+  Frame *frame = &t->frames[t->depth - 1];
+  if (frame->opened) {
+    if (frame->written) {
+      fputc('\n', t->out);
+      write_indent(t->out, t->depth - 1);
+    }
+    fputc(frame->is_object ? '}' : ']', t->out);
+    t->opened--;
+  }
+  t->depth--;
+}
+
+static int reserve_depth(Transformer *t) {
+  if (t->depth < t->cap && t->path_len < t->cap) {
+    return 1;
+  }
+  int cap = t->cap ? t->cap * 2 : 32;
+  Frame *frames = (Frame *)json_realloc(t->frames, cap * sizeof(Frame));
+  if (!frames) {
+    return 0;
+  }
+  t->frames = frames;
+  JsonPathStep *path =
+      (JsonPathStep *)json_realloc(t->path, cap * sizeof(JsonPathStep));
+  if (!path) {
+    return 0;
+  }
+  t->path = path;
+  size_t renames = t->transform->counts[JSON_TRANSFORM_RENAME];
+  if (renames) {
+    unsigned char *claimed =
+        (unsigned char *)json_realloc(t->claimed, (size_t)cap * renames);
+    if (!claimed) {
+      return 0;
+    }
+    t->claimed = claimed;
+  }
+  t->cap = cap;
+  return 1;
+}
+
+static int push_frame(Transformer *t, const JsonToken *token, int keep_all,
+                      const char *key, size_t key_len, long claim) {
+  if (!reserve_depth(t)) {
+    return 0;
+  }
+  size_t renames = t->transform->counts[JSON_TRANSFORM_RENAME];
+  if (renames) {
+    memset(t->claimed + (size_t)t->depth * renames, 0, renames);
+  }
+  Frame *frame = &t->frames[t->depth++];
+  frame->is_object = token->type == JSON_TOKEN_OBJECT_START;
+  frame->keep_all = keep_all;
+  frame->opened = 0;
+  frame->written = 0;
+  frame->next_index = 0;
+  frame->key = key;
+  frame->key_len = key_len;
+  frame->claim = claim;
+  return 1;
+}
+
+static void pop_path(Transformer *t) {
+  json_free(t->path[--t->path_len].owned);
+}
+
+// Copies the value starting at token, whose path entry is already pushed
+static int copy_value(Transformer *t, JsonTokenizer *in, JsonToken *token,
+                      const char *key, size_t key_len) {
+  const JsonTransform *tr = t->transform;
+  Frame *parent = &t->frames[t->depth - 1];
+  int container = token->type == JSON_TOKEN_OBJECT_START ||
+                  token->type == JSON_TOKEN_ARRAY_START;
+
+  if (tr->counts[JSON_TRANSFORM_DROP] &&
+      match_stage(t, JSON_TRANSFORM_DROP, NULL) == JSON_MATCH_FULL) {
+    pop_path(t);
+    return json_tokenizer_skip_value(in, token, NULL, NULL);
+  }
+  int keep_all = parent->keep_all;
+  if (!keep_all) {
+    JsonMatch m = match_stage(t, JSON_TRANSFORM_KEEP, NULL);
+    if (m == JSON_MATCH_NONE || (m == JSON_MATCH_PREFIX && !container)) {
+      pop_path(t);
+      return json_tokenizer_skip_value(in, token, NULL, NULL);
+    }
+    keep_all = m == JSON_MATCH_FULL;
+  }
+  // Members written under a name some rename gives are tracked, so that
+  // two of them in one object are caught
+  const TransformPattern *rename = NULL;
+  long claim = -1;
+  if (key && tr->counts[JSON_TRANSFORM_RENAME]) {
+    if (match_stage(t, JSON_TRANSFORM_RENAME, &rename) == JSON_MATCH_FULL) {
+      key = rename->rename;
+      key_len = strlen(key);
+      claim = (long)rename->group;
+    } else {
+      const JsonPathStep *entry = &t->path[t->path_len - 1];
+      claim = rename_group(t, entry->name, entry->len);
+    }
+  }
+  if (tr->counts[JSON_TRANSFORM_REDACT] &&
+      match_stage(t, JSON_TRANSFORM_REDACT, NULL) == JSON_MATCH_FULL) {
+    pop_path(t);
+    if (!json_tokenizer_skip_value(in, token, NULL, NULL)) {
+      return 0;
+    }
+    if (begin_entry(t, key, key_len, claim)) {
+      fputs("\"[redacted]\"", t->out);
+    }
+    return 1;
+  }
+
+  if (container) {
+    // The path entry stays until the container ends
+    if (!push_frame(t, token, keep_all, key, key_len, claim)) {
+      return 0;
+    }
+    if (keep_all) {
+      open_frames(t); // written even if it ends up empty
+    }
+    return 1;
+  }
+  pop_path(t);
+  if (begin_entry(t, key, key_len, claim)) {
+    fwrite(token->start, 1, token->length, t->out);
+  }
+  return 1;
+}
+
+/**
+ * Copies the document read from in to out, applying the transform's
+ * stages in one pass
+ *
+ * Nothing is buffered beyond the path being read: output is written as the
+ * input is read, so on malformed input part of it has been written.
+ *
+ * @return 1 on success, 0 if the input is malformed, on allocation failure
+ *         or if writing fails, -1 if a rename would give two members of an
+ *         object the same name (reported)
+ */
+int json_transform_stream(const JsonTransform *transform, JsonTokenizer *in,
+                          FILE *out) {
+  JsonToken token;
+  if (!transform || !in || !out || !json_tokenizer_next(in, &token)) {
+    return 0;
+  }
+  if (token.type != JSON_TOKEN_OBJECT_START &&
+      token.type != JSON_TOKEN_ARRAY_START) {
+    // A scalar document has no members to transform
+    if (token.type < JSON_TOKEN_STRING) {
+      return 0;
+    }
+    fwrite(token.start, 1, token.length, out);
+  } else {
+    Transformer t = {.transform = transform, .out = out};
+    int ok = push_frame(&t, &token, !transform->counts[JSON_TRANSFORM_KEEP],
+                        NULL, 0, -1);
+    if (ok) {
+      open_frames(&t); // the root is written even if nothing is kept
+    }
+    while (ok && !t.duplicate && t.depth > 0) {
+      ok = json_tokenizer_next(in, &token);
+      if (!ok) {
+        break;
+      }
+      if (token.type == JSON_TOKEN_OBJECT_END ||
+          token.type == JSON_TOKEN_ARRAY_END) {
+        end_frame(&t);
+        if (t.depth > 0) {
+          pop_path(&t);
+        }
+        continue;
+      }
+      ok = reserve_depth(&t);
+      if (!ok) {
+        break;
+      }
+      Frame *frame = &t.frames[t.depth - 1];
+      JsonPathStep *entry = &t.path[t.path_len];
+      entry->owned = NULL;
+      const char *key = NULL;
+      size_t key_len = 0;
+      if (frame->is_object) {
+        key = token.start;
+        key_len = token.length;
+        if (token.escaped) {
+          entry->owned = json_token_string(&token);
+          ok = entry->owned != NULL;
+        }
+        entry->name = entry->owned ? entry->owned : token.start + 1;
+        entry->len = entry->owned ? strlen(entry->owned) : token.length - 2;
+        entry->index = -1;
+        ok = ok && json_tokenizer_next(in, &token);
+      } else {
+        entry->name = NULL;
+        entry->len = 0;
+        entry->index = frame->next_index++;
+      }
+      t.path_len++;
+      ok = ok && copy_value(&t, in, &token, key, key_len);
+    }
+    while (t.path_len > 0) {
+      pop_path(&t);
+    }
+    json_free(t.frames);
+    json_free(t.path);
+    json_free(t.claimed);
+    if (ok && t.duplicate) {
+      fputc('\n', out);
+      fflush(out);
+      fprintf(stderr,
+              "Error: Renaming to '%s' gives an object two members of that "
+              "name\n",
+              t.duplicate);
+      return -1;
+    }
+    if (!ok) {
+      return 0;
+    }
+  }
+  fputc('\n', out);
+  // Unlike the tree parser, trailing data is not tolerated
+  return json_tokenizer_next(in, &token) && token.type == JSON_TOKEN_END &&
+         !ferror(out);
+}
@@ -3,15 +3,167 @@
  */
 
 #include "json_config.h"
+#include "json_packed.h"
+#include "json_source.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Sorted objects (JSON_FLAG_SORTED) keep their members in one allocation,
+// ordered by key, so lookups can binary search. The next links are kept up
+// to date so code that walks object_head works unchanged.
+typedef struct {
+  size_t count;
+  size_t capacity;
+  JsonKeyValue items[];
+} JsonKeyBlock;
+
+static JsonKeyBlock *key_block(const JsonValue *object) {
+  if (!object->value.object_head) {
+    return NULL;
+  }
+  return (JsonKeyBlock *)((char *)object->value.object_head -
+                          offsetof(JsonKeyBlock, items));
+}
+
+// Rebuilds the next links of block items starting at index from
+static void link_key_block(JsonKeyBlock *block, size_t from) {
+  for (size_t i = from; i < block->count; i++) {
+    block->items[i].next = i + 1 < block->count ? &block->items[i + 1] : NULL;
+  }
+}
+
+// strcmp of a stored key against the first len bytes of key, which
+// contain no NUL
+static int compare_key_n(const char *stored, const char *key, size_t len) {
+  int cmp = strncmp(stored, key, len);
+  if (cmp == 0 && stored[len] != '\0') {
+    return 1;
+  }
+  return cmp;
+}
+
+// Binary search; returns the index of key, or its insertion point
+static size_t find_sorted_key(const JsonKeyBlock *block, const char *key,
+                              size_t len, int *found) {
+  size_t lo = 0;
+  size_t hi = block->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = compare_key_n(block->items[mid].key, key, len);
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *found = 0;
+  return lo;
+}
+
+// Grows the block of a sorted object to hold capacity members
+static JsonKeyBlock *grow_key_block(JsonValue *object, size_t capacity) {
+  JsonKeyBlock *block = key_block(object);
+  if (capacity > (SIZE_MAX - sizeof(JsonKeyBlock)) / sizeof(JsonKeyValue)) {
+    return NULL;
+  }
+  JsonKeyBlock *grown = (JsonKeyBlock *)json_realloc(
+      block, sizeof(JsonKeyBlock) + capacity * sizeof(JsonKeyValue));
+  if (!grown) {
+    return NULL;
+  }
+  if (!block) {
+    grown->count = 0;
+  }
+  grown->capacity = capacity;
+  link_key_block(grown, 0);
+  object->value.object_head = grown->items;
+  return grown;
+}
+
+// Array elements also live in one allocation, so appending takes amortized
+// constant time and get_array_item indexes directly. The next links are
+// kept up to date for code that walks array_head.
+typedef struct {
+  size_t count;
+  size_t capacity;
+  JsonArrayItem items[];
+} JsonItemBlock;
+
+static JsonItemBlock *item_block(const JsonValue *array) {
+  if (!array->value.array_head) {
+    return NULL;
+  }
+  return (JsonItemBlock *)((char *)array->value.array_head -
+                           offsetof(JsonItemBlock, items));
+}
+
+// Rebuilds the next links of block items starting at index from
+static void link_item_block(JsonItemBlock *block, size_t from) {
+  for (size_t i = from; i < block->count; i++) {
+    block->items[i].next = i + 1 < block->count ? &block->items[i + 1] : NULL;
+  }
+}
+
+// Grows the block of an array to hold capacity elements
+static JsonItemBlock *grow_item_block(JsonValue *array, size_t capacity) {
+  JsonItemBlock *block = item_block(array);
+  if (capacity > (SIZE_MAX - sizeof(JsonItemBlock)) / sizeof(JsonArrayItem)) {
+    return NULL;
+  }
+  JsonItemBlock *grown = (JsonItemBlock *)json_realloc(
+      block, sizeof(JsonItemBlock) + capacity * sizeof(JsonArrayItem));
+  if (!grown) {
+    return NULL;
+  }
+  if (!block) {
+    grown->count = 0;
+  }
+  grown->capacity = capacity;
+  link_item_block(grown, 0);
+  array->value.array_head = grown->items;
+  return grown;
+}
+
+// Links the elements of a packed array for walking, once
+static JsonArrayItem *link_packed(JsonPackedArray *block) {
+  if (!block->items) {
+    JsonArrayItem *items =
+        (JsonArrayItem *)json_malloc(block->count * sizeof(JsonArrayItem));
+    if (!items) {
+      return NULL;
+    }
+    for (size_t i = 0; i < block->count; i++) {
+      items[i].value = &block->values[i];
+      items[i].next = i + 1 < block->count ? &items[i + 1] : NULL;
+    }
+    block->items = items;
+  }
+  return block->items;
+}
+
+// Frees a packed array's elements and block. Once linked, the links say
+// which values are elements: one that was replaced through its link has
+// been released by whoever replaced it.
+static void free_packed(JsonPackedArray *block) {
+  for (size_t i = 0; i < block->count; i++) {
+    free_json_value(block->items ? block->items[i].value : &block->values[i]);
+  }
+  json_free(block->items);
+  json_free(block);
+}
+
 /**
  * Creates a new JSON value of the specified type
  */
 JsonValue *create_json_value(JsonType type) {
-  JsonValue *value = (JsonValue *)malloc(sizeof(JsonValue));
+  JsonValue *value = (JsonValue *)json_malloc(sizeof(JsonValue));
   if (!value) {
     return NULL;
   }
@@ -22,6 +174,71 @@ JsonValue *create_json_value(JsonType type) {
   return value;
 }
 
+/**
+ * Reports the source lexeme of a number kept raw by a lazy parse
+ *
+ * The lexeme is not NUL-terminated when it points into the source.
+ *
+ * @return The lexeme length, or 0 if value is not a raw number
+ */
+size_t json_number_lexeme(const JsonValue *value, const char **lexeme) {
+  if (!value || value->type != JSON_NUMBER ||
+      !(value->flags & JSON_FLAG_RAW_NUMBER)) {
+    return 0;
+  }
+  *lexeme = value->value.string;
+  return strspn(value->value.string, "0123456789+-.eE");
+}
+
+/**
+ * Returns the value of a number, decoding a raw lexeme if needed
+ */
+double json_number_value(const JsonValue *value) {
+  if (!value || value->type != JSON_NUMBER) {
+    return 0;
+  }
+  const char *lexeme;
+  size_t len = json_number_lexeme(value, &lexeme);
+  if (!len) {
+    return value->value.number;
+  }
+
+  // Bound strtod by the lexeme, whatever follows it in the source
+  char buffer[64];
+  if (len < sizeof(buffer)) {
+    memcpy(buffer, lexeme, len);
+    buffer[len] = '\0';
+    return strtod(buffer, NULL);
+  }
+  char *copy = (char *)json_malloc(len + 1);
+  if (!copy) {
+    return strtod(lexeme, NULL);
+  }
+  memcpy(copy, lexeme, len);
+  copy[len] = '\0';
+  double d = strtod(copy, NULL);
+  json_free(copy);
+  return d;
+}
+
+/**
+ * Replaces the value of a number, dropping its raw lexeme
+ *
+ * A number shared by hash-consing must be made private first (see
+ * json_unshare).
+ */
+void json_set_number(JsonValue *value, double number) {
+  if (!value || value->type != JSON_NUMBER) {
+    return;
+  }
+  if ((value->flags & JSON_FLAG_RAW_NUMBER) &&
+      !(value->flags & JSON_FLAG_BORROWED)) {
+    json_free(value->value.string);
+  }
+  value->flags &= ~(JSON_FLAG_RAW_NUMBER | JSON_FLAG_BORROWED);
+  value->value.number = number;
+}
+
 /**
  * Frees a JSON value and all its children
  */
@@ -30,27 +247,76 @@ void free_json_value(JsonValue *value) {
     return;
   }
 
+  // A value shared by hash-consing outlives all but its last reference
+  if (value->flags >= JSON_REF_ONE) {
+    value->flags -= JSON_REF_ONE;
+    return;
+  }
+
+  // An element of a packed array only owns its lexeme, if any
+  if (value->flags & JSON_FLAG_INLINE) {
+    if ((value->flags & JSON_FLAG_RAW_NUMBER) &&
+        !(value->flags & JSON_FLAG_BORROWED)) {
+      json_free(value->value.string);
+    }
+    value->flags &= ~JSON_FLAG_RAW_NUMBER;
+    return;
+  }
+
+  // An unexpanded container only refers to the document source
+  if (value->flags & JSON_FLAG_LAZY) {
+    json_free((void *)value->value.lazy);
+    if (value->flags & JSON_FLAG_OWNS_SOURCE) {
+      json_release_source(value);
+    }
+    json_free(value);
+    return;
+  }
+
   switch (value->type) {
+  case JSON_NUMBER:
+    if ((value->flags & JSON_FLAG_RAW_NUMBER) &&
+        !(value->flags & JSON_FLAG_BORROWED)) {
+      json_free(value->value.string);
+    }
+    break;
   case JSON_STRING:
-    free(value->value.string);
+    if (!(value->flags & JSON_FLAG_BORROWED)) {
+      json_free(value->value.string);
+    }
     break;
   case JSON_ARRAY: {
-    JsonArrayItem *item = value->value.array_head;
-    while (item) {
-      JsonArrayItem *next = item->next;
-      free_json_value(item->value);
-      free(item);
-      item = next;
+    if (value->flags & JSON_FLAG_PACKED) {
+      free_packed(value->value.packed);
+      break;
+    }
+    JsonItemBlock *block = item_block(value);
+    if (block) {
+      for (size_t i = 0; i < block->count; i++) {
+        free_json_value(block->items[i].value);
+      }
+      json_free(block);
     }
     break;
   }
   case JSON_OBJECT: {
+    if (value->flags & JSON_FLAG_SORTED) {
+      JsonKeyBlock *block = key_block(value);
+      if (block) {
+        for (size_t i = 0; i < block->count; i++) {
+          json_free(block->items[i].key);
+          free_json_value(block->items[i].value);
+        }
+        json_free(block);
+      }
+      break;
+    }
     JsonKeyValue *kv = value->value.object_head;
     while (kv) {
       JsonKeyValue *next = kv->next;
-      free(kv->key);
+      json_free(kv->key);
       free_json_value(kv->value);
-      free(kv);
+      json_free(kv);
       kv = next;
     }
     break;
@@ -60,14 +326,17 @@ void free_json_value(JsonValue *value) {
     break;
   }
 
-  free(value);
+  if (value->flags & JSON_FLAG_OWNS_SOURCE) {
+    json_release_source(value);
+  }
+  json_free(value);
 }
 
 /**
  * Deeply clones a JSON value
  */
 JsonValue *clone_json_value(const JsonValue *value) {
-  if (!value)
+  if (!value || !json_expand(value))
     return NULL;
   JsonValue *out = create_json_value(value->type);
   if (!out)
@@ -78,15 +347,73 @@ JsonValue *clone_json_value(const JsonValue *value) {
   case JSON_BOOL:
     out->value.boolean = value->value.boolean;
     break;
-  case JSON_NUMBER:
-    out->value.number = value->value.number;
+  case JSON_NUMBER: {
+    const char *lexeme;
+    size_t len = json_number_lexeme(value, &lexeme);
+    if (!len) {
+      out->value.number = value->value.number;
+      break;
+    }
+    // The copy owns its lexeme, so it outlives the source document
+    char *copy = (char *)json_malloc(len + 1);
+    if (!copy) {
+      json_free(out);
+      return NULL;
+    }
+    memcpy(copy, lexeme, len);
+    copy[len] = '\0';
+    out->flags = JSON_FLAG_RAW_NUMBER;
+    out->value.string = copy;
     break;
+  }
   case JSON_STRING:
     out->value.string =
-        value->value.string ? strdup(value->value.string) : NULL;
+        value->value.string ? json_strdup(value->value.string) : NULL;
     break;
   case JSON_ARRAY: {
-    JsonArrayItem *it = value->value.array_head;
+    size_t count;
+    const JsonValue *packed = json_array_packed(value, &count);
+    if (packed) {
+      size_t size = sizeof(JsonPackedArray) + count * sizeof(JsonValue);
+      JsonPackedArray *block = (JsonPackedArray *)json_malloc(size);
+      if (!block) {
+        json_free(out);
+        return NULL;
+      }
+      memcpy(block->values, packed, count * sizeof(JsonValue));
+      block->count = count;
+      block->items = NULL;
+      out->flags = JSON_FLAG_PACKED;
+      out->value.packed = block;
+      // The copy owns its lexemes, so it outlives the source document
+      for (size_t i = 0; i < count; i++) {
+        JsonValue *element = &block->values[i];
+        const char *lexeme;
+        size_t len = json_number_lexeme(element, &lexeme);
+        char *copy = len ? (char *)json_malloc(len + 1) : NULL;
+        element->flags &= ~(JSON_FLAG_RAW_NUMBER | JSON_FLAG_BORROWED);
+        if (len && !copy) {
+          for (size_t j = i + 1; j < count; j++) {
+            block->values[j].flags &= ~JSON_FLAG_RAW_NUMBER;
+          }
+          free_json_value(out);
+          return NULL;
+        }
+        if (copy) {
+          memcpy(copy, lexeme, len);
+          copy[len] = '\0';
+          element->flags |= JSON_FLAG_RAW_NUMBER;
+          element->value.string = copy;
+        }
+      }
+      break;
+    }
+    JsonItemBlock *items = item_block(value);
+    if (items && !json_reserve(out, items->count)) {
+      json_free(out);
+      return NULL;
+    }
+    JsonArrayItem *it = json_array_first(value);
     while (it) {
       JsonValue *child = clone_json_value(it->value);
       if (!child || !add_to_array(out, child)) {
@@ -100,12 +427,20 @@ JsonValue *clone_json_value(const JsonValue *value) {
     break;
   }
   case JSON_OBJECT: {
+    // Members of a sorted object arrive in order, so each add appends.
+    // Keys are unique already and need no check.
+    out->flags = value->flags & JSON_FLAG_SORTED;
+    JsonKeyBlock *members = out->flags ? key_block(value) : NULL;
+    if (members && !json_reserve(out, members->count)) {
+      json_free(out);
+      return NULL;
+    }
     JsonKeyValue *kv = value->value.object_head;
     while (kv) {
       JsonValue *child = clone_json_value(kv->value);
-      if (!child || !add_to_object(out, kv->key ? kv->key : "", child)) {
-        if (child)
-          free_json_value(child);
+      char *key = child ? json_strdup(kv->key ? kv->key : "") : NULL;
+      if (!key || !json_object_add_owned(out, key, child)) {
+        free_json_value(child);
         free_json_value(out);
         return NULL;
       }
@@ -117,14 +452,65 @@ JsonValue *clone_json_value(const JsonValue *value) {
   return out;
 }
 
+/**
+ * Inserts or replaces a member of a sorted object, keeping the key order
+ *
+ * owned, if not NULL, is key allocated for the object to keep; it is freed
+ * if not needed or on failure.
+ */
+static int add_to_sorted_object(JsonValue *object, const char *key,
+                                char *owned, JsonValue *value) {
+  JsonKeyBlock *block = key_block(object);
+  int found = 0;
+  size_t pos = block ? find_sorted_key(block, key, strlen(key), &found) : 0;
+
+  if (found) {
+    json_free(owned);
+    free_json_value(block->items[pos].value);
+    block->items[pos].value = value;
+    return 1;
+  }
+
+  char *key_copy = owned ? owned : json_strdup(key);
+  if (!key_copy) {
+    return 0;
+  }
+
+  size_t count = block ? block->count : 0;
+  if (!block || count == block->capacity) {
+    // A moved block has all its links rebuilt
+    block = grow_key_block(object, count ? count * 2 : 4);
+    if (!block) {
+      json_free(key_copy);
+      return 0;
+    }
+  }
+
+  memmove(&block->items[pos + 1], &block->items[pos],
+          (count - pos) * sizeof(JsonKeyValue));
+  block->items[pos].key = key_copy;
+  block->items[pos].value = value;
+  block->count = count + 1;
+
+  // Links change only from the item before the insertion point
+  link_key_block(block, pos == 0 ? 0 : pos - 1);
+
+  return 1;
+}
+
 /**
  * Adds a key-value pair to a JSON object
  */
 int add_to_object(JsonValue *object, const char *key, JsonValue *value) {
-  if (!object || !key || !value || object->type != JSON_OBJECT) {
+  if (!object || !key || !value || object->type != JSON_OBJECT ||
+      !json_expand(object)) {
     return 0;
   }
 
+  if (object->flags & JSON_FLAG_SORTED) {
+    return add_to_sorted_object(object, key, NULL, value);
+  }
+
   // Check if key already exists, if so, replace the value
   JsonKeyValue *kv = object->value.object_head;
   while (kv) {
@@ -136,18 +522,37 @@ int add_to_object(JsonValue *object, const char *key, JsonValue *value) {
     kv = kv->next;
   }
 
-  // Create new key-value pair
-  JsonKeyValue *new_kv = (JsonKeyValue *)malloc(sizeof(JsonKeyValue));
-  if (!new_kv) {
+  char *key_copy = json_strdup(key);
+  return key_copy && json_object_add_owned(object, key_copy, value);
+}
+
+/**
+ * Adds a member to a JSON object without looking for its key
+ *
+ * For builders that know the key is new (or resolve repeated keys later
+ * with json_object_unique_keys). The object takes ownership of key, which
+ * must come from json_malloc, and frees it on failure too; value stays
+ * the caller's on failure. Sorted objects still replace a member with the
+ * same key, as their binary search needs unique keys.
+ */
+int json_object_add_owned(JsonValue *object, char *key, JsonValue *value) {
+  if (!object || !key || !value || object->type != JSON_OBJECT ||
+      !json_expand(object)) {
+    json_free(key);
     return 0;
   }
 
-  new_kv->key = strdup(key);
-  if (!new_kv->key) {
-    free(new_kv);
+  if (object->flags & JSON_FLAG_SORTED) {
+    return add_to_sorted_object(object, key, key, value);
+  }
+
+  JsonKeyValue *new_kv = (JsonKeyValue *)json_malloc(sizeof(JsonKeyValue));
+  if (!new_kv) {
+    json_free(key);
     return 0;
   }
 
+  new_kv->key = key;
   new_kv->value = value;
   new_kv->next = object->value.object_head;
   object->value.object_head = new_kv;
@@ -155,73 +560,322 @@ int add_to_object(JsonValue *object, const char *key, JsonValue *value) {
   return 1;
 }
 
+// Member of an object with its place in the list, for sorting by key
+typedef struct {
+  JsonKeyValue *kv;
+  size_t pos;
+} MemberRef;
+
+static int compare_member_refs(const void *a, const void *b) {
+  const MemberRef *x = (const MemberRef *)a;
+  const MemberRef *y = (const MemberRef *)b;
+  int cmp = strcmp(x->kv->key, y->kv->key);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+// Objects up to this many members are checked pair by pair
+#define PAIRWISE_MEMBERS 16
+
+/**
+ * Leaves one member per key in an object built with json_object_add_owned
+ *
+ * Each repeated key ends up where add_to_object would have put it: in the
+ * place of its first add, with the value of its last. Small objects are
+ * compared pair by pair, larger ones sorted by key, so building an object
+ * of n members this way takes O(n log n) instead of O(n^2).
+ *
+ * @return 1 on success, 0 on allocation failure (the object is unchanged)
+ */
+int json_object_unique_keys(JsonValue *object) {
+  if (!object || object->type != JSON_OBJECT ||
+      (object->flags & (JSON_FLAG_SORTED | JSON_FLAG_LAZY))) {
+    return 1;
+  }
+
+  size_t count = 0;
+  for (JsonKeyValue *kv = object->value.object_head; kv; kv = kv->next) {
+    count++;
+  }
+  if (count < 2) {
+    return 1;
+  }
+  if (count <= PAIRWISE_MEMBERS) {
+    int repeated = 0;
+    for (JsonKeyValue *a = object->value.object_head; a && !repeated;
+         a = a->next) {
+      for (JsonKeyValue *b = a->next; b && !repeated; b = b->next) {
+        repeated = strcmp(a->key, b->key) == 0;
+      }
+    }
+    if (!repeated) {
+      return 1;
+    }
+  }
+
+  MemberRef *refs = (MemberRef *)json_malloc(count * sizeof(MemberRef));
+  if (!refs) {
+    return 0;
+  }
+  size_t i = 0;
+  for (JsonKeyValue *kv = object->value.object_head; kv; kv = kv->next) {
+    refs[i].kv = kv;
+    refs[i].pos = i;
+    i++;
+  }
+  qsort(refs, count, sizeof(MemberRef), compare_member_refs);
+
+  // The list holds members newest first, so of each run of equal keys the
+  // last keeps its place and takes the value of the first. The others are
+  // marked by a NULL key and unlinked below.
+  for (i = 0; i < count;) {
+    size_t end = i + 1;
+    while (end < count && strcmp(refs[end].kv->key, refs[i].kv->key) == 0) {
+      end++;
+    }
+    if (end - i > 1) {
+      JsonKeyValue *keep = refs[end - 1].kv;
+      free_json_value(keep->value);
+      keep->value = refs[i].kv->value;
+      refs[i].kv->value = NULL;
+      for (size_t j = i; j < end - 1; j++) {
+        json_free(refs[j].kv->key);
+        free_json_value(refs[j].kv->value);
+        refs[j].kv->key = NULL;
+      }
+    }
+    i = end;
+  }
+  json_free(refs);
+
+  JsonKeyValue **link = &object->value.object_head;
+  while (*link) {
+    JsonKeyValue *kv = *link;
+    if (kv->key) {
+      link = &kv->next;
+    } else {
+      *link = kv->next;
+      json_free(kv);
+    }
+  }
+  return 1;
+}
+
+// Turns a packed array into a block of items so that it can grow. Its
+// elements are moved to values of their own, so pointers to them go stale.
+static int unpack_array(JsonValue *array) {
+  JsonArrayItem *links = json_array_first(array);
+  if (!links) {
+    return 0;
+  }
+  JsonPackedArray *packed = array->value.packed;
+  JsonItemBlock *block = (JsonItemBlock *)json_malloc(
+      sizeof(JsonItemBlock) + packed->count * sizeof(JsonArrayItem));
+  if (!block) {
+    return 0;
+  }
+  for (size_t i = 0; i < packed->count; i++) {
+    JsonValue *value = links[i].value;
+    JsonValue *moved =
+        value->flags & JSON_FLAG_INLINE ? clone_json_value(value) : value;
+    if (!moved) {
+      // Undo: free the clones, but not the elements that were already
+      // values of their own
+      for (size_t j = 0; j < i; j++) {
+        if (block->items[j].value != links[j].value) {
+          free_json_value(block->items[j].value);
+        }
+      }
+      json_free(block);
+      return 0;
+    }
+    block->items[i].value = moved;
+  }
+  block->count = packed->count;
+  block->capacity = packed->count;
+  link_item_block(block, 0);
+
+  for (size_t i = 0; i < packed->count; i++) {
+    if (links[i].value->flags & JSON_FLAG_INLINE) {
+      free_json_value(links[i].value);
+    }
+  }
+  json_free(packed->items);
+  json_free(packed);
+  array->flags &= ~JSON_FLAG_PACKED;
+  array->value.array_head = block->items;
+  return 1;
+}
+
 /**
  * Adds a value to a JSON array
+ *
+ * Adding to a packed array (see JSON_FLAG_PACKED) first gives each element
+ * a value of its own, so pointers to its elements are invalidated.
  */
 int add_to_array(JsonValue *array, JsonValue *value) {
-  if (!array || !value || array->type != JSON_ARRAY) {
+  if (!array || !value || array->type != JSON_ARRAY || !json_expand(array)) {
     return 0;
   }
+  if ((array->flags & JSON_FLAG_PACKED) && !unpack_array(array)) {
+    return 0;
+  }
+
+  // Add to the end of the array, doubling its block when full; a moved
+  // block has all its links rebuilt
+  JsonItemBlock *block = item_block(array);
+  size_t count = block ? block->count : 0;
+  if (!block || count == block->capacity) {
+    block = grow_item_block(array, count ? count * 2 : 4);
+    if (!block) {
+      return 0;
+    }
+  }
+
+  block->items[count].value = value;
+  block->items[count].next = NULL;
+  if (count > 0) {
+    block->items[count - 1].next = &block->items[count];
+  }
+  block->count = count + 1;
 
-  JsonArrayItem *new_item = (JsonArrayItem *)malloc(sizeof(JsonArrayItem));
-  if (!new_item) {
+  return 1;
+}
+
+/**
+ * Makes room for count more elements or members in a container
+ *
+ * For builders that know the size up front: the adds that follow do not
+ * reallocate. Arrays and sorted objects keep their items in one block;
+ * unsorted objects keep a list, and have nothing to reserve.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int json_reserve(JsonValue *container, size_t count) {
+  if (!container || !json_expand(container)) {
     return 0;
   }
 
-  new_item->value = value;
+  if (container->type == JSON_ARRAY) {
+    if ((container->flags & JSON_FLAG_PACKED) && !unpack_array(container)) {
+      return 0;
+    }
+    JsonItemBlock *block = item_block(container);
+    size_t used = block ? block->count : 0;
+    if (count > SIZE_MAX - used) {
+      return 0;
+    }
+    if (used + count <= (block ? block->capacity : 0)) {
+      return 1;
+    }
+    return grow_item_block(container, used + count) != NULL;
+  }
 
-  // Add to the end of the array
-  if (!array->value.array_head) {
-    new_item->next = NULL;
-    array->value.array_head = new_item;
-  } else {
-    JsonArrayItem *item = array->value.array_head;
-    while (item->next) {
-      item = item->next;
+  if (container->type == JSON_OBJECT) {
+    if (!(container->flags & JSON_FLAG_SORTED)) {
+      return 1;
+    }
+    JsonKeyBlock *block = key_block(container);
+    size_t used = block ? block->count : 0;
+    if (count > SIZE_MAX - used) {
+      return 0;
     }
-    new_item->next = NULL;
-    item->next = new_item;
+    if (used + count <= (block ? block->capacity : 0)) {
+      return 1;
+    }
+    return grow_key_block(container, used + count) != NULL;
   }
 
-  return 1;
+  return 0;
 }
 
 /**
  * Gets an item from a JSON array by index
  */
 JsonValue *get_array_item(JsonValue *array, int index) {
-  if (!array || array->type != JSON_ARRAY || index < 0) {
+  if (!array || array->type != JSON_ARRAY || index < 0 ||
+      !json_expand(array)) {
     return NULL;
   }
 
-  JsonArrayItem *item = array->value.array_head;
-  int i = 0;
-
-  while (item && i < index) {
-    item = item->next;
-    i++;
+  if (array->flags & JSON_FLAG_PACKED) {
+    JsonPackedArray *block = array->value.packed;
+    if ((size_t)index >= block->count) {
+      return NULL;
+    }
+    return block->items ? block->items[index].value : &block->values[index];
   }
 
-  return item ? item->value : NULL;
+  JsonItemBlock *block = item_block(array);
+  if (!block || (size_t)index >= block->count) {
+    return NULL;
+  }
+  return block->items[index].value;
 }
 
 /**
  * Gets the size of a JSON array
  */
 int get_array_size(JsonValue *array) {
-  if (!array || array->type != JSON_ARRAY) {
+  if (!array || array->type != JSON_ARRAY || !json_expand(array)) {
     return 0;
   }
 
-  int size = 0;
-  JsonArrayItem *item = array->value.array_head;
+  if (array->flags & JSON_FLAG_PACKED) {
+    return (int)array->value.packed->count;
+  }
+
+  JsonItemBlock *block = item_block(array);
+  return block ? (int)block->count : 0;
+}
 
-  while (item) {
-    size++;
-    item = item->next;
+/**
+ * Returns the first member of an object, expanding a lazy object first
+ *
+ * Members follow through next; use this instead of reading object_head
+ * directly so that lazily parsed documents work.
+ */
+JsonKeyValue *json_object_first(const JsonValue *object) {
+  if (!object || object->type != JSON_OBJECT || !json_expand(object)) {
+    return NULL;
+  }
+  return object->value.object_head;
+}
+
+/**
+ * Returns the first element of an array, expanding a lazy array first
+ *
+ * The first walk over a packed array links its elements; returns NULL if
+ * that fails for lack of memory.
+ */
+JsonArrayItem *json_array_first(const JsonValue *array) {
+  if (!array || array->type != JSON_ARRAY || !json_expand(array)) {
+    return NULL;
+  }
+  if (array->flags & JSON_FLAG_PACKED) {
+    return link_packed(array->value.packed);
   }
+  return array->value.array_head;
+}
 
-  return size;
+/**
+ * Returns the elements of a packed array as a C array
+ *
+ * Lets loops over arrays of numbers skip linking them. Returns NULL, and
+ * the array must be walked with json_array_first, if it is not packed or
+ * has been linked already (its elements may then have been replaced).
+ *
+ * @param count Receives the number of elements
+ */
+JsonValue *json_array_packed(const JsonValue *array, size_t *count) {
+  if (!array || array->type != JSON_ARRAY || !json_expand(array) ||
+      !(array->flags & JSON_FLAG_PACKED) || array->value.packed->items) {
+    return NULL;
+  }
+  *count = array->value.packed->count;
+  return array->value.packed->values;
 }
 
 /**
@@ -232,10 +886,33 @@ JsonValue *get_object_item(JsonValue *object, const char *key) {
     return NULL;
   }
 
+  return get_object_item_n(object, key, strlen(key));
+}
+
+/**
+ * Gets a value from a JSON object by a key of known length
+ *
+ * key need not be NUL-terminated, which lets callers look up substrings
+ * (for example C++ string views) without copying them.
+ */
+JsonValue *get_object_item_n(const JsonValue *object, const char *key,
+                             size_t len) {
+  if (!object || !key || object->type != JSON_OBJECT ||
+      memchr(key, '\0', len) || !json_expand(object)) {
+    return NULL;
+  }
+
+  if (object->flags & JSON_FLAG_SORTED) {
+    JsonKeyBlock *block = key_block(object);
+    int found = 0;
+    size_t pos = block ? find_sorted_key(block, key, len, &found) : 0;
+    return found ? block->items[pos].value : NULL;
+  }
+
   JsonKeyValue *kv = object->value.object_head;
 
   while (kv) {
-    if (strcmp(kv->key, key) == 0) {
+    if (compare_key_n(kv->key, key, len) == 0) {
       return kv->value;
     }
     kv = kv->next;
@@ -243,3 +920,179 @@ JsonValue *get_object_item(JsonValue *object, const char *key) {
 
   return NULL;
 }
+
+static int compare_members(const void *a, const void *b) {
+  return strcmp(((const JsonKeyValue *)a)->key, ((const JsonKeyValue *)b)->key);
+}
+
+/**
+ * Converts every object in a tree to the sorted-key layout
+ *
+ * Each object's members are moved into a single block ordered by key.
+ * Objects that are already sorted are only descended into.
+ *
+ * @param value Root of the tree
+ * @return 1 on success, 0 on allocation failure
+ */
+int sort_json_keys(JsonValue *value) {
+  if (!value) {
+    return 1;
+  }
+
+  // Unexpanded containers are sorted when they are expanded
+  if (value->flags & JSON_FLAG_LAZY) {
+    value->flags |= JSON_FLAG_SORTED;
+    return 1;
+  }
+
+  if (value->type == JSON_ARRAY) {
+    // Packed elements are numbers, with nothing to sort
+    if ((value->flags & JSON_FLAG_PACKED) && !value->value.packed->items) {
+      return 1;
+    }
+    for (JsonArrayItem *it = json_array_first(value); it; it = it->next) {
+      if (!sort_json_keys(it->value)) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  if (value->type != JSON_OBJECT) {
+    return 1;
+  }
+
+  size_t count = 0;
+  for (JsonKeyValue *kv = value->value.object_head; kv; kv = kv->next) {
+    if (!sort_json_keys(kv->value)) {
+      return 0;
+    }
+    count++;
+  }
+
+  if (value->flags & JSON_FLAG_SORTED) {
+    return 1;
+  }
+
+  if (count > 0) {
+    if (count > (SIZE_MAX - sizeof(JsonKeyBlock)) / sizeof(JsonKeyValue)) {
+      return 0;
+    }
+    JsonKeyBlock *block = (JsonKeyBlock *)json_malloc(
+        sizeof(JsonKeyBlock) + count * sizeof(JsonKeyValue));
+    if (!block) {
+      return 0;
+    }
+    block->count = count;
+    block->capacity = count;
+
+    // Move the members into the block; keys and values change owner
+    size_t i = 0;
+    JsonKeyValue *kv = value->value.object_head;
+    while (kv) {
+      JsonKeyValue *next = kv->next;
+      block->items[i++] = *kv;
+      json_free(kv);
+      kv = next;
+    }
+
+    // add_to_object keeps keys unique, so the order is total
+    qsort(block->items, count, sizeof(JsonKeyValue), compare_members);
+    link_key_block(block, 0);
+    value->value.object_head = block->items;
+  }
+
+  value->flags |= JSON_FLAG_SORTED;
+  return 1;
+}
+
+// 64-bit finalizer (splitmix64) used to spread hash bits
+static uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 30;
+  x *= UINT64_C(0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C(0x94d049bb133111eb);
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * FNV-1a hash of a byte string, continuing from h
+ */
+uint64_t json_hash_bytes(const char *data, size_t len, uint64_t h) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)data[i];
+    h *= UINT64_C(0x100000001b3);
+  }
+  return h;
+}
+
+/**
+ * Hash of one object member, as combined by hash_json_value
+ */
+static uint64_t hash_member(const char *key, uint64_t value_hash) {
+  const char *k = key ? key : "";
+  uint64_t kh = json_hash_bytes(k, strlen(k), UINT64_C(0xcbf29ce484222325));
+  return mix_hash(kh ^ mix_hash(value_hash));
+}
+
+/**
+ * Computes a structural hash of a JSON value
+ *
+ * Values that compare equal get the same hash: object members are combined
+ * independently of their order, and -0 hashes like 0. Used to compare
+ * subtrees against precomputed baselines without keeping the baseline
+ * tree around.
+ */
+uint64_t hash_json_value(const JsonValue *value) {
+  if (!value) {
+    return mix_hash(JSON_NULL + 1);
+  }
+
+  switch (value->type) {
+  case JSON_NULL:
+    return mix_hash(JSON_NULL + 1);
+  case JSON_BOOL:
+    return mix_hash(((uint64_t)(JSON_BOOL + 1) << 8) |
+                    (value->value.boolean ? 1 : 0));
+  case JSON_NUMBER: {
+    double d = json_number_value(value);
+    if (d == 0) {
+      d = 0; // -0 == 0
+    }
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return mix_hash(bits ^ ((uint64_t)(JSON_NUMBER + 1) << 56));
+  }
+  case JSON_STRING: {
+    const char *str = value->value.string ? value->value.string : "";
+    return mix_hash(json_hash_bytes(str, strlen(str),
+                                    UINT64_C(0xcbf29ce484222325)) +
+                    JSON_STRING + 1);
+  }
+  case JSON_ARRAY: {
+    uint64_t h = mix_hash(JSON_ARRAY + 1);
+    size_t count;
+    const JsonValue *packed = json_array_packed(value, &count);
+    for (size_t i = 0; packed && i < count; i++) {
+      h = mix_hash(h + hash_json_value(&packed[i]));
+    }
+    for (JsonArrayItem *it = packed ? NULL : json_array_first(value); it;
+         it = it->next) {
+      h = mix_hash(h + hash_json_value(it->value));
+    }
+    return h;
+  }
+  case JSON_OBJECT: {
+    // Sum of per-member hashes, so member order does not matter
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    for (JsonKeyValue *kv = json_object_first(value); kv; kv = kv->next) {
+      sum += hash_member(kv->key, hash_json_value(kv->value));
+      count++;
+    }
+    return mix_hash(sum ^ mix_hash(count + JSON_OBJECT + 1));
+  }
+  }
+  return 0;
+}
@@ -14,25 +14,35 @@ typedef struct {
   NodeRef *items;
   int count;
   int cap;
+  int no_paths; // items are kept without their paths
 } NodeVec;
 
 static void nv_init(NodeVec *v) {
   v->items = NULL;
   v->count = 0;
   v->cap = 0;
+  v->no_paths = 0;
+}
+
+// Starts an empty vector that keeps paths if like does
+static void nv_init_like(NodeVec *v, const NodeVec *like) {
+  nv_init(v);
+  v->no_paths = like->no_paths;
 }
 
 static int nv_push(NodeVec *v, JsonValue *val, const char *path) {
   if (v->count == v->cap) {
     int nc = v->cap ? v->cap * 2 : 16;
-    NodeRef *ni = (NodeRef *)realloc(v->items, nc * sizeof(NodeRef));
+    NodeRef *ni = (NodeRef *)json_realloc(v->items, nc * sizeof(NodeRef));
     if (!ni)
       return 0;
     v->items = ni;
     v->cap = nc;
   }
+  if (v->no_paths)
+    path = NULL;
   v->items[v->count].val = val;
-  v->items[v->count].path = path ? strdup(path) : NULL;
+  v->items[v->count].path = path ? json_strdup(path) : NULL;
   if (path && !v->items[v->count].path)
     return 0;
   v->count++;
@@ -43,8 +53,8 @@ static void nv_free(NodeVec *v) {
   if (!v)
     return;
   for (int i = 0; i < v->count; i++)
-    free(v->items[i].path);
-  free(v->items);
+    json_free(v->items[i].path);
+  json_free(v->items);
 }
 
 // String builder
@@ -63,7 +73,7 @@ static void sb_init(Str *b) {
 static int sb_putc(Str *b, char c) {
   if (b->len + 1 >= b->cap) {
     int nc = b->cap ? b->cap * 2 : 64;
-    char *ns = (char *)realloc(b->s, nc);
+    char *ns = (char *)json_realloc(b->s, nc);
     if (!ns)
       return 0;
     b->s = ns;
@@ -135,7 +145,7 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted);
 #if 0
 static void foreach_object(JsonValue *obj, void (*cb)(const char*, JsonValue*, void*), void *ud){
     if(!obj || obj->type!=JSON_OBJECT) return;
-    for(JsonKeyValue *kv=obj->value.object_head; kv; kv=kv->next){
+    for(JsonKeyValue *kv=json_object_first(obj); kv; kv=kv->next){
         cb(kv->key, kv->value, ud);
     }
 }
@@ -143,49 +153,77 @@ static void foreach_object(JsonValue *obj, void (*cb)(const char*, JsonValue*, v
 static void foreach_array(JsonValue *arr, void (*cb)(int, JsonValue*, void*), void *ud){
     if(!arr || arr->type!=JSON_ARRAY) return;
     int idx=0;
-    for(JsonArrayItem *it=arr->value.array_head; it; it=it->next, idx++){
+    for(JsonArrayItem *it=json_array_first(arr); it; it=it->next, idx++){
         cb(idx, it->value, ud);
     }
 }
 #endif
 
+// Append one path segment to a builder, in the same notation used for
+// result paths: .name for identifier-like keys, ['key'] otherwise, [i] for
+// array indices
+static int sb_put_prop(Str *b, const char *name) {
+  if (name && *name && (isalpha((unsigned char)name[0]) || name[0] == '_')) {
+    return sb_putc(b, '.') && sb_puts(b, name);
+  }
+  return sb_puts(b, "['") && sb_puts(b, name ? name : "") && sb_puts(b, "']");
+}
+
+static int sb_put_index(Str *b, int idx) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "[%d]", idx);
+  return sb_puts(b, buf);
+}
+
+static void sb_truncate(Str *b, int len) {
+  if (b->s && len < b->len) {
+    b->len = len;
+    b->s[len] = '\0';
+  }
+}
+
 // Build child path strings
 static char *path_append_prop(const char *base, const char *name) {
   Str b;
   sb_init(&b);
-
-  if (!sb_puts(&b, base ? base : "$"))
+  if (!sb_puts(&b, base ? base : "$") || !sb_put_prop(&b, name)) {
+    json_free(b.s);
     return NULL;
-
-  if (name && *name && (isalpha((unsigned char)name[0]) || name[0] == '_')) {
-    if (!sb_putc(&b, '.'))
-      return NULL;
-    if (!sb_puts(&b, name))
-      return NULL;
-  } else {
-    if (!sb_puts(&b, "['"))
-      return NULL;
-    if (!sb_puts(&b, name ? name : ""))
-      return NULL;
-    if (!sb_puts(&b, "']"))
-      return NULL;
   }
-
   return sb_steal(&b);
 }
 
 static char *path_append_index(const char *base, int idx) {
-  char buf[64];
-  snprintf(buf, sizeof(buf), "[%d]", idx);
   Str b;
   sb_init(&b);
-  if (!sb_puts(&b, base ? base : "$"))
-    return NULL;
-  if (!sb_puts(&b, buf))
+  if (!sb_puts(&b, base ? base : "$") || !sb_put_index(&b, idx)) {
+    json_free(b.s);
     return NULL;
+  }
   return sb_steal(&b);
 }
 
+// Push a child of the node at base, building its path only if v keeps them
+static int nv_push_prop(NodeVec *v, JsonValue *val, const char *base,
+                        const char *name) {
+  if (v->no_paths)
+    return nv_push(v, val, NULL);
+  char *path = path_append_prop(base, name);
+  int ok = path && nv_push(v, val, path);
+  json_free(path);
+  return ok;
+}
+
+static int nv_push_index(NodeVec *v, JsonValue *val, const char *base,
+                         int idx) {
+  if (v->no_paths)
+    return nv_push(v, val, NULL);
+  char *path = path_append_index(base, idx);
+  int ok = path && nv_push(v, val, path);
+  json_free(path);
+  return ok;
+}
+
 // Collect descendants depth-first with their paths
 static int collect_descendants(JsonValue *root, const char *path,
                                NodeVec *vec) {
@@ -194,37 +232,135 @@ static int collect_descendants(JsonValue *root, const char *path,
   if (!root)
     return 1;
   if (root->type == JSON_OBJECT) {
-    for (JsonKeyValue *kv = root->value.object_head; kv; kv = kv->next) {
-      char *p = path_append_prop(path, kv->key);
-      if (!p)
+    for (JsonKeyValue *kv = json_object_first(root); kv; kv = kv->next) {
+      char *p = vec->no_paths ? NULL : path_append_prop(path, kv->key);
+      if (!p && !vec->no_paths)
         return 0;
-      if (!nv_push(vec, kv->value, p)) {
-        free(p);
-        return 0;
-      }
-      free(p); // push immediate child as candidate
-      // and recurse further
-      if (!collect_descendants(kv->value, path_append_prop(path, kv->key), vec))
+      // push immediate child as candidate and recurse further
+      int ok = nv_push(vec, kv->value, p) &&
+               collect_descendants(kv->value, p, vec);
+      json_free(p);
+      if (!ok)
         return 0;
     }
   } else if (root->type == JSON_ARRAY) {
-    int i = 0;
-    for (JsonArrayItem *it = root->value.array_head; it; it = it->next, i++) {
-      char *p = path_append_index(path, i);
-      if (!p)
+    // Packed arrays are read in place rather than linked
+    size_t count;
+    JsonValue *packed = json_array_packed(root, &count);
+    for (size_t i = 0; packed && i < count; i++) {
+      char *p = vec->no_paths ? NULL : path_append_index(path, (int)i);
+      if (!p && !vec->no_paths)
         return 0;
-      if (!nv_push(vec, it->value, p)) {
-        free(p);
+      int ok = nv_push(vec, &packed[i], p);
+      json_free(p);
+      if (!ok)
         return 0;
-      }
-      free(p);
-      if (!collect_descendants(it->value, path_append_index(path, i), vec))
+    }
+    int i = 0;
+    for (JsonArrayItem *it = packed ? NULL : json_array_first(root); it;
+         it = it->next, i++) {
+      char *p = vec->no_paths ? NULL : path_append_index(path, i);
+      if (!p && !vec->no_paths)
+        return 0;
+      int ok = nv_push(vec, it->value, p) &&
+               collect_descendants(it->value, p, vec);
+      json_free(p);
+      if (!ok)
         return 0;
     }
   }
   return 1;
 }
 
+// One container being walked by find_descendant_members
+typedef struct {
+  JsonValue *node;
+  JsonKeyValue *kv;     // next member (objects)
+  JsonArrayItem *item;  // next element (arrays)
+  int index;            // index of item
+  int path_len;         // length of the node's path in the shared buffer
+} DescentFrame;
+
+// Evaluates ..name for one start node: visits the descendants in the same
+// depth-first order as collect_descendants, but only records members called
+// name. Uses an explicit stack and one path buffer that is truncated as the
+// walk backs out, so memory grows with the depth and the matches only.
+static int find_descendant_members(JsonValue *root, const char *path,
+                                   const char *name, NodeVec *out) {
+  if (!root || (root->type != JSON_OBJECT && root->type != JSON_ARRAY))
+    return 1;
+
+  Str b;
+  sb_init(&b);
+  DescentFrame *stack = NULL;
+  int depth = 0;
+  int cap = 0;
+  int ok = sb_puts(&b, path ? path : "$");
+
+  JsonValue *push = root;
+  while (ok) {
+    if (push) {
+      if (depth == cap) {
+        int nc = cap ? cap * 2 : 16;
+        DescentFrame *ns =
+            (DescentFrame *)json_realloc(stack, nc * sizeof(DescentFrame));
+        if (!ns) {
+          ok = 0;
+          break;
+        }
+        stack = ns;
+        cap = nc;
+      }
+      DescentFrame *f = &stack[depth++];
+      f->node = push;
+      f->kv = push->type == JSON_OBJECT ? json_object_first(push) : NULL;
+      f->item = push->type == JSON_ARRAY ? json_array_first(push) : NULL;
+      f->index = 0;
+      f->path_len = b.len;
+      push = NULL;
+    }
+    if (depth == 0)
+      break;
+
+    // Step to the next child of the innermost container
+    DescentFrame *f = &stack[depth - 1];
+    JsonValue *child;
+    sb_truncate(&b, f->path_len);
+    if (f->kv) {
+      child = f->kv->value;
+      ok = sb_put_prop(&b, f->kv->key);
+      f->kv = f->kv->next;
+    } else if (f->item) {
+      child = f->item->value;
+      ok = sb_put_index(&b, f->index++);
+      f->item = f->item->next;
+    } else {
+      depth--;
+      continue;
+    }
+    if (!ok || !child)
+      continue;
+
+    if (child->type == JSON_OBJECT) {
+      JsonValue *c = get_object_item(child, name);
+      if (c) {
+        int child_len = b.len;
+        ok = sb_put_prop(&b, name) && nv_push(out, c, b.s);
+        sb_truncate(&b, child_len);
+      }
+    }
+    // Packed arrays hold numbers only, with no members to find
+    size_t count;
+    if (child->type == JSON_OBJECT ||
+        (child->type == JSON_ARRAY && !json_array_packed(child, &count)))
+      push = child;
+  }
+
+  json_free(stack);
+  json_free(b.s);
+  return ok;
+}
+
 // Parse an identifier (dot-child name)
 static char *parse_identifier(Scan *sc) {
   int start = sc->pos;
@@ -238,7 +374,7 @@ static char *parse_identifier(Scan *sc) {
       break;
   }
   int n = sc->pos - start;
-  char *s = (char *)malloc(n + 1);
+  char *s = (char *)json_malloc(n + 1);
   if (!s)
     return NULL;
   memcpy(s, sc->s + start, n);
@@ -299,14 +435,8 @@ static int apply_child_name(NodeVec *cur, const char *name, NodeVec *next,
     if (v && v->type == JSON_OBJECT) {
       JsonValue *c = get_object_item(v, name);
       if (c) {
-        char *np = path_append_prop(p, name);
-        if (!np)
-          return 0;
-        if (!nv_push(next, c, np)) {
-          free(np);
+        if (!nv_push_prop(next, c, p, name))
           return 0;
-        }
-        free(np);
       }
     }
   }
@@ -322,27 +452,22 @@ static int apply_wildcard(NodeVec *cur, NodeVec *next) {
       continue;
 
     if (v->type == JSON_OBJECT) {
-      for (JsonKeyValue *kv = v->value.object_head; kv; kv = kv->next) {
-        char *np = path_append_prop(p, kv->key);
-        if (!np)
+      for (JsonKeyValue *kv = json_object_first(v); kv; kv = kv->next) {
+        if (!nv_push_prop(next, kv->value, p, kv->key))
           return 0;
-        if (!nv_push(next, kv->value, np)) {
-          free(np);
-          return 0;
-        }
-        free(np);
       }
     } else if (v->type == JSON_ARRAY) {
-      int idx = 0;
-      for (JsonArrayItem *it = v->value.array_head; it; it = it->next, idx++) {
-        char *np = path_append_index(p, idx);
-        if (!np)
+      size_t count;
+      JsonValue *packed = json_array_packed(v, &count);
+      for (size_t j = 0; packed && j < count; j++) {
+        if (!nv_push_index(next, &packed[j], p, (int)j))
           return 0;
-        if (!nv_push(next, it->value, np)) {
-          free(np);
+      }
+      int idx = 0;
+      for (JsonArrayItem *it = packed ? NULL : json_array_first(v); it;
+           it = it->next, idx++) {
+        if (!nv_push_index(next, it->value, p, idx))
           return 0;
-        }
-        free(np);
       }
     }
   }
@@ -414,7 +539,7 @@ static JsonValue *make_number(double d) {
 static JsonValue *make_string_lit(const char *s) {
   JsonValue *v = create_json_value(JSON_STRING);
   if (v)
-    v->value.string = strdup(s ? s : "");
+    v->value.string = json_strdup(s ? s : "");
   return v;
 }
 
@@ -435,7 +560,7 @@ static JsonValue *parse_literal(Scan *sc) {
     if (!s)
       return NULL;
     JsonValue *v = make_string_lit(s);
-    free(s);
+    json_free(s);
     return v;
   }
   // number
@@ -500,7 +625,8 @@ static int eval_cmp(Scan *sc, JsonValue *ctx) {
         res = 0;
       else
         res = 1;
-      free_json_value(lhs);
+      if (!lhs_is_path)
+        free_json_value(lhs);
     }
     return res;
   }
@@ -542,7 +668,7 @@ static int strcmp_null(const char *a, const char *b) {
 
 static int cmp_values(JsonValue *a, JsonValue *b, const char *op) {
   if (a->type == JSON_NUMBER && b->type == JSON_NUMBER) {
-    int c = numcmp(a->value.number, b->value.number);
+    int c = numcmp(json_number_value(a), json_number_value(b));
     if (strcmp(op, "==") == 0)
       return c == 0;
     if (strcmp(op, "!=") == 0)
@@ -619,7 +745,7 @@ static JsonValue *eval_path_from_at(Scan *sc, JsonValue *ctx) {
         cur = get_object_item(cur, name);
       else
         cur = NULL;
-      free(name);
+      json_free(name);
       progressed = 1;
       continue;
     }
@@ -636,7 +762,7 @@ static JsonValue *eval_path_from_at(Scan *sc, JsonValue *ctx) {
           cur = get_object_item(cur, q);
         else
           cur = NULL;
-        free(q);
+        json_free(q);
         progressed = 1;
         continue;
       }
@@ -656,9 +782,255 @@ static JsonValue *eval_path_from_at(Scan *sc, JsonValue *ctx) {
       continue;
     }
   }
-  if (!cur)
-    return create_json_value(JSON_NULL); // treat missing as null
-  return cur; // note: caller should not free if returned is original
+  // Treat missing as null. The result is never freed by the caller: it is
+  // either part of the document or this shared null.
+  static JsonValue missing = {.type = JSON_NULL};
+  return cur ? cur : &missing;
+}
+
+// Filters made only of @.name OP literal terms joined by && and || are
+// compiled once and run a column at a time over arrays of same-shaped
+// objects (see json_columns.c) instead of re-parsing the expression for
+// every element
+#define FILTER_MAX_TERMS 8
+
+typedef enum {
+  FILTER_EQ,
+  FILTER_NE,
+  FILTER_GT,
+  FILTER_GE,
+  FILTER_LT,
+  FILTER_LE
+} FilterOp;
+
+typedef struct {
+  int field;          // column of the @.name operand
+  FilterOp op;        // with the member on the left
+  JsonValue *literal;
+  int starts_group;   // first term after a ||
+} FilterTerm;
+
+typedef struct {
+  FilterTerm terms[FILTER_MAX_TERMS];
+  int term_count;
+  char *fields[FILTER_MAX_TERMS];
+  int field_count;
+} FilterPlan;
+
+static const char *const filter_op_names[] = {"==", "!=", ">",
+                                              ">=", "<",  "<="};
+
+static void free_filter_plan(FilterPlan *plan) {
+  for (int i = 0; i < plan->term_count; i++)
+    free_json_value(plan->terms[i].literal);
+  for (int i = 0; i < plan->field_count; i++)
+    json_free(plan->fields[i]);
+  plan->term_count = 0;
+  plan->field_count = 0;
+}
+
+static int match_filter_op(Scan *sc, FilterOp *op) {
+  // Same order as eval_cmp so that ">=" is not read as ">"
+  static const FilterOp order[] = {FILTER_EQ, FILTER_NE, FILTER_GE,
+                                   FILTER_LE, FILTER_GT, FILTER_LT};
+  for (int i = 0; i < 6; i++) {
+    if (match(sc, filter_op_names[order[i]])) {
+      *op = order[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Reads @.name into a plan field; returns its index or -1
+static int plan_member(Scan *sc, FilterPlan *plan) {
+  if (!match(sc, "@") || !match(sc, "."))
+    return -1;
+  char *name = parse_identifier(sc);
+  if (!name)
+    return -1;
+  for (int i = 0; i < plan->field_count; i++) {
+    if (strcmp(plan->fields[i], name) == 0) {
+      json_free(name);
+      return i;
+    }
+  }
+  plan->fields[plan->field_count] = name;
+  return plan->field_count++;
+}
+
+// Compiles the filter text [start, end) into plan, or returns 0 when it
+// has anything the column evaluator does not cover
+static int plan_filter(const Scan *text, int start, int end,
+                       FilterPlan *plan) {
+  Scan sc = *text;
+  sc.pos = start;
+  plan->term_count = 0;
+  plan->field_count = 0;
+  int starts_group = 1;
+  while (plan->term_count < FILTER_MAX_TERMS) {
+    FilterTerm *term = &plan->terms[plan->term_count];
+    FilterOp op;
+    skip_ws(&sc);
+    if (peek(&sc) == '@') {
+      term->field = plan_member(&sc, plan);
+      skip_ws(&sc);
+      if (term->field < 0 || !match_filter_op(&sc, &op))
+        break;
+      term->literal = parse_literal(&sc);
+    } else {
+      // literal OP @.name, turned around
+      term->literal = parse_literal(&sc);
+      skip_ws(&sc);
+      if (!term->literal || !match_filter_op(&sc, &op)) {
+        free_json_value(term->literal);
+        break;
+      }
+      skip_ws(&sc);
+      term->field = plan_member(&sc, plan);
+      static const FilterOp flipped[] = {FILTER_EQ, FILTER_NE, FILTER_LT,
+                                         FILTER_LE, FILTER_GT, FILTER_GE};
+      op = flipped[op];
+    }
+    if (!term->literal || term->field < 0) {
+      free_json_value(term->literal);
+      break;
+    }
+    term->op = op;
+    term->starts_group = starts_group;
+    plan->term_count++;
+    skip_ws(&sc);
+    if (sc.pos == end)
+      return 1;
+    if (match(&sc, "&&"))
+      starts_group = 0;
+    else if (match(&sc, "||"))
+      starts_group = 1;
+    else
+      break;
+  }
+  free_filter_plan(plan);
+  return 0;
+}
+
+static int test_cmp(int c, FilterOp op) {
+  switch (op) {
+  case FILTER_EQ:
+    return c == 0;
+  case FILTER_NE:
+    return c != 0;
+  case FILTER_GT:
+    return c > 0;
+  case FILTER_GE:
+    return c >= 0;
+  case FILTER_LT:
+    return c < 0;
+  case FILTER_LE:
+    return c <= 0;
+  }
+  return 0;
+}
+
+// ANDs one term into mask, giving the same answers as cmp_values
+static void apply_filter_term(const FilterTerm *term, const JsonColumn *col,
+                              size_t rows, unsigned char *mask) {
+  const JsonValue *lit = term->literal;
+  if (col->type == JSON_COLUMN_NUMBER && lit->type == JSON_NUMBER) {
+    const double *x = col->data.numbers;
+    double b = json_number_value(lit);
+    // Written so that NaN compares like numcmp's "neither less nor greater"
+    switch (term->op) {
+    case FILTER_EQ:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= !(x[i] < b || x[i] > b);
+      break;
+    case FILTER_NE:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= x[i] < b || x[i] > b;
+      break;
+    case FILTER_GT:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= x[i] > b;
+      break;
+    case FILTER_GE:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= !(x[i] < b);
+      break;
+    case FILTER_LT:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= x[i] < b;
+      break;
+    case FILTER_LE:
+      for (size_t i = 0; i < rows; i++)
+        mask[i] &= !(x[i] > b);
+      break;
+    }
+    return;
+  }
+  if (col->type == JSON_COLUMN_STRING && lit->type == JSON_STRING) {
+    for (size_t i = 0; i < rows; i++) {
+      if (mask[i])
+        mask[i] = test_cmp(
+            strcmp_null(col->data.strings[i], lit->value.string), term->op);
+    }
+    return;
+  }
+  if (col->type == JSON_COLUMN_BOOL && lit->type == JSON_BOOL) {
+    int b = lit->value.boolean != 0;
+    for (size_t i = 0; i < rows; i++)
+      mask[i] &= test_cmp(col->data.booleans[i] - b, term->op);
+    return;
+  }
+  if (col->type == JSON_COLUMN_MIXED) {
+    for (size_t i = 0; i < rows; i++) {
+      if (mask[i])
+        mask[i] = cmp_values((JsonValue *)col->data.values[i],
+                             (JsonValue *)lit, filter_op_names[term->op]);
+    }
+    return;
+  }
+  // A typed column against a literal of another type: only "!= null" holds
+  int all = lit->type == JSON_NULL && term->op == FILTER_NE;
+  if (!all)
+    memset(mask, 0, rows);
+}
+
+// Runs a compiled filter over an array. Returns 1 with the matching
+// elements pushed to next, 0 on allocation failure, or -1 to leave the
+// array to the interpreter (not same-shaped objects with the filter's
+// members, or no memory for the columns).
+static int filter_columns(const FilterPlan *plan, JsonValue *array,
+                          const char *path, NodeVec *next) {
+  JsonColumns *cols = json_columns_build(
+      array, (const char *const *)plan->fields, plan->field_count);
+  if (!cols)
+    return -1;
+  size_t rows = cols->rows;
+  unsigned char *matched = (unsigned char *)json_calloc(rows, 2);
+  if (!matched) {
+    json_columns_free(cols);
+    return 0;
+  }
+  unsigned char *group = matched + rows;
+  for (int t = 0; t < plan->term_count;) {
+    memset(group, 1, rows);
+    do {
+      const FilterTerm *term = &plan->terms[t];
+      apply_filter_term(term, &cols->columns[term->field], rows, group);
+      t++;
+    } while (t < plan->term_count && !plan->terms[t].starts_group);
+    for (size_t i = 0; i < rows; i++)
+      matched[i] |= group[i];
+  }
+  int ok = 1;
+  for (size_t i = 0; i < rows && ok; i++) {
+    if (!matched[i])
+      continue;
+    ok = nv_push_index(next, (JsonValue *)cols->elements[i], path, (int)i);
+  }
+  json_free(matched);
+  json_columns_free(cols);
+  return ok;
 }
 
 // Apply array subscripts: indices, unions, slices
@@ -684,37 +1056,49 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
     sc_end.pos = expr_start;
     (void)eval_filter_expr(&sc_end, NULL);
     int expr_end = sc_end.pos;
-    for (int i = 0; i < cur->count; i++) {
+    FilterPlan plan;
+    int planned = plan_filter(sc, expr_start, expr_end, &plan);
+    int ok = 1;
+    for (int i = 0; i < cur->count && ok; i++) {
       JsonValue *v = cur->items[i].val;
       const char *p = cur->items[i].path ? cur->items[i].path : "$";
       if (v && v->type == JSON_ARRAY) {
+        int done = planned ? filter_columns(&plan, v, p, next) : -1;
+        if (done >= 0) {
+          ok = done;
+          continue;
+        }
+        size_t count;
+        JsonValue *packed = json_array_packed(v, &count);
+        for (size_t j = 0; packed && j < count && ok; j++) {
+          Scan sc2 = *sc;
+          sc2.pos = expr_start;
+          if (eval_filter_expr(&sc2, &packed[j])) {
+            ok = nv_push_index(next, &packed[j], p, (int)j);
+          }
+        }
         int idx = 0;
-        for (JsonArrayItem *it = v->value.array_head; it;
+        for (JsonArrayItem *it = packed ? NULL : json_array_first(v); it && ok;
              it = it->next, idx++) {
           Scan sc2 = *sc;
           sc2.pos = expr_start;
           int res = eval_filter_expr(&sc2, it->value);
           if (res) {
-            char *np = path_append_index(p, idx);
-            if (!np)
-              return 0;
-            if (!nv_push(next, it->value, np)) {
-              free(np);
-              return 0;
-            }
-            free(np);
+            ok = nv_push_index(next, it->value, p, idx);
           }
         }
       } else if (v) {
         Scan sc2 = *sc;
         sc2.pos = expr_start;
         int res = eval_filter_expr(&sc2, v);
-        if (res) {
-          if (!nv_push(next, v, p))
-            return 0;
-        }
+        if (res)
+          ok = nv_push(next, v, p);
       }
     }
+    if (planned)
+      free_filter_plan(&plan);
+    if (!ok)
+      return 0;
     sc->pos = expr_end; // advance past expression
     skip_ws(sc);
     if (!match(sc, ")"))
@@ -736,9 +1120,9 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
         return 0;
       if (n == cap) {
         int nc = cap ? cap * 2 : 4;
-        char **nn = (char **)realloc(names, nc * sizeof(char *));
+        char **nn = (char **)json_realloc(names, nc * sizeof(char *));
         if (!nn) {
-          free(q);
+          json_free(q);
           return 0;
         }
         names = nn;
@@ -749,8 +1133,8 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
     } while (match(sc, ","));
     if (!match(sc, "]")) {
       for (int i = 0; i < n; i++)
-        free(names[i]);
-      free(names);
+        json_free(names[i]);
+      json_free(names);
       return 0;
     }
     for (int i = 0; i < cur->count; i++) {
@@ -760,22 +1144,16 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
         for (int k = 0; k < n; k++) {
           JsonValue *c = get_object_item(v, names[k]);
           if (c) {
-            char *np = path_append_prop(p, names[k]);
-            if (!np)
-              return 0;
-            if (!nv_push(next, c, np)) {
-              free(np);
+            if (!nv_push_prop(next, c, p, names[k]))
               return 0;
-            }
-            free(np);
           }
         }
       }
     }
     for (int i = 0; i < n; i++) {
-      free(names[i]);
+      json_free(names[i]);
     }
-    free(names);
+    json_free(names);
     return 1;
   }
 
@@ -830,14 +1208,8 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
         for (int idx = s; idx < e; idx += step) {
           JsonValue *c = get_array_item(v, idx);
           if (c) {
-            char *np = path_append_index(p, idx);
-            if (!np)
-              return 0;
-            if (!nv_push(next, c, np)) {
-              free(np);
+            if (!nv_push_index(next, c, p, idx))
               return 0;
-            }
-            free(np);
           }
         }
       }
@@ -850,7 +1222,7 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
   int nidx = 0, cap = 0;
   if (nidx == cap) {
     cap = 4;
-    idxs = (int *)malloc(cap * sizeof(int));
+    idxs = (int *)json_malloc(cap * sizeof(int));
     if (!idxs)
       return 0;
   }
@@ -859,14 +1231,14 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
   while (match(sc, ",")) {
     int v = parse_int(sc, &ok);
     if (!ok) {
-      free(idxs);
+      json_free(idxs);
       return 0;
     }
     if (nidx == cap) {
       int nc = cap * 2;
-      int *ni = (int *)realloc(idxs, nc * sizeof(int));
+      int *ni = (int *)json_realloc(idxs, nc * sizeof(int));
       if (!ni) {
-        free(idxs);
+        json_free(idxs);
         return 0;
       }
       idxs = ni;
@@ -876,7 +1248,7 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
     skip_ws(sc);
   }
   if (!match(sc, "]")) {
-    free(idxs);
+    json_free(idxs);
     return 0;
   }
   for (int i = 0; i < cur->count; i++) {
@@ -889,7 +1261,7 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
         if (id < 0) {
           if (((JsonPathOptions *)sc->opt)->strict) {
             set_err(sc->opt, "negative indices not supported", sc->pos);
-            free(idxs);
+            json_free(idxs);
             return 0;
           } else
             continue;
@@ -897,30 +1269,23 @@ static int apply_array_subscript(NodeVec *cur, Scan *sc, NodeVec *next) {
         if (id >= 0 && id < n) {
           JsonValue *c = get_array_item(v, id);
           if (c) {
-            char *np = path_append_index(p, id);
-            if (!np) {
-              free(idxs);
-              return 0;
-            }
-            if (!nv_push(next, c, np)) {
-              free(np);
-              free(idxs);
+            if (!nv_push_index(next, c, p, id)) {
+              json_free(idxs);
               return 0;
             }
-            free(np);
           }
         }
       }
     }
   }
-  free(idxs);
+  json_free(idxs);
   return 1;
 }
 
 static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
   // Start with root
   NodeVec cur;
-  nv_init(&cur);
+  nv_init_like(&cur, out);
   if (!nv_push(&cur, doc, "$")) {
     nv_free(&cur);
     return 0;
@@ -935,10 +1300,34 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
     skip_ws(sc);
     if (match(sc, ".")) {
       if (match(sc, ".")) {
-        // recursive descent: collect all descendants of current set as
-        // candidates for next selector
+        // recursive descent followed by a name: search for the member
+        // directly instead of collecting every descendant first
+        if (isalpha((unsigned char)peek(sc)) || peek(sc) == '_') {
+          char *name = parse_identifier(sc);
+          if (!name) {
+            nv_free(&cur);
+            return 0;
+          }
+          NodeVec tmp;
+          nv_init_like(&tmp, &cur);
+          for (int i = 0; i < cur.count; i++) {
+            if (!find_descendant_members(cur.items[i].val, cur.items[i].path,
+                                         name, &tmp)) {
+              json_free(name);
+              nv_free(&tmp);
+              nv_free(&cur);
+              return 0;
+            }
+          }
+          json_free(name);
+          nv_free(&cur);
+          cur = tmp;
+          continue;
+        }
+        // otherwise collect all descendants of current set as candidates
+        // for the next selector
         NodeVec desc;
-        nv_init(&desc);
+        nv_init_like(&desc, &cur);
         for (int i = 0; i < cur.count; i++) {
           if (!collect_descendants(cur.items[i].val,
                                    cur.items[i].path ? cur.items[i].path : "$",
@@ -948,10 +1337,10 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
             return 0;
           }
         }
-        // Now expect child selector (*) or identifier or bracket
+        // Now expect child selector (*) or bracket
         if (match(sc, "*")) {
           NodeVec tmp;
-          nv_init(&tmp);
+          nv_init_like(&tmp, &cur);
           if (!apply_wildcard(&desc, &tmp)) {
             nv_free(&desc);
             nv_free(&tmp);
@@ -966,7 +1355,7 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
         if (peek(sc) == '[') {
           getc_(sc);
           NodeVec tmp;
-          nv_init(&tmp);
+          nv_init_like(&tmp, &cur);
           if (!apply_array_subscript(&desc, sc, &tmp)) {
             nv_free(&desc);
             nv_free(&tmp);
@@ -978,51 +1367,15 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
           cur = tmp;
           continue;
         }
-        char *name = parse_identifier(sc);
-        if (!name) {
-          set_err(sc->opt, "expected name after '..'", sc->pos);
-          nv_free(&desc);
-          nv_free(&cur);
-          return 0;
-        }
-        NodeVec tmp;
-        nv_init(&tmp);
-        for (int i = 0; i < desc.count; i++) {
-          JsonValue *v = desc.items[i].val;
-          const char *p = desc.items[i].path ? desc.items[i].path : "$";
-          if (v && v->type == JSON_OBJECT) {
-            JsonValue *c = get_object_item(v, name);
-            if (c) {
-              char *np = path_append_prop(p, name);
-              if (!np) {
-                free(name);
-                nv_free(&desc);
-                nv_free(&tmp);
-                nv_free(&cur);
-                return 0;
-              }
-              if (!nv_push(&tmp, c, np)) {
-                free(np);
-                free(name);
-                nv_free(&desc);
-                nv_free(&tmp);
-                nv_free(&cur);
-                return 0;
-              }
-              free(np);
-            }
-          }
-        }
-        free(name);
+        set_err(sc->opt, "expected name after '..'", sc->pos);
         nv_free(&desc);
         nv_free(&cur);
-        cur = tmp;
-        continue;
+        return 0;
       }
       // dot child
       if (match(sc, "*")) {
         NodeVec next;
-        nv_init(&next);
+        nv_init_like(&next, &cur);
         if (!apply_wildcard(&cur, &next)) {
           nv_free(&cur);
           nv_free(&next);
@@ -1039,20 +1392,20 @@ static int eval_steps(JsonValue *doc, Scan *sc, NodeVec *out, int *emitted) {
         return 0;
       }
       NodeVec next;
-      nv_init(&next);
+      nv_init_like(&next, &cur);
       if (!apply_child_name(&cur, name, &next, emitted)) {
-        free(name);
+        json_free(name);
         nv_free(&cur);
         nv_free(&next);
         return 0;
       }
-      free(name);
+      json_free(name);
       nv_free(&cur);
       cur = next;
       continue;
     } else if (match(sc, "[")) {
       NodeVec next;
-      nv_init(&next);
+      nv_init_like(&next, &cur);
       if (!apply_array_subscript(&cur, sc, &next)) {
         nv_free(&cur);
         nv_free(&next);
@@ -1092,7 +1445,7 @@ static JsonValue* build_paths_array(const NodeVec *nodes){
     for(int i=0;i<nodes->count;i++){
         JsonValue *s=create_json_value(JSON_STRING);
         if(!s){ free_json_value(arr); return NULL; }
-        s->value.string = nodes->items[i].path? strdup(nodes->items[i].path): strdup("$");
+        s->value.string = nodes->items[i].path? json_strdup(nodes->items[i].path): json_strdup("$");
         add_to_array(arr, s);
     }
     return arr;
@@ -1105,7 +1458,7 @@ static JsonValue* build_pairs_array(const NodeVec *nodes){
         if(!obj){ free_json_value(arr); return NULL; }
         JsonValue *sp=create_json_value(JSON_STRING);
         if(!sp){ free_json_value(obj); free_json_value(arr); return NULL; }
-        sp->value.string = nodes->items[i].path? strdup(nodes->items[i].path): strdup("$");
+        sp->value.string = nodes->items[i].path? json_strdup(nodes->items[i].path): json_strdup("$");
         add_to_object(obj, "path", sp);
         JsonValue *val=clone_json_value(nodes->items[i].val);
         if(!val){ free_json_value(obj); free_json_value(arr); return NULL; }
@@ -1137,7 +1490,7 @@ JsonPathResults *evaluate_jsonpath(JsonValue *doc, const char *expression,
     } else {
       // lenient -> empty results
       JsonPathResults *res =
-          (JsonPathResults *)calloc(1, sizeof(JsonPathResults));
+          (JsonPathResults *)json_calloc(1, sizeof(JsonPathResults));
       if (!res) {
         nv_free(&nodes);
         return NULL;
@@ -1152,10 +1505,11 @@ JsonPathResults *evaluate_jsonpath(JsonValue *doc, const char *expression,
   }
   // Apply limit if requested
   int limit = (options && options->limit > 0) ? options->limit : nodes.count;
-  if (limit < nodes.count)
-    nodes.count = limit;
+  while (nodes.count > limit)
+    json_free(nodes.items[--nodes.count].path);
 
-  JsonPathResults *res = (JsonPathResults *)calloc(1, sizeof(JsonPathResults));
+  JsonPathResults *res =
+      (JsonPathResults *)json_calloc(1, sizeof(JsonPathResults));
   if (!res) {
     nv_free(&nodes);
     return NULL;
@@ -1164,39 +1518,39 @@ JsonPathResults *evaluate_jsonpath(JsonValue *doc, const char *expression,
   res->mode = mode;
   res->count = nodes.count;
   if (mode == JSONPATH_MODE_PATHS) {
-    res->paths = (char **)calloc(nodes.count, sizeof(char *));
+    res->paths = (char **)json_calloc(nodes.count, sizeof(char *));
     if (!res->paths) {
       nv_free(&nodes);
-      free(res);
+      json_free(res);
       return NULL;
     }
     for (int i = 0; i < nodes.count; i++) {
-      res->paths[i] =
-          nodes.items[i].path ? strdup(nodes.items[i].path) : strdup("$");
+      res->paths[i] = json_strdup(nodes.items[i].path ? nodes.items[i].path
+                                                      : "$");
     }
   } else if (mode == JSONPATH_MODE_VALUES) {
-    res->values = (JsonValue **)calloc(nodes.count, sizeof(JsonValue *));
+    res->values = (JsonValue **)json_calloc(nodes.count, sizeof(JsonValue *));
     if (!res->values) {
       nv_free(&nodes);
-      free(res);
+      json_free(res);
       return NULL;
     }
     for (int i = 0; i < nodes.count; i++) {
       res->values[i] = clone_json_value(nodes.items[i].val);
     }
   } else { // pairs
-    res->paths = (char **)calloc(nodes.count, sizeof(char *));
-    res->values = (JsonValue **)calloc(nodes.count, sizeof(JsonValue *));
+    res->paths = (char **)json_calloc(nodes.count, sizeof(char *));
+    res->values = (JsonValue **)json_calloc(nodes.count, sizeof(JsonValue *));
     if (!res->paths || !res->values) {
       nv_free(&nodes);
-      free(res->paths);
-      free(res->values);
-      free(res);
+      json_free(res->paths);
+      json_free(res->values);
+      json_free(res);
       return NULL;
     }
     for (int i = 0; i < nodes.count; i++) {
-      res->paths[i] =
-          nodes.items[i].path ? strdup(nodes.items[i].path) : strdup("$");
+      res->paths[i] = json_strdup(nodes.items[i].path ? nodes.items[i].path
+                                                      : "$");
       res->values[i] = clone_json_value(nodes.items[i].val);
     }
   }
@@ -1204,19 +1558,53 @@ JsonPathResults *evaluate_jsonpath(JsonValue *doc, const char *expression,
   return res;
 }
 
+int visit_jsonpath(JsonValue *doc, const char *expression,
+                   const JsonPathOptions *options, JsonPathVisitor visit,
+                   void *data) {
+  if (!doc || !expression || !visit) {
+    if (options && options->strict)
+      fprintf(stderr, "jsonpath: null doc or expression\n");
+    return -1;
+  }
+  Scan sc = {.s = expression,
+             .pos = 0,
+             .len = (int)strlen(expression),
+             .opt = options};
+  // Matches are only looked at, so neither their paths nor copies are made
+  NodeVec nodes;
+  nv_init(&nodes);
+  nodes.no_paths = 1;
+  int emitted = 0;
+  if (!eval_steps(doc, &sc, &nodes, &emitted)) {
+    nv_free(&nodes);
+    return -1;
+  }
+  int limit = (options && options->limit > 0) ? options->limit : nodes.count;
+  int visited = 0;
+  while (visited < nodes.count && visited < limit) {
+    if (!visit(nodes.items[visited].val, data)) {
+      nv_free(&nodes);
+      return -1;
+    }
+    visited++;
+  }
+  nv_free(&nodes);
+  return visited;
+}
+
 void free_jsonpath_results(JsonPathResults *res) {
   if (!res)
     return;
   if (res->paths) {
     for (int i = 0; i < res->count; i++)
-      free(res->paths[i]);
-    free(res->paths);
+      json_free(res->paths[i]);
+    json_free(res->paths);
   }
   if (res->values) {
     for (int i = 0; i < res->count; i++)
       if (res->values[i])
         free_json_value(res->values[i]);
-    free(res->values);
+    json_free(res->values);
   }
-  free(res);
+  json_free(res);
 }
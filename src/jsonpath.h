@@ -36,6 +36,17 @@ typedef struct {
 JsonPathResults *evaluate_jsonpath(JsonValue *doc, const char *expression,
                                    const JsonPathOptions *options);
 
+// Called with each match of visit_jsonpath; returns 0 to abort the walk
+typedef int (*JsonPathVisitor)(JsonValue *value, void *data);
+
+// Calls visit on each match of expression, in the order evaluate_jsonpath
+// would return them, without copying the values or building their paths.
+// options->mode is ignored. Returns the number of matches visited, or -1
+// if the expression could not be evaluated or visit aborted.
+int visit_jsonpath(JsonValue *doc, const char *expression,
+                   const JsonPathOptions *options, JsonPathVisitor visit,
+                   void *data);
+
 // Frees a results object produced by evaluate_jsonpath
 void free_jsonpath_results(JsonPathResults *res);
 
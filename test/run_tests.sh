@@ -362,6 +362,355 @@ if [ -f "$TEMP_CONFIG" ]; then
     run_test "Pi is number" "3.14159" "$(./jct $TEMP_CONFIG get app.pi)"
 fi
 
+# Test 18: Size limits
+echo -e "${BLUE}Testing size limits...${NC}"
+expect_exit_code "--max-size rejects oversized input" "./jct --max-size 16 $TEST_DATA get strings.simple" 1
+expect_stderr_contains "--max-size reports the limit" "./jct --max-size 16 $TEST_DATA get strings.simple" "over 16 bytes"
+run_test "--max-size 0 disables the limit" "hello world" "$(./jct --max-size 0 $TEST_DATA get strings.simple)"
+run_test "Read from a non-seekable stream" "hello world" "$(cat $TEST_DATA | ./jct /dev/stdin get strings.simple)"
+
+# Test 19: Compressed configs (full coverage needs make WITH_ZLIB=1)
+echo -e "${BLUE}Testing compressed configs...${NC}"
+GZ_CONFIG="test/temp_config.json.gz"
+gzip -c "$TEST_DATA" > "$GZ_CONFIG"
+if ./jct "$GZ_CONFIG" get strings.simple >/dev/null 2>&1; then
+    run_test "Read gzip config" "hello world" "$(./jct $GZ_CONFIG get strings.simple)"
+    ./jct "$GZ_CONFIG" set compressed.flag true
+    run_test "Set in gzip config" "true" "$(./jct $GZ_CONFIG get compressed.flag)"
+    run_test "Saved gzip config stays compressed" "true" "$(gzip -dc $GZ_CONFIG | ./jct /dev/stdin get compressed.flag)"
+    # Larger than one input slice, and concatenated members whose trailer
+    # only gives the size of the last one
+    { printf '{"items": ['; awk 'BEGIN { srand(1); for (i = 0; i < 300000; i++) printf "%s%d", (i ? "," : ""), int(rand() * 1e9) }'; printf '],'; } > test/temp_large.json
+    LAST_ITEM=$(sed 's/.*,\([0-9]*\)\],$/\1/' test/temp_large.json)
+    gzip -c test/temp_large.json > "$GZ_CONFIG"
+    rm -f test/temp_large.json
+    echo '"last": "ok"}' | gzip -c >> "$GZ_CONFIG"
+    run_test "Read large multi-member gzip" "ok $LAST_ITEM" "$(./jct $GZ_CONFIG get last) $(./jct $GZ_CONFIG get items.299999)"
+else
+    expect_stderr_contains "gzip config without zlib support" "./jct $GZ_CONFIG get strings.simple" "WITH_ZLIB"
+    expect_exit_code "set refuses to overwrite unreadable gzip config" "./jct $GZ_CONFIG set compressed.flag true" 1
+fi
+rm -f "$GZ_CONFIG"
+
+# Test 20: Streaming export
+echo -e "${BLUE}Testing export...${NC}"
+EXPORT_BASE="test/temp_export_base.json"
+EXPORT_MOD="test/temp_export_mod.json"
+echo '{"a": 1, "b": {"c": [1, 2], "d": "x"}, "e": true}' > "$EXPORT_BASE"
+echo '{"a": 1, "b": {"c": [1, 3], "d": "x"}, "f": null}' > "$EXPORT_MOD"
+run_test "Export changed and added keys" '{"b":{"c":[1,3]},"f":null}' "$(./jct $EXPORT_MOD export $EXPORT_BASE | tr -d ' \n')"
+echo '{"f": null, "b": {"d": "x", "c": [1,3]}, "a": 1.0}' > "$EXPORT_MOD"
+run_test "Export with reordered keys" '{"b":{"c":[1,3]},"f":null}' "$(./jct $EXPORT_MOD export $EXPORT_BASE | tr -d ' \n')"
+run_test "Export identical files" '{}' "$(./jct $EXPORT_BASE export $EXPORT_BASE | tr -d ' \n')"
+rm -f "$EXPORT_BASE" "$EXPORT_MOD"
+
+# Test 21: Export against a baseline index
+echo -e "${BLUE}Testing baseline index...${NC}"
+INDEX_BASE="test/temp_index_base.json"
+INDEX_MOD="test/temp_index_mod.json"
+echo '{"a": 1, "b": {"c": [1, 2], "d": "x"}, "e": true}' > "$INDEX_BASE"
+./jct "$INDEX_BASE" index
+run_test "Index written next to the file" "yes" "$([ -s "$INDEX_BASE.jctidx" ] && echo yes || echo no)"
+echo '{"e": true, "b": {"d": "y", "c": [1, 2]}, "a": 1.0, "f": {"g": 0}}' > "$INDEX_MOD"
+run_test "Export using the index" '{"b":{"d":"y"},"f":{"g":0}}' "$(./jct $INDEX_MOD export $INDEX_BASE | tr -d ' \n')"
+echo '{"a": 2, "b": {"c": [1, 2], "d": "x"}, "e": true}' > "$INDEX_BASE"
+touch -d '2000-01-01' "$INDEX_BASE"
+run_test "Stale index is ignored" '{"a":1,"b":{"d":"y"},"f":{"g":0}}' "$(./jct $INDEX_MOD export $INDEX_BASE | tr -d ' \n')"
+rm -f "$INDEX_BASE" "$INDEX_BASE.jctidx" "$INDEX_MOD"
+
+# Test 22: Journaled set
+echo -e "${BLUE}Testing journaled set...${NC}"
+JOURNAL_CONFIG="test/temp_journal.json"
+echo '{"night": {"mode": false}, "a": 1}' > "$JOURNAL_CONFIG"
+./jct --journal "$JOURNAL_CONFIG" set night.mode true
+run_test "Journaled set leaves the file untouched" '{"night":{"mode":false},"a":1}' "$(tr -d ' \n' < "$JOURNAL_CONFIG")"
+run_test "Journal is replayed on load" "true" "$(./jct "$JOURNAL_CONFIG" get night.mode)"
+printf '["set","a","2"' >> "$JOURNAL_CONFIG.journal"
+run_test "Torn journal record is ignored" "1" "$(./jct "$JOURNAL_CONFIG" get a)"
+./jct "$JOURNAL_CONFIG" compact
+run_test "Compact merges the journal" "true:no" "$(./jct "$JOURNAL_CONFIG" get night.mode):$([ -e "$JOURNAL_CONFIG.journal" ] && echo yes || echo no)"
+rm -f "$JOURNAL_CONFIG" "$JOURNAL_CONFIG.journal"
+
+# Test 23: Struct binding generator
+echo -e "${BLUE}Testing codegen...${NC}"
+CODEGEN_SAMPLE="test/temp_codegen.json"
+CODEGEN_HEADER="test/temp_codegen.h"
+echo '{"video": {"fps": 25, "gain": 1.5, "name": "main", "on": true}, "ids": [1, 2], "zones": [{"x": 1}, {"y": 2}]}' > "$CODEGEN_SAMPLE"
+./jct "$CODEGEN_SAMPLE" codegen cam > "$CODEGEN_HEADER"
+run_test "Sample types become struct members" "int64_t fps;double gain;char *name;int on;" "$(sed -n '/^struct CamVideo {/,/^};/p' "$CODEGEN_HEADER" | grep -o '^  [^/]*;' | sed 's/^  //' | tr -d '\n')"
+run_test "Arrays of objects merge their members" "int64_t x;int64_t y;" "$(sed -n '/^struct CamZonesItem {/,/^};/p' "$CODEGEN_HEADER" | grep -o '^  [^/]*;' | sed 's/^  //' | tr -d '\n')"
+if command -v cc > /dev/null; then
+    test_command "Generated parser compiles" "printf '#define CAM_IMPLEMENTATION\n#include \"temp_codegen.h\"\n' | cc -std=c99 -Wall -Werror -Isrc -Itest -fsyntax-only -x c -" true
+fi
+rm -f "$CODEGEN_SAMPLE" "$CODEGEN_HEADER"
+
+# Test 24: Lazy scalars keep number lexemes
+echo -e "${BLUE}Testing lazy scalar decoding...${NC}"
+LAZY_CONFIG="test/temp_lazy.json"
+echo '{"pi": 3.14159265358979, "gain": 1.50, "name": "cam"}' > "$LAZY_CONFIG"
+run_test "Get prints a number as written" "3.14159265358979" "$(./jct "$LAZY_CONFIG" get pi)"
+./jct "$LAZY_CONFIG" set name cam2
+run_test "Set keeps untouched numbers verbatim" '{"gain":1.50,"name":"cam2","pi":3.14159265358979}' "$(tr -d ' \n' < "$LAZY_CONFIG")"
+rm -f "$LAZY_CONFIG"
+
+# Test 25: Lazy containers
+echo -e "${BLUE}Testing lazy containers...${NC}"
+LAZY_CONFIG="test/temp_lazy.json"
+echo '{"zones": [{"name": "a]}"}, {"name": "b", "rect": [1, [2, 3]]}], "x": {}}' > "$LAZY_CONFIG"
+run_test "Get expands only the path" "3" "$(./jct "$LAZY_CONFIG" get zones.1.rect.1.1)"
+run_test "Get skips brackets inside strings" "b" "$(./jct "$LAZY_CONFIG" get zones.1.name)"
+echo '{"a": [1, 2}' > "$LAZY_CONFIG"
+expect_exit_code "Get rejects mismatched brackets" "./jct $LAZY_CONFIG get a" "1"
+rm -f "$LAZY_CONFIG"
+
+# Test 26: Parallel serialization
+echo -e "${BLUE}Testing parallel serialization...${NC}"
+THREADS_CONFIG="test/temp_threads.json"
+{ printf '['; seq -f '{"id": %g, "tag": "z\\t"}' 1 5000 | paste -sd,; printf ']'; } > "$THREADS_CONFIG"
+SERIAL_OUT=$(./jct "$THREADS_CONFIG" path '$[*]' --pretty | cksum)
+run_test "Threads give the same output" "$SERIAL_OUT" "$(./jct --threads 4 "$THREADS_CONFIG" path '$[*]' --pretty | cksum)"
+SERIAL_OUT=$(./jct "$THREADS_CONFIG" print | cksum)
+run_test "Threads print the same array" "$SERIAL_OUT" "$(./jct --threads 4 "$THREADS_CONFIG" print | cksum)"
+{ printf '{"list": {'; seq 5000 -1 1 | sed 's/.*/"k&": [&, "q\\"&"]/' | paste -sd,; printf '}}'; } > "$THREADS_CONFIG"
+SERIAL_OUT=$(./jct "$THREADS_CONFIG" get list | cksum)
+run_test "Threads print the same sorted object" "$SERIAL_OUT" "$(./jct --threads 3 "$THREADS_CONFIG" get list | cksum)"
+run_test "Threads keep keys sorted" "k1,k10,k100" "$(./jct --threads 3 "$THREADS_CONFIG" get list | sed -n 's/^  "\(k[0-9]*\)".*/\1/p' | head -3 | paste -sd,)"
+rm -f "$THREADS_CONFIG"
+
+# Test 27: Import several overlays
+echo -e "${BLUE}Testing import of several overlays...${NC}"
+IMPORT_DEST="test/temp_import.json"
+IMPORT_A="test/temp_import_a.json"
+IMPORT_B="test/temp_import_b.json"
+echo '{"image": {"hflip": false, "vflip": false}, "name": "base"}' > "$IMPORT_DEST"
+echo '{"image": {"hflip": true}, "name": "a"}' > "$IMPORT_A"
+echo '{"name": "b"}' > "$IMPORT_B"
+./jct "$IMPORT_DEST" import "$IMPORT_A" "$IMPORT_B" > /dev/null
+run_test "Import merges the first overlay" "true" "$(./jct "$IMPORT_DEST" get image.hflip)"
+run_test "Import keeps untouched keys" "false" "$(./jct "$IMPORT_DEST" get image.vflip)"
+run_test "Import applies overlays in order" "b" "$(./jct "$IMPORT_DEST" get name)"
+rm -f "$IMPORT_DEST" "$IMPORT_A" "$IMPORT_B"
+
+# Test 28: Memory budget
+echo -e "${BLUE}Testing memory budget...${NC}"
+BUDGET_CONFIG="test/temp_budget.json"
+{ printf '{"items": ['; seq -f '{"id": %g, "name": "item"}' 1 2000 | paste -sd,; printf '], "mode": "day"}'; } > "$BUDGET_CONFIG"
+BUDGET_SUM=$(cksum < "$BUDGET_CONFIG")
+expect_exit_code "Exceeding the budget exits 12" "./jct --max-mem 16K $BUDGET_CONFIG set mode night" "12"
+run_test "Failed set leaves the file alone" "$BUDGET_SUM" "$(cksum < "$BUDGET_CONFIG")"
+run_test "Get within the budget" "day" "$(./jct --max-mem 4M "$BUDGET_CONFIG" get mode)"
+run_test "Path within the budget" "[2000]" "$(./jct --max-mem 4M "$BUDGET_CONFIG" path '$.items[1999].id')"
+# A document larger than the budget can still be looked up by key
+{ printf '{"items": ['; seq -f '{"id": %g, "name": "item"}' 1 20000 | paste -sd,; printf '], "mode": "day"}'; } > "$BUDGET_CONFIG"
+run_test "Get from input larger than the budget" "day" "$(./jct --max-mem 256K "$BUDGET_CONFIG" get mode)"
+run_test "Get element from input larger than the budget" "101" "$(./jct --max-mem 256K "$BUDGET_CONFIG" get items.100.id)"
+run_test "Path from input larger than the budget" "[101]" "$(./jct --max-mem 256K "$BUDGET_CONFIG" path '$.items[100].id')"
+rm -f "$BUDGET_CONFIG"
+
+# Test 29: Streaming import
+echo -e "${BLUE}Testing streaming import...${NC}"
+STREAM_DEST="test/temp_stream_dest.json"
+STREAM_SRC="test/temp_stream_src.json"
+echo '{"image": {"hflip": false, "vflip": false}, "ids": [1, 2]}' > "$STREAM_DEST"
+echo '{"image": {"vflip": true, "mode": {"night": 1}}, "ids": [3]}' > "$STREAM_SRC"
+./jct "$STREAM_DEST" import "$STREAM_SRC" > /dev/null
+run_test "Streamed merge keeps untouched members" "false" "$(./jct "$STREAM_DEST" get image.hflip)"
+run_test "Streamed merge adds nested objects" "1" "$(./jct "$STREAM_DEST" get image.mode.night)"
+run_test "Streamed merge replaces arrays" "3" "$(./jct "$STREAM_DEST" get ids.0)"
+STREAM_SUM=$(cksum < "$STREAM_DEST")
+echo '{"image": {"hflip": true}, "ids": [' > "$STREAM_SRC"
+expect_exit_code "Invalid source fails the import" "./jct $STREAM_DEST import $STREAM_SRC" "1"
+run_test "Failed import leaves the destination alone" "$STREAM_SUM" "$(cksum < "$STREAM_DEST")"
+echo '{"a": {"b": 1, "c": [1, 2]}}' > "$STREAM_DEST"
+echo '{"a": {"c": [3], "g": {"h": 1}}, "a": {"z": 1}}' > "$STREAM_SRC"
+./jct "$STREAM_DEST" import "$STREAM_SRC" > /dev/null
+run_test "Repeated source key keeps only its last value" '{"b":1,"c":[1,2],"z":1}' "$(./jct "$STREAM_DEST" get a | tr -d ' \n')"
+rm -f "$STREAM_DEST" "$STREAM_SRC"
+
+# Test 30: Filters over arrays of same-shaped objects
+echo -e "${BLUE}Testing columnar filters...${NC}"
+COLUMNS_FILE="test/temp_columns.json"
+echo '{"det": [{"x": 1, "label": "car", "ok": true}, {"label": "dog", "x": 7, "ok": false}, {"x": 9, "label": "car", "ok": null}], "mixed": [{"x": 1}, {"y": 2}, {"x": 3}]}' > "$COLUMNS_FILE"
+run_test "Numeric filter" '[7,9]' "$(./jct "$COLUMNS_FILE" path '$.det[?(@.x > 5)].x')"
+run_test "Compound filter" '["car","dog"]' "$(./jct "$COLUMNS_FILE" path '$.det[?(@.x < 2 || @.label == "dog" && @.ok == false)].label')"
+run_test "Literal on the left" '[1]' "$(./jct "$COLUMNS_FILE" path '$.det[?(5 > @.x)].x')"
+run_test "Mixed-type member" '[9]' "$(./jct "$COLUMNS_FILE" path '$.det[?(@.ok == null)].x')"
+run_test "Filter paths" '["$.det[1]"]' "$(./jct "$COLUMNS_FILE" path '$.det[?(@.label == "dog")]' --mode paths)"
+run_test "Objects of different shapes" '[3]' "$(./jct "$COLUMNS_FILE" path '$.mixed[?(@.x > 1)].x')"
+rm -f "$COLUMNS_FILE"
+
+# Test 31: Aggregating JSONPath matches
+echo -e "${BLUE}Testing agg...${NC}"
+AGG_FILE="test/temp_agg.json"
+echo '{"readings": [{"v": 4}, {"v": -2}, {"v": "n/a"}, {"v": 10}, {"v": 0.5}]}' > "$AGG_FILE"
+run_test "All aggregations in order" '{"sum":12.5,"avg":3.125,"min":-2,"max":10,"count":4,"topk":[10,4]}' "$(./jct "$AGG_FILE" agg '$.readings[*].v' --op sum,avg,min,max,count,topk=2)"
+run_test "No matching numbers" '{"count":0,"max":null}' "$(./jct "$AGG_FILE" agg '$.missing[*]' --op count,max)"
+expect_exit_code "Unknown aggregation" "./jct $AGG_FILE agg \$.readings --op median" "2"
+rm -f "$AGG_FILE"
+
+# Test 32: Streaming transform
+echo -e "${BLUE}Testing transform...${NC}"
+TRANSFORM_FILE="test/temp_transform.json"
+echo '{"a": {"b": 1, "c": 2}, "c": {"x": [1, 2], "password": "p"}, "old": 5, "users": [{"id": 1, "password": "q"}]}' > "$TRANSFORM_FILE"
+run_test "Keep, drop and rename" '{"a":{"b":1},"c":{"x":[1,2]},"new":5}' "$(./jct "$TRANSFORM_FILE" transform --keep 'a.b,c.*,old' --drop '..password' --rename old=new | tr -d ' \n')"
+run_test "Redact at any depth" '{"a":{"b":1,"c":2},"c":{"x":[1,2],"password":"[redacted]"},"old":5,"users":[{"id":1,"password":"[redacted]"}]}' "$(./jct "$TRANSFORM_FILE" transform --redact '..password' | tr -d ' \n')"
+run_test "Keep array element members" '{"users":[{"id":1}]}' "$(./jct "$TRANSFORM_FILE" transform --keep 'users.*.id' | tr -d ' \n')"
+expect_exit_code "Invalid transform pattern" "./jct $TRANSFORM_FILE transform --keep a...b" "2"
+expect_exit_code "Rename to a dotted name" "./jct $TRANSFORM_FILE transform --rename a.b=a.q" "2"
+expect_stderr_contains "Rename onto an existing sibling" "./jct $TRANSFORM_FILE transform --rename old=a" "Renaming to 'a'"
+expect_exit_code "Rename onto an existing sibling fails" "./jct $TRANSFORM_FILE transform --rename old=a" "1"
+expect_exit_code "Two renames to one name" "./jct $TRANSFORM_FILE transform --rename a.b=z,a.c=z" "1"
+run_test "Renames that swap names" '{"a":{"c":1,"b":2}}' "$(./jct "$TRANSFORM_FILE" transform --keep a --rename a.b=c,a.c=b | tr -d ' \n')"
+run_test "Same name in different objects" '{"a":{"b":1,"c":2},"b":5}' "$(./jct "$TRANSFORM_FILE" transform --keep a,old --rename old=b | tr -d ' \n')"
+echo '{"a": [1,' > "$TRANSFORM_FILE"
+expect_exit_code "Transform of malformed JSON" "./jct $TRANSFORM_FILE transform" "1"
+rm -f "$TRANSFORM_FILE"
+
+# Test 33: Shared identical values (--dedup)
+echo -e "${BLUE}Testing --dedup...${NC}"
+DEDUP_FILE="test/temp_dedup.json"
+DEDUP_SRC="test/temp_dedup_src.json"
+echo '{"ch0": {"codec": "h264", "osd": {"size": 18}}, "ch1": {"codec": "h264", "osd": {"size": 18}}}' > "$DEDUP_FILE"
+run_test "Print with shared values" "$(./jct $DEDUP_FILE print)" "$(./jct --dedup $DEDUP_FILE print)"
+./jct --dedup $DEDUP_FILE set ch1.osd.size 24 >/dev/null
+run_test "Set changes one shared block" "18 24" "$(./jct $DEDUP_FILE get ch0.osd.size) $(./jct $DEDUP_FILE get ch1.osd.size)"
+echo '{"ch0": {"osd": {"font": "a.ttf"}}}' > "$DEDUP_SRC"
+echo '{"ch0": {"codec": "h264", "osd": {"size": 18}}, "ch1": {"codec": "h264", "osd": {"size": 18}}}' > "$DEDUP_FILE"
+./jct --dedup $DEDUP_FILE import $DEDUP_SRC >/dev/null
+run_test "Import into one shared block" '{"size":18}' "$(./jct $DEDUP_FILE get ch1.osd | tr -d ' \n')"
+rm -f "$DEDUP_FILE" "$DEDUP_SRC"
+
+# Test 34: Packed number arrays
+echo -e "${BLUE}Testing packed number arrays...${NC}"
+PACKED_FILE="test/temp_packed.json"
+echo '{"lut": [0, 1.50, -2, 3e2], "mixed": [1, "a"], "rows": [[1, 2], [3, 4]]}' > "$PACKED_FILE"
+run_test "Print packed arrays" '{"lut":[0,1.50,-2,3e2],"mixed":[1,"a"],"rows":[[1,2],[3,4]]}' "$(./jct $PACKED_FILE print | tr -d ' \n')"
+run_test "Get packed element" "3e2" "$(./jct $PACKED_FILE get lut.3)"
+run_test "Path slice of packed array" "[1.5,-2]" "$(./jct $PACKED_FILE path '$.lut[1:3]' | tr -d ' \n')"
+run_test "Path filter on packed array" "[1.5,300]" "$(./jct $PACKED_FILE path '$.lut[?(@ > 1)]' | tr -d ' \n')"
+./jct $PACKED_FILE set lut.1 7 >/dev/null
+./jct $PACKED_FILE set lut.4 8 >/dev/null
+run_test "Set and append on packed array" "[0,7,-2,3e2,8]" "$(./jct $PACKED_FILE get lut | tr -d ' \n')"
+rm -f "$PACKED_FILE"
+
+# Test 35: Selective loading (--select)
+echo -e "${BLUE}Testing --select...${NC}"
+SELECT_FILE="test/temp_select.json"
+echo '{"video": {"ch0": {"fps": 25}, "ch1": {"fps": 30}}, "audio": {"rate": 16000}, "osd": {"font": "a\"}.ttf", "sizes": [1, [2]]}}' > "$SELECT_FILE"
+run_test "Select sections" '{"audio":{"rate":16000},"video":{"ch0":{"fps":25},"ch1":{"fps":30}}}' "$(./jct --select 'video.*,$.audio' $SELECT_FILE print | tr -d ' \n')"
+run_test "Select by descent" '{"video":{"ch1":{"fps":30}}}' "$(./jct --select '..ch1' $SELECT_FILE print | tr -d ' \n')"
+run_test "Select array element" '{"osd":{"sizes":[null,[2]]}}' "$(./jct --select 'osd.sizes.1' $SELECT_FILE print | tr -d ' \n')"
+run_test "Get selected array element" "2" "$(./jct --select 'osd.sizes.1' $SELECT_FILE get osd.sizes.1.0)"
+run_test "Path to selected array element" "[[2]]" "$(./jct --select 'osd.sizes.1' $SELECT_FILE path '$.osd.sizes[1]' | tr -d ' \n')"
+run_test "Get within selection" "25" "$(./jct --select video $SELECT_FILE get video.ch0.fps)"
+expect_exit_code "Select rejects writes" "./jct --select video $SELECT_FILE set audio.rate 8000" "1"
+expect_exit_code "Invalid select pattern" "./jct --select 'a...b' $SELECT_FILE print" "1"
+run_test "Select with bracket steps" '{"osd":{"font":"a\"}.ttf","sizes":[null,[2]]}}' "$(./jct --select "\$.osd['font'],osd.sizes[1]" $SELECT_FILE print | tr -d ' \n')"
+expect_exit_code "Malformed bracket step" "./jct --select 'osd.sizes[x]' $SELECT_FILE print" "1"
+rm -f "$SELECT_FILE"
+
+# Test 36: Bulk building (large arrays, repeated keys)
+echo -e "${BLUE}Testing bulk building...${NC}"
+BULK_FILE="test/temp_bulk.json"
+{
+    printf '{"list": ['
+    for i in $(seq 0 1999); do printf '"v%d",' "$i"; done
+    printf '"last"], "map": {'
+    for i in $(seq 0 19); do printf '"k%d": %d, ' "$i" "$i"; done
+    printf '"k5": "again", "k0": {"x": 1}, "k5": "final"}, "small": {"b": 1, "a": 2, "b": 3}}'
+} > "$BULK_FILE"
+run_test "Last element of a large array" "last" "$(./jct $BULK_FILE get list.2000)"
+run_test "Element in a large array" "v1234" "$(./jct $BULK_FILE get list.1234)"
+run_test "Repeated key keeps last value" "final" "$(./jct $BULK_FILE get map.k5)"
+run_test "Repeated key with object value" '{"x":1}' "$(./jct $BULK_FILE get map.k0 | tr -d ' \n')"
+run_test "Repeated keys counted once" "20" "$(./jct $BULK_FILE print | grep -c '"k[0-9]*":')"
+run_test "Repeated key keeps its place" '[{"b":3,"a":2}]' "$(./jct $BULK_FILE path '$.small' | tr -d ' \n')"
+rm -f "$BULK_FILE"
+
+# Test 37: SIMD kernels agree with the scalar code
+echo -e "${BLUE}Testing SIMD kernels against scalar code...${NC}"
+SIMD_CONFIG="test/temp_simd.json"
+# Strings of every length up to 150 with escapes at shifting offsets, so
+# they fall on both sides of 16-, 32- and 64-byte block edges
+awk 'BEGIN { printf "{"; for (i = 1; i <= 150; i++) { s = sprintf("%*s", i, ""); gsub(/ /, "x", s); printf "%s\"k%d\\\"\": [\"%s\\\"%s\\\\\\n\\t\\/\\r%s\\b\\f\", \"%s\"]", (i > 1 ? "," : ""), i, s, substr(s, 1, i % 37), s, s } printf "}\n" }' > "$SIMD_CONFIG"
+for SIMD_COMMAND in print "path \$..*" transform; do
+    SCALAR_OUT=$(JCT_SIMD=scalar ./jct "$SIMD_CONFIG" $SIMD_COMMAND | cksum)
+    run_test "Default kernel matches scalar ($SIMD_COMMAND)" "$SCALAR_OUT" "$(./jct "$SIMD_CONFIG" $SIMD_COMMAND | cksum)"
+done
+run_test "Escapes decode" 'xxxxx"xxxxx\' "$(./jct "$SIMD_CONFIG" get 'k5".0' | head -1)"
+cp "$SIMD_CONFIG" "$SIMD_CONFIG.scalar"
+JCT_SIMD=scalar ./jct "$SIMD_CONFIG.scalar" set added 'a"b' >/dev/null
+./jct "$SIMD_CONFIG" set added 'a"b' >/dev/null
+run_test "Default kernel saves as scalar" "$(cksum < "$SIMD_CONFIG.scalar")" "$(cksum < "$SIMD_CONFIG")"
+run_test "Saved escapes reload" 'xxxxx"xxxxx\' "$(./jct "$SIMD_CONFIG" get 'k5".0' | head -1)"
+rm -f "$SIMD_CONFIG" "$SIMD_CONFIG.scalar"
+
+# Test 38: ..name over nested arrays and objects
+echo -e "${BLUE}Testing ..name order and paths...${NC}"
+DESCENT_CONFIG="test/temp_descent.json"
+cat > "$DESCENT_CONFIG" << 'EOF'
+{"name": "root", "a": [{"name": "a0", "kids": [{"name": "a0k0"}, [{"name": "deep"}]]}, 5, {"x": {"name": "a2x"}}], "b": {"name": {"name": "inner"}, "c": [[{"name": "bc"}]]}, "z": {"name": "last"}}
+EOF
+# Descendants only, parents before their children, members in the order
+# the parser keeps them (newest first)
+EXPECTED='["$.z.name","$.b.name","$.b.c[0][0].name","$.b.name.name","$.a[0].name","$.a[0].kids[0].name","$.a[0].kids[1][0].name","$.a[2].x.name"]'
+run_test "..name paths" "$EXPECTED" "$(./jct "$DESCENT_CONFIG" path '$..name' --mode paths)"
+EXPECTED='["last",{"name":"inner"},"bc","inner","a0","a0k0","deep","a2x"]'
+run_test "..name values" "$EXPECTED" "$(./jct "$DESCENT_CONFIG" path '$..name' --mode values)"
+run_test "..name with limit" '["$.z.name","$.b.name"]' "$(./jct "$DESCENT_CONFIG" path '$..name' --mode paths --limit 2)"
+# The fused search must agree with collecting the descendants and then
+# selecting, which is what ..['name'] does
+for DESCENT_QUERY in '$..name' '$.a[*]..name' '$.b..name' '$..kids..name'; do
+    BRACKET_QUERY="${DESCENT_QUERY%name}['name']"
+    run_test "$DESCENT_QUERY matches $BRACKET_QUERY" "$(./jct "$DESCENT_CONFIG" path "$BRACKET_QUERY" --mode pairs)" "$(./jct "$DESCENT_CONFIG" path "$DESCENT_QUERY" --mode pairs)"
+done
+rm -f "$DESCENT_CONFIG"
+
+# Test 39: restore against a scratch root with rom/ and overlay/ trees
+echo -e "${BLUE}Testing restore with JCT_ROOT...${NC}"
+FAKE_ROOT="$PWD/test/temp_root"
+rm -rf "$FAKE_ROOT"
+mkdir -p "$FAKE_ROOT/rom/etc" "$FAKE_ROOT/overlay/etc"
+# a, b, d and e have ROM originals; c was only ever created in the overlay
+for f in a b d e; do echo '{"v": 1}' > "$FAKE_ROOT/rom/etc/$f.json"; done
+for f in a b c; do echo '{"v": 2}' > "$FAKE_ROOT/overlay/etc/$f.json"; done
+# d has journaled changes and no overlay copy
+echo '{"v": 3}' > "$FAKE_ROOT/overlay/etc/d.json.journal"
+echo '{"v": 3}' > "$FAKE_ROOT/overlay/etc/b.json.journal"
+
+export JCT_ROOT="$FAKE_ROOT"
+expect_exit_code "Restore of an original file" "./jct /etc/e.json restore" 2
+expect_exit_code "Restore without a ROM original" "./jct /etc/c.json restore" 1
+expect_exit_code "Restore of a relative path" "./jct etc/a.json restore" 5
+expect_exit_code "Restore of one file" "./jct /etc/a.json restore" 0
+test_command "Overlay copy removed" "test ! -e '$FAKE_ROOT/overlay/etc/a.json' -a -e '$FAKE_ROOT/rom/etc/a.json'" "true"
+expect_exit_code "Restore of a journal-only file" "./jct /etc/d.json restore" 0
+test_command "Journal removed" "test ! -e '$FAKE_ROOT/overlay/etc/d.json.journal'" "true"
+
+# Several files: every one is attempted, the first failure is the exit code
+echo '{"v": 2}' > "$FAKE_ROOT/overlay/etc/a.json"
+expect_exit_code "Restore of several files" "./jct /etc/a.json restore /etc/e.json /etc/b.json" 2
+test_command "Later files still restored" "test ! -e '$FAKE_ROOT/overlay/etc/a.json' -a ! -e '$FAKE_ROOT/overlay/etc/b.json' -a ! -e '$FAKE_ROOT/overlay/etc/b.json.journal'" "true"
+
+# A glob matches modified files only, skipping those without an original
+echo '{"v": 2}' > "$FAKE_ROOT/overlay/etc/a.json"
+echo '{"v": 3}' > "$FAKE_ROOT/overlay/etc/d.json.journal"
+expect_exit_code "Restore of a glob" "./jct '/etc/*.json' restore" 0
+test_command "Glob restored modified files" "test ! -e '$FAKE_ROOT/overlay/etc/a.json' -a ! -e '$FAKE_ROOT/overlay/etc/d.json.journal'" "true"
+test_command "Glob skipped file without original" "test -e '$FAKE_ROOT/overlay/etc/c.json'" "true"
+expect_exit_code "Glob with nothing to restore" "./jct '/etc/*.json' restore" 2
+expect_stderr_contains "Glob with nothing to restore message" "./jct '/etc/*.json' restore" "No modified files to restore"
+
+# --list takes the files from a JSON document
+echo '{"v": 2}' > "$FAKE_ROOT/overlay/etc/a.json"
+echo '{"v": 2}' > "$FAKE_ROOT/overlay/etc/b.json"
+echo '{"configs": ["/etc/a.json", "/etc/b.json"], "other": ["/etc/c.json"]}' > "$FAKE_ROOT/list.json"
+expect_exit_code "Restore of a --list" "./jct '$FAKE_ROOT/list.json' restore --list '\$.configs[*]'" 0
+test_command "Listed files restored" "test ! -e '$FAKE_ROOT/overlay/etc/a.json' -a ! -e '$FAKE_ROOT/overlay/etc/b.json' -a -e '$FAKE_ROOT/overlay/etc/c.json'" "true"
+expect_stderr_contains "--list of a non-path value" "./jct '$FAKE_ROOT/list.json' restore --list '\$.configs'" "is not a path"
+unset JCT_ROOT
+rm -rf "$FAKE_ROOT"
+
 # Clean up
 rm -f "$TEMP_CONFIG"
 
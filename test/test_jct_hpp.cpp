@@ -0,0 +1,122 @@
+/**
+ * test_jct_hpp.cpp - Checks of the C++ interface in src/jct.hpp
+ *
+ * Built and run by 'make test' as C++17 and, where the compiler has it,
+ * C++20 (which adds jct::path<"..."> and jct::get<T, "...">). Exits with
+ * the number of failed checks.
+ */
+
+#include "jct.hpp"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static const char config[] = R"({"a": 1, "c": [10, 20, 30],
+  "video": {"fps": 25, "codec": "h264", "scale": 0.5, "on": true}})";
+
+static void test_parse() {
+  jct::Document doc = jct::Document::parse(config);
+  CHECK(doc);
+  CHECK(doc.root().is_object());
+  CHECK(doc.root().size() == 3);
+
+  // Documents are move-only owners
+  jct::Document moved = std::move(doc);
+  CHECK(!doc);
+  CHECK(moved);
+
+  // Input need not be NUL-terminated
+  std::string_view prefix("[1, 2]garbage", 6);
+  jct::Document slice = jct::Document::parse(prefix);
+  CHECK(slice.root().size() == 2);
+}
+
+static void test_find_and_at() {
+  jct::Document doc = jct::Document::parse(config);
+  std::optional<jct::ValueView> video = doc.root().find("video");
+  CHECK(video && video->is_object());
+  CHECK(!doc.root().find("missing"));
+  CHECK(doc["video"]["codec"].as_string() == std::string_view("h264"));
+  CHECK(doc["video"]["on"].as_bool() == true);
+
+  std::optional<jct::ValueView> second = doc["c"].at(1);
+  CHECK(second && second->as<int>() == 20);
+  CHECK(!doc["c"].at(3));
+  CHECK(!doc["a"].at(0));
+  CHECK(doc["c"][2].as<long>() == 30L);
+
+  // Typed access checks the range and that the number is whole
+  CHECK(doc["video"]["scale"].as<double>() == 0.5);
+  CHECK(!doc["video"]["scale"].as<int>());
+  CHECK(!doc["video"]["codec"].as<int>());
+  CHECK(doc["video"]["codec"].as<std::string>() == std::string("h264"));
+
+  // Missing steps give empty views, not errors
+  CHECK(!doc["nope"]["deeper"][0]);
+  CHECK(doc["c"][0].as<int>() == 10);
+  CHECK(!doc["c"][-1]);
+}
+
+static void test_members() {
+  // Unsorted objects keep their members newest first, so members() walks
+  // them in reverse document order
+  jct::Document doc = jct::Document::parse(config);
+  std::string keys;
+  for (jct::Member member : doc.root().members()) {
+    keys += std::string(member.key) + ' ';
+  }
+  CHECK(keys == "video c a ");
+
+  int sum = 0;
+  for (jct::ValueView element : doc["c"].elements()) {
+    sum += element.as<int>().value_or(0);
+  }
+  CHECK(sum == 60);
+  CHECK(doc["a"].members().empty());
+  CHECK(doc["a"].elements().empty());
+}
+
+static void test_paths() {
+  jct::Document doc = jct::Document::parse(config);
+  static constexpr jct::basic_path fps("video.fps");
+  static_assert(fps.size() == 2, "path split at compile time");
+  CHECK(fps.segment(1) == "fps");
+  CHECK(fps.get<int>(doc) == 25);
+  CHECK(jct::get<int>(doc, fps) == 25);
+  CHECK(JCT_PATH("video.fps").get<int>(doc) == 25);
+  CHECK(JCT_PATH("c.1").get<int>(doc) == 20);
+  CHECK(!JCT_PATH("video.missing").get<int>(doc));
+  CHECK(!JCT_PATH("a.b").find(doc));
+
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+  CHECK((jct::get<int, "video.fps">(doc) == 25));
+  CHECK(jct::path<"video.codec">::get<std::string_view>(doc) ==
+        std::string_view("h264"));
+  CHECK(!(jct::get<int, "video.codec">(doc)));
+#endif
+}
+
+int main() {
+  test_parse();
+  test_find_and_at();
+  test_members();
+  test_paths();
+  if (failures == 0) {
+    std::printf("jct.hpp (C++%ld): all checks passed\n",
+                static_cast<long>(__cplusplus / 100 % 100));
+  }
+  return failures;
+}